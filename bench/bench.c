@@ -0,0 +1,440 @@
+#include "pd_stub.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+	ps_bench
+
+	Headless micro-benchmark for the perform routines. Each case creates one external through the Pd stub in pd_stub/, sends it the messages for a parameter mode, calls its dsp method with fresh signal vectors and times stub_tick() (the captured perform chain) for every block size. One record is written per case and block size, as JSON lines (default) or CSV:
+
+		{"object": "folder~", "mode": "default", "input": "signal", "sample": "float", "block": 64, "ticks": 123456, "ns_per_sample": 0.41, "samples_per_sec": 2.4e9}
+
+	samples_per_sec is single-threaded, i.e. per core, except in the cases with worker threads ("threads n" modes, see common/ps_parallel.h): those time Pd's thread including its wait for the workers, so they compare with the same case without threads. The Makefile builds the bench twice, bench/ps_bench with float samples and bench/ps_bench64 with double samples (a PD_FLOATSIZE 64 build, see core/ps_core.h), and "sample" says which one wrote a record.
+
+	Usage: ps_bench [--block n]... [--only object[/mode]] [--seconds s] [--repeat n] [--format json|csv] [--silence] [--baseline file] [--threshold percent] [--verify] [--list]
+
+	Inputs are described per inlet as "noise amplitude", "sine hz amplitude" or "const value" and are generated once per case. Cases with more than one channel feed every inlet a multichannel signal (each channel with its own noise seed), and ns_per_sample is then per sample of one channel.
+
+	--silence times every case a second time after its inputs went silent. The object first runs on its inputs, then BENCH_SILENCE_SAMPLES of zeros let recursive state (envelope followers, soften buffers, filter histories) decay toward zero, and only then is it timed, with "input": "silence" in the record. Any state that ends up denormal shows as a silence cost far above the signal cost.
+
+	--repeat n times every case n times and keeps the fastest, which takes most of the scheduling noise out of a comparison.
+
+	Performance regressions: the JSON output of a run is itself a baseline. Save it once (ps_bench --repeat 5 > baseline.json), and later runs with --baseline baseline.json add the baseline's ns_per_sample and the relative change to every record that has a match (same object, mode, input, sample type and block size). A record more than --threshold percent slower than its baseline (default 10) gets "regressed": true, and ps_bench then exits with 1. Baselines only compare on the machine and build they were recorded with.
+
+	--verify runs the golden output checks in verify.c instead of timing anything, for every case or those matching --only, and exits with 1 if any fails.
+*/
+
+#define BENCH_SAMPLE_RATE 44100.0f
+#if PD_FLOATSIZE == 64
+	#define BENCH_SAMPLE_TYPE "double"
+#else
+	#define BENCH_SAMPLE_TYPE "float"
+#endif
+#define BENCH_INLETS_MAX 4
+#define BENCH_BLOCKS_MAX 16
+#define BENCH_BASELINE_MAX 1024
+// wiener~ writes block size / 2 - 1 bins, enough for the largest block
+#define BENCH_SPECTRUM_POINTS 4095
+#define BENCH_WARMUP_SAMPLES 65536
+// 10 seconds, long enough for an envelope follower to reach the denormal range
+#define BENCH_SILENCE_SAMPLES 441000
+
+void blend_tilde_setup (void);
+void folder_tilde_setup (void);
+void nlchain_tilde_setup (void);
+void wavecap_tilde_setup (void);
+void wiener_tilde_setup (void);
+void wraparound_tilde_setup (void);
+
+int bench_verify (const char* only, const char* format);
+
+typedef struct _bench_case {
+	const char* object;
+	const char* mode;
+	const char* args;
+	// messages sent after creation, separated by ';'
+	const char* messages;
+	int inlets;
+	int outlets;
+	const char* inputs[BENCH_INLETS_MAX];
+	int channels;
+} t_bench_case;
+
+static const t_bench_case bench_cases[] = {
+	{"blend~", "default", "", "", 3, 1, {"noise 1.5", "sine 220 1", "sine 331 1"}, 1},
+	{"folder~", "default", "1", "", 3, 1, {"noise 1.5", "const -0.5", "const 0.5"}, 1},
+	{"wraparound~", "hard", "1.5", "", 1, 1, {"noise 1"}, 1},
+	{"wraparound~", "soften", "1.5", "soften 16 0.8", 1, 1, {"noise 1"}, 1},
+	{"wraparound~", "soften_64", "1.5", "soften 64 0.2", 1, 1, {"noise 1"}, 1},
+	{"folder~", "oversample_2", "1", "oversample 2", 3, 1, {"noise 1.5", "const -0.5", "const 0.5"}, 1},
+	{"folder~", "oversample_8", "1", "oversample 8", 3, 1, {"noise 1.5", "const -0.5", "const 0.5"}, 1},
+	{"wraparound~", "hard_oversample_2", "1.5", "oversample 2", 1, 1, {"noise 1"}, 1},
+	{"wraparound~", "hard_oversample_8", "1.5", "oversample 8", 1, 1, {"noise 1"}, 1},
+	{"nlchain~", "fold_wrap_blend", "", "wrap_gain 1.5", 4, 1, {"noise 1.5", "const -0.5", "const 0.5", "sine 220 1"}, 1},
+	{"nlchain~", "fold_wrap_blend_soften", "", "wrap_gain 1.5; soften 16 0.8", 4, 1, {"noise 1.5", "const -0.5", "const 0.5", "sine 220 1"}, 1},
+	{"nlchain~", "wrap_fold", "wrap fold", "wrap_gain 1.5", 3, 1, {"noise 1.5", "const -0.5", "const 0.5"}, 1},
+	{"blend~", "mc16", "", "", 3, 1, {"noise 1.5", "sine 220 1", "sine 331 1"}, 16},
+	{"folder~", "mc16", "1", "", 3, 1, {"noise 1.5", "const -0.5", "const 0.5"}, 16},
+	{"wraparound~", "hard_mc16", "1.5", "", 1, 1, {"noise 1"}, 16},
+	{"wraparound~", "soften_mc16", "1.5", "soften 16 0.8", 1, 1, {"noise 1"}, 16},
+	{"nlchain~", "wrap_soften_mc16", "wrap", "wrap_gain 1.5; soften 64 0.2", 1, 1, {"noise 1"}, 16},
+	{"nlchain~", "wrap_soften_mc16_threads_4", "wrap", "wrap_gain 1.5; soften 64 0.2; threads 4", 1, 1, {"noise 1"}, 16},
+	{"wavecap~", "truncate", "", "bang; table_interp 0", 3, 1, {"sine 110 1", "const 0.005", "const 0"}, 1},
+	{"wavecap~", "lin_2", "", "bang; table_interp 1", 3, 1, {"sine 110 1", "const 0.005", "const 0"}, 1},
+	{"wavecap~", "lin_4", "", "bang; table_interp 2", 3, 1, {"sine 110 1", "const 0.005", "const 0"}, 1},
+	{"wavecap~", "sinc_16", "", "bang; table_sinc_taps 16; table_interp 3", 3, 1, {"sine 110 1", "const 0.005", "const 0"}, 1},
+	{"wavecap~", "sinc_32", "", "bang; table_sinc_taps 32; table_interp 3", 3, 1, {"sine 110 1", "const 0.005", "const 0"}, 1},
+	{"wavecap~", "env_follow", "", "bang; table_interp 1; env_enable", 3, 1, {"sine 110 1", "noise 0.01", "const 0"}, 1},
+	{"wavecap~", "morph_4", "", "table_slots 4; bang; table_interp 1", 3, 1, {"sine 110 1", "const 0.005", "sine 0.5 1.5"}, 1},
+	{"wavecap~", "voices_8", "", "bang; table_interp 1; voices 8; pitches 110 220 330 440 550 660 770 880", 3, 1, {"sine 110 1", "const 0", "const 0"}, 1},
+	{"wavecap~", "pitch_track", "", "bang; table_interp 1; pitch_enable", 3, 1, {"sine 110 1", "sine 220 1", "const 0"}, 1},
+	{"wiener~", "amplitude_hann", "", "", 1, 0, {"noise 1"}, 1},
+	{"wiener~", "power_rectangle", "", "power_spectrum; window_type rectangle", 1, 0, {"noise 1"}, 1},
+	{"wiener~", "amplitude_hann_mc8", "", "", 1, 0, {"noise 1"}, 8},
+	{"wiener~", "amplitude_hann_mc8_threads_4", "", "threads 4", 1, 0, {"noise 1"}, 8},
+	{"wiener~", "spectrum_db", "", "spectrum_array bench_spectrum; spectrum_db 1; spectrum_redraw 0", 1, 0, {"noise 1"}, 1},
+};
+
+static const int bench_cases_num = sizeof(bench_cases) / sizeof(bench_cases[0]);
+
+// one record of a baseline file
+typedef struct _bench_baseline {
+	char object[32];
+	char mode[64];
+	char input[16];
+	char sample[16];
+	int block;
+	double ns_per_sample;
+} t_bench_baseline;
+
+static t_bench_baseline bench_baseline[BENCH_BASELINE_MAX];
+static int bench_baseline_num = 0;
+
+static double bench_now_ns (void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+	deterministic input generator (xorshift noise so runs are comparable)
+*/
+static void bench_input_fill (t_sample* vec, int n, const char* spec, unsigned int seed) {
+	char kind[16] = "const";
+	double a = 0.0;
+	double b = 1.0;
+	unsigned int state = seed * 2654435761u + 1u;
+	int i;
+
+	sscanf(spec, "%15s %lf %lf", kind, &a, &b);
+
+	for (i = 0; i < n; i++) {
+		if (strcmp(kind, "noise") == 0) {
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			vec[i] = (t_sample) (a * ((state / 4294967295.0) * 2.0 - 1.0));
+		}
+		else if (strcmp(kind, "sine") == 0) {
+			vec[i] = (t_sample) (b * sin(2.0 * 3.14159265358979 * a * i / BENCH_SAMPLE_RATE));
+		}
+		else {
+			vec[i] = (t_sample) a;
+		}
+	}
+}
+
+static void bench_send_all (void* x, const char* messages) {
+	char buf[512];
+	char* message = buf;
+	char* end;
+
+	// split by hand, stub_send() tokenizes with strtok()
+	strncpy(buf, messages, sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = '\0';
+	while (message) {
+		end = strchr(message, ';');
+		if (end) {
+			*end++ = '\0';
+		}
+		while (*message == ' ') {
+			message++;
+		}
+		if (*message) {
+			stub_send(x, message);
+		}
+		message = end;
+	}
+}
+
+/*
+	times one case at one block size, returns ns per sample (negative on failure)
+	with silence set the inputs are zeroed after the warm up and the object runs BENCH_SILENCE_SAMPLES more before timing
+*/
+static double bench_run (const t_bench_case* c, int n, double seconds, int silence, long* ticks_out) {
+	int signals = c->inlets + c->outlets;
+	int channels = c->channels > 1 ? c->channels : 1;
+	t_signal** sp;
+	void* x;
+	long ticks = 0;
+	long warmup;
+	long batch;
+	long i;
+	int j;
+	int k;
+	double start;
+	double elapsed;
+
+	x = stub_new(c->object, c->args);
+	if (x == NULL) {
+		return -1.0;
+	}
+	bench_send_all(x, c->messages);
+
+	sp = stub_signals_new(signals, n, BENCH_SAMPLE_RATE);
+	for (j = 0; j < c->inlets; j++) {
+		signal_setmultiout(&sp[j], channels);
+		for (k = 0; k < channels; k++) {
+			bench_input_fill(sp[j]->s_vec + k * n, n, c->inputs[j], j + 1 + k * BENCH_INLETS_MAX);
+		}
+	}
+
+	stub_chain_reset();
+	stub_dsp(x, sp);
+
+	// warm up (also lets wavecap~ finish recording its table)
+	warmup = BENCH_WARMUP_SAMPLES / n + 1;
+	for (i = 0; i < warmup; i++) {
+		stub_tick();
+	}
+	if (silence) {
+		for (j = 0; j < c->inlets; j++) {
+			memset(sp[j]->s_vec, 0, (size_t) n * channels * sizeof(t_sample));
+		}
+		warmup = BENCH_SILENCE_SAMPLES / n + 1;
+		for (i = 0; i < warmup; i++) {
+			stub_tick();
+		}
+	}
+
+	// time batches until the budget is spent
+	batch = 1 + 16384 / n;
+	elapsed = 0.0;
+	while (elapsed < seconds * 1e9) {
+		start = bench_now_ns();
+		for (i = 0; i < batch; i++) {
+			stub_tick();
+		}
+		elapsed += bench_now_ns() - start;
+		ticks += batch;
+	}
+
+	stub_chain_reset();
+	stub_free(x);
+	stub_signals_free(sp, signals);
+
+	*ticks_out = ticks;
+	return elapsed / ((double) ticks * n * channels);
+}
+
+/*
+	reads the records of a previous JSON run, returns 0 if the file cannot be read
+*/
+static int bench_baseline_load (const char* path) {
+	FILE* file = fopen(path, "r");
+	char line[512];
+	t_bench_baseline* b;
+
+	if (file == NULL) {
+		return 0;
+	}
+	while (bench_baseline_num < BENCH_BASELINE_MAX && fgets(line, sizeof(line), file)) {
+		b = &bench_baseline[bench_baseline_num];
+		if (sscanf(line, "{\"object\": \"%31[^\"]\", \"mode\": \"%63[^\"]\", \"input\": \"%15[^\"]\", \"sample\": \"%15[^\"]\", \"block\": %d, \"ticks\": %*d, \"ns_per_sample\": %lf", b->object, b->mode, b->input, b->sample, &b->block, &b->ns_per_sample) == 6) {
+			bench_baseline_num++;
+		}
+	}
+	fclose(file);
+	return 1;
+}
+
+static const t_bench_baseline* bench_baseline_find (const t_bench_case* c, const char* input, int block) {
+	int i;
+
+	for (i = 0; i < bench_baseline_num; i++) {
+		if (bench_baseline[i].block == block && strcmp(bench_baseline[i].object, c->object) == 0 && strcmp(bench_baseline[i].mode, c->mode) == 0 && strcmp(bench_baseline[i].input, input) == 0 && strcmp(bench_baseline[i].sample, BENCH_SAMPLE_TYPE) == 0) {
+			return &bench_baseline[i];
+		}
+	}
+	return NULL;
+}
+
+static int bench_selected (const t_bench_case* c, const char* only) {
+	char name[128];
+
+	if (only == NULL) {
+		return 1;
+	}
+	if (strchr(only, '/')) {
+		snprintf(name, sizeof(name), "%s/%s", c->object, c->mode);
+		return strcmp(name, only) == 0;
+	}
+	return strcmp(c->object, only) == 0;
+}
+
+int main (int argc, char** argv) {
+	int blocks[BENCH_BLOCKS_MAX] = {64, 128, 256, 512, 1024, 2048, 4096, 8192};
+	int blocks_num = 8;
+	int blocks_custom = 0;
+	const char* only = NULL;
+	const char* format = "json";
+	double seconds = 0.25;
+	int repeat = 1;
+	int silence = 0;
+	int verify = 0;
+	const char* baseline_path = NULL;
+	double threshold = 10.0;
+	const t_bench_baseline* baseline;
+	double change = 0.0;
+	int regressed;
+	int regressions = 0;
+	int s;
+	int r;
+	double ns_per_sample;
+	double ns_per_sample_run;
+	long ticks;
+	long ticks_run;
+	const char* input;
+	int i;
+	int b;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--block") == 0 && i + 1 < argc) {
+			if (!blocks_custom) {
+				blocks_num = 0;
+				blocks_custom = 1;
+			}
+			if (blocks_num < BENCH_BLOCKS_MAX) {
+				blocks[blocks_num++] = atoi(argv[++i]);
+			}
+		}
+		else if (strcmp(argv[i], "--only") == 0 && i + 1 < argc) {
+			only = argv[++i];
+		}
+		else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+			seconds = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+			format = argv[++i];
+		}
+		else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+			repeat = atoi(argv[++i]);
+			if (repeat < 1) {
+				repeat = 1;
+			}
+		}
+		else if (strcmp(argv[i], "--silence") == 0) {
+			silence = 1;
+		}
+		else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+			baseline_path = argv[++i];
+		}
+		else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+			threshold = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--verify") == 0) {
+			verify = 1;
+		}
+		else if (strcmp(argv[i], "--list") == 0) {
+			for (b = 0; b < bench_cases_num; b++) {
+				printf("%s/%s\n", bench_cases[b].object, bench_cases[b].mode);
+			}
+			return 0;
+		}
+		else {
+			fprintf(stderr, "usage: %s [--block n]... [--only object[/mode]] [--seconds s] [--repeat n] [--format json|csv] [--silence] [--baseline file] [--threshold percent] [--verify] [--list]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	if (baseline_path && !bench_baseline_load(baseline_path)) {
+		fprintf(stderr, "%s: cannot read baseline %s\n", argv[0], baseline_path);
+		return 2;
+	}
+
+	blend_tilde_setup();
+	folder_tilde_setup();
+	nlchain_tilde_setup();
+	wavecap_tilde_setup();
+	wiener_tilde_setup();
+	wraparound_tilde_setup();
+	stub_array_new("bench_spectrum", BENCH_SPECTRUM_POINTS);
+
+	if (verify) {
+		return bench_verify(only, format) > 0;
+	}
+
+	if (strcmp(format, "csv") == 0) {
+		printf("object,mode,input,sample,block,ticks,ns_per_sample,samples_per_sec%s\n", baseline_path ? ",baseline_ns_per_sample,change,regressed" : "");
+	}
+
+	for (i = 0; i < bench_cases_num; i++) {
+		if (!bench_selected(&bench_cases[i], only)) {
+			continue;
+		}
+		for (b = 0; b < blocks_num; b++) {
+			for (s = 0; s <= silence; s++) {
+				input = s ? "silence" : "signal";
+				ns_per_sample = -1.0;
+				for (r = 0; r < repeat; r++) {
+					ns_per_sample_run = bench_run(&bench_cases[i], blocks[b], seconds, s, &ticks_run);
+					if (ns_per_sample_run < 0.0) {
+						return 1;
+					}
+					if (ns_per_sample < 0.0 || ns_per_sample_run < ns_per_sample) {
+						ns_per_sample = ns_per_sample_run;
+						ticks = ticks_run;
+					}
+				}
+
+				baseline = baseline_path ? bench_baseline_find(&bench_cases[i], input, blocks[b]) : NULL;
+				regressed = 0;
+				if (baseline) {
+					change = ns_per_sample / baseline->ns_per_sample - 1.0;
+					regressed = change * 100.0 > threshold;
+					regressions += regressed;
+				}
+
+				if (strcmp(format, "csv") == 0) {
+					printf("%s,%s,%s,%s,%d,%ld,%.4f,%.6g", bench_cases[i].object, bench_cases[i].mode, input, BENCH_SAMPLE_TYPE, blocks[b], ticks, ns_per_sample, 1e9 / ns_per_sample);
+					if (baseline) {
+						printf(",%.4f,%.4f,%s", baseline->ns_per_sample, change, regressed ? "true" : "false");
+					}
+					else if (baseline_path) {
+						printf(",,,");
+					}
+					printf("\n");
+				}
+				else {
+					printf("{\"object\": \"%s\", \"mode\": \"%s\", \"input\": \"%s\", \"sample\": \"%s\", \"block\": %d, \"ticks\": %ld, \"ns_per_sample\": %.4f, \"samples_per_sec\": %.6g", bench_cases[i].object, bench_cases[i].mode, input, BENCH_SAMPLE_TYPE, blocks[b], ticks, ns_per_sample, 1e9 / ns_per_sample);
+					if (baseline) {
+						printf(", \"baseline_ns_per_sample\": %.4f, \"change\": %.4f, \"regressed\": %s", baseline->ns_per_sample, change, regressed ? "true" : "false");
+					}
+					printf("}\n");
+				}
+				fflush(stdout);
+			}
+		}
+	}
+
+	if (regressions > 0) {
+		fprintf(stderr, "%s: %d records regressed more than %g%% against %s\n", argv[0], regressions, threshold, baseline_path);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,518 @@
+#include "z_libpd.h"
+#include "m_pd.h"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+	ps_patch_runner
+
+	Offline runner for real patches, such as the demo patches next to each external. It loads a patch into libpd with the externals linked in, turns DSP on and renders as fast as the CPU allows. The dac~ output goes to a 32-bit float WAV file, and the report covers whole-graph throughput plus DSP time for every instance of our externals.
+
+	Usage: ps_patch_runner [--seconds s] [--sr rate] [--channels n] [--out file.wav] [--send "receiver message ..."]... [--instances n [--min-scaling f]] patch.pd
+
+	--send messages are delivered after the patch is loaded and before rendering starts, e.g. --send "gain_osc 1" to open a number box that feeds a *~.
+
+	--instances n is a multi-instance stress test, and needs a libpd built with multi-instance support (make MULTI=true in libpd, make runner RUNNER_INSTANCES=1 here). The patch is first rendered alone in one Pd instance for a baseline, then in n Pd instances at once, each on its own thread. With the externals free of shared mutable state (common/ps_lock.h) and n free cores, the aggregate throughput should be n times the baseline. The report gives the ratio as "scaling" (1.0 is linear), and --min-scaling makes the runner fail below it. Nothing is written to --out in this mode.
+
+	Per-object time comes from runner_hook.h. Each dsp_add() made by one of our externals is wrapped by runner_perform(), which times the real perform routine and credits it to the object passed as its first argument. Vanilla objects are not timed individually, and their share shows up as the difference between the whole-graph time and the sum of our objects. The report is one JSON object on stdout.
+*/
+
+#define RUNNER_SLOTS_MAX 1024
+#define RUNNER_CHANNELS_MAX 16
+
+void blend_tilde_setup (void);
+void folder_tilde_setup (void);
+void nlchain_tilde_setup (void);
+void wavecap_tilde_setup (void);
+void wiener_tilde_setup (void);
+void wraparound_tilde_setup (void);
+
+typedef struct _runner_slot {
+	void* object;
+	t_class* owner;
+	int instance;
+	double ns;
+	long calls;
+} t_runner_slot;
+
+static t_runner_slot runner_slots[RUNNER_SLOTS_MAX];
+static int runner_slots_num = 0;
+// instances build their DSP graphs concurrently in --instances mode
+static pthread_mutex_t runner_slots_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// one patch rendered in one Pd instance
+typedef struct _runner_job {
+	const char* patch_dir;
+	const char* patch_file;
+	const char** sends;
+	int sends_num;
+	int sr;
+	int channels;
+	double seconds;
+	pthread_barrier_t* start;
+#ifdef PDINSTANCE
+	t_pdinstance* instance;
+#endif
+
+	// results
+	unsigned int frames;
+	double elapsed;
+	int failed;
+} t_runner_job;
+
+static double runner_now_ns (void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+	timing trampoline: w[1] is the slot, w[2] the real perform routine, w[3]... its own arguments
+	the real routine is called with w + 2 so that its w[1] is its first argument, and it returns past the end of our arguments too
+*/
+static t_int* runner_perform (t_int* w) {
+	t_runner_slot* slot = (t_runner_slot*) w[1];
+	t_perfroutine f = (t_perfroutine) w[2];
+	double start = runner_now_ns();
+	t_int* next = f(w + 2);
+
+	slot->ns += runner_now_ns() - start;
+	slot->calls++;
+	return next;
+}
+
+static t_runner_slot* runner_slot_find (void* object) {
+	int instance = 0;
+	int i;
+
+	for (i = 0; i < runner_slots_num; i++) {
+		if (runner_slots[i].object == object) {
+			return &runner_slots[i];
+		}
+		if (runner_slots[i].owner == *(t_pd*) object) {
+			instance++;
+		}
+	}
+	if (runner_slots_num >= RUNNER_SLOTS_MAX) {
+		return NULL;
+	}
+
+	runner_slots[runner_slots_num].object = object;
+	runner_slots[runner_slots_num].owner = *(t_pd*) object;
+	runner_slots[runner_slots_num].instance = instance;
+	return &runner_slots[runner_slots_num++];
+}
+
+void runner_dsp_add (t_perfroutine f, int n, ...) {
+	t_int vec[66];
+	t_runner_slot* slot;
+	va_list ap;
+	int i;
+
+	va_start(ap, n);
+	for (i = 0; i < n && i < 64; i++) {
+		vec[i + 2] = va_arg(ap, t_int);
+	}
+	va_end(ap);
+
+	// every perform routine in this repository takes its object as the first argument
+	pthread_mutex_lock(&runner_slots_lock);
+	slot = n > 0 ? runner_slot_find((void*) vec[2]) : NULL;
+	pthread_mutex_unlock(&runner_slots_lock);
+	if (slot == NULL) {
+		dsp_addv(f, n, vec + 2);
+		return;
+	}
+	vec[0] = (t_int) slot;
+	vec[1] = (t_int) f;
+	dsp_addv(runner_perform, n + 2, vec);
+}
+
+static void runner_print (const char* s) {
+	fprintf(stderr, "%s", s);
+}
+
+/*
+	32-bit float WAV writer
+*/
+static void runner_write_u32 (FILE* f, unsigned int v) {
+	unsigned char b[4];
+
+	b[0] = v & 0xff;
+	b[1] = (v >> 8) & 0xff;
+	b[2] = (v >> 16) & 0xff;
+	b[3] = (v >> 24) & 0xff;
+	fwrite(b, 1, 4, f);
+}
+
+static void runner_write_u16 (FILE* f, unsigned int v) {
+	unsigned char b[2];
+
+	b[0] = v & 0xff;
+	b[1] = (v >> 8) & 0xff;
+	fwrite(b, 1, 2, f);
+}
+
+static void runner_wav_header (FILE* f, int channels, int sr, unsigned int frames) {
+	unsigned int data_bytes = frames * channels * 4;
+
+	fwrite("RIFF", 1, 4, f);
+	runner_write_u32(f, 36 + data_bytes);
+	fwrite("WAVEfmt ", 1, 8, f);
+	runner_write_u32(f, 16);
+	runner_write_u16(f, 3);
+	runner_write_u16(f, channels);
+	runner_write_u32(f, sr);
+	runner_write_u32(f, sr * channels * 4);
+	runner_write_u16(f, channels * 4);
+	runner_write_u16(f, 32);
+	fwrite("data", 1, 4, f);
+	runner_write_u32(f, data_bytes);
+}
+
+static void runner_send (const char* text) {
+	char buf[512];
+	char* token;
+	char* end;
+	char* receiver;
+	char* selector;
+	double f;
+
+	strncpy(buf, text, sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = '\0';
+	receiver = strtok(buf, " ");
+	selector = strtok(NULL, " ");
+	if (receiver == NULL) {
+		return;
+	}
+	if (selector == NULL) {
+		libpd_bang(receiver);
+		return;
+	}
+
+	// "receiver 0.5" is a float, "receiver soften 16 0.8" a message
+	f = strtod(selector, &end);
+	libpd_start_message(16);
+	if (*end == '\0') {
+		libpd_add_float((float) f);
+		selector = "list";
+	}
+	for (token = strtok(NULL, " "); token; token = strtok(NULL, " ")) {
+		f = strtod(token, &end);
+		if (*end == '\0') {
+			libpd_add_float((float) f);
+		}
+		else {
+			libpd_add_symbol(token);
+		}
+	}
+	libpd_finish_message(receiver, selector);
+}
+
+/*
+	loads the job's patch into the current Pd instance and turns DSP on, returns the patch or NULL
+*/
+static void* runner_open (const t_runner_job* job) {
+	void* patch;
+	int i;
+
+	if (libpd_init_audio(job->channels, job->channels, job->sr) != 0) {
+		fprintf(stderr, "could not initialize libpd audio\n");
+		return NULL;
+	}
+	libpd_add_to_search_path(job->patch_dir);
+	patch = libpd_openfile(job->patch_file, job->patch_dir);
+	if (patch == NULL) {
+		fprintf(stderr, "could not open %s/%s\n", job->patch_dir, job->patch_file);
+		return NULL;
+	}
+	for (i = 0; i < job->sends_num; i++) {
+		runner_send(job->sends[i]);
+	}
+
+	libpd_start_message(1);
+	libpd_add_float(1.0f);
+	libpd_finish_message("pd", "dsp");
+	return patch;
+}
+
+#ifdef PDINSTANCE
+/*
+	stress test thread: renders the job in its own Pd instance, timed from the moment every thread is ready
+*/
+static void* runner_job_thread (void* arg) {
+	t_runner_job* job = (t_runner_job*) arg;
+	int ticks_per_buffer = 16;
+	void* patch;
+	float* in_buffer = NULL;
+	float* out_buffer = NULL;
+	long buffers = 0;
+	long b;
+	int block;
+	double start;
+
+	libpd_set_instance(job->instance);
+	libpd_set_printhook(runner_print);
+	patch = runner_open(job);
+	block = libpd_blocksize();
+	if (patch) {
+		in_buffer = (float*) calloc((size_t) block * ticks_per_buffer * job->channels, sizeof(float));
+		out_buffer = (float*) calloc((size_t) block * ticks_per_buffer * job->channels, sizeof(float));
+		buffers = (long) (job->seconds * job->sr / (block * ticks_per_buffer)) + 1;
+	}
+	job->failed = patch == NULL || in_buffer == NULL || out_buffer == NULL;
+
+	// a failed thread still has to reach the barrier, or the others would wait forever
+	pthread_barrier_wait(job->start);
+	if (!job->failed) {
+		start = runner_now_ns();
+		for (b = 0; b < buffers; b++) {
+			libpd_process_float(ticks_per_buffer, in_buffer, out_buffer);
+		}
+		job->elapsed = runner_now_ns() - start;
+		job->frames = (unsigned int) (buffers * block * ticks_per_buffer);
+	}
+
+	if (patch) {
+		libpd_closefile(patch);
+	}
+	free(in_buffer);
+	free(out_buffer);
+	return NULL;
+}
+
+/*
+	renders instances_num copies of the job concurrently, each in a fresh Pd instance on its own thread, returns 0 when all of them ran
+*/
+static int runner_jobs_run (const t_runner_job* job, t_runner_job* jobs, int instances_num) {
+	pthread_t* threads = (pthread_t*) calloc(instances_num, sizeof(pthread_t));
+	pthread_barrier_t start;
+	int failed = threads == NULL;
+	int i;
+
+	if (failed) {
+		return 1;
+	}
+	pthread_barrier_init(&start, NULL, instances_num);
+	for (i = 0; i < instances_num; i++) {
+		jobs[i] = *job;
+		jobs[i].start = &start;
+		jobs[i].instance = libpd_new_instance();
+	}
+	for (i = 0; i < instances_num; i++) {
+		pthread_create(&threads[i], NULL, runner_job_thread, &jobs[i]);
+	}
+	for (i = 0; i < instances_num; i++) {
+		pthread_join(threads[i], NULL);
+		libpd_free_instance(jobs[i].instance);
+		failed |= jobs[i].failed;
+	}
+	pthread_barrier_destroy(&start);
+	free(threads);
+	return failed;
+}
+
+/*
+	--instances mode: baseline in one instance, then instances_num at once, and one JSON report
+*/
+static int runner_stress (const t_runner_job* job, const char* patch_path, int instances_num, double min_scaling) {
+	t_runner_job baseline;
+	t_runner_job* jobs = (t_runner_job*) calloc(instances_num, sizeof(t_runner_job));
+	double baseline_rtf;
+	double aggregate_seconds = 0.0;
+	double wall = 0.0;
+	double aggregate_rtf;
+	double scaling;
+	int i;
+
+	if (jobs == NULL || runner_jobs_run(job, &baseline, 1) || runner_jobs_run(job, jobs, instances_num)) {
+		fprintf(stderr, "stress test failed to run %s\n", patch_path);
+		free(jobs);
+		return 1;
+	}
+
+	// aggregate throughput: audio rendered by all instances over the time the slowest one took
+	baseline_rtf = ((double) baseline.frames / job->sr) / (baseline.elapsed * 1e-9);
+	for (i = 0; i < instances_num; i++) {
+		aggregate_seconds += (double) jobs[i].frames / job->sr;
+		if (jobs[i].elapsed > wall) {
+			wall = jobs[i].elapsed;
+		}
+	}
+	aggregate_rtf = aggregate_seconds / (wall * 1e-9);
+	scaling = aggregate_rtf / (instances_num * baseline_rtf);
+
+	printf("{\"patch\": \"%s\", \"sr\": %d, \"instances\": %d, \"seconds\": %.3f, \"baseline_realtime_factor\": %.2f, \"aggregate_realtime_factor\": %.2f, \"scaling\": %.3f, \"instance_realtime_factors\": [", patch_path, job->sr, instances_num, (double) baseline.frames / job->sr, baseline_rtf, aggregate_rtf, scaling);
+	for (i = 0; i < instances_num; i++) {
+		printf("%s%.2f", i ? ", " : "", ((double) jobs[i].frames / job->sr) / (jobs[i].elapsed * 1e-9));
+	}
+	printf("]}\n");
+	free(jobs);
+
+	if (scaling < min_scaling) {
+		fprintf(stderr, "%s: scaling %.3f over %d instances is below %.3f\n", patch_path, scaling, instances_num, min_scaling);
+		return 1;
+	}
+	return 0;
+}
+#endif
+
+int main (int argc, char** argv) {
+	double seconds = 10.0;
+	int sr = 44100;
+	int channels = 2;
+	const char* out_path = NULL;
+	const char* sends[64];
+	int sends_num = 0;
+	const char* patch_path = NULL;
+	int instances_num = 0;
+	double min_scaling = 0.0;
+	t_runner_job job;
+	char patch_dir[1024];
+	const char* patch_file;
+	char* slash;
+	void* patch;
+	FILE* out = NULL;
+	float* in_buffer;
+	float* out_buffer;
+	int block;
+	int ticks_per_buffer = 16;
+	long buffers;
+	long b;
+	unsigned int frames;
+	double start;
+	double elapsed;
+	double objects_ns = 0.0;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+			seconds = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--sr") == 0 && i + 1 < argc) {
+			sr = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--channels") == 0 && i + 1 < argc) {
+			channels = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+			out_path = argv[++i];
+		}
+		else if (strcmp(argv[i], "--send") == 0 && i + 1 < argc && sends_num < 64) {
+			sends[sends_num++] = argv[++i];
+		}
+		else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc) {
+			instances_num = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--min-scaling") == 0 && i + 1 < argc) {
+			min_scaling = atof(argv[++i]);
+		}
+		else if (argv[i][0] != '-' && patch_path == NULL) {
+			patch_path = argv[i];
+		}
+		else {
+			patch_path = NULL;
+			break;
+		}
+	}
+	if (patch_path == NULL || channels < 1 || channels > RUNNER_CHANNELS_MAX || instances_num < 0) {
+		fprintf(stderr, "usage: %s [--seconds s] [--sr rate] [--channels n] [--out file.wav] [--send \"receiver message ...\"]... [--instances n [--min-scaling f]] patch.pd\n", argv[0]);
+		return 2;
+	}
+#ifndef PDINSTANCE
+	(void) min_scaling;
+	if (instances_num > 0) {
+		fprintf(stderr, "--instances needs a multi-instance build (make runner RUNNER_INSTANCES=1)\n");
+		return 2;
+	}
+#endif
+
+	// libpd wants the patch file name and its directory separately
+	strncpy(patch_dir, patch_path, sizeof(patch_dir) - 1);
+	patch_dir[sizeof(patch_dir) - 1] = '\0';
+	slash = strrchr(patch_dir, '/');
+	if (slash) {
+		*slash = '\0';
+		patch_file = slash + 1;
+	}
+	else {
+		strcpy(patch_dir, ".");
+		patch_file = patch_path;
+	}
+
+	libpd_set_printhook(runner_print);
+	libpd_init();
+	blend_tilde_setup();
+	folder_tilde_setup();
+	nlchain_tilde_setup();
+	wavecap_tilde_setup();
+	wiener_tilde_setup();
+	wraparound_tilde_setup();
+
+	memset(&job, 0, sizeof(job));
+	job.patch_dir = patch_dir;
+	job.patch_file = patch_file;
+	job.sends = sends;
+	job.sends_num = sends_num;
+	job.sr = sr;
+	job.channels = channels;
+	job.seconds = seconds;
+#ifdef PDINSTANCE
+	if (instances_num > 0) {
+		return runner_stress(&job, patch_path, instances_num, min_scaling);
+	}
+#endif
+
+	patch = runner_open(&job);
+	if (patch == NULL) {
+		return 1;
+	}
+
+	block = libpd_blocksize();
+	in_buffer = (float*) calloc((size_t) block * ticks_per_buffer * channels, sizeof(float));
+	out_buffer = (float*) calloc((size_t) block * ticks_per_buffer * channels, sizeof(float));
+	buffers = (long) (seconds * sr / (block * ticks_per_buffer)) + 1;
+	frames = (unsigned int) (buffers * block * ticks_per_buffer);
+
+	if (out_path) {
+		out = fopen(out_path, "wb");
+		if (out == NULL) {
+			fprintf(stderr, "could not open %s for writing\n", out_path);
+			return 1;
+		}
+		runner_wav_header(out, channels, sr, frames);
+	}
+
+	// render; file output is outside the timed region
+	elapsed = 0.0;
+	for (b = 0; b < buffers; b++) {
+		start = runner_now_ns();
+		libpd_process_float(ticks_per_buffer, in_buffer, out_buffer);
+		elapsed += runner_now_ns() - start;
+		if (out) {
+			fwrite(out_buffer, sizeof(float), (size_t) block * ticks_per_buffer * channels, out);
+		}
+	}
+	if (out) {
+		fclose(out);
+	}
+
+	// report
+	printf("{\"patch\": \"%s\", \"sr\": %d, \"block\": %d, \"seconds\": %.3f, \"wall_seconds\": %.6f, \"realtime_factor\": %.2f, \"ns_per_sample\": %.3f, \"objects\": [", patch_path, sr, block, (double) frames / sr, elapsed * 1e-9, ((double) frames / sr) / (elapsed * 1e-9), elapsed / frames);
+	for (i = 0; i < runner_slots_num; i++) {
+		objects_ns += runner_slots[i].ns;
+		printf("%s\n\t{\"object\": \"%s\", \"instance\": %d, \"blocks\": %ld, \"ns_per_block\": %.1f, \"ns_per_sample\": %.3f, \"dsp_share\": %.4f}", i ? "," : "", class_getname(&runner_slots[i].owner), runner_slots[i].instance, runner_slots[i].calls, runner_slots[i].calls ? runner_slots[i].ns / runner_slots[i].calls : 0.0, runner_slots[i].ns / frames, runner_slots[i].ns / elapsed);
+	}
+	printf("%s], \"other_dsp_share\": %.4f}\n", runner_slots_num ? "\n" : "", (elapsed - objects_ns) / elapsed);
+
+	libpd_closefile(patch);
+	free(in_buffer);
+	free(out_buffer);
+	return 0;
+}
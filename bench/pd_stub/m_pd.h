@@ -0,0 +1,189 @@
+#ifndef PS_BENCH_M_PD_H
+#define PS_BENCH_M_PD_H
+
+/*
+	m_pd.h (benchmark stub)
+
+	The subset of Pd's m_pd.h that the externals use, so they can be compiled and driven without Pd. The declarations match Pd's own, and pd_stub.c implements them: classes and methods are recorded, dsp_add() appends to a chain that the harness runs, and outlets are sinks. Only bench/ puts this directory on the include path.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define PD_MAJOR_VERSION 0
+#define PD_MINOR_VERSION 54
+#define PD_BUGFIX_VERSION 0
+
+#ifndef PD_FLOATSIZE
+#define PD_FLOATSIZE 32
+#endif
+
+#define EXTERN extern
+
+#define MAXPDSTRING 1000
+
+#if PD_FLOATSIZE == 32
+typedef float t_float;
+typedef float t_floatarg;
+#else
+typedef double t_float;
+typedef double t_floatarg;
+#endif
+typedef t_float t_sample;
+typedef intptr_t t_int;
+
+typedef struct _symbol {
+	const char* s_name;
+	struct _class** s_thing;
+	struct _symbol* s_next;
+} t_symbol;
+
+typedef struct _class t_class;
+typedef t_class* t_pd;
+typedef struct _outlet t_outlet;
+typedef struct _inlet t_inlet;
+typedef struct _clock t_clock;
+typedef struct _garray t_garray;
+typedef struct _gpointer t_gpointer;
+
+#define t_glist struct _glist
+#define t_canvas struct _glist
+
+typedef union word {
+	t_float w_float;
+	t_symbol* w_symbol;
+	t_gpointer* w_gpointer;
+	int w_index;
+} t_word;
+
+typedef enum {
+	A_NULL,
+	A_FLOAT,
+	A_SYMBOL,
+	A_POINTER,
+	A_SEMI,
+	A_COMMA,
+	A_DEFFLOAT,
+	A_DEFSYM,
+	A_DOLLAR,
+	A_DOLLSYM,
+	A_GIMME,
+	A_CANT
+} t_atomtype;
+
+typedef struct _atom {
+	t_atomtype a_type;
+	union word a_w;
+} t_atom;
+
+typedef struct _gobj {
+	t_pd g_pd;
+	struct _gobj* g_next;
+} t_gobj;
+
+typedef struct _text {
+	t_gobj te_g;
+	void* te_binbuf;
+	t_outlet* te_outlet;
+	t_inlet* te_inlet;
+	short te_xpix;
+	short te_ypix;
+	short te_width;
+	unsigned int te_type:2;
+} t_text;
+
+typedef t_text t_object;
+#define ob_pd te_g.g_pd
+
+typedef struct _signal {
+	int s_n;
+	t_sample* s_vec;
+	t_float s_sr;
+	int s_refcount;
+	int s_isborrowed;
+	struct _signal* s_borrowedfrom;
+	struct _signal* s_nextfree;
+	struct _signal* s_nextused;
+	int s_vecsize;
+	int s_nchans;
+	int s_overlap;
+} t_signal;
+
+typedef t_int* (*t_perfroutine)(t_int* args);
+typedef void* (*t_newmethod)(void);
+typedef void (*t_method)(void);
+
+#define CLASS_DEFAULT 0
+#define CLASS_NOINLET 8
+#define CLASS_MULTICHANNEL 128
+
+EXTERN t_symbol s_signal;
+EXTERN t_symbol s_float;
+EXTERN t_symbol s_symbol;
+EXTERN t_symbol s_list;
+EXTERN t_symbol s_bang;
+EXTERN t_symbol s_;
+
+EXTERN t_symbol* gensym(const char* s);
+EXTERN t_pd* pd_new(t_class* cls);
+EXTERN void pd_free(t_pd* x);
+EXTERN t_pd* pd_findbyclass(t_symbol* s, const t_class* c);
+EXTERN void pd_list(t_pd* x, t_symbol* s, int argc, t_atom* argv);
+
+EXTERN t_class* class_new(t_symbol* name, t_newmethod newmethod, t_method freemethod, size_t size, int flags, t_atomtype arg1, ...);
+EXTERN void class_addmethod(t_class* c, t_method fn, t_symbol* sel, t_atomtype arg1, ...);
+EXTERN void class_addbang(t_class* c, t_method fn);
+EXTERN void class_addfloat(t_class* c, t_method fn);
+EXTERN void class_addlist(t_class* c, t_method fn);
+EXTERN void class_domainsignalin(t_class* c, int onset);
+#define CLASS_MAINSIGNALIN(c, type, field) class_domainsignalin(c, (int) offsetof(type, field))
+
+EXTERN void dsp_add(t_perfroutine f, int n, ...);
+EXTERN void dsp_addv(t_perfroutine f, int n, t_int* vec);
+EXTERN void signal_setmultiout(t_signal** sig, int nchans);
+
+EXTERN t_inlet* inlet_new(t_object* owner, t_pd* dest, t_symbol* s1, t_symbol* s2);
+EXTERN t_inlet* floatinlet_new(t_object* owner, t_float* fp);
+EXTERN t_outlet* outlet_new(t_object* owner, t_symbol* s);
+EXTERN void outlet_bang(t_outlet* x);
+EXTERN void outlet_float(t_outlet* x, t_float f);
+EXTERN void outlet_list(t_outlet* x, t_symbol* s, int argc, t_atom* argv);
+EXTERN void outlet_anything(t_outlet* x, t_symbol* s, int argc, t_atom* argv);
+
+EXTERN void post(const char* fmt, ...);
+EXTERN void error(const char* fmt, ...);
+EXTERN void pd_error(const void* object, const char* fmt, ...);
+
+EXTERN void* getbytes(size_t nbytes);
+EXTERN void* resizebytes(void* x, size_t oldsize, size_t newsize);
+EXTERN void freebytes(void* x, size_t nbytes);
+
+EXTERN t_class* garray_class;
+EXTERN int garray_getfloatwords(t_garray* x, int* size, t_word** vec);
+EXTERN void garray_resize_long(t_garray* x, long n);
+EXTERN void garray_redraw(t_garray* x);
+EXTERN void garray_usedindsp(t_garray* x);
+
+EXTERN t_clock* clock_new(void* owner, t_method fn);
+EXTERN void clock_set(t_clock* x, double systime);
+EXTERN void clock_delay(t_clock* x, double delaytime);
+EXTERN void clock_unset(t_clock* x);
+EXTERN void clock_free(t_clock* x);
+EXTERN double clock_getlogicaltime(void);
+EXTERN double clock_gettimesince(double prevsystime);
+
+EXTERN t_canvas* canvas_getcurrent(void);
+EXTERN void canvas_makefilename(const t_glist* c, const char* file, char* result, int resultsize);
+
+EXTERN t_float sys_getsr(void);
+EXTERN int sys_getblksize(void);
+
+EXTERN t_float atom_getfloat(const t_atom* a);
+EXTERN t_float atom_getfloatarg(int which, int argc, const t_atom* argv);
+EXTERN t_symbol* atom_getsymbolarg(int which, int argc, const t_atom* argv);
+
+#define SETFLOAT(atom, f) ((atom)->a_type = A_FLOAT, (atom)->a_w.w_float = (f))
+#define SETSYMBOL(atom, s) ((atom)->a_type = A_SYMBOL, (atom)->a_w.w_symbol = (s))
+
+#endif
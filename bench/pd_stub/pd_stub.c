@@ -0,0 +1,650 @@
+#include "pd_stub.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+	pd_stub.c
+
+	Minimal Pd host for the benchmark. See m_pd.h and pd_stub.h in this directory.
+*/
+
+#define STUB_METHOD_ARGS_MAX 6
+#define STUB_CLASSES_MAX 32
+#define STUB_CHAIN_MAX 65536
+#define STUB_CLOCKS_MAX 256
+#define STUB_ARRAYS_MAX 32
+
+typedef struct _stub_method {
+	t_symbol* sel;
+	t_method fn;
+	int argc;
+	t_atomtype argt[STUB_METHOD_ARGS_MAX];
+} t_stub_method;
+
+struct _class {
+	t_symbol* c_name;
+	t_newmethod c_new;
+	t_method c_free;
+	size_t c_size;
+	int c_flags;
+	int c_argc;
+	t_atomtype c_argt[STUB_METHOD_ARGS_MAX];
+	t_method c_bang;
+	int c_methods_num;
+	t_stub_method* c_methods;
+};
+
+struct _outlet {
+	t_object* o_owner;
+};
+
+struct _inlet {
+	t_object* i_owner;
+};
+
+struct _clock {
+	void* c_owner;
+	t_method c_fn;
+	double c_settime;
+	int c_set;
+};
+
+struct _garray {
+	t_symbol* a_name;
+	int a_size;
+	t_word* a_vec;
+};
+
+t_symbol s_signal = {"signal", 0, 0};
+t_symbol s_float = {"float", 0, 0};
+t_symbol s_symbol = {"symbol", 0, 0};
+t_symbol s_list = {"list", 0, 0};
+t_symbol s_bang = {"bang", 0, 0};
+t_symbol s_ = {"", 0, 0};
+
+volatile double stub_outlet_sink = 0.0;
+int stub_quiet = 1;
+int stub_errors = 0;
+int stub_errors_quiet = 0;
+
+static t_symbol* stub_symbols = NULL;
+static t_class* stub_classes[STUB_CLASSES_MAX];
+static int stub_classes_num = 0;
+static t_int stub_chain[STUB_CHAIN_MAX];
+static int stub_chain_used = 0;
+static t_clock* stub_clocks[STUB_CLOCKS_MAX];
+static int stub_clocks_num = 0;
+static struct _garray stub_arrays[STUB_ARRAYS_MAX];
+static int stub_arrays_num = 0;
+static double stub_logical_time = 0.0;
+static double stub_block_ms = 64.0 / 44.1;
+
+static struct _class stub_garray_class;
+t_class* garray_class = &stub_garray_class;
+
+/*
+	symbols, objects and classes
+*/
+
+t_symbol* gensym (const char* s) {
+	t_symbol* sym;
+	char* name;
+
+	for (sym = stub_symbols; sym; sym = sym->s_next) {
+		if (strcmp(sym->s_name, s) == 0) {
+			return sym;
+		}
+	}
+
+	sym = (t_symbol*) calloc(1, sizeof(t_symbol));
+	name = (char*) malloc(strlen(s) + 1);
+	strcpy(name, s);
+	sym->s_name = name;
+	sym->s_next = stub_symbols;
+	stub_symbols = sym;
+	return sym;
+}
+
+t_pd* pd_new (t_class* cls) {
+	t_pd* x = (t_pd*) calloc(1, cls->c_size);
+	*x = cls;
+	return x;
+}
+
+void pd_free (t_pd* x) {
+	t_class* c = *x;
+
+	if (c->c_free) {
+		((void (*)(t_pd*)) c->c_free)(x);
+	}
+	free(x);
+}
+
+t_pd* pd_findbyclass (t_symbol* s, const t_class* c) {
+	int i;
+
+	if (c != garray_class) {
+		return NULL;
+	}
+	for (i = 0; i < stub_arrays_num; i++) {
+		if (stub_arrays[i].a_name == s) {
+			return (t_pd*) &stub_arrays[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+	canvases: there is no patch, so relative file names stay relative to the working directory
+*/
+
+t_canvas* canvas_getcurrent (void) {
+	return NULL;
+}
+
+void canvas_makefilename (const t_glist* c, const char* file, char* result, int resultsize) {
+	snprintf(result, resultsize, "%s", file);
+}
+
+static int stub_argtypes (t_atomtype* argt, t_atomtype arg1, va_list ap) {
+	int argc = 0;
+	t_atomtype argtype = arg1;
+
+	while (argtype != A_NULL && argc < STUB_METHOD_ARGS_MAX) {
+		argt[argc++] = argtype;
+		argtype = (t_atomtype) va_arg(ap, int);
+	}
+	return argc;
+}
+
+t_class* class_new (t_symbol* name, t_newmethod newmethod, t_method freemethod, size_t size, int flags, t_atomtype arg1, ...) {
+	t_class* c = (t_class*) calloc(1, sizeof(t_class));
+	va_list ap;
+
+	c->c_name = name;
+	c->c_new = newmethod;
+	c->c_free = freemethod;
+	c->c_size = size;
+	c->c_flags = flags;
+	va_start(ap, arg1);
+	c->c_argc = stub_argtypes(c->c_argt, arg1, ap);
+	va_end(ap);
+
+	if (stub_classes_num < STUB_CLASSES_MAX) {
+		stub_classes[stub_classes_num++] = c;
+	}
+	return c;
+}
+
+void class_addmethod (t_class* c, t_method fn, t_symbol* sel, t_atomtype arg1, ...) {
+	t_stub_method* m;
+	va_list ap;
+
+	c->c_methods = (t_stub_method*) realloc(c->c_methods, sizeof(t_stub_method) * (c->c_methods_num + 1));
+	m = &c->c_methods[c->c_methods_num++];
+	m->sel = sel;
+	m->fn = fn;
+	va_start(ap, arg1);
+	m->argc = stub_argtypes(m->argt, arg1, ap);
+	va_end(ap);
+}
+
+void class_addbang (t_class* c, t_method fn) {
+	c->c_bang = fn;
+}
+
+void class_addfloat (t_class* c, t_method fn) {
+	class_addmethod(c, fn, &s_float, A_FLOAT, A_NULL);
+}
+
+void class_addlist (t_class* c, t_method fn) {
+	class_addmethod(c, fn, &s_list, A_GIMME, A_NULL);
+}
+
+void class_domainsignalin (t_class* c, int onset) {
+}
+
+/*
+	dsp chain
+*/
+
+void dsp_addv (t_perfroutine f, int n, t_int* vec) {
+	int i;
+
+	if (stub_chain_used + n + 1 > STUB_CHAIN_MAX) {
+		fprintf(stderr, "pd_stub: dsp chain full\n");
+		exit(1);
+	}
+	stub_chain[stub_chain_used++] = (t_int) f;
+	for (i = 0; i < n; i++) {
+		stub_chain[stub_chain_used++] = vec[i];
+	}
+}
+
+void dsp_add (t_perfroutine f, int n, ...) {
+	t_int vec[64];
+	va_list ap;
+	int i;
+
+	va_start(ap, n);
+	for (i = 0; i < n && i < 64; i++) {
+		vec[i] = va_arg(ap, t_int);
+	}
+	va_end(ap);
+	dsp_addv(f, n, vec);
+}
+
+void signal_setmultiout (t_signal** sig, int nchans) {
+	t_signal* s = *sig;
+
+	if (nchans > s->s_nchans) {
+		free(s->s_vec);
+		s->s_vec = (t_sample*) calloc((size_t) s->s_n * nchans, sizeof(t_sample));
+	}
+	s->s_nchans = nchans;
+}
+
+/*
+	inlets, outlets and console
+*/
+
+t_inlet* inlet_new (t_object* owner, t_pd* dest, t_symbol* s1, t_symbol* s2) {
+	t_inlet* i = (t_inlet*) calloc(1, sizeof(t_inlet));
+	i->i_owner = owner;
+	return i;
+}
+
+t_inlet* floatinlet_new (t_object* owner, t_float* fp) {
+	return inlet_new(owner, NULL, &s_float, &s_float);
+}
+
+t_outlet* outlet_new (t_object* owner, t_symbol* s) {
+	t_outlet* o = (t_outlet*) calloc(1, sizeof(t_outlet));
+	o->o_owner = owner;
+	return o;
+}
+
+void outlet_bang (t_outlet* x) {
+	stub_outlet_sink += 1.0;
+}
+
+void outlet_float (t_outlet* x, t_float f) {
+	stub_outlet_sink += f;
+}
+
+void outlet_list (t_outlet* x, t_symbol* s, int argc, t_atom* argv) {
+	int i;
+
+	for (i = 0; i < argc; i++) {
+		stub_outlet_sink += atom_getfloat(&argv[i]);
+	}
+}
+
+void outlet_anything (t_outlet* x, t_symbol* s, int argc, t_atom* argv) {
+	outlet_list(x, s, argc, argv);
+}
+
+// receivers are never bound here, so this is only reached if an external skips the s_thing check
+void pd_list (t_pd* x, t_symbol* s, int argc, t_atom* argv) {
+	outlet_list(NULL, s, argc, argv);
+}
+
+static void stub_vprint (const char* prefix, const char* fmt, va_list ap) {
+	fputs(prefix, stderr);
+	vfprintf(stderr, fmt, ap);
+	fputc('\n', stderr);
+}
+
+void post (const char* fmt, ...) {
+	va_list ap;
+
+	if (stub_quiet) {
+		return;
+	}
+	va_start(ap, fmt);
+	stub_vprint("", fmt, ap);
+	va_end(ap);
+}
+
+void error (const char* fmt, ...) {
+	va_list ap;
+
+	stub_errors++;
+	if (stub_errors_quiet) {
+		return;
+	}
+	va_start(ap, fmt);
+	stub_vprint("error: ", fmt, ap);
+	va_end(ap);
+}
+
+void pd_error (const void* object, const char* fmt, ...) {
+	va_list ap;
+
+	stub_errors++;
+	if (stub_errors_quiet) {
+		return;
+	}
+	va_start(ap, fmt);
+	stub_vprint("error: ", fmt, ap);
+	va_end(ap);
+}
+
+void* getbytes (size_t nbytes) {
+	return calloc(1, nbytes ? nbytes : 1);
+}
+
+void* resizebytes (void* x, size_t oldsize, size_t newsize) {
+	char* y = (char*) realloc(x, newsize ? newsize : 1);
+
+	if (y && newsize > oldsize) {
+		memset(y + oldsize, 0, newsize - oldsize);
+	}
+	return y;
+}
+
+void freebytes (void* x, size_t nbytes) {
+	free(x);
+}
+
+/*
+	arrays
+*/
+
+int garray_getfloatwords (t_garray* x, int* size, t_word** vec) {
+	*size = x->a_size;
+	*vec = x->a_vec;
+	return 1;
+}
+
+void garray_resize_long (t_garray* x, long n) {
+	x->a_vec = (t_word*) resizebytes(x->a_vec, sizeof(t_word) * x->a_size, sizeof(t_word) * n);
+	x->a_size = (int) n;
+}
+
+void garray_redraw (t_garray* x) {
+}
+
+void garray_usedindsp (t_garray* x) {
+}
+
+t_garray* stub_array_new (const char* name, int size) {
+	t_garray* a;
+
+	if (stub_arrays_num >= STUB_ARRAYS_MAX) {
+		return NULL;
+	}
+	a = &stub_arrays[stub_arrays_num++];
+	a->a_name = gensym(name);
+	a->a_size = size;
+	a->a_vec = (t_word*) calloc(size, sizeof(t_word));
+	return a;
+}
+
+t_word* stub_array_words (t_garray* a, int* size) {
+	*size = a->a_size;
+	return a->a_vec;
+}
+
+/*
+	clocks (logical time advances one block per stub_tick)
+*/
+
+t_clock* clock_new (void* owner, t_method fn) {
+	t_clock* c = (t_clock*) calloc(1, sizeof(t_clock));
+
+	c->c_owner = owner;
+	c->c_fn = fn;
+	if (stub_clocks_num < STUB_CLOCKS_MAX) {
+		stub_clocks[stub_clocks_num++] = c;
+	}
+	return c;
+}
+
+void clock_set (t_clock* x, double systime) {
+	x->c_settime = systime;
+	x->c_set = 1;
+}
+
+void clock_delay (t_clock* x, double delaytime) {
+	clock_set(x, stub_logical_time + (delaytime > 0.0 ? delaytime : 0.0));
+}
+
+void clock_unset (t_clock* x) {
+	x->c_set = 0;
+}
+
+void clock_free (t_clock* x) {
+	int i;
+
+	for (i = 0; i < stub_clocks_num; i++) {
+		if (stub_clocks[i] == x) {
+			stub_clocks[i] = stub_clocks[--stub_clocks_num];
+			break;
+		}
+	}
+	free(x);
+}
+
+double clock_getlogicaltime (void) {
+	return stub_logical_time;
+}
+
+double clock_gettimesince (double prevsystime) {
+	return stub_logical_time - prevsystime;
+}
+
+t_float sys_getsr (void) {
+	return 44100.0f;
+}
+
+int sys_getblksize (void) {
+	return 64;
+}
+
+/*
+	atoms
+*/
+
+t_float atom_getfloat (const t_atom* a) {
+	return a->a_type == A_FLOAT ? a->a_w.w_float : 0.0f;
+}
+
+t_float atom_getfloatarg (int which, int argc, const t_atom* argv) {
+	return which < argc ? atom_getfloat(&argv[which]) : 0.0f;
+}
+
+t_symbol* atom_getsymbolarg (int which, int argc, const t_atom* argv) {
+	return (which < argc && argv[which].a_type == A_SYMBOL) ? argv[which].a_w.w_symbol : &s_;
+}
+
+static int stub_parse (const char* text, t_atom* argv, int argc_max) {
+	char buf[1024];
+	char* token;
+	char* end;
+	double f;
+	int argc = 0;
+
+	strncpy(buf, text, sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = '\0';
+	for (token = strtok(buf, " \t"); token && argc < argc_max; token = strtok(NULL, " \t")) {
+		f = strtod(token, &end);
+		if (*end == '\0') {
+			SETFLOAT(&argv[argc], (t_float) f);
+		}
+		else {
+			SETSYMBOL(&argv[argc], gensym(token));
+		}
+		argc++;
+	}
+	return argc;
+}
+
+/*
+	host side
+*/
+
+t_class* stub_class_find (const char* name) {
+	t_symbol* sym = gensym(name);
+	int i;
+
+	for (i = 0; i < stub_classes_num; i++) {
+		if (stub_classes[i]->c_name == sym) {
+			return stub_classes[i];
+		}
+	}
+	return NULL;
+}
+
+void* stub_new (const char* name, const char* args) {
+	t_class* c = stub_class_find(name);
+	t_atom argv[16];
+	int argc;
+
+	if (c == NULL) {
+		fprintf(stderr, "pd_stub: no class %s\n", name);
+		return NULL;
+	}
+	argc = stub_parse(args ? args : "", argv, 16);
+
+	if (c->c_argc == 0) {
+		return ((void* (*)(void)) c->c_new)();
+	}
+	switch (c->c_argt[0]) {
+	case A_GIMME:
+		return ((void* (*)(t_symbol*, int, t_atom*)) c->c_new)(c->c_name, argc, argv);
+	case A_FLOAT:
+	case A_DEFFLOAT:
+		return ((void* (*)(t_floatarg)) c->c_new)(atom_getfloatarg(0, argc, argv));
+	case A_SYMBOL:
+	case A_DEFSYM:
+		return ((void* (*)(t_symbol*)) c->c_new)(atom_getsymbolarg(0, argc, argv));
+	default:
+		fprintf(stderr, "pd_stub: %s: unsupported creation arguments\n", name);
+		return NULL;
+	}
+}
+
+void stub_free (void* x) {
+	pd_free((t_pd*) x);
+}
+
+int stub_send (void* x, const char* message) {
+	t_class* c = *(t_class**) x;
+	t_atom argv[64];
+	t_symbol* sel;
+	t_stub_method* m;
+	int argc = stub_parse(message, argv, 64);
+	int i;
+
+	if (argc == 0 || argv[0].a_type != A_SYMBOL) {
+		return 0;
+	}
+	sel = argv[0].a_w.w_symbol;
+
+	if (sel == &s_bang || strcmp(sel->s_name, "bang") == 0) {
+		if (c->c_bang) {
+			((void (*)(void*)) c->c_bang)(x);
+			return 1;
+		}
+	}
+
+	for (i = 0; i < c->c_methods_num; i++) {
+		m = &c->c_methods[i];
+		if (strcmp(m->sel->s_name, sel->s_name) != 0) {
+			continue;
+		}
+		if (m->argc == 0) {
+			((void (*)(void*)) m->fn)(x);
+		}
+		else if (m->argt[0] == A_GIMME) {
+			((void (*)(void*, t_symbol*, int, t_atom*)) m->fn)(x, sel, argc - 1, argv + 1);
+		}
+		else if (m->argt[0] == A_SYMBOL || m->argt[0] == A_DEFSYM) {
+			((void (*)(void*, t_symbol*)) m->fn)(x, atom_getsymbolarg(1, argc, argv));
+		}
+		else if (m->argc == 1) {
+			((void (*)(void*, t_floatarg)) m->fn)(x, atom_getfloatarg(1, argc, argv));
+		}
+		else if (m->argc == 2) {
+			((void (*)(void*, t_floatarg, t_floatarg)) m->fn)(x, atom_getfloatarg(1, argc, argv), atom_getfloatarg(2, argc, argv));
+		}
+		else {
+			((void (*)(void*, t_floatarg, t_floatarg, t_floatarg)) m->fn)(x, atom_getfloatarg(1, argc, argv), atom_getfloatarg(2, argc, argv), atom_getfloatarg(3, argc, argv));
+		}
+		return 1;
+	}
+
+	fprintf(stderr, "pd_stub: %s: no method for %s\n", c->c_name->s_name, sel->s_name);
+	return 0;
+}
+
+t_signal** stub_signals_new (int count, int n, t_float sr) {
+	t_signal** sp = (t_signal**) calloc(count, sizeof(t_signal*));
+	int i;
+
+	for (i = 0; i < count; i++) {
+		sp[i] = (t_signal*) calloc(1, sizeof(t_signal));
+		sp[i]->s_n = n;
+		sp[i]->s_vecsize = n;
+		sp[i]->s_sr = sr;
+		sp[i]->s_nchans = 1;
+		sp[i]->s_vec = (t_sample*) calloc(n, sizeof(t_sample));
+	}
+	stub_block_ms = 1000.0 * n / sr;
+	return sp;
+}
+
+void stub_signals_free (t_signal** sp, int count) {
+	int i;
+
+	for (i = 0; i < count; i++) {
+		free(sp[i]->s_vec);
+		free(sp[i]);
+	}
+	free(sp);
+}
+
+int stub_dsp (void* x, t_signal** sp) {
+	t_class* c = *(t_class**) x;
+	int i;
+
+	for (i = 0; i < c->c_methods_num; i++) {
+		if (strcmp(c->c_methods[i].sel->s_name, "dsp") == 0) {
+			((void (*)(void*, t_signal**)) c->c_methods[i].fn)(x, sp);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void stub_chain_reset (void) {
+	stub_chain_used = 0;
+}
+
+int stub_chain_length (void) {
+	return stub_chain_used;
+}
+
+void stub_tick (void) {
+	t_int* w = stub_chain;
+	t_int* end = stub_chain + stub_chain_used;
+	double tick_end = stub_logical_time + stub_block_ms;
+	int i;
+
+	// like Pd, fire the clocks that come due within the tick at their own time, then advance logical time to the end of the tick and compute its DSP
+	for (i = 0; i < stub_clocks_num; i++) {
+		if (stub_clocks[i]->c_set && stub_clocks[i]->c_settime < tick_end) {
+			stub_clocks[i]->c_set = 0;
+			stub_logical_time = stub_clocks[i]->c_settime > stub_logical_time ? stub_clocks[i]->c_settime : stub_logical_time;
+			((void (*)(void*)) stub_clocks[i]->c_fn)(stub_clocks[i]->c_owner);
+		}
+	}
+	stub_logical_time = tick_end;
+
+	while (w < end) {
+		w = ((t_perfroutine) *w)(w);
+	}
+}
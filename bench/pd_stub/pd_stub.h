@@ -0,0 +1,38 @@
+#ifndef PS_BENCH_PD_STUB_H
+#define PS_BENCH_PD_STUB_H
+
+#include "m_pd.h"
+
+/*
+	pd_stub.h
+
+	Host side of the Pd stub: what Pd itself would do to an external. Classes are looked up by name after their setup function has run, objects are created and sent messages by selector, and "dsp" appends their perform routines to one chain that stub_tick() runs once per block.
+*/
+
+// classes and objects
+t_class* stub_class_find (const char* name);
+void* stub_new (const char* name, const char* args);
+void stub_free (void* x);
+
+// messages, written the way they would be typed into a Pd message box (e.g. "soften 16 0.8")
+int stub_send (void* x, const char* message);
+
+// dsp: signals are ordered inlets first then outlets, each n samples long
+t_signal** stub_signals_new (int count, int n, t_float sr);
+void stub_signals_free (t_signal** sp, int count);
+int stub_dsp (void* x, t_signal** sp);
+void stub_chain_reset (void);
+int stub_chain_length (void);
+void stub_tick (void);
+
+// arrays that pd_findbyclass(name, garray_class) resolves
+t_garray* stub_array_new (const char* name, int size);
+t_word* stub_array_words (t_garray* a, int* size);
+
+// outlet sink and console (stub_errors counts error() and pd_error(), which stub_errors_quiet keeps off the console)
+extern volatile double stub_outlet_sink;
+extern int stub_quiet;
+extern int stub_errors;
+extern int stub_errors_quiet;
+
+#endif
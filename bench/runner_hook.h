@@ -0,0 +1,16 @@
+#ifndef PS_RUNNER_HOOK_H
+#define PS_RUNNER_HOOK_H
+
+/*
+	runner_hook.h
+
+	Force-included (-include) when the externals are compiled into ps_patch_runner. Every dsp_add() they make goes through runner_dsp_add(), which inserts a timing trampoline in front of the perform routine so the runner can report DSP time per object. The externals' sources are unchanged.
+*/
+
+#include "m_pd.h"
+
+void runner_dsp_add (t_perfroutine f, int n, ...);
+
+#define dsp_add runner_dsp_add
+
+#endif
@@ -0,0 +1,1498 @@
+#include "pd_stub.h"
+
+#include "../core/ps_denormal.h"
+#include "../core/ps_oversample.h"
+#include "../core/ps_wavetable.h"
+#include "../core/ps_wiener.h"
+
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+	ps_bench --verify
+
+	Golden output checks for the perform routines. Every check runs one external through the Pd stub, exactly as the benchmark does, and compares its output with a reference oracle: a plain per-frame implementation with none of the block tricks (merged channels, range pre-checks, fixed block sizes, fused chains, polyphase filters, packed accumulators, voice lanes). Where the original scalar object had the feature, the oracle is its perform loop, kept here as it was (see oracles below), so those oracles never call the core functions the externals run. nlchain~ is checked against those loops patched in series, including stage lists that repeat a stage.
+
+	Each check runs at block sizes 1, 64, 100, 128, 256 and 1024 (64, 128 and 256 take the fixed size kernels), with one channel, one channel computed in place (the outlet sharing the first inlet's memory), four channels on every inlet and four channels on the first inlet only. Inputs are one of:
+
+		* random	(xorshift noise, wide enough to cross every threshold and wrap)
+		* edges		(frames drawn from the boundaries: 0, -0, +-1, +-3 and their float neighbours, denormals)
+		* large		(noise of amplitude 1000, which takes the slow wrap loops)
+		* nan		(random with a NaN every 61 frames, only where NaN cannot stall a loop or poison a filter)
+		* silence	(all zeros)
+
+	Checks with an event send one parameter change with a delay in ms (gain, table_interp, env_atk_ms, env_dcy_ms) between the blocks once VERIFY_EVENT_SENT frames are rendered, and their oracle runs the baseline loop with the old value up to the frame the change falls due at and the new value from there, so the change has to land on that frame at every block size (see common/ps_events.h).
+
+	Checks with a table file play wavecap~'s tables from one (see Table files in wavecap~/wavecap~.c), written to a temporary file: the object saves its tables, shrinks them and loads the file back, or loads a file written here with the other sample precision, or is sent a series of truncated and corrupt files that load must each reject, leaving the imported tables to play.
+
+	The oracles run under ps_denormal_begin() like the perform routines, so denormal inputs read as zero in both. Checks of an object on worker threads (threads n, see common/ps_parallel.h) compare its output one block later, and skip the first block, which is silent.
+
+	Tolerances:
+		* ulp		largest distance in units in the last place over every frame (NaN matches NaN). The stateless kernels and the soften average do the oracle's arithmetic per frame in the same order (-ffp-contract=off), so they must match exactly.
+		* snr_db	error energy over reference energy in dB (floored at -400 when the error is 0). Used where the optimized code legitimately rounds differently from a double precision oracle: the polyphase oversampling filters and the wavetable interpolators.
+		* ratio_db	largest |20 log10(output / reference)| over the blocks, for the one value per block wiener~ outputs.
+
+	The snr_db and ratio_db tolerances leave about 20 dB (an order of magnitude for ratio_db) over the worst error measured with the AVX-512 and the baseline (PS_NO_DISPATCH) kernels: -120 dB for float against a measured -138, -250 dB for double against -307.
+
+	One record is written per check and input set, with the worst error over all block sizes and layouts and where it happened:
+
+		{"check": "folder~/default", "input": "random", "sample": "float", "metric": "ulp", "error": 0, "tolerance": 0, "worst_block": 64, "worst_layout": "mono", "pass": true}
+
+	ps_bench --verify exits with 1 if any check fails. Only the instruction set the dispatcher picks for the running CPU is checked (common/ps_dispatch.h); build with CFLAGS=-DPS_NO_DISPATCH to check the baseline code, or run on another machine for the others.
+*/
+
+#define VERIFY_SAMPLE_RATE 44100.0f
+#if PD_FLOATSIZE == 64
+	#define VERIFY_SAMPLE_TYPE "double"
+	#define VERIFY_SAMPLE_MIN DBL_MIN
+	#define verify_nextafter nextafter
+	#define verify_fabs fabs
+#else
+	#define VERIFY_SAMPLE_TYPE "float"
+	#define VERIFY_SAMPLE_MIN FLT_MIN
+	#define verify_nextafter nextafterf
+	#define verify_fabs fabsf
+#endif
+#define VERIFY_FRAMES 4096
+#define VERIFY_INLETS_MAX 4
+#define VERIFY_CHANNELS_MAX 4
+#define VERIFY_DB_FLOOR -400.0
+#define VERIFY_NAN_PERIOD 61
+#define VERIFY_TABLE_SIZE 1024
+#define VERIFY_TABLE_SLOTS 4
+#define VERIFY_VOICES 8
+// nlchain~'s NLCHAIN_STAGES_MAX
+#define VERIFY_STAGES_MAX 8
+#define VERIFY_ENV_ATK_MS 10.0f
+#define VERIFY_ENV_DCY_MS 500.0f
+#define VERIFY_EVENT_SENT 1000
+
+static const int verify_blocks[] = {1, 64, 100, 128, 256, 1024};
+static const int verify_blocks_num = sizeof(verify_blocks) / sizeof(verify_blocks[0]);
+
+typedef enum {
+	verify_input_random,
+	verify_input_edges,
+	verify_input_large,
+	verify_input_nan,
+	verify_input_silence,
+	verify_inputs_num
+} verify_input;
+
+static const char* const verify_input_names[verify_inputs_num] = {"random", "edges", "large", "nan", "silence"};
+
+#define VERIFY_INPUTS_ALL ((1 << verify_inputs_num) - 1)
+#define VERIFY_INPUTS_FINITE (VERIFY_INPUTS_ALL & ~(1 << verify_input_nan))
+
+typedef enum {
+	verify_layout_mono,
+	verify_layout_in_place,
+	verify_layout_mc,
+	verify_layout_mc_mixed,
+	verify_layouts_num
+} verify_layout;
+
+static const char* const verify_layout_names[verify_layouts_num] = {"mono", "in_place", "mc4", "mc4_mixed"};
+
+typedef enum {
+	verify_metric_ulp,
+	verify_metric_snr_db,
+	verify_metric_ratio_db
+} verify_metric;
+
+static const char* const verify_metric_names[] = {"ulp", "snr_db", "ratio_db"};
+
+// where wavecap~'s tables come from, see verify_table_file_load()
+typedef enum {
+	verify_file_none,
+	verify_file_saved,
+	verify_file_other,
+	verify_file_corrupt
+} verify_file;
+
+// what an inlet carries, which sets the value ranges of each input set
+typedef enum {
+	verify_role_audio,
+	verify_role_increment,
+	verify_role_morph
+} verify_role;
+
+struct _verify_check;
+
+/*
+	renders the reference for one channel: in holds one pointer per inlet to frames frames, n is the block size
+	out gets frames frames, or one value per block for checks without a signal outlet
+*/
+typedef void (*t_verify_oracle) (const struct _verify_check* c, const t_sample* const* in, t_sample* out, int frames, int n);
+
+typedef struct _verify_check {
+	const char* object;
+	const char* mode;
+	const char* args;
+	// messages sent after creation, separated by ';' (the tables wavecap~ reads are imported first)
+	const char* messages;
+	int inlets;
+	int outlets;
+	verify_role roles[VERIFY_INLETS_MAX];
+	t_verify_oracle oracle;
+	verify_metric metric;
+	double tolerance;
+	double tolerance_double;
+	// bit mask of verify_input
+	int inputs;
+	int block_min;
+	int channels_max;
+	// blocks the output lags behind the oracle (worker threads, see common/ps_parallel.h)
+	int latency;
+	// a parameter change sent during the render (see verify_event_frame()), with its value and delay in ms
+	const char* event;
+	t_sample event_value;
+	t_sample event_delay_ms;
+	verify_file file;
+
+	// parameters the oracle needs, matching args and messages
+	t_sample gain;
+	int soften_n;
+	t_sample soften_alpha;
+	int factor;
+	int slots;
+	ps_interp_type interp;
+	int power_spectrum;
+	int window_hann;
+	// wavecap~'s envelope follower, off when 0
+	t_sample env_atk_ms;
+	t_sample env_dcy_ms;
+} t_verify_check;
+
+/*
+	events
+*/
+
+// the frame the check's event is sent at, rendered at block size n: the start of the first block at or after VERIFY_EVENT_SENT
+static int verify_event_sent (int n) {
+	return n * ((VERIFY_EVENT_SENT + n - 1) / n);
+}
+
+// the frame the check's event falls due at, its delay in frames after it is sent (INT_MAX without one)
+static int verify_event_frame (const t_verify_check* c, int n) {
+	if (c->event == NULL) {
+		return INT_MAX;
+	}
+	return verify_event_sent(n) + (int) ceil((double) c->event_delay_ms * VERIFY_SAMPLE_RATE / 1000.0);
+}
+
+// the frames of the n frame block at frame block that come before the check's event falls due
+static int verify_event_split (const t_verify_check* c, int block, int n) {
+	int frame = verify_event_frame(c, n);
+
+	if (frame <= block) {
+		return 0;
+	}
+	return frame - block < n ? frame - block : n;
+}
+
+// the check's parameters once its event has fallen due
+static t_verify_check verify_event_apply (const t_verify_check* c) {
+	t_verify_check after = *c;
+
+	if (c->event == NULL) {
+		return after;
+	}
+	if (strcmp(c->event, "gain") == 0) {
+		after.gain = c->event_value;
+	}
+	else if (strcmp(c->event, "table_interp") == 0) {
+		after.interp = (ps_interp_type) (int) c->event_value;
+	}
+	else if (strcmp(c->event, "env_atk_ms") == 0) {
+		after.env_atk_ms = c->event_value;
+	}
+	else if (strcmp(c->event, "env_dcy_ms") == 0) {
+		after.env_dcy_ms = c->event_value;
+	}
+	return after;
+}
+
+/*
+	oracles
+
+	folder~, blend~, wraparound~ (so nlchain~) and the wavecap~ oscillator are checked against the perform loops of the original scalar objects, copied from the first version of each file unchanged but for float becoming t_sample, which makes the double build check double. They share no code with core/, so a change to a core function cannot move the oracle along with the code under test. A block with an event falling due in it runs as two calls of the loop, split at that frame.
+*/
+
+static void verify_baseline_folder_perform (t_sample gain, const t_sample* in_sig, const t_sample* in_lower_thresh, const t_sample* in_upper_thresh, t_sample* out, int n) {
+	// create state
+	int folded_current;
+	int frame_current_idx = 0;
+	t_sample frame_current_sig;
+	t_sample frame_current_lower_thresh;
+	t_sample below_lower_thresh;
+	t_sample frame_current_upper_thresh;
+	t_sample above_upper_thresh;
+	t_sample frame_current_folded;
+
+	while (n--) {
+		frame_current_lower_thresh = *(in_lower_thresh + frame_current_idx) * gain;
+		frame_current_upper_thresh = *(in_upper_thresh + frame_current_idx) * gain;
+		frame_current_sig = *(in_sig + frame_current_idx) * gain;
+		frame_current_folded = frame_current_sig;
+		folded_current = 0;
+		
+		// fold over lower
+		below_lower_thresh = frame_current_lower_thresh - frame_current_sig;
+		if (below_lower_thresh > 0.0f) {
+			frame_current_folded = frame_current_lower_thresh + below_lower_thresh;
+			folded_current = 1;
+		}
+
+		// fold over upper
+		above_upper_thresh = frame_current_sig - frame_current_upper_thresh;
+		if (above_upper_thresh > 0.0f) {
+			frame_current_folded = frame_current_upper_thresh - above_upper_thresh;
+			folded_current = 1;
+		}
+
+		*(out + frame_current_idx++) = frame_current_folded;
+	}
+	(void) folded_current;
+}
+
+static void verify_baseline_blend_perform (t_sample gain_ctrl, const t_sample* in_ctrl, const t_sample* in_sig1, const t_sample* in_sig2, t_sample* out, int n) {
+	// create state
+	int sample_current_idx = 0;
+	t_sample a;
+	t_sample b;
+	t_sample sig1;
+	t_sample sig2;
+	t_sample ctrl;
+
+	while (n--) {
+		// control signal
+		ctrl = *(in_ctrl + sample_current_idx) * gain_ctrl;
+
+		// hard clip control signal
+		if (ctrl > 1.0f) {
+			ctrl = 1.0f;
+		}
+		else if (ctrl < -1.0f) {
+			ctrl = -1.0f;
+		}
+
+		// calculate a/b
+		// if the signal inverted from last sample
+		a = (ctrl + 1.0f);
+		b = fabs(ctrl - 1.0f);
+
+		// audio signal
+		sig1 = *(in_sig1 + sample_current_idx);
+		sig2 = *(in_sig2 + sample_current_idx);
+
+		*(out + sample_current_idx++) = ((a * sig1) + (b * sig2)) / 2.0f;
+	}
+}
+
+typedef struct _verify_wraparound {
+	t_sample gain;
+	int hard;
+	int soften_n;
+	int soften_buffer_idx;
+	t_sample* soften_buffer;
+	t_sample soften_alpha;
+	int soften_buffer_active_n;
+	int wrapped_last;
+} t_verify_wraparound;
+
+// a new wraparound~ of gain, sent soften when the check softens
+static void verify_baseline_wraparound_init (t_verify_wraparound* x, const t_verify_check* c, t_sample gain) {
+	memset(x, 0, sizeof(t_verify_wraparound));
+	x->gain = gain;
+	x->hard = 1;
+	if (c->soften_n > 0) {
+		x->hard = 0;
+		x->soften_n = c->soften_n;
+		x->soften_buffer = (t_sample*) calloc(x->soften_n, sizeof(t_sample));
+		x->soften_buffer_active_n = x->soften_n;
+		x->soften_alpha = c->soften_alpha;
+	}
+}
+
+static void verify_baseline_soften_buffer_push (t_verify_wraparound* x, t_sample frame) {
+	x->soften_buffer[x->soften_buffer_idx++] = frame;
+	if (x->soften_buffer_idx >= x->soften_n) {
+		x->soften_buffer_idx = 0;
+	}
+}
+
+static t_sample verify_baseline_calculate_exponential_moving_average_fast (t_verify_wraparound* x) {
+	t_sample dividend = 0.0f;
+	t_sample divisor = 0.0f;
+	int i = 0;
+	int soften_n = x->soften_n;
+	int soften_buffer_idx = x->soften_buffer_idx - 1;
+	int soften_buffer_idx_before_add = soften_buffer_idx;
+	t_sample i_alpha;
+
+	while (i <= soften_buffer_idx_before_add) {
+		i_alpha = pow(x->soften_alpha, i);
+		dividend += i_alpha * x->soften_buffer[soften_buffer_idx--];
+		divisor += i_alpha;
+		i++;
+	}
+	soften_buffer_idx += soften_n;
+	while (i < soften_n) {
+		i_alpha = pow(x->soften_alpha, i);
+		dividend += i_alpha * x->soften_buffer[soften_buffer_idx--];
+		divisor += i_alpha;
+		i++;
+	}
+
+	return dividend/divisor;
+}
+
+static void verify_baseline_wraparound_perform (t_verify_wraparound* x, const t_sample* in, t_sample* out, int n) {
+	// pull state from struct
+	t_sample gain = x->gain;
+	int wrapped_last = x->wrapped_last;
+	int hard = x->hard;
+	int soften_n = x->soften_n;
+
+	// create state
+	int wrapped_current = 0;
+	int frame_current_idx = 0;
+	t_sample frame_current;
+	t_sample frame_current_wrapped;
+
+	if (hard) {
+		while (n--) {
+			frame_current = *(in + frame_current_idx) * gain;
+			
+			// calculate wrapped frame
+			wrapped_current = 0;
+			while (frame_current < -1.0f) {
+				frame_current += 2.0f;
+				wrapped_current = 1;
+			}
+			while (frame_current > 1.0f) {
+				frame_current -= 2.0f;
+				wrapped_current = 1;
+			}
+
+			*(out + frame_current_idx++) = frame_current;
+		}
+	}
+	else {
+		while (n--) {
+			frame_current = *(in + frame_current_idx) * gain;
+			
+			// calculate wrapped frame
+			wrapped_current = 0;
+			frame_current_wrapped = frame_current;
+			while (frame_current_wrapped < -1.0f) {
+				frame_current_wrapped += 2.0f;
+				wrapped_current = 1;
+			}
+			while (frame_current_wrapped > 1.0f) {
+				frame_current_wrapped -= 2.0f;
+				wrapped_current = 1;
+			}
+
+			// push hard wrapped frame onto soften buffer
+			verify_baseline_soften_buffer_push(x, frame_current_wrapped);
+
+			// if we're switching from unwrapped to wrapped or vice versa activate softening
+			if (wrapped_current ^ wrapped_last) {
+				x->soften_buffer_active_n = 0;
+			}
+
+			// if we're actively softening then continue to do so
+			if (x->soften_buffer_active_n < soften_n) {
+				frame_current = verify_baseline_calculate_exponential_moving_average_fast(x);
+				x->soften_buffer_active_n++;
+			}
+			else {
+				frame_current = frame_current_wrapped;
+			}
+
+			*(out + frame_current_idx++) = frame_current;
+			wrapped_last = wrapped_current;
+		}
+	}
+
+	x->wrapped_last = wrapped_current;
+}
+
+static void verify_oracle_fold (const t_verify_check* c, const t_sample* const* in, t_sample* out, int frames, int n) {
+	t_verify_check after = verify_event_apply(c);
+	int block;
+	int split;
+
+	for (block = 0; block < frames; block += n) {
+		split = verify_event_split(c, block, n);
+		if (split > 0) {
+			verify_baseline_folder_perform(c->gain, in[0] + block, in[1] + block, in[2] + block, out + block, split);
+		}
+		if (split < n) {
+			verify_baseline_folder_perform(after.gain, in[0] + block + split, in[1] + block + split, in[2] + block + split, out + block + split, n - split);
+		}
+	}
+}
+
+static void verify_oracle_blend (const t_verify_check* c, const t_sample* const* in, t_sample* out, int frames, int n) {
+	t_verify_check after = verify_event_apply(c);
+	int block;
+	int split;
+
+	for (block = 0; block < frames; block += n) {
+		split = verify_event_split(c, block, n);
+		if (split > 0) {
+			verify_baseline_blend_perform(c->gain, in[0] + block, in[1] + block, in[2] + block, out + block, split);
+		}
+		if (split < n) {
+			verify_baseline_blend_perform(after.gain, in[0] + block + split, in[1] + block + split, in[2] + block + split, out + block + split, n - split);
+		}
+	}
+}
+
+static void verify_oracle_wrap (const t_verify_check* c, const t_sample* const* in, t_sample* out, int frames, int n) {
+	t_verify_check after = verify_event_apply(c);
+	t_verify_wraparound x;
+	int block;
+	int split;
+
+	verify_baseline_wraparound_init(&x, c, c->gain);
+	for (block = 0; block < frames; block += n) {
+		split = verify_event_split(c, block, n);
+		if (split > 0) {
+			verify_baseline_wraparound_perform(&x, in[0] + block, out + block, split);
+		}
+		if (split < n) {
+			x.gain = after.gain;
+			verify_baseline_wraparound_perform(&x, in[0] + block + split, out + block + split, n - split);
+		}
+	}
+	free(x.soften_buffer);
+}
+
+/*
+	nlchain~ as the objects of its stage list (c->args) patched in series, block by block: folder~ of gain 1, wraparound~ of gain c->gain (one per wrap stage), blend~ with the chain input as its second signal
+*/
+static void verify_oracle_nlchain (const t_verify_check* c, const t_sample* const* in, t_sample* out, int frames, int n) {
+	char stages[64];
+	char* stage;
+	t_verify_wraparound wraps[VERIFY_STAGES_MAX];
+	int wraps_num = 0;
+	// the blend control follows the fold thresholds when there is a fold stage
+	int ctrl_inlet = strstr(c->args, "fold") != NULL || c->args[0] == '\0' ? 3 : 1;
+	int block;
+	int w;
+
+	for (block = 0; block < frames; block += n) {
+		memcpy(out + block, in[0] + block, n * sizeof(t_sample));
+		strncpy(stages, c->args[0] ? c->args : "fold wrap blend", sizeof(stages) - 1);
+		stages[sizeof(stages) - 1] = '\0';
+		w = 0;
+		for (stage = strtok(stages, " "); stage; stage = strtok(NULL, " ")) {
+			if (strcmp(stage, "fold") == 0) {
+				verify_baseline_folder_perform(1.0f, out + block, in[1] + block, in[2] + block, out + block, n);
+			}
+			else if (strcmp(stage, "wrap") == 0) {
+				if (w == wraps_num) {
+					verify_baseline_wraparound_init(&wraps[wraps_num++], c, c->gain);
+				}
+				verify_baseline_wraparound_perform(&wraps[w++], out + block, out + block, n);
+			}
+			else if (strcmp(stage, "blend") == 0) {
+				verify_baseline_blend_perform(1.0f, in[ctrl_inlet] + block, out + block, in[0] + block, out + block, n);
+			}
+		}
+	}
+	for (w = 0; w < wraps_num; w++) {
+		free(wraps[w].soften_buffer);
+	}
+}
+
+/*
+	half-band filter of one stage as a plain causal FIR over the whole signal, in double
+	up: zero stuffs in (frames) to 2 * frames and filters with twice the taps
+	down: filters in (2 * frames) and keeps every other frame, frames results
+	the centre tap sits 2 * taps - 1 frames in, where ps_oversample.h's polyphase form has it
+*/
+static void verify_halfband (int stage, int up, const double* in, double* out, int frames) {
+	const float* taps = ps_oversample_taps[stage];
+	int taps_num = ps_oversample_taps_num[stage];
+	int centre = 2 * taps_num - 1;
+	double scale = up ? 2.0 : 1.0;
+	double* x = (double*) calloc(2 * frames, sizeof(double));
+	double sum;
+	int m;
+	int k;
+	int j;
+
+	for (m = 0; m < 2 * frames; m++) {
+		x[m] = up ? (m % 2 == 0 ? in[m / 2] : 0.0) : in[m];
+	}
+	for (m = 0; m < 2 * frames; m++) {
+		if (!up && m % 2 != 0) {
+			continue;
+		}
+		sum = m - centre >= 0 ? 0.5 * scale * x[m - centre] : 0.0;
+		for (k = 0; k < taps_num; k++) {
+			j = m - centre - (2 * k + 1);
+			if (j >= 0) {
+				sum += scale * taps[k] * x[j];
+			}
+			j = m - centre + (2 * k + 1);
+			if (j >= 0 && j <= m) {
+				sum += scale * taps[k] * x[j];
+			}
+		}
+		if (up) {
+			out[m] = sum;
+		}
+		else {
+			out[m / 2] = sum;
+		}
+	}
+	free(x);
+}
+
+/*
+	folder~ oversampled: every input up through the stages, folder~'s loop at the high rate, back down through the stages
+*/
+static void verify_oracle_fold_oversampled (const t_verify_check* c, const t_sample* const* in, t_sample* out, int frames, int n) {
+	int high = frames * c->factor;
+	t_sample* inputs[3];
+	t_sample* folded = (t_sample*) calloc(high, sizeof(t_sample));
+	double* a = (double*) calloc(high, sizeof(double));
+	double* b = (double*) calloc(high, sizeof(double));
+	double* swap;
+	int length;
+	int stage;
+	int stages_num = 0;
+	int input;
+	int i;
+
+	while ((1 << stages_num) < c->factor) {
+		stages_num++;
+	}
+
+	for (input = 0; input < 3; input++) {
+		inputs[input] = (t_sample*) calloc(high, sizeof(t_sample));
+		for (i = 0; i < frames; i++) {
+			a[i] = in[input][i];
+		}
+		for (stage = 0, length = frames; stage < stages_num; stage++, length *= 2) {
+			verify_halfband(stage, 1, a, b, length);
+			swap = a;
+			a = b;
+			b = swap;
+		}
+		for (i = 0; i < high; i++) {
+			inputs[input][i] = (t_sample) a[i];
+		}
+	}
+
+	verify_baseline_folder_perform(c->gain, inputs[0], inputs[1], inputs[2], folded, high);
+	for (i = 0; i < high; i++) {
+		a[i] = folded[i];
+	}
+	for (stage = stages_num - 1, length = high / 2; stage >= 0; stage--, length /= 2) {
+		verify_halfband(stage, 0, a, b, length);
+		swap = a;
+		a = b;
+		b = swap;
+	}
+	for (i = 0; i < frames; i++) {
+		out[i] = (t_sample) a[i];
+	}
+
+	for (input = 0; input < 3; input++) {
+		free(inputs[input]);
+	}
+	free(folded);
+	free(a);
+	free(b);
+}
+
+/*
+	wiener~: the window from its formula and a direct DFT, in double, over the bins wiener~ analyzes (all but the last two of n / 2 + 1)
+*/
+static void verify_oracle_wiener (const t_verify_check* c, const t_sample* const* in, t_sample* out, int frames, int n) {
+	int bins_num = n / 2 - 1;
+	double* x = (double*) calloc(n, sizeof(double));
+	double re;
+	double im;
+	double power;
+	double sum;
+	double sum_ln;
+	int block;
+	int i;
+	int k;
+
+	for (block = 0; block * n < frames; block++) {
+		for (i = 0; i < n; i++) {
+			x[i] = in[0][block * n + i] * (c->window_hann ? 0.5 * (1.0 - cos(2.0 * M_PI * i / (n - 1))) : 1.0);
+		}
+		sum = 0.0;
+		sum_ln = 0.0;
+		for (k = 0; k < bins_num; k++) {
+			re = 0.0;
+			im = 0.0;
+			for (i = 0; i < n; i++) {
+				re += x[i] * cos(2.0 * M_PI * ((long) k * i % n) / n);
+				im -= x[i] * sin(2.0 * M_PI * ((long) k * i % n) / n);
+			}
+			power = re * re + im * im + PS_WIENER_EPSILON;
+			if (c->power_spectrum) {
+				sum += power;
+				sum_ln += log(power);
+			}
+			else {
+				sum += sqrt(power);
+				sum_ln += log(sqrt(power));
+			}
+		}
+		out[block] = (t_sample) (exp(sum_ln / bins_num) / (sum / bins_num));
+	}
+	free(x);
+}
+
+/*
+	wavecap~: the interpolators the original did not have, reading the table one tap at a time in double, each slot of a morph interpolated on its own
+*/
+static t_sample* verify_tables = NULL;
+static t_sample* verify_sinc_kernel = NULL;
+
+static double verify_table_read (const t_verify_check* c, const t_sample* table, t_sample phase) {
+	uint32_t mask = VERIFY_TABLE_SIZE - 1;
+	long truncphase = (long) phase;
+	double fr = phase - (t_sample) truncphase;
+	double in[4];
+	t_sample row_position;
+	int row_idx;
+	t_sample row_mix;
+	const t_sample* row;
+	int taps = 16;
+	double sum;
+	int j;
+
+	switch (c->interp) {
+	case ps_interp_truncate:
+		return table[truncphase & mask];
+	case ps_interp_lin_2:
+		return table[truncphase & mask] + fr * ((double) table[(truncphase + 1) & mask] - table[truncphase & mask]);
+	case ps_interp_lin_4:
+		for (j = 0; j < 4; j++) {
+			in[j] = table[(truncphase - 1 + j) & mask];
+		}
+		return in[1] + 0.5 * fr * (in[2] - in[0] + fr * (4.0 * in[2] + 2.0 * in[0] - 5.0 * in[1] - in[3] + fr * (3.0 * (in[1] - in[2]) - in[0] + in[3])));
+	case ps_interp_sinc:
+		row_position = (phase - (t_sample) truncphase) * PS_WAVETABLE_SINC_PHASES;
+		row_idx = (int) row_position;
+		if (row_idx >= PS_WAVETABLE_SINC_PHASES) {
+			row_idx = PS_WAVETABLE_SINC_PHASES - 1;
+		}
+		row_mix = row_position - (t_sample) row_idx;
+		row = verify_sinc_kernel + row_idx * taps;
+		sum = 0.0;
+		for (j = 0; j < taps; j++) {
+			sum += (row[j] + (double) row_mix * ((double) row[j + taps] - row[j])) * table[(truncphase - taps / 2 + 1 + j) & mask];
+		}
+		return sum;
+	default:
+		return 0.0;
+	}
+}
+
+static double verify_table_read_morph (const t_verify_check* c, t_sample phase, t_sample morph) {
+	int slot;
+	double a;
+	double b;
+
+	if (c->slots == 1) {
+		return verify_table_read(c, verify_tables, phase);
+	}
+	if (!(morph > 0.0f)) {
+		morph = 0.0f;
+	}
+	else if (morph > (t_sample) (c->slots - 1)) {
+		morph = (t_sample) (c->slots - 1);
+	}
+	slot = (int) morph;
+	if (slot >= c->slots - 1) {
+		slot = c->slots - 2;
+	}
+	a = verify_table_read(c, verify_tables + slot * VERIFY_TABLE_SIZE, phase);
+	b = verify_table_read(c, verify_tables + (slot + 1) * VERIFY_TABLE_SIZE, phase);
+	return a + (morph - (t_sample) slot) * (b - a);
+}
+
+/*
+	wavecap~'s oscillator: inlet 2 is the phase increment in table lengths per sample, or with the envelope follower on (env_atk_ms set) the signal whose envelope is
+*/
+typedef struct _verify_wavecap {
+	int env_enabled;
+	t_sample env_atk_coeff;
+	t_sample env_dcy_coeff;
+	t_sample env_last;
+	t_sample phase;
+	t_sample phaseIncrement;
+} t_verify_wavecap;
+
+/*
+	wavecap_perform past the recording. The original had one slot and no windowed-sinc interpolation, so sinc and every morph over slots read through verify_table_read_morph() instead of its switch
+*/
+static void verify_baseline_wavecap_perform (t_verify_wavecap* x, const t_verify_check* c, const t_sample* in_env, const t_sample* in_morph, t_sample* out, int n) {
+	// pull state from struct
+	uint32_t table_size = VERIFY_TABLE_SIZE;
+	uint32_t table_mask = VERIFY_TABLE_SIZE - 1;
+	const t_sample* table = verify_tables;
+	int env_enabled = x->env_enabled;
+	t_sample env_atk_coeff = x->env_atk_coeff;
+	t_sample env_dcy_coeff = x->env_dcy_coeff;
+	t_sample env_last = x->env_last;
+	t_sample phase = x->phase;
+	t_sample phaseIncrement = x->phaseIncrement;
+
+	// create state
+	int n_computed = 0;
+	t_sample env_tmp = 0.0f;
+
+	// alias Terbe's variables
+	long longPhase;
+	t_sample phaseMix;
+	uint32_t tableMask = table_mask;
+	const t_sample* wavetable = table;
+	long truncphase;
+	t_sample fr;
+	t_sample inm1;
+	t_sample in;
+	t_sample inp1;
+	t_sample inp2;
+
+	// follow envelope and generate wave
+	while (n_computed < n) {
+		// envelope follower
+		if (env_enabled) {
+			env_tmp = verify_fabs(*in_env++);
+			if (env_tmp > env_last) {
+				env_last = env_atk_coeff * (env_last - env_tmp) + env_tmp;
+			}
+			else {
+				env_last = env_dcy_coeff * (env_last - env_tmp) + env_tmp;
+			}
+		}
+		else {
+			env_last = *in_env++;
+		}
+
+		// wavetable oscillator
+		phaseIncrement = verify_fabs(env_last) * table_size;
+
+		// interpolate
+		if (c->slots > 1 || c->interp == ps_interp_sinc) {
+			*(out++) = (t_sample) verify_table_read_morph(c, phase, in_morph[n_computed]);
+		}
+		else switch (c->interp) {
+		case ps_interp_truncate:
+			longPhase = (long)phase;
+			longPhase = longPhase & tableMask;
+
+			*(out++) = *(wavetable + longPhase);
+			break;
+		case ps_interp_lin_2:
+			longPhase = (long)phase;
+			longPhase = longPhase & tableMask;
+			phaseMix = phase - (t_sample)longPhase;
+
+			// Xa * (1.0 - pM) + Xb * pM = Xa - Xa*pM + Xb*pM = Xa + pM*(Xb - Xa)
+			*(out++) = *(wavetable + longPhase)
+			+ (phaseMix * (*(wavetable + ((longPhase + 1)&tableMask)) - *(wavetable + longPhase)));
+			break;
+		case ps_interp_lin_4:
+			truncphase = (long) phase;
+			fr = phase - (t_sample) truncphase;
+			inm1 = wavetable[(truncphase - 1) & tableMask];
+			in = wavetable[(truncphase + 0) & tableMask];
+			inp1 = wavetable[(truncphase + 1) & tableMask];
+			inp2 = wavetable[(truncphase + 2) & tableMask];
+
+			*(out++) = in + 0.5 * fr * (inp1 - inm1 +
+				fr * (4.0 * inp1 + 2.0 * inm1 - 5.0 * in - inp2 +
+				fr * (3.0 * (in - inp1) - inm1 + inp2)));
+			break;
+		default:
+			*(out++) = 0.0f;
+		}
+
+		n_computed++;
+		phase += phaseIncrement;
+		while (phase >= (t_sample) table_size)
+			phase = phase - (t_sample) table_size;
+		while (phase < 0.0f)
+			phase = phase + (t_sample) table_size;
+	}
+	x->env_last = env_last;
+	x->phase = phase;
+	x->phaseIncrement = phaseIncrement;
+}
+
+// _wavecap_env_atk_coeff_recompute() and _wavecap_env_dcy_coeff_recompute() of the original
+static t_sample verify_env_coeff (t_sample ms) {
+	return exp(log(0.01)/(ms * VERIFY_SAMPLE_RATE * 0.001));
+}
+
+static void verify_oracle_wavecap (const t_verify_check* c, const t_sample* const* in, t_sample* out, int frames, int n) {
+	t_verify_check after = verify_event_apply(c);
+	t_verify_wavecap x;
+	int block;
+	int split;
+
+	memset(&x, 0, sizeof(t_verify_wavecap));
+	if (c->env_atk_ms > 0.0f) {
+		x.env_enabled = 1;
+		x.env_atk_coeff = verify_env_coeff(c->env_atk_ms);
+		x.env_dcy_coeff = verify_env_coeff(c->env_dcy_ms);
+	}
+	for (block = 0; block < frames; block += n) {
+		split = verify_event_split(c, block, n);
+		if (split > 0) {
+			verify_baseline_wavecap_perform(&x, c, in[1] + block, in[2] + block, out + block, split);
+		}
+		if (split < n) {
+			// the frame of the change, where an envelope time also restarts the envelope
+			if (block + split == verify_event_frame(c, n) && (after.env_atk_ms != c->env_atk_ms || after.env_dcy_ms != c->env_dcy_ms)) {
+				x.env_atk_coeff = verify_env_coeff(after.env_atk_ms);
+				x.env_dcy_coeff = verify_env_coeff(after.env_dcy_ms);
+				x.env_last = 0.0f;
+			}
+			verify_baseline_wavecap_perform(&x, &after, in[1] + block + split, in[2] + block + split, out + block + split, n - split);
+		}
+	}
+}
+
+/*
+	a bank of the oscillator above at fixed pitches, each with wavecap_perform's envelope follower rising toward 1 (voices did not exist in the original)
+*/
+static void verify_oracle_voices (const t_verify_check* c, const t_sample* const* in, t_sample* out, int frames, int n) {
+	t_sample table_size = (t_sample) VERIFY_TABLE_SIZE;
+	t_sample increment_scale = table_size / VERIFY_SAMPLE_RATE;
+	t_sample env_atk_ms = VERIFY_ENV_ATK_MS;
+	t_sample env_dcy_ms = VERIFY_ENV_DCY_MS;
+	t_sample sample_rate = VERIFY_SAMPLE_RATE;
+	t_sample env_atk_coeff = exp(log(0.01)/(env_atk_ms * sample_rate * 0.001));
+	t_sample env_dcy_coeff = exp(log(0.01)/(env_dcy_ms * sample_rate * 0.001));
+	t_sample phase[VERIFY_VOICES] = {0.0f};
+	t_sample env_last[VERIFY_VOICES] = {0.0f};
+	t_sample env_tmp = 1.0f;
+	t_sample increment;
+	t_sample sum;
+	int i;
+	int v;
+
+	for (i = 0; i < frames; i++) {
+		sum = 0.0f;
+		for (v = 0; v < VERIFY_VOICES; v++) {
+			// pitches 110, 220, ... 880 Hz (the voices message of the check)
+			increment = (t_sample) (110.0f * (v + 1)) * increment_scale;
+			if (env_tmp > env_last[v]) {
+				env_last[v] = env_atk_coeff * (env_last[v] - env_tmp) + env_tmp;
+			}
+			else {
+				env_last[v] = env_dcy_coeff * (env_last[v] - env_tmp) + env_tmp;
+			}
+			sum += env_last[v] * (t_sample) verify_table_read_morph(c, phase[v], in[2][i]);
+			phase[v] += increment;
+			phase[v] -= phase[v] >= table_size ? table_size : 0.0f;
+		}
+		out[i] = sum;
+	}
+}
+
+/*
+	checks
+*/
+
+#define VERIFY_AUDIO_3 {verify_role_audio, verify_role_audio, verify_role_audio}
+#define VERIFY_AUDIO_4 {verify_role_audio, verify_role_audio, verify_role_audio, verify_role_audio}
+#define VERIFY_WAVECAP_ROLES {verify_role_audio, verify_role_increment, verify_role_morph}
+#define VERIFY_VOICES_MESSAGES "env_atk_ms 10; env_dcy_ms 500; voices 8; pitches 110 220 330 440 550 660 770 880"
+
+static const t_verify_check verify_checks[] = {
+	{"folder~", "default", "1.25", "", 3, 1, VERIFY_AUDIO_3, verify_oracle_fold, verify_metric_ulp, 0.0, 0.0, VERIFY_INPUTS_ALL, 1, VERIFY_CHANNELS_MAX, .gain = 1.25f},
+	{"folder~", "oversample_2", "1.25", "oversample 2", 3, 1, VERIFY_AUDIO_3, verify_oracle_fold_oversampled, verify_metric_snr_db, -120.0, -250.0, VERIFY_INPUTS_FINITE, 1, VERIFY_CHANNELS_MAX, .gain = 1.25f, .factor = 2},
+	{"folder~", "oversample_4", "1.25", "oversample 4", 3, 1, VERIFY_AUDIO_3, verify_oracle_fold_oversampled, verify_metric_snr_db, -120.0, -250.0, VERIFY_INPUTS_FINITE, 1, VERIFY_CHANNELS_MAX, .gain = 1.25f, .factor = 4},
+	{"folder~", "oversample_8", "1.25", "oversample 8", 3, 1, VERIFY_AUDIO_3, verify_oracle_fold_oversampled, verify_metric_snr_db, -120.0, -250.0, VERIFY_INPUTS_FINITE, 1, VERIFY_CHANNELS_MAX, .gain = 1.25f, .factor = 8},
+	{"folder~", "gain_event", "1.25", "", 3, 1, VERIFY_AUDIO_3, verify_oracle_fold, verify_metric_ulp, 0.0, 0.0, VERIFY_INPUTS_ALL, 1, VERIFY_CHANNELS_MAX, .event = "gain", .event_value = 0.75f, .event_delay_ms = 7.3f, .gain = 1.25f},
+	{"folder~", "gain_event_now", "1.25", "", 3, 1, VERIFY_AUDIO_3, verify_oracle_fold, verify_metric_ulp, 0.0, 0.0, VERIFY_INPUTS_ALL, 1, VERIFY_CHANNELS_MAX, .event = "gain", .event_value = 0.75f, .event_delay_ms = 0.0f, .gain = 1.25f},
+	{"blend~", "default", "", "", 3, 1, VERIFY_AUDIO_3, verify_oracle_blend, verify_metric_ulp, 0.0, 0.0, VERIFY_INPUTS_ALL, 1, VERIFY_CHANNELS_MAX, .gain = 1.0f},
+	{"blend~", "gain_event", "", "", 3, 1, VERIFY_AUDIO_3, verify_oracle_blend, verify_metric_ulp, 0.0, 0.0, VERIFY_INPUTS_ALL, 1, VERIFY_CHANNELS_MAX, .event = "gain", .event_value = 2.5f, .event_delay_ms = 7.3f, .gain = 1.0f},
+	{"wraparound~", "hard", "1.5", "", 1, 1, {verify_role_audio}, verify_oracle_wrap, verify_metric_ulp, 0.0, 0.0, VERIFY_INPUTS_ALL, 1, VERIFY_CHANNELS_MAX, .gain = 1.5f},
+	{"wraparound~", "soften", "1.5", "soften 16 0.8", 1, 1, {verify_role_audio}, verify_oracle_wrap, verify_metric_ulp, 0.0, 0.0, VERIFY_INPUTS_ALL, 1, VERIFY_CHANNELS_MAX, .gain = 1.5f, .soften_n = 16, .soften_alpha = 0.8},
+	{"wraparound~", "soften_gain_event", "1.5", "soften 16 0.8", 1, 1, {verify_role_audio}, verify_oracle_wrap, verify_metric_ulp, 0.0, 0.0, VERIFY_INPUTS_ALL, 1, VERIFY_CHANNELS_MAX, .event = "gain", .event_value = 3.25f, .event_delay_ms = 7.3f, .gain = 1.5f, .soften_n = 16, .soften_alpha = 0.8},
+	{"nlchain~", "fold_wrap_blend", "", "wrap_gain 1.5", 4, 1, VERIFY_AUDIO_4, verify_oracle_nlchain, verify_metric_ulp, 0.0, 0.0, VERIFY_INPUTS_ALL, 1, VERIFY_CHANNELS_MAX, .gain = 1.5f},
+	{"nlchain~", "fold_wrap_blend_soften", "", "wrap_gain 1.5; soften 16 0.8", 4, 1, VERIFY_AUDIO_4, verify_oracle_nlchain, verify_metric_ulp, 0.0, 0.0, VERIFY_INPUTS_ALL, 1, VERIFY_CHANNELS_MAX, .gain = 1.5f, .soften_n = 16, .soften_alpha = 0.8},
+	{"nlchain~", "wrap_fold", "wrap fold", "wrap_gain 1.5", 3, 1, VERIFY_AUDIO_3, verify_oracle_nlchain, verify_metric_ulp, 0.0, 0.0, VERIFY_INPUTS_ALL, 1, VERIFY_CHANNELS_MAX, .gain = 1.5f},
+	{"nlchain~", "wrap_fold_wrap_soften", "wrap fold wrap", "wrap_gain 1.5; soften 16 0.8", 3, 1, VERIFY_AUDIO_3, verify_oracle_nlchain, verify_metric_ulp, 0.0, 0.0, VERIFY_INPUTS_ALL, 1, VERIFY_CHANNELS_MAX, .gain = 1.5f, .soften_n = 16, .soften_alpha = 0.8},
+	{"nlchain~", "wrap_wrap_soften", "wrap wrap", "wrap_gain 1.5; soften 16 0.8", 1, 1, {verify_role_audio}, verify_oracle_nlchain, verify_metric_ulp, 0.0, 0.0, VERIFY_INPUTS_ALL, 1, VERIFY_CHANNELS_MAX, .gain = 1.5f, .soften_n = 16, .soften_alpha = 0.8},
+	{"nlchain~", "fold_wrap_fold_wrap_blend_soften", "fold wrap fold wrap blend", "wrap_gain 1.5; soften 16 0.8", 4, 1, VERIFY_AUDIO_4, verify_oracle_nlchain, verify_metric_ulp, 0.0, 0.0, VERIFY_INPUTS_ALL, 1, VERIFY_CHANNELS_MAX, .gain = 1.5f, .soften_n = 16, .soften_alpha = 0.8},
+	{"nlchain~", "fold_fold_wrap_blend_blend", "fold fold wrap blend blend", "wrap_gain 1.5", 4, 1, VERIFY_AUDIO_4, verify_oracle_nlchain, verify_metric_ulp, 0.0, 0.0, VERIFY_INPUTS_ALL, 1, VERIFY_CHANNELS_MAX, .gain = 1.5f},
+	{"nlchain~", "fold_wrap_blend_threads_2", "", "wrap_gain 1.5; threads 2", 4, 1, VERIFY_AUDIO_4, verify_oracle_nlchain, verify_metric_ulp, 0.0, 0.0, VERIFY_INPUTS_ALL, 1, VERIFY_CHANNELS_MAX, .latency = 1, .gain = 1.5f},
+	{"nlchain~", "wrap_soften_threads_3", "wrap", "wrap_gain 1.5; soften 16 0.8; threads 3", 1, 1, {verify_role_audio}, verify_oracle_nlchain, verify_metric_ulp, 0.0, 0.0, VERIFY_INPUTS_ALL, 1, VERIFY_CHANNELS_MAX, .latency = 1, .gain = 1.5f, .soften_n = 16, .soften_alpha = 0.8},
+	{"wavecap~", "truncate", "", "table_interp 0", 3, 1, VERIFY_WAVECAP_ROLES, verify_oracle_wavecap, verify_metric_snr_db, -120.0, -250.0, VERIFY_INPUTS_FINITE, 1, 1, .slots = 1, .interp = ps_interp_truncate},
+	{"wavecap~", "lin_2", "", "table_interp 1", 3, 1, VERIFY_WAVECAP_ROLES, verify_oracle_wavecap, verify_metric_snr_db, -120.0, -250.0, VERIFY_INPUTS_FINITE, 1, 1, .slots = 1, .interp = ps_interp_lin_2},
+	{"wavecap~", "lin_4", "", "table_interp 2", 3, 1, VERIFY_WAVECAP_ROLES, verify_oracle_wavecap, verify_metric_snr_db, -120.0, -250.0, VERIFY_INPUTS_FINITE, 1, 1, .slots = 1, .interp = ps_interp_lin_4},
+	{"wavecap~", "interp_event", "", "table_interp 1", 3, 1, VERIFY_WAVECAP_ROLES, verify_oracle_wavecap, verify_metric_snr_db, -120.0, -250.0, VERIFY_INPUTS_FINITE, 1, 1, .event = "table_interp", .event_value = 0.0f, .event_delay_ms = 7.3f, .slots = 1, .interp = ps_interp_lin_2},
+	{"wavecap~", "env_atk_event", "", "table_interp 2; env_enable; env_atk_ms 10; env_dcy_ms 500", 3, 1, VERIFY_WAVECAP_ROLES, verify_oracle_wavecap, verify_metric_snr_db, -120.0, -250.0, VERIFY_INPUTS_FINITE, 1, 1, .event = "env_atk_ms", .event_value = 2.0f, .event_delay_ms = 7.3f, .slots = 1, .interp = ps_interp_lin_4, .env_atk_ms = 10.0f, .env_dcy_ms = 500.0f},
+	{"wavecap~", "env_dcy_event", "", "table_interp 2; env_enable; env_atk_ms 10; env_dcy_ms 500", 3, 1, VERIFY_WAVECAP_ROLES, verify_oracle_wavecap, verify_metric_snr_db, -120.0, -250.0, VERIFY_INPUTS_FINITE, 1, 1, .event = "env_dcy_ms", .event_value = 20.0f, .event_delay_ms = 7.3f, .slots = 1, .interp = ps_interp_lin_4, .env_atk_ms = 10.0f, .env_dcy_ms = 500.0f},
+	{"wavecap~", "sinc_16", "", "table_sinc_taps 16; table_interp 3", 3, 1, VERIFY_WAVECAP_ROLES, verify_oracle_wavecap, verify_metric_snr_db, -120.0, -250.0, VERIFY_INPUTS_FINITE, 1, 1, .slots = 1, .interp = ps_interp_sinc},
+	{"wavecap~", "morph_4_lin_4", "", "table_interp 2", 3, 1, VERIFY_WAVECAP_ROLES, verify_oracle_wavecap, verify_metric_snr_db, -120.0, -250.0, VERIFY_INPUTS_FINITE, 1, 1, .slots = VERIFY_TABLE_SLOTS, .interp = ps_interp_lin_4},
+	{"wavecap~", "morph_4_lin_4_saved", "", "table_interp 2", 3, 1, VERIFY_WAVECAP_ROLES, verify_oracle_wavecap, verify_metric_snr_db, -120.0, -250.0, VERIFY_INPUTS_FINITE, 1, 1, .file = verify_file_saved, .slots = VERIFY_TABLE_SLOTS, .interp = ps_interp_lin_4},
+	{"wavecap~", "morph_4_lin_4_other_precision", "", "table_interp 2", 3, 1, VERIFY_WAVECAP_ROLES, verify_oracle_wavecap, verify_metric_snr_db, -120.0, -250.0, VERIFY_INPUTS_FINITE, 1, 1, .file = verify_file_other, .slots = VERIFY_TABLE_SLOTS, .interp = ps_interp_lin_4},
+	{"wavecap~", "morph_4_lin_4_corrupt", "", "table_interp 2", 3, 1, VERIFY_WAVECAP_ROLES, verify_oracle_wavecap, verify_metric_snr_db, -120.0, -250.0, VERIFY_INPUTS_FINITE, 1, 1, .file = verify_file_corrupt, .slots = VERIFY_TABLE_SLOTS, .interp = ps_interp_lin_4},
+	{"wavecap~", "morph_4_sinc_16", "", "table_sinc_taps 16; table_interp 3", 3, 1, VERIFY_WAVECAP_ROLES, verify_oracle_wavecap, verify_metric_snr_db, -120.0, -250.0, VERIFY_INPUTS_FINITE, 1, 1, .slots = VERIFY_TABLE_SLOTS, .interp = ps_interp_sinc},
+	{"wavecap~", "voices_8", "", "table_interp 2; " VERIFY_VOICES_MESSAGES, 3, 1, VERIFY_WAVECAP_ROLES, verify_oracle_voices, verify_metric_snr_db, -120.0, -250.0, VERIFY_INPUTS_FINITE, 1, 1, .slots = 1, .interp = ps_interp_lin_4},
+	{"wavecap~", "voices_8_morph_4", "", "table_sinc_taps 16; table_interp 3; " VERIFY_VOICES_MESSAGES, 3, 1, VERIFY_WAVECAP_ROLES, verify_oracle_voices, verify_metric_snr_db, -120.0, -250.0, VERIFY_INPUTS_FINITE, 1, 1, .slots = VERIFY_TABLE_SLOTS, .interp = ps_interp_sinc},
+	{"wiener~", "amplitude_hann", "", "", 1, 0, {verify_role_audio}, verify_oracle_wiener, verify_metric_ratio_db, 1e-4, 1e-9, VERIFY_INPUTS_FINITE, 64, 1, .window_hann = 1},
+	{"wiener~", "power_rectangle", "", "power_spectrum; window_type rectangle", 1, 0, {verify_role_audio}, verify_oracle_wiener, verify_metric_ratio_db, 1e-4, 1e-9, VERIFY_INPUTS_FINITE, 64, 1, .power_spectrum = 1},
+	{"wiener~", "amplitude_hann_threads_2", "", "threads 2", 1, 0, {verify_role_audio}, verify_oracle_wiener, verify_metric_ratio_db, 1e-4, 1e-9, VERIFY_INPUTS_FINITE, 64, 1, .latency = 1, .window_hann = 1},
+};
+
+static const int verify_checks_num = sizeof(verify_checks) / sizeof(verify_checks[0]);
+
+/*
+	inputs
+*/
+
+static unsigned int verify_random_next (unsigned int* state) {
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+// uniform in [-1.0, 1.0]
+static double verify_random (unsigned int* state) {
+	return (verify_random_next(state) / 4294967295.0) * 2.0 - 1.0;
+}
+
+static t_sample verify_edge (unsigned int* state) {
+	static const double edges[] = {0.0, -0.0, 1.0, -1.0, 3.0, -3.0, 0.5, -0.5, 2.0, -2.0};
+	t_sample edge = (t_sample) edges[verify_random_next(state) % (sizeof(edges) / sizeof(edges[0]))];
+
+	// half the time the float next to the edge, now and then a denormal
+	switch (verify_random_next(state) % 8) {
+	case 0:
+	case 1:
+		return verify_nextafter(edge, INFINITY);
+	case 2:
+	case 3:
+		return verify_nextafter(edge, -INFINITY);
+	case 4:
+		return (t_sample) (verify_random(state) * VERIFY_SAMPLE_MIN * 0.5);
+	default:
+		return edge;
+	}
+}
+
+static void verify_input_fill (t_sample* vec, int frames, verify_role role, verify_input input, unsigned int seed) {
+	// phase increments in table lengths per sample and morph positions over VERIFY_TABLE_SLOTS slots
+	static const double increment_edges[] = {0.0, 1.0 / VERIFY_TABLE_SIZE, 0.25, 0.5, 1.0, -0.5, 1e-7, 0.999999};
+	static const double morph_edges[] = {-1.0, 0.0, 1.0, 2.0, 3.0, 4.0, 2.5, 0.999999};
+	unsigned int state = seed * 2654435761u + 1u;
+	int i;
+
+	for (i = 0; i < frames; i++) {
+		if (input == verify_input_silence) {
+			vec[i] = 0.0f;
+		}
+		else if (role == verify_role_increment) {
+			if (input == verify_input_edges) {
+				vec[i] = (t_sample) increment_edges[verify_random_next(&state) % 8];
+			}
+			else {
+				vec[i] = (t_sample) (verify_random(&state) * (input == verify_input_large ? 4.0 : 0.02));
+			}
+		}
+		else if (role == verify_role_morph) {
+			if (input == verify_input_edges) {
+				vec[i] = (t_sample) morph_edges[verify_random_next(&state) % 8];
+			}
+			else {
+				vec[i] = (t_sample) (1.5 + verify_random(&state) * (input == verify_input_large ? 1000.0 : 2.0));
+			}
+		}
+		else if (input == verify_input_edges) {
+			vec[i] = verify_edge(&state);
+		}
+		else {
+			vec[i] = (t_sample) (verify_random(&state) * (input == verify_input_large ? 1000.0 : 2.5));
+			if (input == verify_input_nan && i % VERIFY_NAN_PERIOD == VERIFY_NAN_PERIOD - 1) {
+				vec[i] = NAN;
+			}
+		}
+	}
+}
+
+/*
+	the tables wavecap~ imports and the oracle reads: a few harmonics with noise, so every interpolator has something to smooth
+	rounded to float, so a table file holds them exactly at either sample precision
+*/
+static void verify_tables_setup (void) {
+	char name[32];
+	t_garray* array;
+	t_word* words;
+	unsigned int state = 12345u;
+	int size;
+	int slot;
+	int i;
+
+	if (verify_tables) {
+		return;
+	}
+	verify_tables = (t_sample*) calloc(VERIFY_TABLE_SLOTS * VERIFY_TABLE_SIZE, sizeof(t_sample));
+	verify_sinc_kernel = (t_sample*) calloc((PS_WAVETABLE_SINC_PHASES + 1) * 16, sizeof(t_sample));
+	ps_wavetable_sinc_kernel_fill(verify_sinc_kernel, 16);
+
+	for (slot = 0; slot < VERIFY_TABLE_SLOTS; slot++) {
+		snprintf(name, sizeof(name), "verify_slot_%d", slot);
+		array = stub_array_new(name, VERIFY_TABLE_SIZE);
+		words = stub_array_words(array, &size);
+		for (i = 0; i < VERIFY_TABLE_SIZE; i++) {
+			verify_tables[slot * VERIFY_TABLE_SIZE + i] = (t_sample) (float) (sin(2.0 * M_PI * (slot + 1) * i / VERIFY_TABLE_SIZE) * 0.6 + sin(2.0 * M_PI * 7 * i / VERIFY_TABLE_SIZE) * 0.2 + verify_random(&state) * 0.2);
+			words[i].w_float = verify_tables[slot * VERIFY_TABLE_SIZE + i];
+		}
+	}
+}
+
+/*
+	table files, laid out as wavecap~'s save writes them: a header of uint32 fields (magic, version, byte order, sample bytes, size, slots, data offset) padded to 64 bytes, then the samples
+*/
+#define VERIFY_FILE_DATA_OFFSET 64
+#define VERIFY_FILE_SAMPLES (VERIFY_TABLE_SLOTS * VERIFY_TABLE_SIZE)
+#define VERIFY_FILE_OTHER (sizeof(t_sample) == sizeof(float) ? sizeof(double) : sizeof(float))
+#define VERIFY_FILE_END(sample_bytes) (VERIFY_FILE_DATA_OFFSET + VERIFY_FILE_SAMPLES * (long) (sample_bytes))
+
+typedef struct _verify_table_file {
+	const char* magic;
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t sample_bytes;
+	uint32_t size;
+	uint32_t slots;
+	uint32_t data_offset;
+	// bytes written, -1 for the header and every sample
+	long length;
+} t_verify_table_file;
+
+// the header save writes for the tables, at sample_bytes
+#define VERIFY_FILE(sample_bytes) "PSWT", 1, 0x01020304, (sample_bytes), VERIFY_TABLE_SIZE, VERIFY_TABLE_SLOTS, VERIFY_FILE_DATA_OFFSET
+
+// files load must reject: cut short, then each header field wrong in turn
+static const t_verify_table_file verify_files_corrupt[] = {
+	{VERIFY_FILE(sizeof(t_sample)), 0},
+	{VERIFY_FILE(sizeof(t_sample)), 20},
+	{VERIFY_FILE(sizeof(t_sample)), VERIFY_FILE_END(sizeof(t_sample)) - (long) sizeof(t_sample)},
+	{VERIFY_FILE(VERIFY_FILE_OTHER), VERIFY_FILE_END(VERIFY_FILE_OTHER) - (long) VERIFY_FILE_OTHER},
+	{"PSWX", 1, 0x01020304, sizeof(t_sample), VERIFY_TABLE_SIZE, VERIFY_TABLE_SLOTS, VERIFY_FILE_DATA_OFFSET, -1},
+	{"PSWT", 2, 0x01020304, sizeof(t_sample), VERIFY_TABLE_SIZE, VERIFY_TABLE_SLOTS, VERIFY_FILE_DATA_OFFSET, -1},
+	{"PSWT", 1, 0x04030201, sizeof(t_sample), VERIFY_TABLE_SIZE, VERIFY_TABLE_SLOTS, VERIFY_FILE_DATA_OFFSET, -1},
+	{"PSWT", 1, 0x01020304, 2, VERIFY_TABLE_SIZE, VERIFY_TABLE_SLOTS, VERIFY_FILE_DATA_OFFSET, -1},
+	{"PSWT", 1, 0x01020304, sizeof(t_sample), 0, VERIFY_TABLE_SLOTS, VERIFY_FILE_DATA_OFFSET, -1},
+	{"PSWT", 1, 0x01020304, sizeof(t_sample), VERIFY_TABLE_SIZE - 24, VERIFY_TABLE_SLOTS, VERIFY_FILE_DATA_OFFSET, -1},
+	{"PSWT", 1, 0x01020304, sizeof(t_sample), VERIFY_TABLE_SIZE, 0, VERIFY_FILE_DATA_OFFSET, -1},
+	{"PSWT", 1, 0x01020304, sizeof(t_sample), VERIFY_TABLE_SIZE, VERIFY_TABLE_SLOTS, 8, -1},
+	{"PSWT", 1, 0x01020304, sizeof(t_sample), VERIFY_TABLE_SIZE, VERIFY_TABLE_SLOTS, VERIFY_FILE_DATA_OFFSET + 2, -1},
+	{"PSWT", 1, 0x01020304, sizeof(t_sample), VERIFY_TABLE_SIZE, VERIFY_TABLE_SLOTS, 1u << 20, -1},
+	{"PSWT", 1, 0x01020304, sizeof(t_sample), VERIFY_TABLE_SIZE, VERIFY_TABLE_SLOTS * 2, VERIFY_FILE_DATA_OFFSET, -1},
+	{"PSWT", 1, 0x01020304, sizeof(t_sample), 1u << 30, 1u << 30, VERIFY_FILE_DATA_OFFSET, -1},
+	{"PSWT", 1, 0x01020304, sizeof(t_sample), 1u << 31, 2, VERIFY_FILE_DATA_OFFSET, -1},
+};
+
+static const int verify_files_corrupt_num = sizeof(verify_files_corrupt) / sizeof(verify_files_corrupt[0]);
+
+// the temporary file of the checks with a table file
+static const char* verify_table_file_path (void) {
+	static char path[256] = "";
+	const char* dir = getenv("TMPDIR");
+
+	if (path[0] == '\0') {
+		snprintf(path, sizeof(path), "%s/ps_bench_verify_%s_%d.pswt", dir && dir[0] ? dir : "/tmp", VERIFY_SAMPLE_TYPE, (int) getpid());
+	}
+	return path;
+}
+
+/*
+	writes the tables to path with the header f describes, negated when negate is set (so a corrupt file that load wrongly accepts changes the output)
+*/
+static void verify_table_file_write (const char* path, const t_verify_table_file* f, int negate) {
+	long length = f->sample_bytes == sizeof(double) || f->sample_bytes == sizeof(float) ? VERIFY_FILE_END(f->sample_bytes) : VERIFY_FILE_END(sizeof(float));
+	unsigned char* bytes = (unsigned char*) calloc(VERIFY_FILE_END(sizeof(double)), 1);
+	uint32_t fields[6];
+	double sample;
+	float sample_float;
+	FILE* file;
+	int i;
+
+	memcpy(bytes, f->magic, 4);
+	fields[0] = f->version;
+	fields[1] = f->byte_order;
+	fields[2] = f->sample_bytes;
+	fields[3] = f->size;
+	fields[4] = f->slots;
+	fields[5] = f->data_offset;
+	memcpy(bytes + 4, fields, sizeof(fields));
+	for (i = 0; i < VERIFY_FILE_SAMPLES; i++) {
+		sample = negate ? -verify_tables[i] : verify_tables[i];
+		sample_float = (float) sample;
+		if (f->sample_bytes == sizeof(double)) {
+			memcpy(bytes + VERIFY_FILE_DATA_OFFSET + i * sizeof(double), &sample, sizeof(double));
+		}
+		else {
+			memcpy(bytes + VERIFY_FILE_DATA_OFFSET + i * sizeof(float), &sample_float, sizeof(float));
+		}
+	}
+	if (f->length >= 0 && f->length < length) {
+		length = f->length;
+	}
+
+	file = fopen(path, "wb");
+	if (file == NULL || (length > 0 && fwrite(bytes, length, 1, file) != 1) || fclose(file) != 0) {
+		fprintf(stderr, "verify: could not write %s\n", path);
+		exit(1);
+	}
+	free(bytes);
+}
+
+/*
+	gives wavecap~ x, with the tables imported, the table file of the check:
+		* saved		x saves its tables, shrinks them to one short slot and loads the file back, so only a full round trip plays the tables
+		* other		x loads the tables written at the other sample precision, which it converts
+		* corrupt	x loads each of verify_files_corrupt, which it must reject
+*/
+static void verify_table_file_load (void* x, const t_verify_check* c) {
+	t_verify_table_file other = {VERIFY_FILE(VERIFY_FILE_OTHER), -1};
+	const char* path = verify_table_file_path();
+	char message[320];
+	int errors;
+	int i;
+
+	switch (c->file) {
+	case verify_file_saved:
+		snprintf(message, sizeof(message), "save %s", path);
+		stub_send(x, message);
+		stub_send(x, "table_slots 1");
+		stub_send(x, "table_size 64");
+		break;
+	case verify_file_other:
+		verify_table_file_write(path, &other, 0);
+		break;
+	case verify_file_corrupt:
+		// the rejections are expected, a load that takes one of the files shows in the output
+		snprintf(message, sizeof(message), "load %s", path);
+		stub_errors_quiet = 1;
+		for (i = 0; i < verify_files_corrupt_num; i++) {
+			verify_table_file_write(path, &verify_files_corrupt[i], 1);
+			errors = stub_errors;
+			stub_send(x, message);
+			if (stub_errors == errors) {
+				fprintf(stderr, "verify: load took corrupt table file %d\n", i);
+			}
+		}
+		stub_errors_quiet = 0;
+		return;
+	default:
+		return;
+	}
+	snprintf(message, sizeof(message), "load %s", path);
+	stub_send(x, message);
+}
+
+static void verify_send_all (void* x, const char* messages) {
+	char buf[512];
+	char* message = buf;
+	char* end;
+
+	strncpy(buf, messages, sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = '\0';
+	while (message) {
+		end = strchr(message, ';');
+		if (end) {
+			*end++ = '\0';
+		}
+		while (*message == ' ') {
+			message++;
+		}
+		if (*message) {
+			stub_send(x, message);
+		}
+		message = end;
+	}
+}
+
+/*
+	renders frames frames of the external at block size n
+	in[j] holds channels_in[j] channels of frames frames each, one after the other, and out gets channels channels the same way (one value per block for checks without a signal outlet)
+	returns 0 if the object could not be created
+*/
+static int verify_render (const t_verify_check* c, int n, int frames, int channels, const int* channels_in, int in_place, t_sample* const* in, t_sample* out) {
+	int signals = c->inlets + c->outlets;
+	char message[64];
+	t_sample* outlet_vec = NULL;
+	t_signal** sp;
+	void* x;
+	int block;
+	int slot;
+	int j;
+	int k;
+
+	x = stub_new(c->object, c->args);
+	if (x == NULL) {
+		return 0;
+	}
+	if (c->slots > 1) {
+		snprintf(message, sizeof(message), "table_slots %d", c->slots);
+		stub_send(x, message);
+	}
+	for (slot = 0; slot < c->slots; slot++) {
+		snprintf(message, sizeof(message), "table_slot %d", slot);
+		stub_send(x, message);
+		snprintf(message, sizeof(message), "table_import verify_slot_%d", slot);
+		stub_send(x, message);
+	}
+	verify_table_file_load(x, c);
+	verify_send_all(x, c->messages);
+
+	sp = stub_signals_new(signals, n, VERIFY_SAMPLE_RATE);
+	for (j = 0; j < c->inlets; j++) {
+		signal_setmultiout(&sp[j], channels_in[j]);
+	}
+	if (in_place) {
+		outlet_vec = sp[c->inlets]->s_vec;
+		sp[c->inlets]->s_vec = sp[0]->s_vec;
+	}
+
+	stub_chain_reset();
+	stub_dsp(x, sp);
+
+	for (block = 0; block * n < frames; block++) {
+		for (j = 0; j < c->inlets; j++) {
+			for (k = 0; k < channels_in[j]; k++) {
+				memcpy(sp[j]->s_vec + k * n, in[j] + k * frames + block * n, n * sizeof(t_sample));
+			}
+		}
+		if (c->event && block * n == verify_event_sent(n)) {
+			snprintf(message, sizeof(message), "%s %g %g", c->event, c->event_value, c->event_delay_ms);
+			stub_send(x, message);
+		}
+		stub_outlet_sink = 0.0;
+		stub_tick();
+		if (c->outlets == 0) {
+			out[block] = (t_sample) stub_outlet_sink;
+			continue;
+		}
+		for (k = 0; k < channels; k++) {
+			memcpy(out + k * frames + block * n, sp[c->inlets]->s_vec + k * n, n * sizeof(t_sample));
+		}
+	}
+
+	stub_chain_reset();
+	stub_free(x);
+	if (c->file != verify_file_none) {
+		remove(verify_table_file_path());
+	}
+	if (in_place) {
+		sp[c->inlets]->s_vec = outlet_vec;
+	}
+	stub_signals_free(sp, signals);
+	return 1;
+}
+
+/*
+	errors
+*/
+
+// position on a line through every value of the sample type, so neighbouring values are 1 apart and -0 is 0
+static double verify_ordinal (t_sample value) {
+#if PD_FLOATSIZE == 64
+	int64_t bits;
+
+	memcpy(&bits, &value, sizeof(bits));
+	return bits < 0 ? -(double) (bits & INT64_MAX) : (double) bits;
+#else
+	int32_t bits;
+
+	memcpy(&bits, &value, sizeof(bits));
+	return bits < 0 ? -(double) (bits & INT32_MAX) : (double) bits;
+#endif
+}
+
+static double verify_ulp (t_sample a, t_sample b) {
+	if (isnan(a) || isnan(b)) {
+		return isnan(a) && isnan(b) ? 0.0 : INFINITY;
+	}
+	return fabs(verify_ordinal(a) - verify_ordinal(b));
+}
+
+/*
+	runs one check with one input set over every block size and layout, returns the worst error and where it happened
+*/
+static double verify_check_run (const t_verify_check* c, verify_input input, int* worst_block, verify_layout* worst_layout) {
+	int frames_max = verify_blocks[verify_blocks_num - 1] * ((VERIFY_FRAMES + verify_blocks[verify_blocks_num - 1] - 1) / verify_blocks[verify_blocks_num - 1]);
+	t_sample* in[VERIFY_INLETS_MAX];
+	t_sample* out = (t_sample*) calloc(VERIFY_CHANNELS_MAX * (frames_max + VERIFY_FRAMES), sizeof(t_sample));
+	t_sample* reference = (t_sample*) calloc(frames_max + VERIFY_FRAMES, sizeof(t_sample));
+	const t_sample* channel_in[VERIFY_INLETS_MAX];
+	int channels_in[VERIFY_INLETS_MAX];
+	double worst = c->metric == verify_metric_snr_db ? VERIFY_DB_FLOOR : 0.0;
+	int worst_set = 0;
+	double error;
+	double error_energy;
+	double reference_energy;
+	t_ps_denormal denormal;
+	int channels;
+	int frames;
+	int values;
+	int lag;
+	int layout;
+	int b;
+	int n;
+	int i;
+	int j;
+	int k;
+
+	for (j = 0; j < c->inlets; j++) {
+		in[j] = (t_sample*) calloc(VERIFY_CHANNELS_MAX * (frames_max + VERIFY_FRAMES), sizeof(t_sample));
+	}
+
+	for (b = 0; b < verify_blocks_num; b++) {
+		n = verify_blocks[b];
+		if (n < c->block_min) {
+			continue;
+		}
+		frames = n * ((VERIFY_FRAMES + n - 1) / n);
+
+		for (layout = 0; layout < verify_layouts_num; layout++) {
+			if ((layout == verify_layout_in_place && c->outlets == 0) || (layout >= verify_layout_mc && c->channels_max < VERIFY_CHANNELS_MAX)) {
+				continue;
+			}
+			channels = layout >= verify_layout_mc ? VERIFY_CHANNELS_MAX : 1;
+			for (j = 0; j < c->inlets; j++) {
+				channels_in[j] = layout == verify_layout_mc || (layout == verify_layout_mc_mixed && j == 0) ? channels : 1;
+				for (k = 0; k < channels_in[j]; k++) {
+					verify_input_fill(in[j] + k * frames, frames, c->roles[j], input, 1 + j + k * VERIFY_INLETS_MAX);
+				}
+			}
+
+			if (!verify_render(c, n, frames, channels, channels_in, layout == verify_layout_in_place, in, out)) {
+				fprintf(stderr, "verify: could not create %s\n", c->object);
+				exit(1);
+			}
+
+			error = c->metric == verify_metric_snr_db ? VERIFY_DB_FLOOR : 0.0;
+			error_energy = 0.0;
+			reference_energy = 0.0;
+			values = c->outlets ? frames : frames / n;
+			lag = c->outlets ? c->latency * n : c->latency;
+			for (k = 0; k < channels; k++) {
+				for (j = 0; j < c->inlets; j++) {
+					channel_in[j] = in[j] + (channels_in[j] > 1 ? k : 0) * frames;
+				}
+				denormal = ps_denormal_begin();
+				c->oracle(c, channel_in, reference, frames, n);
+				ps_denormal_end(denormal);
+
+				for (i = 0; i + lag < values; i++) {
+					switch (c->metric) {
+					case verify_metric_ulp:
+						error = fmax(error, verify_ulp(out[k * frames + lag + i], reference[i]));
+						break;
+					case verify_metric_snr_db:
+						error_energy += ((double) out[k * frames + lag + i] - reference[i]) * ((double) out[k * frames + lag + i] - reference[i]);
+						reference_energy += (double) reference[i] * reference[i];
+						break;
+					case verify_metric_ratio_db:
+						error = fmax(error, fabs(20.0 * log10((double) out[k * frames + lag + i] / reference[i])));
+						break;
+					}
+				}
+			}
+			if (c->metric == verify_metric_snr_db && error_energy > 0.0) {
+				error = reference_energy > 0.0 ? fmax(10.0 * log10(error_energy / reference_energy), VERIFY_DB_FLOOR) : INFINITY;
+			}
+
+			// NaN (a value that should not be one) is the worst error there is
+			if (isnan(error) || error > worst || !worst_set) {
+				worst = isnan(error) ? INFINITY : fmax(error, worst);
+				worst_set = 1;
+				*worst_block = n;
+				*worst_layout = (verify_layout) layout;
+			}
+		}
+	}
+
+	for (j = 0; j < c->inlets; j++) {
+		free(in[j]);
+	}
+	free(out);
+	free(reference);
+	return worst;
+}
+
+/*
+	runs every check (or those matching only, as object or object/mode), returns the number that failed
+*/
+int bench_verify (const char* only, const char* format) {
+	char name[128];
+	const t_verify_check* c;
+	double tolerance;
+	double error;
+	int worst_block = 0;
+	verify_layout worst_layout = verify_layout_mono;
+	int passed;
+	int failed = 0;
+	int checks = 0;
+	int input;
+	int i;
+
+	verify_tables_setup();
+
+	if (strcmp(format, "csv") == 0) {
+		printf("check,input,sample,metric,error,tolerance,worst_block,worst_layout,pass\n");
+	}
+
+	for (i = 0; i < verify_checks_num; i++) {
+		c = &verify_checks[i];
+		snprintf(name, sizeof(name), "%s/%s", c->object, c->mode);
+		if (only && strcmp(name, only) != 0 && strcmp(c->object, only) != 0) {
+			continue;
+		}
+		tolerance = PD_FLOATSIZE == 64 ? c->tolerance_double : c->tolerance;
+
+		for (input = 0; input < verify_inputs_num; input++) {
+			if (!(c->inputs & (1 << input))) {
+				continue;
+			}
+			error = verify_check_run(c, (verify_input) input, &worst_block, &worst_layout);
+			passed = error <= tolerance;
+			failed += !passed;
+			checks++;
+
+			if (strcmp(format, "csv") == 0) {
+				printf("%s,%s,%s,%s,%.6g,%.6g,%d,%s,%s\n", name, verify_input_names[input], VERIFY_SAMPLE_TYPE, verify_metric_names[c->metric], error, tolerance, worst_block, verify_layout_names[worst_layout], passed ? "true" : "false");
+			}
+			else {
+				printf("{\"check\": \"%s\", \"input\": \"%s\", \"sample\": \"%s\", \"metric\": \"%s\", \"error\": %.6g, \"tolerance\": %.6g, \"worst_block\": %d, \"worst_layout\": \"%s\", \"pass\": %s}\n", name, verify_input_names[input], VERIFY_SAMPLE_TYPE, verify_metric_names[c->metric], isinf(error) ? 1e300 : error, tolerance, worst_block, verify_layout_names[worst_layout], passed ? "true" : "false");
+			}
+			fflush(stdout);
+		}
+	}
+
+	fprintf(stderr, "verify: %d of %d checks failed\n", failed, checks);
+	return failed;
+}
@@ -4,7 +4,15 @@
 #endif
 
 #include "m_pd.h"
-#include <math.h>
+
+#include "../common/ps_bypass.h"
+#include "../common/ps_dispatch.h"
+#include "../common/ps_events.h"
+#include "../common/ps_lock.h"
+#include "../common/ps_multichannel.h"
+#include "../common/ps_profile.h"
+#include "../core/ps_blend.h"
+#include "../core/ps_denormal.h"
 
 /*	
 	blend~
@@ -18,7 +26,11 @@
 		2. audio signal 1
 		3. audio signal 2
 
-	Detail for linear blend:
+	All three inlets take multichannel signals (Pd 0.54+). The output has as many channels as the widest input, and an input with fewer channels is reused across them (see common/ps_multichannel.h).
+
+	The control signal is scaled by a gain before blending [default 1]. The "gain" message sets it, with an optional delay in ms, on the exact frame it falls due at rather than the next block boundary (see common/ps_events.h).
+
+	Detail for linear blend (ps_blend() in core/ps_blend.h):
 
 		ctrl[x] = ctrl signal at sample x
 		sig1[x] = audio signal 1 at sample x
@@ -48,65 +60,207 @@
 */
 
 static t_class* blend_class;
+static t_ps_lock blend_setup_lock = PS_LOCK_INIT;
 
 typedef struct _blend {
     t_object x_obj;
     t_float gain_ctrl;
+	// perform timings (empty unless built with PS_PROFILE)
+	t_ps_profile profile;
+	// silent and constant block bypass (see common/ps_bypass.h)
+	t_ps_bypass bypass;
+	// sample-accurate gain changes (see common/ps_events.h)
+	t_ps_events events;
 } t_blend;
 
+enum {
+	blend_event_gain
+};
+
+/*
+	applies a gain change outside the perform routine (see ps_events_send())
+*/
+static void _blend_event (void* owner, const t_ps_event* event) {
+	((t_blend*) owner)->gain_ctrl = event->value;
+}
+
 /*
-	main dsp callback
+	message receiver to set the control gain, delay_ms from now
 */
-static t_int* blend_perform (t_int* w) {
+static void blend_gain (t_blend* x, t_floatarg f, t_floatarg delay_ms) {
+	ps_events_send(&x->events, x, _blend_event, blend_event_gain, f, delay_ms);
+	post("gain: %f", f);
+}
+
+/*
+	blends one channel split at the gain changes of the block, each segment with the gain due at its first frame
+*/
+static PS_KERNEL void _blend_events (const t_ps_event* events, int events_num, t_float gain_ctrl, t_float* in_ctrl, t_float* in_sig1, t_float* in_sig2, t_float* out, int n) {
+	int event = 0;
+	int start;
+	int end;
+
+	for (start = 0; start < n; start = end) {
+		while (event < events_num && events[event].offset <= start) {
+			gain_ctrl = events[event++].value;
+		}
+		end = event < events_num ? events[event].offset : n;
+		ps_blend(in_ctrl + start, in_sig1 + start, in_sig2 + start, out + start, end - start, gain_ctrl);
+	}
+}
+
+/*
+	main dsp callback, for blocks of exactly fixed_n frames when that is not 0
+*/
+PS_KERNEL_BODY t_int* _blend_perform (t_int* w, int fixed_n) {
 	// pull state from args
-	float gain_ctrl = ((t_blend*) w[1])->gain_ctrl;
-    t_float* in_ctrl = (t_float*) w[2];
-    t_float* in_sig1 = (t_float*) w[3];
-    t_float* in_sig2 = (t_float*) w[4];
+	t_blend* x = (t_blend*) w[1];
+	t_float gain_ctrl = x->gain_ctrl;
+    t_float* in_ctrl_vec = (t_float*) w[2];
+    t_float* in_sig1_vec = (t_float*) w[3];
+    t_float* in_sig2_vec = (t_float*) w[4];
     t_float* out = (t_float*) w[5];
-    int n = (int) w[6];
+    int n = fixed_n ? fixed_n : (int) w[6];
+	int nchans = (int) w[7];
+	int nchans_ctrl = (int) w[8];
+	int nchans_sig1 = (int) w[9];
+	int nchans_sig2 = (int) w[10];
+
+	// pull state from struct
+	int bypass_enabled = x->bypass.enabled;
+	int events_num = ps_events_block(&x->events, n);
+	const t_ps_event* events = x->events.pending;
 
 	// create state
-	int sample_current_idx = 0;
-	short slope_positive;
-	float a;
-	float b;
-	float sig1;
-	float sig2;
-	float ctrl;
-
-	while (n--) {
-		// control signal
-		ctrl = *(in_ctrl + sample_current_idx) * gain_ctrl;
-
-		// hard clip control signal
-		if (ctrl > 1.0f) {
-			ctrl = 1.0f;
+	t_ps_denormal denormal;
+	int channel;
+	t_float* in_ctrl;
+	t_float* in_sig1;
+	t_float* in_sig2;
+	t_sample frame;
+	int channel_blocks = nchans;
+	int bypassed = 0;
+
+	PS_PROFILE_BEGIN(&x->profile);
+	denormal = ps_denormal_begin();
+
+	// blending is stateless, so when every input has all channels they are one long block (not so with gain changes within the block, and a single channel stays as it is, which keeps a fixed n constant)
+	if (events_num == 0 && nchans > 1 && nchans_ctrl == nchans && nchans_sig1 == nchans && nchans_sig2 == nchans) {
+		n *= nchans;
+		nchans = 1;
+	}
+
+	for (channel = 0; channel < nchans; channel++) {
+		in_ctrl = ps_channel(in_ctrl_vec, channel, nchans_ctrl, n);
+		in_sig1 = ps_channel(in_sig1_vec, channel, nchans_sig1, n);
+		in_sig2 = ps_channel(in_sig2_vec, channel, nchans_sig2, n);
+
+		if (events_num > 0) {
+			_blend_events(events, events_num, gain_ctrl, in_ctrl, in_sig1, in_sig2, out, n);
+		}
+		// constant inputs blend to one constant frame (see common/ps_bypass.h)
+		else if (bypass_enabled && ps_bypass_constant(in_ctrl, n) && ps_bypass_constant(in_sig1, n) && ps_bypass_constant(in_sig2, n)) {
+			ps_blend(in_ctrl, in_sig1, in_sig2, &frame, 1, gain_ctrl);
+			ps_bypass_fill(out, frame, n);
+			// a merged block stands for every channel
+			bypassed += channel_blocks / nchans;
 		}
-		else if (ctrl < -1.0f) {
-			ctrl = -1.0f;
+		else {
+			ps_blend(in_ctrl, in_sig1, in_sig2, out, n, gain_ctrl);
 		}
+		out += n;
+	}
+	if (events_num > 0) {
+		x->gain_ctrl = events[events_num - 1].value;
+	}
 
-		// calculate a/b
-		// if the signal inverted from last sample
-		a = (ctrl + 1.0f);
-		b = fabs(ctrl - 1.0f);
+	ps_denormal_end(denormal);
+	ps_bypass_count(&x->bypass, channel_blocks, bypassed);
+	PS_PROFILE_END(&x->profile);
 
-		// audio signal
-		sig1 = *(in_sig1 + sample_current_idx);
-		sig2 = *(in_sig2 + sample_current_idx);
+    return (w + 11);
+}
 
-		*(out + sample_current_idx++) = ((a * sig1) + (b * sig2)) / 2.0f;
-	}
+/*
+	perform routines for any block size and for the common fixed ones, picked in blend_dsp
+*/
+static PS_KERNEL t_int* blend_perform (t_int* w) {
+	return _blend_perform(w, 0);
+}
+
+static PS_KERNEL t_int* blend_perform_64 (t_int* w) {
+	return _blend_perform(w, 64);
+}
+
+static PS_KERNEL t_int* blend_perform_128 (t_int* w) {
+	return _blend_perform(w, 128);
+}
+
+static PS_KERNEL t_int* blend_perform_256 (t_int* w) {
+	return _blend_perform(w, 256);
+}
 
-    return (w + 7);
+/*
+	pd callback: per-block DSP timings, see common/ps_profile.h
+*/
+static void blend_stats (t_blend* x, t_symbol* receiver) {
+	ps_profile_stats(&x->profile, "blend~", receiver);
+}
+
+static void blend_stats_reset (t_blend* x) {
+	ps_profile_reset(&x->profile, "blend~");
+}
+
+/*
+	pd callback: silent and constant block bypass, see common/ps_bypass.h
+*/
+static void blend_bypass_stats (t_blend* x, t_symbol* receiver) {
+	ps_bypass_stats(&x->bypass, "blend~", receiver);
+}
+
+static void blend_bypass_stats_reset (t_blend* x) {
+	ps_bypass_reset(&x->bypass);
+}
+
+static void blend_bypass_enable (t_blend* x) {
+	ps_bypass_enable(&x->bypass, "blend~", 1);
+}
+
+static void blend_bypass_disable (t_blend* x) {
+	ps_bypass_enable(&x->bypass, "blend~", 0);
 }
 
 /*
 	pd callback: register dsp
 */
 static void blend_dsp (t_blend* x, t_signal** sp) {
-    dsp_add(blend_perform, 6, x, sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, sp[3]->s_vec, sp[0]->s_n);
+	int nchans = PS_SIGNAL_NCHANS(sp[0]);
+	t_perfroutine perform;
+
+	if (PS_SIGNAL_NCHANS(sp[1]) > nchans) {
+		nchans = PS_SIGNAL_NCHANS(sp[1]);
+	}
+	if (PS_SIGNAL_NCHANS(sp[2]) > nchans) {
+		nchans = PS_SIGNAL_NCHANS(sp[2]);
+	}
+	ps_signal_setmultiout(&sp[3], nchans);
+	ps_events_dsp(&x->events, sp[0]->s_sr, sp[0]->s_n);
+
+	switch (sp[0]->s_n) {
+	case 64:
+		perform = blend_perform_64;
+		break;
+	case 128:
+		perform = blend_perform_128;
+		break;
+	case 256:
+		perform = blend_perform_256;
+		break;
+	default:
+		perform = blend_perform;
+	}
+
+    dsp_add(perform, 10, x, sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, sp[3]->s_vec, sp[0]->s_n, nchans, PS_SIGNAL_NCHANS(sp[0]), PS_SIGNAL_NCHANS(sp[1]), PS_SIGNAL_NCHANS(sp[2]));
 }
 
 /*
@@ -115,6 +269,9 @@ static void blend_dsp (t_blend* x, t_signal** sp) {
 static void* blend_new (void) {
     t_blend* x = (t_blend*) pd_new(blend_class);
 	x->gain_ctrl = 1.0;
+	ps_profile_init(&x->profile);
+	ps_bypass_init(&x->bypass);
+	ps_events_init(&x->events);
     inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, &s_signal);
     inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, &s_signal);
 	outlet_new(&x->x_obj, gensym("signal"));
@@ -125,8 +282,23 @@ static void* blend_new (void) {
 	pd callback: setup object
 */
 void blend_tilde_setup(void) {
-    blend_class = class_new(gensym("blend~"), (t_newmethod) blend_new, 0, sizeof(t_blend), 0, A_GIMME, 0);
+	ps_lock(&blend_setup_lock);
+	if (blend_class) {
+		ps_unlock(&blend_setup_lock);
+		return;
+	}
+
+    blend_class = class_new(gensym("blend~"), (t_newmethod) blend_new, 0, sizeof(t_blend), PS_CLASS_MULTICHANNEL, A_GIMME, 0);
 	
     CLASS_MAINSIGNALIN(blend_class, t_blend, gain_ctrl);
+    class_addmethod(blend_class, (t_method) blend_gain, gensym("gain"), A_FLOAT, A_DEFFLOAT, 0);
+    class_addmethod(blend_class, (t_method) blend_stats, gensym("stats"), A_DEFSYM, 0);
+    class_addmethod(blend_class, (t_method) blend_stats_reset, gensym("stats_reset"), A_NULL, 0);
+    class_addmethod(blend_class, (t_method) blend_bypass_stats, gensym("bypass_stats"), A_DEFSYM, 0);
+    class_addmethod(blend_class, (t_method) blend_bypass_stats_reset, gensym("bypass_stats_reset"), A_NULL, 0);
+    class_addmethod(blend_class, (t_method) blend_bypass_enable, gensym("bypass_enable"), A_NULL, 0);
+    class_addmethod(blend_class, (t_method) blend_bypass_disable, gensym("bypass_disable"), A_NULL, 0);
     class_addmethod(blend_class, (t_method) blend_dsp, gensym("dsp"), A_CANT, 0);
+
+	ps_unlock(&blend_setup_lock);
 }
\ No newline at end of file
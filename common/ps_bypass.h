@@ -0,0 +1,139 @@
+#ifndef PS_BYPASS_H
+#define PS_BYPASS_H
+
+/*
+	ps_bypass.h
+
+	Block bypass for silent and constant inputs. Most voices of a patch are silent most of the time, and a silent block costs a perform routine as much as any other: folder~ and blend~ fold and blend every zero, wiener~ runs a full FFT and a log() per bin to output the same 1.0 every block. Before running its kernel on a channel, a perform routine checks whether every input of it is constant over the block. If so, it computes one frame, or takes a cached result, and fills the block with it.
+
+	A bypassed block must leave exactly the output and state that running the kernel would have. Stateless kernels (folding, blending, hard wrapping) give the same frame for the same input, so one frame is exact. Stateful ones advance their state the way n frames of the constant input would, or decline the bypass:
+
+		* wraparound~ (and nlchain~'s wrap stage) when softening is idle and the constant does not cross the wrap boundary: the soften buffer is then flushed with the constant frame, as n pushes would leave it (ps_wrap_soften_constant() in core/ps_wrap.h)
+		* wavecap~ when the control input is silent and the envelope has decayed to exactly zero: the phase stands still, so every sample is one table read (ps_wavetable_osc_silent() in core/ps_wavetable.h)
+		* wiener~ when the block is all zeros: the flatness of silence is computed once per block size and spectrum type and cached
+
+	Oversampling, recording, pitch tracking and the voice bank never bypass, their filters and buffers see every frame.
+
+	Inputs are compared bit for bit with their first frame, in chunks of PS_BYPASS_CHUNK frames so a changing signal is rejected after the first few vector compares. A block that alternates 0.0 and -0.0 therefore runs the kernel, which is always correct, and a block of one NaN payload is constant, which is exact too.
+
+	Every object counts the channel blocks it ran and bypassed. The counters are written by the perform routine only, like common/ps_profile.h (a read racing a block may be one perform call behind on one of them), and exposed by three messages:
+
+		* bypass_stats [receiver]: post "blocks, bypassed" to the console, or send them to receiver as the list "blocks bypassed"
+		* bypass_stats_reset: clear the counters
+		* bypass_enable / bypass_disable: turn the bypass on [default] or off, e.g. to compare the cost of a silent patch
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _WIN32
+	#define PS_BYPASS_INLINE static __inline
+#else
+	#define PS_BYPASS_INLINE static inline
+#endif
+
+#define PS_BYPASS_CHUNK 16
+
+#if PD_FLOATSIZE == 64
+	typedef uint64_t t_ps_bypass_bits;
+#else
+	typedef uint32_t t_ps_bypass_bits;
+#endif
+
+typedef char _ps_bypass_bits_match_t_sample[sizeof(t_ps_bypass_bits) == sizeof(t_sample) ? 1 : -1];
+
+typedef struct _ps_bypass {
+	int enabled;
+	volatile uint32_t reset_requested;
+	volatile uint32_t blocks;
+	volatile uint32_t bypassed;
+} t_ps_bypass;
+
+// call from the object's new method
+PS_BYPASS_INLINE void ps_bypass_init (t_ps_bypass* b) {
+	b->enabled = 1;
+	b->reset_requested = 0;
+	b->blocks = 0;
+	b->bypassed = 0;
+}
+
+/*
+	1 if all n frames of in are bit for bit the same
+*/
+PS_BYPASS_INLINE int ps_bypass_constant (const t_sample* in, int n) {
+	t_ps_bypass_bits first;
+	t_ps_bypass_bits bits;
+	t_ps_bypass_bits differ = 0;
+	int chunk_end;
+	int i = 0;
+
+	memcpy(&first, in, sizeof(first));
+	while (i < n) {
+		chunk_end = n - i < PS_BYPASS_CHUNK ? n : i + PS_BYPASS_CHUNK;
+		for (; i < chunk_end; i++) {
+			memcpy(&bits, in + i, sizeof(bits));
+			differ |= bits ^ first;
+		}
+		if (differ) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+	1 if all n frames of in are the same zero (0.0 or -0.0)
+*/
+PS_BYPASS_INLINE int ps_bypass_silent (const t_sample* in, int n) {
+	return in[0] == 0.0f && ps_bypass_constant(in, n);
+}
+
+PS_BYPASS_INLINE void ps_bypass_fill (t_sample* out, t_sample value, int n) {
+	int i;
+
+	for (i = 0; i < n; i++) {
+		out[i] = value;
+	}
+}
+
+/*
+	adds one perform call's channel blocks, from the perform routine
+*/
+PS_BYPASS_INLINE void ps_bypass_count (t_ps_bypass* b, int blocks, int bypassed) {
+	if (b->reset_requested) {
+		b->blocks = 0;
+		b->bypassed = 0;
+		b->reset_requested = 0;
+	}
+	b->bypassed += bypassed;
+	b->blocks += blocks;
+}
+
+PS_BYPASS_INLINE void ps_bypass_reset (t_ps_bypass* b) {
+	b->reset_requested = 1;
+}
+
+PS_BYPASS_INLINE void ps_bypass_enable (t_ps_bypass* b, const char* name, int enabled) {
+	b->enabled = enabled;
+	post("%s: bypass %s", name, enabled ? "enabled" : "disabled");
+}
+
+PS_BYPASS_INLINE void ps_bypass_stats (t_ps_bypass* b, const char* name, t_symbol* receiver) {
+	uint32_t bypassed = b->reset_requested ? 0 : b->bypassed;
+	uint32_t blocks = b->reset_requested ? 0 : b->blocks;
+	t_atom list[2];
+
+	if (receiver == NULL || receiver == &s_) {
+		post("%s: %u blocks, %u bypassed (%.1f%%)", name, (unsigned int) blocks, (unsigned int) bypassed, blocks ? 100.0 * bypassed / blocks : 0.0);
+		return;
+	}
+	if (receiver->s_thing == NULL) {
+		error("%s: bypass_stats: no receiver named %s", name, receiver->s_name);
+		return;
+	}
+	SETFLOAT(&list[0], (t_float) blocks);
+	SETFLOAT(&list[1], (t_float) bypassed);
+	pd_list(receiver->s_thing, &s_list, 2, list);
+}
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef PS_DISPATCH_H
+#define PS_DISPATCH_H
+
+/*
+	ps_dispatch.h
+
+	Runtime instruction set dispatch for the perform routines.
+
+	PS_KERNEL marks a function to be compiled once per instruction set listed below. The dynamic loader then picks the best clone for the running CPU when the external is loaded (GCC/clang function multiversioning through an ifunc). Everything else is built for the baseline target, which is SSE2 on x86-64.
+
+		* avx512f
+		* avx2
+		* default (baseline, SSE2 on x86-64)
+
+	Multiversioning needs an ELF loader with ifunc support, so it is only used for x86-64 Linux builds. Everywhere else (MSVC, macOS, ARM) PS_KERNEL expands to nothing and the kernels are built once for the compiler's target. Define PS_NO_DISPATCH to turn it off, e.g. for -march=native builds.
+
+	PS_KERNEL_BODY marks a perform routine body that is shared by several PS_KERNEL entry points, e.g. one per fixed block size. It is always inlined, so each clone of each entry point gets its own copy, compiled for its instruction set and with its constant arguments folded in.
+*/
+
+#if !defined(PS_NO_DISPATCH) && defined(__x86_64__) && defined(__linux__) && defined(__has_attribute)
+	#if __has_attribute(target_clones)
+		#define PS_KERNEL __attribute__((target_clones("avx512f", "avx2", "default")))
+	#endif
+#endif
+
+#ifndef PS_KERNEL
+	#define PS_KERNEL
+#endif
+
+#if defined(__GNUC__)
+	#define PS_KERNEL_BODY static inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+	#define PS_KERNEL_BODY static __forceinline
+#else
+	#define PS_KERNEL_BODY static inline
+#endif
+
+#endif
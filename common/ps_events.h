@@ -0,0 +1,217 @@
+#ifndef PS_EVENTS_H
+#define PS_EVENTS_H
+
+/*
+	ps_events.h
+
+	Sample-accurate parameter changes. A message that sets a parameter (folder~'s gain, wavecap~'s env_atk_ms ...) used to be read once at the top of the next block, so automation was quantized to the block size, and the only sample accurate alternative was a signal inlet that costs a full vector for a value that rarely changes. Instead, the message handler puts the change on the object's event queue, stamped with Pd's logical time plus an optional delay in ms, and the perform routine splits its block at the frames where events fall due. Each segment runs the usual vectorized kernel with the values due at its first frame, so a block without events costs nothing extra.
+
+	Timing follows vline~: Pd runs the clocks that fall within a tick (a [delay], [metro] or [pipe] going off) before it computes the tick's DSP, so a change sent at logical time t lands on the first frame of the next block at or after t. A message without a delay from a clock lands inside the block, one from the GUI at its first frame. A new event cancels the pending events of the same parameter scheduled at or after its time, like a new segment of vline~, so "gain 0 100" followed by "gain 1 50" leaves only the second.
+
+	The queue is a single-producer, single-consumer ring of PS_EVENTS_CAPACITY events. The message handler writes it (ps_events_send()) and the perform routine reads it (ps_events_block()) without locks, then keeps the events it took sorted by time until they fall due. When the perform routine has not read the queue for two blocks the object is outside a running DSP chain (DSP off, or a switch~ed off subpatch). Then the message handler reads the queue itself and applies everything that is due right away, so nothing piles up while DSP is off and the values are in place when it restarts.
+
+		static void foo_gain (t_foo* x, t_floatarg f, t_floatarg delay_ms) {
+			ps_events_send(&x->events, x, _foo_event, foo_event_gain, f, delay_ms);
+		}
+
+		// perform routine
+		events_num = ps_events_block(&x->events, n);
+		for (start = 0; start < n; start = end) {
+			while (event < events_num && x->events.pending[event].offset <= start) {
+				... apply x->events.pending[event++]
+			}
+			end = event < events_num ? x->events.pending[event].offset : n;
+			... kernel on frames [start, end)
+		}
+*/
+
+#include <math.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+	#include <windows.h>
+	#define PS_EVENTS_INLINE static __inline
+#else
+	#define PS_EVENTS_INLINE static inline
+#endif
+
+// power of 2
+#define PS_EVENTS_CAPACITY 64
+
+// an event this close to a frame (in frames) lands on it rather than the next one
+#define PS_EVENTS_EPSILON 1e-6
+
+#ifdef _MSC_VER
+	#define _ps_events_load(p) (*(volatile uint32_t*) (p))
+	#define _ps_events_store(p, v) InterlockedExchange((volatile LONG*) (p), (LONG) (v))
+#else
+	#define _ps_events_load(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+	#define _ps_events_store(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#endif
+
+typedef struct _ps_event {
+	// logical time the event falls due, in ms since the queue was initialized
+	double time;
+	// frame of the current block it falls due at, set by ps_events_block()
+	int offset;
+	// object-defined parameter id
+	int param;
+	t_float value;
+} t_ps_event;
+
+// applies one event to the object, from a message handler when the queue is idle
+typedef void (*t_ps_events_apply) (void* owner, const t_ps_event* event);
+
+typedef struct _ps_events {
+	// ring from the message handler to the perform routine
+	t_ps_event ring[PS_EVENTS_CAPACITY];
+	uint32_t ring_write;
+	uint32_t ring_read;
+
+	// events taken from the ring, sorted by time, owned by the perform routine
+	t_ps_event pending[PS_EVENTS_CAPACITY];
+	int pending_num;
+	// leading pending events the last block applied, removed at the next read
+	int pending_done;
+
+	// logical time of ms 0, and the end of the last block read
+	double reference;
+	double block_end;
+	// set by ps_events_dsp()
+	double ms_per_frame;
+	double ms_per_block;
+} t_ps_events;
+
+// call from the object's new method
+PS_EVENTS_INLINE void ps_events_init (t_ps_events* e) {
+	e->ring_write = 0;
+	e->ring_read = 0;
+	e->pending_num = 0;
+	e->pending_done = 0;
+	e->reference = clock_getlogicaltime();
+	e->block_end = 0.0;
+	e->ms_per_frame = 0.0;
+	e->ms_per_block = 0.0;
+}
+
+// call from the object's dsp method
+PS_EVENTS_INLINE void ps_events_dsp (t_ps_events* e, t_float sample_rate, int n) {
+	e->ms_per_frame = sample_rate > 0.0f ? 1000.0 / sample_rate : 0.0;
+	e->ms_per_block = e->ms_per_frame * n;
+}
+
+/*
+	inserts into the pending events by time, after those at the same time, and cancels the later ones of its parameter (0 when full)
+*/
+PS_EVENTS_INLINE int _ps_events_insert (t_ps_events* e, const t_ps_event* event) {
+	int kept = 0;
+	int i;
+
+	for (i = 0; i < e->pending_num; i++) {
+		if (e->pending[i].param != event->param || e->pending[i].time < event->time) {
+			e->pending[kept++] = e->pending[i];
+		}
+	}
+	e->pending_num = kept;
+	if (kept == PS_EVENTS_CAPACITY) {
+		return 0;
+	}
+
+	for (i = kept; i > 0 && e->pending[i - 1].time > event->time; i--) {
+		e->pending[i] = e->pending[i - 1];
+	}
+	e->pending[i] = *event;
+	e->pending_num++;
+	return 1;
+}
+
+/*
+	drops the events the last block applied and moves the ring into the pending events
+*/
+PS_EVENTS_INLINE void _ps_events_drain (t_ps_events* e) {
+	uint32_t write = _ps_events_load(&e->ring_write);
+	uint32_t read = e->ring_read;
+	int i;
+
+	if (e->pending_done > 0) {
+		for (i = e->pending_done; i < e->pending_num; i++) {
+			e->pending[i - e->pending_done] = e->pending[i];
+		}
+		e->pending_num -= e->pending_done;
+		e->pending_done = 0;
+	}
+
+	// a full pending list leaves the rest in the ring until events fall due
+	while (read != write && e->pending_num < PS_EVENTS_CAPACITY) {
+		_ps_events_insert(e, &e->ring[read & (PS_EVENTS_CAPACITY - 1)]);
+		read++;
+	}
+	_ps_events_store(&e->ring_read, read);
+}
+
+/*
+	from the perform routine: the number of pending events falling due within the next n frames, e->pending[0] on, with their offset set
+*/
+PS_EVENTS_INLINE int ps_events_block (t_ps_events* e, int n) {
+	double block_start;
+	double offset;
+	int events_num = 0;
+
+	// Pd advances logical time to the end of the tick before it computes the tick's DSP
+	e->block_end = clock_gettimesince(e->reference);
+	if (e->ring_read == _ps_events_load(&e->ring_write) && e->pending_num == e->pending_done) {
+		e->pending_num = 0;
+		e->pending_done = 0;
+		return 0;
+	}
+	_ps_events_drain(e);
+
+	block_start = e->block_end - e->ms_per_frame * n;
+	while (events_num < e->pending_num) {
+		offset = e->ms_per_frame > 0.0 ? ceil((e->pending[events_num].time - block_start) / e->ms_per_frame - PS_EVENTS_EPSILON) : 0.0;
+		if (offset >= n) {
+			break;
+		}
+		e->pending[events_num].offset = offset > 0.0 ? (int) offset : 0;
+		events_num++;
+	}
+	e->pending_done = events_num;
+	return events_num;
+}
+
+/*
+	from a message handler: schedules value for param delay_ms from now, or applies it with apply when the perform routine is not running
+*/
+PS_EVENTS_INLINE void ps_events_send (t_ps_events* e, void* owner, t_ps_events_apply apply, int param, t_float value, t_float delay_ms) {
+	double now = clock_gettimesince(e->reference);
+	uint32_t write = e->ring_write;
+	t_ps_event event;
+	int i;
+
+	event.time = now + (delay_ms > 0.0f ? delay_ms : 0.0);
+	event.offset = 0;
+	event.param = param;
+	event.value = value;
+
+	// the perform routine has stopped reading, take its place and apply what is due (see above)
+	if (e->ms_per_block <= 0.0 || now - e->block_end >= 2.0 * e->ms_per_block) {
+		_ps_events_drain(e);
+		if (!_ps_events_insert(e, &event)) {
+			error("event queue full, dropped a change");
+		}
+		for (i = 0; i < e->pending_num && e->pending[i].time <= now; i++) {
+			apply(owner, &e->pending[i]);
+		}
+		e->pending_done = i;
+		return;
+	}
+
+	if (write - _ps_events_load(&e->ring_read) == PS_EVENTS_CAPACITY) {
+		error("event queue full, dropped a change");
+		return;
+	}
+	e->ring[write & (PS_EVENTS_CAPACITY - 1)] = event;
+	_ps_events_store(&e->ring_write, write + 1);
+}
+
+#endif
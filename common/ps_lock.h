@@ -0,0 +1,38 @@
+#ifndef PS_LOCK_H
+#define PS_LOCK_H
+
+/*
+	ps_lock.h
+
+	A statically initialized mutex for the little state the externals share across objects: class setup and wavecap~'s table registry and sinc kernel cache. Pd compiled with PDINSTANCE (libpd multi-instance hosts) runs several Pd instances in one process, one per thread. Then objects from different instances run concurrently, and anything static has to be locked or it races.
+
+	Classes are process-wide. Pd keeps a class's method table per instance and adds new classes to every instance, so the t_class pointer a setup function stores is valid everywhere. A host may still call the setup function once per instance, so every setup function runs once under its lock and returns early after that. Symbols are per instance, though: gensym("foo") is a different pointer in each one. Registries keyed by t_symbol* are therefore naturally per instance, which is what a patch expects.
+
+	Never take a lock in a perform routine. Locks here are only held in setup, object creation and message handlers, for a handful of instructions or a one-time table build.
+
+		static t_ps_lock lock = PS_LOCK_INIT;
+
+		ps_lock(&lock);
+		...
+		ps_unlock(&lock);
+*/
+
+#ifdef _WIN32
+	#include <windows.h>
+
+	typedef SRWLOCK t_ps_lock;
+
+	#define PS_LOCK_INIT SRWLOCK_INIT
+	#define ps_lock(l) AcquireSRWLockExclusive(l)
+	#define ps_unlock(l) ReleaseSRWLockExclusive(l)
+#else
+	#include <pthread.h>
+
+	typedef pthread_mutex_t t_ps_lock;
+
+	#define PS_LOCK_INIT PTHREAD_MUTEX_INITIALIZER
+	#define ps_lock(l) pthread_mutex_lock(l)
+	#define ps_unlock(l) pthread_mutex_unlock(l)
+#endif
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef PS_MMAP_H
+#define PS_MMAP_H
+
+/*
+	ps_mmap.h
+
+	Read-only file mappings, for data the externals load from disk and never write (wavecap~'s saved tables). Mapping a file copies nothing: its pages come in from the OS page cache when they are first read, and every process and instance that maps the same file shares those pages. The first read of a page that is not cached yet waits for the disk, so a perform routine reading a freshly mapped file that nothing else has read lately can stall on a page fault.
+
+	Open and close from message handlers, never from a perform routine. A mapping that a running DSP chain may still read is retired like pool memory (common/ps_rtpool.h) and closed at the owner's next dsp call.
+*/
+
+#include <stddef.h>
+
+#ifdef _WIN32
+	#include <windows.h>
+	#define PS_MMAP_INLINE static __inline
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+	#define PS_MMAP_INLINE static inline
+#endif
+
+typedef struct _ps_mmap {
+	const unsigned char* data;
+	size_t size;
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#endif
+	// retired list link, owned by whoever retired the mapping
+	struct _ps_mmap* retired;
+} t_ps_mmap;
+
+/*
+	maps the whole file at path read-only; 0 when it cannot be opened or is empty
+*/
+PS_MMAP_INLINE int ps_mmap_open (t_ps_mmap* m, const char* path) {
+#ifdef _WIN32
+	LARGE_INTEGER size;
+
+	m->data = NULL;
+	m->mapping = NULL;
+	m->retired = NULL;
+	m->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m->file == INVALID_HANDLE_VALUE) {
+		return 0;
+	}
+	if (!GetFileSizeEx(m->file, &size) || size.QuadPart <= 0 || (unsigned long long) size.QuadPart > (size_t) -1) {
+		CloseHandle(m->file);
+		return 0;
+	}
+	m->size = (size_t) size.QuadPart;
+	m->mapping = CreateFileMappingA(m->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m->mapping != NULL) {
+		m->data = (const unsigned char*) MapViewOfFile(m->mapping, FILE_MAP_READ, 0, 0, 0);
+	}
+	if (m->data == NULL) {
+		if (m->mapping != NULL) {
+			CloseHandle(m->mapping);
+		}
+		CloseHandle(m->file);
+		return 0;
+	}
+	return 1;
+#else
+	struct stat st;
+	void* data;
+	int fd;
+
+	m->data = NULL;
+	m->retired = NULL;
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return 0;
+	}
+	if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+		close(fd);
+		return 0;
+	}
+	// the mapping keeps the file alive, the descriptor is not needed after this
+	data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		return 0;
+	}
+	m->data = (const unsigned char*) data;
+	m->size = (size_t) st.st_size;
+	return 1;
+#endif
+}
+
+PS_MMAP_INLINE void ps_mmap_close (t_ps_mmap* m) {
+	if (m->data == NULL) {
+		return;
+	}
+#ifdef _WIN32
+	UnmapViewOfFile(m->data);
+	CloseHandle(m->mapping);
+	CloseHandle(m->file);
+#else
+	munmap((void*) m->data, m->size);
+#endif
+	m->data = NULL;
+}
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef PS_MULTICHANNEL_H
+#define PS_MULTICHANNEL_H
+
+/*
+	ps_multichannel.h
+
+	Pd 0.54 multichannel signals, with a fallback for older Pd headers.
+
+	A class created with PS_CLASS_MULTICHANNEL gets every channel of a multichannel connection in one signal. s_vec holds s_nchans blocks of s_n samples back to back, and the dsp method sizes its own outputs with ps_signal_setmultiout(). One instance then runs all channels in one perform call instead of one object and one perform call per channel.
+
+	Channel counts follow Pd's own multichannel objects: the output has as many channels as the widest input, and an input with fewer channels is reused modulo its channel count, so a single-channel input applies to every channel.
+
+	Before Pd 0.54 (no CLASS_MULTICHANNEL in m_pd.h) every signal has one channel and outputs are allocated by Pd, so the same dsp methods build single-channel chains.
+*/
+
+#ifdef CLASS_MULTICHANNEL
+	#define PS_CLASS_MULTICHANNEL CLASS_MULTICHANNEL
+	#define PS_SIGNAL_NCHANS(sig) ((sig)->s_nchans)
+	#define ps_signal_setmultiout(sig, nchans) signal_setmultiout(sig, nchans)
+#else
+	#define PS_CLASS_MULTICHANNEL 0
+	#define PS_SIGNAL_NCHANS(sig) 1
+	#define ps_signal_setmultiout(sig, nchans) ((void) 0)
+#endif
+
+/*
+	first sample of channel for an input with nchans channels of n samples
+*/
+#ifdef _WIN32
+static __inline t_sample* ps_channel (t_sample* vec, int channel, int nchans, int n) {
+#else
+static inline t_sample* ps_channel (t_sample* vec, int channel, int nchans, int n) {
+#endif
+	return vec + (channel % nchans) * n;
+}
+
+#endif
@@ -0,0 +1,382 @@
+#ifndef PS_PARALLEL_H
+#define PS_PARALLEL_H
+
+/*
+	ps_parallel.h
+
+	Worker threads for an object whose channels are independent, so that one bank of many channels (nlchain~'s chains, wiener~'s FFTs) can use more than the one core Pd computes DSP on. pd~ can spread a patch over cores too, but it runs a second Pd process and pipes every signal through it.
+
+	With threads, the object's perform routine hands its block to the workers and outputs the block they computed during the previous tick, so the object adds exactly one block of latency:
+
+		1. wait until the workers are done with the block released last tick (ps_parallel_wait(), the barrier)
+		2. copy the new input into the lanes' buffers and the lanes' output to the outlets
+		3. release the workers on the new block (ps_parallel_release()) and return
+
+	The workers compute while Pd runs the rest of the DSP chain. A lane is one channel. Lane i always runs on worker i % workers, so its state stays in one core's cache. Between steps 1 and 3 no worker runs, so the lane buffers change hands without locks. The release is a generation counter the workers watch, and the barrier is a count of the workers done with it; both are plain atomics. A waiting worker spins on the generation for PS_PARALLEL_SPIN_US microseconds of the monotonic clock, then sleeps on a semaphore that the release posts only when it finds the worker asleep. Within a burst of ticks the next block comes before the spin ends and the worker takes it without a wake up. Between audio buffers, and once DSP stops, it sleeps. The spin costs each worker at most 100 us of a core per block: under 7% at 64-sample blocks and 44.1 kHz, more with smaller blocks or higher rates. With more workers than cores besides Pd's, spinning would only take the time the others need, so then nothing spins: the workers sleep right away and the barrier yields.
+
+	Workers inherit the scheduling priority of the thread that starts them, which is Pd's. Where the OS allows (Linux and Windows) each one is pinned to a core of its own, going round the cores from core 1 on, since core 0 usually takes the audio interrupts.
+
+	Everything the lanes read belongs to the workers from a release to the next barrier. A message handler or dsp method that changes any of it calls ps_parallel_wait() first. The wait costs at most the rest of the block in flight, which the next perform call would have waited for anyway. Start and stop the workers from message handlers, never from a perform routine.
+
+		static void _foo_lane (void* owner, int lane) {
+			... run channel lane on its own buffers
+		}
+
+		// new method
+		ps_parallel_init(&x->parallel, _foo_lane, x);
+
+		// perform routine
+		if (x->parallel.workers_num > 0) {
+			ready = ps_parallel_wait(&x->parallel);
+			... copy the input to the lanes, and their output to out if ready (zeros if not)
+			ps_parallel_release(&x->parallel, nchans);
+		}
+*/
+
+#include <stdint.h>
+
+#ifdef _WIN32
+	#include <windows.h>
+	#define PS_PARALLEL_INLINE static __inline
+#else
+	#include <errno.h>
+	#include <pthread.h>
+	#include <sched.h>
+	#include <semaphore.h>
+	#include <time.h>
+	#include <unistd.h>
+	#define PS_PARALLEL_INLINE static inline
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+	#include <immintrin.h>
+	#define _ps_parallel_pause() _mm_pause()
+#else
+	#define _ps_parallel_pause()
+#endif
+
+#define PS_PARALLEL_WORKERS_MAX 32
+// how long a waiting worker spins before it sleeps, longer than the gap between the blocks of a burst of ticks (bounded by time, a pause instruction takes from about 10 to 140 cycles depending on the CPU)
+#define PS_PARALLEL_SPIN_US 100
+
+// the worker flags and counters are sequentially consistent, the sleep handshake needs a store then a load to stay in order
+#ifdef _MSC_VER
+	#define _ps_parallel_load(p) (*(volatile uint32_t*) (p))
+	#define _ps_parallel_store(p, v) InterlockedExchange((volatile LONG*) (p), (LONG) (v))
+	#define _ps_parallel_exchange(p, v) ((uint32_t) InterlockedExchange((volatile LONG*) (p), (LONG) (v)))
+	#define _ps_parallel_add(p, v) InterlockedExchangeAdd((volatile LONG*) (p), (LONG) (v))
+#else
+	#define _ps_parallel_load(p) __atomic_load_n(p, __ATOMIC_SEQ_CST)
+	#define _ps_parallel_store(p, v) __atomic_store_n(p, v, __ATOMIC_SEQ_CST)
+	#define _ps_parallel_exchange(p, v) __atomic_exchange_n(p, v, __ATOMIC_SEQ_CST)
+	#define _ps_parallel_add(p, v) __atomic_fetch_add(p, v, __ATOMIC_SEQ_CST)
+#endif
+
+// runs one lane of the released block, on a worker thread
+typedef void (*t_ps_parallel_run) (void* owner, int lane);
+
+typedef struct _ps_parallel_worker {
+	struct _ps_parallel* pool;
+	int index;
+	// generation of the last block this worker ran
+	uint32_t seen;
+	uint32_t sleeping;
+#ifdef _WIN32
+	HANDLE thread;
+	HANDLE wake;
+#else
+	pthread_t thread;
+	sem_t wake;
+#endif
+} t_ps_parallel_worker;
+
+typedef struct _ps_parallel {
+	t_ps_parallel_run run;
+	void* owner;
+	// 0 when the object runs on Pd's thread
+	int workers_num;
+	// microseconds to spin before sleeping or yielding, 0 when the workers outnumber the spare cores
+	int spin_us;
+	t_ps_parallel_worker workers[PS_PARALLEL_WORKERS_MAX];
+	// lanes of the released block
+	int lanes_num;
+	uint32_t generation;
+	// workers done with the current generation
+	uint32_t done;
+	uint32_t quit;
+	// the lanes hold a block the perform routine has not output yet
+	int ready;
+} t_ps_parallel;
+
+// round robin over the cores for pinning, shared by every pool of the external
+static uint32_t _ps_parallel_next_core = 0;
+
+PS_PARALLEL_INLINE int _ps_parallel_cores (void) {
+#ifdef _WIN32
+	SYSTEM_INFO info;
+
+	GetSystemInfo(&info);
+	return (int) info.dwNumberOfProcessors;
+#else
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return cores > 0 ? (int) cores : 1;
+#endif
+}
+
+// monotonic clock in microseconds, for bounding the spins
+PS_PARALLEL_INLINE double _ps_parallel_now_us (void) {
+#ifdef _WIN32
+	LARGE_INTEGER count;
+	LARGE_INTEGER frequency;
+
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&frequency);
+	return (double) count.QuadPart * 1e6 / (double) frequency.QuadPart;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec * 1e6 + (double) ts.tv_nsec * 1e-3;
+#endif
+}
+
+/*
+	one round of a spin: pauses and returns 1 until p->spin_us have passed since the first round (spin_start, 0 before it), then returns 0
+*/
+PS_PARALLEL_INLINE int _ps_parallel_spin (const t_ps_parallel* p, double* spin_start) {
+	double now;
+
+	if (p->spin_us <= 0) {
+		return 0;
+	}
+	now = _ps_parallel_now_us();
+	if (*spin_start == 0.0) {
+		*spin_start = now;
+	}
+	else if (now - *spin_start >= p->spin_us) {
+		return 0;
+	}
+	_ps_parallel_pause();
+	return 1;
+}
+
+/*
+	pins a new worker to the next core from core 1 on, where the OS allows it
+*/
+PS_PARALLEL_INLINE void _ps_parallel_pin (t_ps_parallel_worker* w) {
+	int cores = _ps_parallel_cores();
+#ifdef _WIN32
+	if (cores > (int) (8 * sizeof(DWORD_PTR))) {
+		cores = 8 * sizeof(DWORD_PTR);
+	}
+	if (cores > 1) {
+		SetThreadAffinityMask(w->thread, (DWORD_PTR) 1 << (1 + _ps_parallel_add(&_ps_parallel_next_core, 1) % (cores - 1)));
+	}
+#elif defined(__linux__) && defined(_GNU_SOURCE)
+	cpu_set_t set;
+
+	if (cores > 1 && cores <= CPU_SETSIZE) {
+		CPU_ZERO(&set);
+		CPU_SET(1 + _ps_parallel_add(&_ps_parallel_next_core, 1) % (cores - 1), &set);
+		pthread_setaffinity_np(w->thread, sizeof(set), &set);
+	}
+#else
+	(void) w;
+#endif
+}
+
+/*
+	worker side: sleeps until the generation moves past seen
+*/
+PS_PARALLEL_INLINE void _ps_parallel_worker_wait (t_ps_parallel_worker* w) {
+	t_ps_parallel* p = w->pool;
+	double spin_start = 0.0;
+
+	while (_ps_parallel_load(&p->generation) == w->seen) {
+		if (_ps_parallel_spin(p, &spin_start)) {
+			continue;
+		}
+		// either the release sees the flag and posts, or this sees the new generation (or both, which leaves one spare post)
+		_ps_parallel_store(&w->sleeping, 1);
+		if (_ps_parallel_load(&p->generation) == w->seen) {
+#ifdef _WIN32
+			WaitForSingleObject(w->wake, INFINITE);
+#else
+			while (sem_wait(&w->wake) != 0 && errno == EINTR);
+#endif
+		}
+		_ps_parallel_store(&w->sleeping, 0);
+	}
+}
+
+#ifdef _WIN32
+static DWORD WINAPI _ps_parallel_worker_main (LPVOID arg) {
+#else
+static void* _ps_parallel_worker_main (void* arg) {
+#endif
+	t_ps_parallel_worker* w = (t_ps_parallel_worker*) arg;
+	t_ps_parallel* p = w->pool;
+	int lane;
+
+	for (;;) {
+		_ps_parallel_worker_wait(w);
+		w->seen = _ps_parallel_load(&p->generation);
+		if (_ps_parallel_load(&p->quit)) {
+			break;
+		}
+		for (lane = w->index; lane < p->lanes_num; lane += p->workers_num) {
+			p->run(p->owner, lane);
+		}
+		_ps_parallel_add(&p->done, 1);
+	}
+#ifdef _WIN32
+	return 0;
+#else
+	return NULL;
+#endif
+}
+
+// call from the object's new method
+PS_PARALLEL_INLINE void ps_parallel_init (t_ps_parallel* p, t_ps_parallel_run run, void* owner) {
+	p->run = run;
+	p->owner = owner;
+	p->workers_num = 0;
+	p->spin_us = 0;
+	p->lanes_num = 0;
+	p->generation = 0;
+	p->done = 0;
+	p->quit = 0;
+	p->ready = 0;
+}
+
+/*
+	barrier: returns once the workers are done with the released block, 1 if the lanes hold a block that was not output yet
+	costs nothing without workers
+*/
+PS_PARALLEL_INLINE int ps_parallel_wait (t_ps_parallel* p) {
+	double spin_start = 0.0;
+
+	while (_ps_parallel_load(&p->done) != (uint32_t) p->workers_num) {
+		if (!_ps_parallel_spin(p, &spin_start)) {
+#ifdef _WIN32
+			SwitchToThread();
+#else
+			sched_yield();
+#endif
+		}
+	}
+	return p->ready;
+}
+
+/*
+	waits for the workers and forgets their block, from a dsp method before the lane buffers are reallocated
+*/
+PS_PARALLEL_INLINE void ps_parallel_drop (t_ps_parallel* p) {
+	ps_parallel_wait(p);
+	p->ready = 0;
+}
+
+/*
+	from the perform routine, after ps_parallel_wait(): starts the workers on lanes [0, lanes_num) of a new block
+*/
+PS_PARALLEL_INLINE void ps_parallel_release (t_ps_parallel* p, int lanes_num) {
+	int i;
+
+	p->lanes_num = lanes_num;
+	p->ready = 1;
+	_ps_parallel_store(&p->done, 0);
+	_ps_parallel_store(&p->generation, p->generation + 1);
+	for (i = 0; i < p->workers_num; i++) {
+		if (_ps_parallel_exchange(&p->workers[i].sleeping, 0)) {
+#ifdef _WIN32
+			ReleaseSemaphore(p->workers[i].wake, 1, NULL);
+#else
+			sem_post(&p->workers[i].wake);
+#endif
+		}
+	}
+}
+
+/*
+	waits for the block in flight and joins the workers, the object runs on Pd's thread again
+*/
+PS_PARALLEL_INLINE void ps_parallel_stop (t_ps_parallel* p) {
+	int i;
+
+	if (p->workers_num == 0) {
+		return;
+	}
+	ps_parallel_wait(p);
+	_ps_parallel_store(&p->quit, 1);
+	_ps_parallel_store(&p->generation, p->generation + 1);
+	for (i = 0; i < p->workers_num; i++) {
+#ifdef _WIN32
+		ReleaseSemaphore(p->workers[i].wake, 1, NULL);
+		WaitForSingleObject(p->workers[i].thread, INFINITE);
+		CloseHandle(p->workers[i].thread);
+		CloseHandle(p->workers[i].wake);
+#else
+		sem_post(&p->workers[i].wake);
+		pthread_join(p->workers[i].thread, NULL);
+		sem_destroy(&p->workers[i].wake);
+#endif
+	}
+	p->workers_num = 0;
+	p->done = 0;
+	p->quit = 0;
+	p->ready = 0;
+}
+
+/*
+	stops any workers and starts workers_num new ones (at most PS_PARALLEL_WORKERS_MAX), returns how many started
+*/
+PS_PARALLEL_INLINE int ps_parallel_start (t_ps_parallel* p, int workers_num) {
+	t_ps_parallel_worker* w;
+	int i;
+
+	ps_parallel_stop(p);
+	if (workers_num > PS_PARALLEL_WORKERS_MAX) {
+		workers_num = PS_PARALLEL_WORKERS_MAX;
+	}
+	p->spin_us = workers_num < _ps_parallel_cores() ? PS_PARALLEL_SPIN_US : 0;
+
+	// the workers read workers_num to stripe the lanes, it only changes while they are stopped
+	for (i = 0; i < workers_num; i++) {
+		w = &p->workers[i];
+		w->pool = p;
+		w->index = i;
+		w->seen = p->generation;
+		w->sleeping = 0;
+#ifdef _WIN32
+		w->wake = CreateSemaphoreA(NULL, 0, 1 << 30, NULL);
+		if (w->wake == NULL) {
+			break;
+		}
+		w->thread = CreateThread(NULL, 0, _ps_parallel_worker_main, w, CREATE_SUSPENDED, NULL);
+		if (w->thread == NULL) {
+			CloseHandle(w->wake);
+			break;
+		}
+		SetThreadPriority(w->thread, GetThreadPriority(GetCurrentThread()));
+		_ps_parallel_pin(w);
+		ResumeThread(w->thread);
+#else
+		if (sem_init(&w->wake, 0, 0) != 0) {
+			break;
+		}
+		if (pthread_create(&w->thread, NULL, _ps_parallel_worker_main, w) != 0) {
+			sem_destroy(&w->wake);
+			break;
+		}
+		_ps_parallel_pin(w);
+#endif
+	}
+	p->workers_num = i;
+	// idle workers count as done, so the first wait returns at once
+	p->done = i;
+	p->ready = 0;
+	return i;
+}
+
+#endif
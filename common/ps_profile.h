@@ -0,0 +1,223 @@
+#ifndef PS_PROFILE_H
+#define PS_PROFILE_H
+
+/*
+	ps_profile.h
+
+	Optional per-object DSP profiling. Build with PS_PROFILE defined (make PROFILE=1) to time every call of an external's perform routine. Each object keeps the block count, total, min and max ns, plus a log-scale histogram that the p99 is read from. Two messages expose it:
+
+		* stats [receiver]: post "blocks, min, mean, max and p99 ns per block" to the console, or send them to receiver as the list "blocks min mean max p99"
+		* stats_reset: clear the numbers
+
+	Only the perform routine writes the counters, and the message side only reads them. stats_reset raises a flag that the next timed block acts on. That keeps the audio thread free of locks and safe against a GUI thread that queries it, as in libpd hosts. On 32-bit builds a stats read racing a block may see a torn total, which only skews one report.
+
+	Histogram buckets are exact below 8 ns, and above that each octave is split into 8 buckets, so p99 is reported to within 12.5%, rounded up and never above the max.
+
+	Without PS_PROFILE, PS_PROFILE_BEGIN/PS_PROFILE_END expand to nothing, so the perform routines are unchanged. The messages stay registered so patches load either way, and they report that profiling is compiled out.
+*/
+
+#ifdef _WIN32
+	#define PS_PROFILE_INLINE static __inline
+#else
+	#define PS_PROFILE_INLINE static inline
+#endif
+
+#ifdef PS_PROFILE
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _WIN32
+	#include <windows.h>
+	#include <intrin.h>
+#else
+	#include <time.h>
+#endif
+
+#define PS_PROFILE_STEPS 8
+#define PS_PROFILE_BUCKETS (30 * PS_PROFILE_STEPS)
+
+typedef struct _ps_profile {
+	uint64_t start;
+	volatile uint32_t reset_requested;
+	volatile uint32_t blocks;
+	volatile uint64_t total_ns;
+	volatile uint32_t min_ns;
+	volatile uint32_t max_ns;
+	volatile uint32_t histogram[PS_PROFILE_BUCKETS];
+} t_ps_profile;
+
+#define PS_PROFILE_BEGIN(p) ps_profile_begin(p)
+#define PS_PROFILE_END(p) ps_profile_end(p)
+
+PS_PROFILE_INLINE uint64_t ps_profile_now_ns (void) {
+#ifdef _WIN32
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+
+	if (frequency.QuadPart == 0) {
+		QueryPerformanceFrequency(&frequency);
+	}
+	QueryPerformanceCounter(&counter);
+	return (uint64_t) ((double) counter.QuadPart * 1e9 / (double) frequency.QuadPart);
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+#endif
+}
+
+PS_PROFILE_INLINE int ps_profile_msb (uint32_t v) {
+#if defined(__GNUC__)
+	return 31 - __builtin_clz(v);
+#elif defined(_WIN32)
+	unsigned long idx;
+
+	_BitScanReverse(&idx, v);
+	return (int) idx;
+#else
+	int idx = 0;
+
+	while (v >>= 1) {
+		idx++;
+	}
+	return idx;
+#endif
+}
+
+/*
+	histogram bucket for a duration and the largest duration a bucket holds
+*/
+PS_PROFILE_INLINE int ps_profile_bucket (uint32_t ns) {
+	int octave;
+
+	if (ns < PS_PROFILE_STEPS) {
+		return (int) ns;
+	}
+	octave = ps_profile_msb(ns);
+	return (octave - 2) * PS_PROFILE_STEPS + (int) ((ns >> (octave - 3)) & (PS_PROFILE_STEPS - 1));
+}
+
+PS_PROFILE_INLINE uint64_t ps_profile_bucket_max (int bucket) {
+	int shift;
+
+	if (bucket < PS_PROFILE_STEPS) {
+		return (uint64_t) bucket;
+	}
+	shift = bucket / PS_PROFILE_STEPS - 1;
+	return ((uint64_t) (PS_PROFILE_STEPS + bucket % PS_PROFILE_STEPS + 1) << shift) - 1;
+}
+
+PS_PROFILE_INLINE void ps_profile_begin (t_ps_profile* p) {
+	p->start = ps_profile_now_ns();
+}
+
+PS_PROFILE_INLINE void ps_profile_end (t_ps_profile* p) {
+	uint64_t elapsed = ps_profile_now_ns() - p->start;
+	uint32_t ns = elapsed > 0xffffffffu ? 0xffffffffu : (uint32_t) elapsed;
+
+	if (p->reset_requested) {
+		memset((void*) p->histogram, 0, sizeof(p->histogram));
+		p->blocks = 0;
+		p->total_ns = 0;
+		p->min_ns = 0xffffffffu;
+		p->max_ns = 0;
+		p->reset_requested = 0;
+	}
+
+	p->histogram[ps_profile_bucket(ns)]++;
+	p->total_ns += ns;
+	if (ns < p->min_ns) {
+		p->min_ns = ns;
+	}
+	if (ns > p->max_ns) {
+		p->max_ns = ns;
+	}
+	// published last so a reader never counts a block whose time is missing
+	p->blocks++;
+}
+
+// call from the object's new method; the first timed block clears the counters
+PS_PROFILE_INLINE void ps_profile_init (t_ps_profile* p) {
+	p->reset_requested = 1;
+}
+
+PS_PROFILE_INLINE void ps_profile_reset (t_ps_profile* p, const char* name) {
+	(void) name;
+	p->reset_requested = 1;
+}
+
+PS_PROFILE_INLINE void ps_profile_stats (t_ps_profile* p, const char* name, t_symbol* receiver) {
+	uint32_t blocks = p->reset_requested ? 0 : p->blocks;
+	uint32_t min_ns = 0;
+	uint32_t max_ns = 0;
+	double mean_ns = 0.0;
+	uint64_t p99_ns = 0;
+	uint32_t rank;
+	uint32_t seen = 0;
+	int bucket;
+	t_atom list[5];
+
+	if (blocks > 0) {
+		min_ns = p->min_ns;
+		max_ns = p->max_ns;
+		mean_ns = (double) p->total_ns / blocks;
+
+		// smallest bucket at or above the 99th percentile rank
+		rank = blocks - blocks / 100;
+		for (bucket = 0; bucket < PS_PROFILE_BUCKETS; bucket++) {
+			seen += p->histogram[bucket];
+			if (seen >= rank) {
+				break;
+			}
+		}
+		p99_ns = ps_profile_bucket_max(bucket);
+		if (p99_ns > max_ns) {
+			p99_ns = max_ns;
+		}
+	}
+
+	if (receiver == NULL || receiver == &s_) {
+		post("%s: %u blocks, ns per block min %u mean %.1f max %u p99 %u", name, (unsigned int) blocks, (unsigned int) min_ns, mean_ns, (unsigned int) max_ns, (unsigned int) p99_ns);
+		return;
+	}
+	if (receiver->s_thing == NULL) {
+		error("%s: stats: no receiver named %s", name, receiver->s_name);
+		return;
+	}
+	SETFLOAT(&list[0], (t_float) blocks);
+	SETFLOAT(&list[1], (t_float) min_ns);
+	SETFLOAT(&list[2], (t_float) mean_ns);
+	SETFLOAT(&list[3], (t_float) max_ns);
+	SETFLOAT(&list[4], (t_float) p99_ns);
+	pd_list(receiver->s_thing, &s_list, 5, list);
+}
+
+#else
+
+typedef struct _ps_profile {
+	char unused;
+} t_ps_profile;
+
+#define PS_PROFILE_BEGIN(p)
+#define PS_PROFILE_END(p)
+
+PS_PROFILE_INLINE void ps_profile_init (t_ps_profile* p) {
+	(void) p;
+}
+
+PS_PROFILE_INLINE void ps_profile_reset (t_ps_profile* p, const char* name) {
+	(void) p;
+	error("%s: stats_reset: compiled without PS_PROFILE", name);
+}
+
+PS_PROFILE_INLINE void ps_profile_stats (t_ps_profile* p, const char* name, t_symbol* receiver) {
+	(void) p;
+	(void) receiver;
+	error("%s: stats: compiled without PS_PROFILE", name);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,269 @@
+#ifndef PS_RTPOOL_H
+#define PS_RTPOOL_H
+
+/*
+	ps_rtpool.h
+
+	Preallocated memory pool for everything the externals allocate, so that DSP restarts and parameter messages never call the system allocator. That allocator can take a lock shared with the GUI or another Pd instance, or page fault on fresh memory, exactly when the audio deadline is near.
+
+	Each external owns one pool, an arena of PS_RTPOOL_CAPACITY bytes (4 MB by default). The arena is allocated and touched once when the class is set up (ps_rtpool_setup()). The environment variable PS_RTPOOL_MB overrides the size at load time. Blocks come in power-of-two size classes from 64 bytes up. The arena is carved from the front, and every freed block goes on its class's free list for the next request of that class. That covers the pattern here: the same tables and FFT buffers are freed and allocated again at every DSP rebuild or parameter change. Requests larger than the arena allows fall back to malloc() and are counted in ps_rtpool_fallbacks().
+
+	Allocation and free are lock-free and safe from any thread. The free lists are stacks with a tagged head, which is swapped with a 64-bit compare-and-swap, so objects of several Pd instances (common/ps_lock.h) can share a pool.
+
+	Deferred reclamation: a message handler that replaces a buffer the perform routine reads hands the old one to ps_rtpool_retire() instead of freeing it. Retired blocks collect on a list the owner keeps. The owner's perform routine hands them back to the pool with ps_rtpool_recycle() before it reads anything, so a message sent every block (an automated soften or table_size) reuses the same blocks instead of carving the arena until it runs out. Pd itself never runs a message between the halves of a perform call, but a host that does so still cannot have a buffer reused under a running block. Blocks that fell back to malloc() wait for ps_rtpool_reclaim(), which frees everything from the dsp method (the old DSP chain is gone by then) and when the owner is deleted, so free() never runs on the audio thread.
+
+	Include this before any core/ header: it points PS_CORE_CALLOC and PS_CORE_FREE (core/ps_core.h) at the pool, so core allocations such as the oversampling buffers come from it too.
+*/
+
+#ifdef PS_CORE_H
+	#error "include ps_rtpool.h before the core/ headers"
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+	#include <windows.h>
+	#define PS_RTPOOL_INLINE static __inline
+#else
+	#define PS_RTPOOL_INLINE static inline
+#endif
+
+#ifndef PS_RTPOOL_CAPACITY
+	#define PS_RTPOOL_CAPACITY (4 << 20)
+#endif
+
+// blocks and their headers are 64-byte aligned, class k holds 64 << k bytes
+#define PS_RTPOOL_ALIGN 64
+#define PS_RTPOOL_CLASSES 24
+#define PS_RTPOOL_SYSTEM (-1)
+
+#define PS_CORE_CALLOC ps_rtpool_calloc
+#define PS_CORE_FREE ps_rtpool_free
+
+#ifdef _MSC_VER
+	#define _ps_rtpool_load(p) (*(volatile uint64_t*) (p))
+	#define _ps_rtpool_cas(p, expected, desired) (InterlockedCompareExchange64((volatile LONG64*) (p), (LONG64) (desired), (LONG64) (expected)) == (LONG64) (expected))
+	#define _ps_rtpool_add(p, v) ((uint64_t) InterlockedExchangeAdd64((volatile LONG64*) (p), (LONG64) (v)))
+#else
+	#define _ps_rtpool_load(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+	#define _ps_rtpool_cas(p, expected, desired) __atomic_compare_exchange_n(p, &(expected), desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+	#define _ps_rtpool_add(p, v) __atomic_fetch_add(p, v, __ATOMIC_ACQ_REL)
+#endif
+
+// header in front of every block, one PS_RTPOOL_ALIGN unit long so the memory after it stays aligned
+typedef struct _ps_rtpool_block {
+	// retired list link, owned by whoever retired the block
+	struct _ps_rtpool_block* retired;
+	// size class, or PS_RTPOOL_SYSTEM for a malloc() fallback
+	int32_t size_class;
+	// free list link: arena offset of the next block in PS_RTPOOL_ALIGN units, 0 ends the list
+	uint32_t next;
+	unsigned char pad[PS_RTPOOL_ALIGN - sizeof(void*) - 2 * sizeof(uint32_t)];
+} t_ps_rtpool_block;
+
+typedef char _ps_rtpool_block_is_one_unit[sizeof(t_ps_rtpool_block) == PS_RTPOOL_ALIGN ? 1 : -1];
+
+typedef struct _ps_rtpool {
+	unsigned char* memory;
+	unsigned char* arena;
+	uint64_t capacity;
+	uint64_t used;
+	// free list heads: the tag in the high 32 bits, the first block's offset in the low ones
+	uint64_t free_heads[PS_RTPOOL_CLASSES];
+	uint64_t fallbacks;
+} t_ps_rtpool;
+
+typedef struct _ps_rtpool_retired {
+	t_ps_rtpool_block* head;
+} t_ps_rtpool_retired;
+
+// one pool per external
+static t_ps_rtpool ps_rtpool;
+
+/*
+	allocates and touches the arena, once per external (call it from the setup function)
+*/
+PS_RTPOOL_INLINE void ps_rtpool_setup (void) {
+	const char* mb = getenv("PS_RTPOOL_MB");
+	uint64_t capacity = mb ? (uint64_t) atoi(mb) << 20 : (uint64_t) PS_RTPOOL_CAPACITY;
+
+	if (ps_rtpool.memory) {
+		return;
+	}
+
+	// offset 0 marks the end of a free list, so the arena starts one block in
+	ps_rtpool.used = PS_RTPOOL_ALIGN;
+	ps_rtpool.memory = capacity ? (unsigned char*) malloc(capacity + PS_RTPOOL_ALIGN) : NULL;
+	if (ps_rtpool.memory == NULL) {
+		ps_rtpool.capacity = 0;
+		return;
+	}
+	ps_rtpool.arena = (unsigned char*) (((uintptr_t) ps_rtpool.memory + PS_RTPOOL_ALIGN - 1) & ~(uintptr_t) (PS_RTPOOL_ALIGN - 1));
+	ps_rtpool.capacity = capacity;
+	memset(ps_rtpool.arena, 0, (size_t) capacity);
+}
+
+/*
+	number of allocations that did not fit the arena and went to malloc()
+*/
+PS_RTPOOL_INLINE uint64_t ps_rtpool_fallbacks (void) {
+	return _ps_rtpool_load(&ps_rtpool.fallbacks);
+}
+
+PS_RTPOOL_INLINE t_ps_rtpool_block* _ps_rtpool_block_at (uint32_t offset) {
+	return (t_ps_rtpool_block*) (ps_rtpool.arena + (uint64_t) offset * PS_RTPOOL_ALIGN);
+}
+
+PS_RTPOOL_INLINE t_ps_rtpool_block* _ps_rtpool_pop (int size_class) {
+	uint64_t head = _ps_rtpool_load(&ps_rtpool.free_heads[size_class]);
+	uint64_t next;
+	t_ps_rtpool_block* block;
+
+	while ((uint32_t) head) {
+		// a block popped and reused by another thread in between changes the tag, so the swap fails and we retry
+		block = _ps_rtpool_block_at((uint32_t) head);
+		next = (((head >> 32) + 1) << 32) | block->next;
+		if (_ps_rtpool_cas(&ps_rtpool.free_heads[size_class], head, next)) {
+			return block;
+		}
+		head = _ps_rtpool_load(&ps_rtpool.free_heads[size_class]);
+	}
+	return NULL;
+}
+
+PS_RTPOOL_INLINE void _ps_rtpool_push (t_ps_rtpool_block* block) {
+	uint32_t offset = (uint32_t) (((unsigned char*) block - ps_rtpool.arena) / PS_RTPOOL_ALIGN);
+	uint64_t head;
+	uint64_t next;
+
+	do {
+		head = _ps_rtpool_load(&ps_rtpool.free_heads[block->size_class]);
+		block->next = (uint32_t) head;
+		next = (((head >> 32) + 1) << 32) | offset;
+	} while (!_ps_rtpool_cas(&ps_rtpool.free_heads[block->size_class], head, next));
+}
+
+/*
+	bytes of uninitialized memory, aligned to PS_RTPOOL_ALIGN when it comes from the arena; NULL if even malloc() failed
+*/
+PS_RTPOOL_INLINE void* ps_rtpool_alloc (size_t bytes) {
+	int size_class = 0;
+	uint64_t block_bytes;
+	uint64_t offset;
+	t_ps_rtpool_block* block;
+
+	while (size_class < PS_RTPOOL_CLASSES && ((uint64_t) PS_RTPOOL_ALIGN << size_class) < bytes) {
+		size_class++;
+	}
+
+	if (size_class < PS_RTPOOL_CLASSES && ps_rtpool.capacity) {
+		block = _ps_rtpool_pop(size_class);
+		if (block) {
+			return block + 1;
+		}
+
+		// carve a new block; an overshoot past the end is never handed out, and only leaves the tail unused
+		block_bytes = sizeof(t_ps_rtpool_block) + ((uint64_t) PS_RTPOOL_ALIGN << size_class);
+		if (_ps_rtpool_load(&ps_rtpool.used) + block_bytes <= ps_rtpool.capacity) {
+			offset = _ps_rtpool_add(&ps_rtpool.used, block_bytes);
+			if (offset + block_bytes <= ps_rtpool.capacity) {
+				block = (t_ps_rtpool_block*) (ps_rtpool.arena + offset);
+				block->size_class = size_class;
+				return block + 1;
+			}
+		}
+	}
+
+	_ps_rtpool_add(&ps_rtpool.fallbacks, 1);
+	block = (t_ps_rtpool_block*) malloc(sizeof(t_ps_rtpool_block) + bytes);
+	if (block == NULL) {
+		return NULL;
+	}
+	block->size_class = PS_RTPOOL_SYSTEM;
+	return block + 1;
+}
+
+/*
+	count * size bytes of zeroed memory, like calloc()
+*/
+PS_RTPOOL_INLINE void* ps_rtpool_calloc (size_t count, size_t size) {
+	void* memory = ps_rtpool_alloc(count * size);
+
+	if (memory) {
+		memset(memory, 0, count * size);
+	}
+	return memory;
+}
+
+/*
+	returns memory to the pool right away; only for memory no perform routine can still read (see ps_rtpool_retire())
+*/
+PS_RTPOOL_INLINE void ps_rtpool_free (void* memory) {
+	t_ps_rtpool_block* block;
+
+	if (memory == NULL) {
+		return;
+	}
+	block = (t_ps_rtpool_block*) memory - 1;
+	if (block->size_class == PS_RTPOOL_SYSTEM) {
+		free(block);
+		return;
+	}
+	_ps_rtpool_push(block);
+}
+
+/*
+	puts memory a running DSP chain may still read on the owner's retired list, to be freed by ps_rtpool_reclaim()
+*/
+PS_RTPOOL_INLINE void ps_rtpool_retire (t_ps_rtpool_retired* retired, void* memory) {
+	t_ps_rtpool_block* block;
+
+	if (memory == NULL) {
+		return;
+	}
+	block = (t_ps_rtpool_block*) memory - 1;
+	block->retired = retired->head;
+	retired->head = block;
+}
+
+/*
+	returns the arena blocks on the retired list to the pool, from the top of the owner's perform routine
+	malloc() fallbacks stay on the list for ps_rtpool_reclaim()
+*/
+PS_RTPOOL_INLINE void ps_rtpool_recycle (t_ps_rtpool_retired* retired) {
+	t_ps_rtpool_block* block = retired->head;
+	t_ps_rtpool_block* next;
+	t_ps_rtpool_block** kept = &retired->head;
+
+	while (block) {
+		next = block->retired;
+		if (block->size_class == PS_RTPOOL_SYSTEM) {
+			*kept = block;
+			kept = &block->retired;
+		}
+		else {
+			_ps_rtpool_push(block);
+		}
+		block = next;
+	}
+	*kept = NULL;
+}
+
+/*
+	frees everything on the retired list, from the dsp method or on delete
+*/
+PS_RTPOOL_INLINE void ps_rtpool_reclaim (t_ps_rtpool_retired* retired) {
+	t_ps_rtpool_block* block = retired->head;
+	t_ps_rtpool_block* next;
+
+	while (block) {
+		next = block->retired;
+		ps_rtpool_free(block + 1);
+		block = next;
+	}
+	retired->head = NULL;
+}
+
+#endif
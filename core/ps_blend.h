@@ -0,0 +1,61 @@
+#ifndef PS_BLEND_H
+#define PS_BLEND_H
+
+/*
+	ps_blend.h
+
+	Linear blend of two signals by a control signal, the core of blend~. The control is scaled by gain_ctrl and clipped to [-1.0, 1.0]. At 1.0 the output is signal 1, at -1.0 it is signal 2:
+
+		a[x] = ctrl[x] + 1.0
+		b[x] = |ctrl[x] - 1.0|
+		out[x] = [(a[x] * sig1[x]) + (b[x] * sig2[x])] / 2.0
+
+	Blending is stateless, so a block can be split or joined freely.
+*/
+
+#include "ps_core.h"
+
+#include <math.h>
+
+/*
+	blends one frame (ctrl already scaled)
+*/
+PS_CORE_INLINE ps_sample ps_blend_frame (ps_sample ctrl, ps_sample sig1, ps_sample sig2) {
+	ps_sample a;
+	ps_sample b;
+
+	// hard clip control signal
+	if (ctrl > 1.0f) {
+		ctrl = 1.0f;
+	}
+	else if (ctrl < -1.0f) {
+		ctrl = -1.0f;
+	}
+
+	// calculate a/b
+	a = (ctrl + 1.0f);
+	b = ps_fabs(ctrl - 1.0f);
+
+	return ((a * sig1) + (b * sig2)) / 2.0f;
+}
+
+/*
+	blends n frames (out may be any of the inputs)
+*/
+PS_CORE_BLOCK void ps_blend (const ps_sample* in_ctrl, const ps_sample* in_sig1, const ps_sample* in_sig2, ps_sample* out, int n, ps_sample gain_ctrl) {
+	int sample_current_idx;
+
+	for (sample_current_idx = 0; sample_current_idx < n; sample_current_idx++) {
+		*(out + sample_current_idx) = ps_blend_frame(*(in_ctrl + sample_current_idx) * gain_ctrl, *(in_sig1 + sample_current_idx), *(in_sig2 + sample_current_idx));
+	}
+}
+
+/*
+	defines ps_blend_N() for blocks of exactly N frames
+*/
+#define PS_BLEND_FIXED(N) \
+	static PS_KERNEL void ps_blend_##N (const ps_sample* in_ctrl, const ps_sample* in_sig1, const ps_sample* in_sig2, ps_sample* out, ps_sample gain_ctrl) { \
+		ps_blend(in_ctrl, in_sig1, in_sig2, out, N, gain_ctrl); \
+	}
+
+#endif
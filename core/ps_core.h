@@ -0,0 +1,89 @@
+#ifndef PS_CORE_H
+#define PS_CORE_H
+
+/*
+	ps_core.h
+
+	Configuration shared by the DSP core headers in this directory. The core is the signal processing of the externals with no Pd dependency, so the same code runs inside Pd and in any other C or C++ host:
+
+		* ps_fold.h			folder~
+		* ps_blend.h		blend~
+		* ps_wrap.h			wraparound~ (hard and softened)
+		* ps_oversample.h	half-band oversampling around a nonlinearity (folder~ and wraparound~)
+		* ps_wavetable.h	wavecap~ table interpolation, oscillator and voice bank
+		* ps_wiener.h		wiener~ windowing and spectral flatness (the FFT is left to the host)
+		* ps_denormal.h		flush-to-zero scoping for block callbacks, and the snap that keeps recursive state out of the denormal range
+
+	Everything is header-only C99 that also compiles as C++. Functions are static inline and meant to be called from the host's own block callback, which is where PS_KERNEL (common/ps_dispatch.h) belongs. Block functions take plain sample pointers and a frame count, keep their state in small structs the host owns, and never allocate (only ps_oversample_alloc() does, outside the block callback). That allocation goes through PS_CORE_CALLOC and PS_CORE_FREE, calloc() and free() unless the host defines them first (the externals point them at common/ps_rtpool.h).
+
+	Sample type:
+		ps_sample is the type of every signal buffer and of the state computed from it (phases, envelopes, tables). It is float, or double when PS_CORE_DOUBLE is 1. PS_CORE_DOUBLE follows PD_FLOATSIZE when m_pd.h was included first, so ps_sample always matches the t_sample of a Pd build, and other hosts define it before including any core header. There is one sample type per translation unit. The ps_fabs(), ps_floor() ... macros below pick the float or double version of a math function to match, so float builds never round trip through double and double builds never truncate to float. Filter coefficients (ps_oversample.h) stay float tables in both.
+
+	Block size:
+		Hosts running at a fixed block size can have a kernel compiled for it with the PS_*_FIXED(N) macros next to each block function. They define ps_fold_64() and so on with the frame count as a compile time constant, which lets the compiler unroll and drop the remainder loops. The block functions they wrap (ps_fold(), ps_blend(), ps_wrap_hard()) are PS_CORE_BLOCK, always inlined: a host with several fixed size kernels calls them from many places, and an out of line copy would be built for the baseline instruction set instead of the caller's.
+*/
+
+#include "../common/ps_dispatch.h"
+
+#ifdef _WIN32
+    #ifndef NAN
+        static const unsigned long __nan[2] = {0xffffffff, 0x7fffffff};
+        #define NAN (*(const float *) __nan)
+    #endif
+#endif
+
+#ifndef PS_CORE_DOUBLE
+	#if defined(PD_FLOATSIZE) && PD_FLOATSIZE == 64
+		#define PS_CORE_DOUBLE 1
+	#else
+		#define PS_CORE_DOUBLE 0
+	#endif
+#endif
+
+#include <math.h>
+
+#if PS_CORE_DOUBLE
+	typedef double ps_sample;
+	#define ps_fabs fabs
+	#define ps_floor floor
+	#define ps_fmod fmod
+	#define ps_sqrt sqrt
+	#define ps_exp exp
+	#define ps_log log
+	#define ps_pow pow
+	#define ps_sin sin
+	#define ps_cos cos
+#else
+	typedef float ps_sample;
+	#define ps_fabs fabsf
+	#define ps_floor floorf
+	#define ps_fmod fmodf
+	#define ps_sqrt sqrtf
+	#define ps_exp expf
+	#define ps_log logf
+	#define ps_pow powf
+	#define ps_sin sinf
+	#define ps_cos cosf
+#endif
+
+#ifndef PS_CORE_CALLOC
+	#include <stdlib.h>
+	#define PS_CORE_CALLOC calloc
+	#define PS_CORE_FREE free
+#endif
+
+#ifdef _WIN32
+	#define PS_CORE_INLINE static __inline
+#else
+	#define PS_CORE_INLINE static inline
+#endif
+
+#if defined(__GNUC__)
+	#define PS_CORE_BLOCK static inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+	#define PS_CORE_BLOCK static __forceinline
+#else
+	#define PS_CORE_BLOCK PS_CORE_INLINE
+#endif
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef PS_DENORMAL_H
+#define PS_DENORMAL_H
+
+/*
+	ps_denormal.h
+
+	Keeps denormal (subnormal) floats out of the DSP. Recursive state that decays toward zero on silent input, like an envelope follower, ends up in the denormal range below about 1e-38, and on x86 every operation on a denormal then takes a slow microcode path that can make a sample 10 to 100 times more expensive. The CPU load jumps exactly when a track goes quiet. There are two defences, and the code uses both:
+
+		* ps_denormal_begin() / ps_denormal_end() scope a block callback with flush-to-zero and denormals-are-zero set (MXCSR FTZ and DAZ on x86 SSE, FPCR FZ on AArch64). The previous mode is restored at the end, since the host and other plugins share the thread. Elsewhere they do nothing, and PS_NO_FTZ turns them off.
+		* ps_denormal_snap() sets a value below PS_DENORMAL_FLOOR (about -300 dB) to exactly zero. The recursive state in core/ goes through it, so it never reaches the denormal range even in a host that does not scope its callbacks.
+		* ps_denormal_flush() sets only denormals to zero, what FTZ/DAZ would do. State that is not recursive (the soften buffer of wraparound~ holds copies of its input) goes through it, since a double build has meaningful values far below the floor.
+
+	Usage in a block callback:
+
+		t_ps_denormal denormal = ps_denormal_begin();
+		...
+		ps_denormal_end(denormal);
+*/
+
+#include "ps_core.h"
+
+#include <float.h>
+#include <math.h>
+
+#define PS_DENORMAL_FLOOR 1e-15f
+// smallest normal ps_sample
+#if PS_CORE_DOUBLE
+	#define PS_DENORMAL_NORMAL_MIN DBL_MIN
+#else
+	#define PS_DENORMAL_NORMAL_MIN FLT_MIN
+#endif
+
+#if !defined(PS_NO_FTZ) && (defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+	#include <xmmintrin.h>
+	#define PS_DENORMAL_SSE
+	// MXCSR flush-to-zero (bit 15) and denormals-are-zero (bit 6)
+	#define PS_DENORMAL_SSE_FLAGS 0x8040u
+#elif !defined(PS_NO_FTZ) && defined(__aarch64__)
+	#define PS_DENORMAL_AARCH64
+	// FPCR flush-to-zero (bit 24), which covers inputs as well
+	#define PS_DENORMAL_AARCH64_FLAGS (1ull << 24)
+#endif
+
+// the floating point mode to restore
+typedef unsigned long long t_ps_denormal;
+
+/*
+	turns on flush-to-zero and denormals-are-zero for the calling thread, returns the mode to restore
+*/
+PS_CORE_INLINE t_ps_denormal ps_denormal_begin (void) {
+#if defined(PS_DENORMAL_SSE)
+	unsigned int csr = _mm_getcsr();
+
+	if ((csr & PS_DENORMAL_SSE_FLAGS) != PS_DENORMAL_SSE_FLAGS) {
+		_mm_setcsr(csr | PS_DENORMAL_SSE_FLAGS);
+	}
+	return csr;
+#elif defined(PS_DENORMAL_AARCH64)
+	unsigned long long fpcr;
+
+	__asm__ __volatile__ ("mrs %0, fpcr" : "=r" (fpcr));
+	if (!(fpcr & PS_DENORMAL_AARCH64_FLAGS)) {
+		__asm__ __volatile__ ("msr fpcr, %0" : : "r" (fpcr | PS_DENORMAL_AARCH64_FLAGS));
+	}
+	return fpcr;
+#else
+	return 0;
+#endif
+}
+
+/*
+	restores the mode ps_denormal_begin() returned
+*/
+PS_CORE_INLINE void ps_denormal_end (t_ps_denormal previous) {
+#if defined(PS_DENORMAL_SSE)
+	if (((unsigned int) previous & PS_DENORMAL_SSE_FLAGS) != PS_DENORMAL_SSE_FLAGS) {
+		_mm_setcsr((unsigned int) previous);
+	}
+#elif defined(PS_DENORMAL_AARCH64)
+	if (!(previous & PS_DENORMAL_AARCH64_FLAGS)) {
+		__asm__ __volatile__ ("msr fpcr, %0" : : "r" (previous));
+	}
+#else
+	(void) previous;
+#endif
+}
+
+/*
+	zero for values closer to zero than PS_DENORMAL_FLOOR, the value itself otherwise (a select, so it vectorizes)
+*/
+PS_CORE_INLINE ps_sample ps_denormal_snap (ps_sample x) {
+	return ps_fabs(x) < PS_DENORMAL_FLOOR ? 0.0f : x;
+}
+
+/*
+	zero for denormals, the value itself otherwise (a select, so it vectorizes)
+*/
+PS_CORE_INLINE ps_sample ps_denormal_flush (ps_sample x) {
+	return ps_fabs(x) < PS_DENORMAL_NORMAL_MIN ? 0.0f : x;
+}
+
+#endif
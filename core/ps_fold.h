@@ -0,0 +1,57 @@
+#ifndef PS_FOLD_H
+#define PS_FOLD_H
+
+/*
+	ps_fold.h
+
+	Wave folding over a lower and an upper threshold signal, the core of folder~. The signal and both thresholds are scaled by gain first. A frame below the lower threshold is reflected back above it and a frame above the upper threshold is reflected back below it. Folding is stateless, so a block can be split or joined (e.g. all channels as one long block) freely.
+*/
+
+#include "ps_core.h"
+
+/*
+	folds one frame
+*/
+PS_CORE_INLINE ps_sample ps_fold_frame (ps_sample sig, ps_sample lower_thresh, ps_sample upper_thresh, ps_sample gain) {
+	ps_sample frame_current_lower_thresh = lower_thresh * gain;
+	ps_sample frame_current_upper_thresh = upper_thresh * gain;
+	ps_sample frame_current_sig = sig * gain;
+	ps_sample frame_current_folded = frame_current_sig;
+	ps_sample below_lower_thresh;
+	ps_sample above_upper_thresh;
+
+	// fold over lower
+	below_lower_thresh = frame_current_lower_thresh - frame_current_sig;
+	if (below_lower_thresh > 0.0f) {
+		frame_current_folded = frame_current_lower_thresh + below_lower_thresh;
+	}
+
+	// fold over upper
+	above_upper_thresh = frame_current_sig - frame_current_upper_thresh;
+	if (above_upper_thresh > 0.0f) {
+		frame_current_folded = frame_current_upper_thresh - above_upper_thresh;
+	}
+
+	return frame_current_folded;
+}
+
+/*
+	folds n frames of sig over the thresholds (out may be any of the inputs)
+*/
+PS_CORE_BLOCK void ps_fold (const ps_sample* in_sig, const ps_sample* in_lower_thresh, const ps_sample* in_upper_thresh, ps_sample* out, int n, ps_sample gain) {
+	int frame_current_idx;
+
+	for (frame_current_idx = 0; frame_current_idx < n; frame_current_idx++) {
+		*(out + frame_current_idx) = ps_fold_frame(*(in_sig + frame_current_idx), *(in_lower_thresh + frame_current_idx), *(in_upper_thresh + frame_current_idx), gain);
+	}
+}
+
+/*
+	defines ps_fold_N() for blocks of exactly N frames
+*/
+#define PS_FOLD_FIXED(N) \
+	static PS_KERNEL void ps_fold_##N (const ps_sample* in_sig, const ps_sample* in_lower_thresh, const ps_sample* in_upper_thresh, ps_sample* out, ps_sample gain) { \
+		ps_fold(in_sig, in_lower_thresh, in_upper_thresh, out, N, gain); \
+	}
+
+#endif
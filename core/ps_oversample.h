@@ -0,0 +1,310 @@
+#ifndef PS_OVERSAMPLE_H
+#define PS_OVERSAMPLE_H
+
+/*
+	ps_oversample.h
+
+	2x, 4x and 8x oversampling for the nonlinear externals. Folding and wrapping create harmonics far above the input's band, which alias back down at the patch's sample rate. Running the nonlinearity at a multiple of the rate and filtering back down keeps most of them out. An external oversamples only its own core this way, instead of the whole subpatch running under block~.
+
+	Each factor of 2 is one half-band stage. A half-band FIR has every other tap zero except the centre one (0.5), so in polyphase form one output phase is a plain delay and the other is a symmetric sum over tap pairs. Upsampling by 2 costs taps multiplies per input frame, and decimating by 2 costs taps multiplies per output frame. The coefficient tables were designed minimax over the stopband:
+
+		* stage 0 (base rate <-> 2x): 20 pairs, 79 taps, passband to 0.44 of the base Nyquist (19.4 kHz at 44.1 kHz), stopband from 0.56 at -81 dB
+		* stage 1 (2x <-> 4x): 5 pairs, 19 taps, stopband -101 dB above the band stage 0 keeps
+		* stage 2 (4x <-> 8x): 3 pairs, 11 taps, stopband -101 dB likewise
+
+	The up and down filters together delay the signal by ps_oversample_latency() base-rate frames: 39 at 2x, 43.5 at 4x and 44.75 at 8x.
+
+	Usage from a host (see folder~ and wraparound~) with inputs_num signal inputs:
+
+		1. ps_oversample_init() when the object is created, ps_oversample_free() when it is deleted
+		2. ps_oversample_alloc() when the block size or channel count is known (the dsp method in Pd) and when the factor changes
+		3. per channel in the block callback: ps_oversample_up() every input, run the nonlinearity at factor times the block size into the output buffer, then ps_oversample_down() into the outlet
+
+	Every channel keeps its own filter history; the work buffers are shared by all channels. ps_oversample_up() copies its input before writing, so inlets and outlets may share memory as Pd allows.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ps_core.h"
+
+#define PS_OVERSAMPLE_FACTOR_MAX 8
+#define PS_OVERSAMPLE_STAGES_MAX 3
+#define PS_OVERSAMPLE_INPUTS_MAX 3
+#define PS_OVERSAMPLE_TAPS_MAX 20
+
+/*
+	half-band taps 1, 3, 5, ... frames from the centre (the centre tap is 0.5), for stages from the base rate up
+*/
+static const float ps_oversample_taps_0[20] = {
+	3.176438554e-01f, -1.041197163e-01f, 6.040384497e-02f, -4.100978990e-02f, 2.979320849e-02f,
+	-2.236448513e-02f, 1.704306260e-02f, -1.304788280e-02f, 9.965221563e-03f, -7.552637732e-03f,
+	5.655459198e-03f, -4.167070554e-03f, 3.008814018e-03f, -2.119139967e-03f, 1.447868898e-03f,
+	-9.527558342e-04f, 5.977781054e-04f, -3.521344489e-04f, 1.897084665e-04f, -1.055408580e-04f
+};
+static const float ps_oversample_taps_1[5] = {
+	3.066888385e-01f, -7.550744161e-02f, 2.392245619e-02f, -5.904197288e-03f, 8.048745958e-04f
+};
+static const float ps_oversample_taps_2[3] = {
+	2.947042191e-01f, -5.150979176e-02f, 6.809991507e-03f
+};
+
+static const float* const ps_oversample_taps[PS_OVERSAMPLE_STAGES_MAX] = {ps_oversample_taps_0, ps_oversample_taps_1, ps_oversample_taps_2};
+static const int ps_oversample_taps_num[PS_OVERSAMPLE_STAGES_MAX] = {20, 5, 3};
+
+/*
+	filter history of one channel
+	up_history holds the last 2 * taps frames fed to each upsampling stage of each input, down_even_history and down_odd_history the two phases fed to each decimating stage
+*/
+typedef struct _ps_oversample_channel {
+	ps_sample* up_history[PS_OVERSAMPLE_INPUTS_MAX][PS_OVERSAMPLE_STAGES_MAX];
+	ps_sample* down_even_history[PS_OVERSAMPLE_STAGES_MAX];
+	ps_sample* down_odd_history[PS_OVERSAMPLE_STAGES_MAX];
+} t_ps_oversample_channel;
+
+typedef struct _ps_oversample {
+	// 1 (off), 2, 4 or 8
+	int factor;
+	int stages_num;
+	int inputs_num;
+	int channels_num;
+	// base-rate block size the buffers are sized for
+	int n;
+	t_ps_oversample_channel* channels;
+	// oversampled inputs (factor * n frames each)
+	ps_sample* inputs[PS_OVERSAMPLE_INPUTS_MAX];
+	// the nonlinearity writes its factor * n frames here for ps_oversample_down()
+	ps_sample* output;
+	// staging for a stage's input behind its history (factor / 2 * n + 2 * taps frames each) and the interpolators' even phase (factor / 2 * n)
+	ps_sample* staging_a;
+	ps_sample* staging_b;
+	ps_sample* sums;
+	// histories and work buffers in one allocation
+	ps_sample* memory;
+} t_ps_oversample;
+
+/*
+	symmetric tap pairs summed into sums[0, n): sums[i] += taps[k] * scale * (x[i - taps_num - k] + x[i - taps_num + 1 + k]) for every k
+	each pass over the block takes two taps, which halves the loads and stores of sums
+*/
+PS_CORE_INLINE void _ps_oversample_sum_taps (const float* taps, int taps_num, ps_sample scale, ps_sample* x, ps_sample* sums, int n) {
+	ps_sample* before_0;
+	ps_sample* after_0;
+	ps_sample* before_1;
+	ps_sample* after_1;
+	ps_sample c_0;
+	ps_sample c_1;
+	int i;
+	int k;
+
+	for (k = 0; k + 1 < taps_num; k += 2) {
+		c_0 = scale * taps[k];
+		c_1 = scale * taps[k + 1];
+		before_0 = x - taps_num - k;
+		after_0 = x - taps_num + 1 + k;
+		before_1 = before_0 - 1;
+		after_1 = after_0 + 1;
+		for (i = 0; i < n; i++) {
+			sums[i] += c_0 * (before_0[i] + after_0[i]) + c_1 * (before_1[i] + after_1[i]);
+		}
+	}
+	if (k < taps_num) {
+		c_0 = scale * taps[k];
+		before_0 = x - taps_num - k;
+		after_0 = x - taps_num + 1 + k;
+		for (i = 0; i < n; i++) {
+			sums[i] += c_0 * (before_0[i] + after_0[i]);
+		}
+	}
+}
+
+/*
+	half-band interpolation of n frames by 2
+	in may be out, staging needs n + 2 * taps frames and sums n
+*/
+static PS_KERNEL void _ps_oversample_interpolate (const float* taps, int taps_num, ps_sample* history, ps_sample* in, ps_sample* out, int n, ps_sample* staging, ps_sample* sums) {
+	int history_n = 2 * taps_num;
+	ps_sample* x = staging + history_n;
+	int i;
+
+	memcpy(staging, history, history_n * sizeof(ps_sample));
+	memcpy(x, in, n * sizeof(ps_sample));
+
+	// even phase: symmetric tap pairs around frame i - taps_num + 0.5 (the interpolator's gain of 2 folded into the taps)
+	for (i = 0; i < n; i++) {
+		sums[i] = 0.0f;
+	}
+	_ps_oversample_sum_taps(taps, taps_num, 2.0f, x, sums, n);
+
+	// odd phase: the centre tap alone, a delay
+	for (i = 0; i < n; i++) {
+		out[2 * i] = sums[i];
+		out[2 * i + 1] = x[i - taps_num + 1];
+	}
+
+	memcpy(history, staging + n, history_n * sizeof(ps_sample));
+}
+
+/*
+	half-band decimation of 2 * n frames to n
+	in may be out, staging_even and staging_odd need n + 2 * taps frames
+*/
+static PS_KERNEL void _ps_oversample_decimate (const float* taps, int taps_num, ps_sample* even_history, ps_sample* odd_history, ps_sample* in, ps_sample* out, int n, ps_sample* staging_even, ps_sample* staging_odd) {
+	int history_n = 2 * taps_num;
+	ps_sample* even = staging_even + history_n;
+	ps_sample* odd = staging_odd + history_n;
+	int i;
+
+	memcpy(staging_even, even_history, history_n * sizeof(ps_sample));
+	memcpy(staging_odd, odd_history, history_n * sizeof(ps_sample));
+	for (i = 0; i < n; i++) {
+		even[i] = in[2 * i];
+		odd[i] = in[2 * i + 1];
+	}
+
+	// the centre tap on the odd phase, tap pairs on the even one; the odd phase is staged, so out may be in
+	for (i = 0; i < n; i++) {
+		out[i] = 0.5f * odd[i - taps_num];
+	}
+	_ps_oversample_sum_taps(taps, taps_num, 1.0f, even, out, n);
+
+	memcpy(even_history, staging_even + n, history_n * sizeof(ps_sample));
+	memcpy(odd_history, staging_odd + n, history_n * sizeof(ps_sample));
+}
+
+PS_CORE_INLINE void ps_oversample_init (t_ps_oversample* os) {
+	memset(os, 0, sizeof(t_ps_oversample));
+	os->factor = 1;
+}
+
+PS_CORE_INLINE void ps_oversample_free (t_ps_oversample* os) {
+	if (os->memory) {
+		PS_CORE_FREE(os->memory);
+	}
+	if (os->channels) {
+		PS_CORE_FREE(os->channels);
+	}
+	ps_oversample_init(os);
+}
+
+/*
+	base-rate frames of delay through the up and down filters of a factor
+*/
+PS_CORE_INLINE float ps_oversample_latency (int factor) {
+	float latency = 0.0f;
+	int stage;
+
+	for (stage = 0; (2 << stage) <= factor; stage++) {
+		latency += (2 * ps_oversample_taps_num[stage] - 1) / (float) (1 << stage);
+	}
+	return latency;
+}
+
+/*
+	(re)allocates for a factor of 1, 2, 4 or 8 with inputs_num inputs, channels_num channels and base-rate blocks of n frames, clearing the filter histories
+	returns 0 if the factor is not supported or memory ran out, leaving the oversampler off (factor 1)
+*/
+PS_CORE_INLINE int ps_oversample_alloc (t_ps_oversample* os, int factor, int inputs_num, int channels_num, int n) {
+	int stages_num = 0;
+	int history_n = 0;
+	int staging_n;
+	ps_sample* memory;
+	t_ps_oversample_channel* channel;
+	int stage;
+	int input;
+	int i;
+
+	ps_oversample_free(os);
+
+	while ((1 << stages_num) < factor) {
+		stages_num++;
+	}
+	if (factor < 1 || factor > PS_OVERSAMPLE_FACTOR_MAX || (1 << stages_num) != factor || inputs_num > PS_OVERSAMPLE_INPUTS_MAX) {
+		return 0;
+	}
+	if (factor == 1 || channels_num < 1 || n < 1) {
+		os->factor = factor;
+		os->inputs_num = inputs_num;
+		os->channels_num = channels_num;
+		os->n = n;
+		return factor == 1;
+	}
+
+	// per channel: 2 * taps frames for each input and stage going up, twice that per stage coming down
+	for (stage = 0; stage < stages_num; stage++) {
+		history_n += (inputs_num + 2) * 2 * ps_oversample_taps_num[stage];
+	}
+	staging_n = factor / 2 * n + 2 * PS_OVERSAMPLE_TAPS_MAX;
+
+	os->channels = (t_ps_oversample_channel*) PS_CORE_CALLOC(channels_num, sizeof(t_ps_oversample_channel));
+	os->memory = (ps_sample*) PS_CORE_CALLOC(channels_num * history_n + (inputs_num + 1) * factor * n + 2 * staging_n + factor / 2 * n, sizeof(ps_sample));
+	if (os->channels == NULL || os->memory == NULL) {
+		ps_oversample_free(os);
+		return 0;
+	}
+
+	memory = os->memory;
+	for (i = 0; i < channels_num; i++) {
+		channel = os->channels + i;
+		for (stage = 0; stage < stages_num; stage++) {
+			for (input = 0; input < inputs_num; input++) {
+				channel->up_history[input][stage] = memory;
+				memory += 2 * ps_oversample_taps_num[stage];
+			}
+			channel->down_even_history[stage] = memory;
+			memory += 2 * ps_oversample_taps_num[stage];
+			channel->down_odd_history[stage] = memory;
+			memory += 2 * ps_oversample_taps_num[stage];
+		}
+	}
+	for (input = 0; input < inputs_num; input++) {
+		os->inputs[input] = memory;
+		memory += factor * n;
+	}
+	os->output = memory;
+	memory += factor * n;
+	os->staging_a = memory;
+	memory += staging_n;
+	os->staging_b = memory;
+	memory += staging_n;
+	os->sums = memory;
+
+	os->factor = factor;
+	os->stages_num = stages_num;
+	os->inputs_num = inputs_num;
+	os->channels_num = channels_num;
+	os->n = n;
+	return 1;
+}
+
+/*
+	upsamples n base-rate frames of one input of a channel, returns the factor * n oversampled frames
+*/
+PS_CORE_INLINE ps_sample* ps_oversample_up (t_ps_oversample* os, int channel, int input, ps_sample* in) {
+	t_ps_oversample_channel* state = os->channels + channel;
+	ps_sample* out = os->inputs[input];
+	int n = os->n;
+	int stage;
+
+	for (stage = 0; stage < os->stages_num; stage++) {
+		_ps_oversample_interpolate(ps_oversample_taps[stage], ps_oversample_taps_num[stage], state->up_history[input][stage], stage == 0 ? in : out, out, n, os->staging_a, os->sums);
+		n *= 2;
+	}
+	return out;
+}
+
+/*
+	decimates the factor * n frames in os->output of a channel into n base-rate frames at out
+*/
+PS_CORE_INLINE void ps_oversample_down (t_ps_oversample* os, int channel, ps_sample* out) {
+	t_ps_oversample_channel* state = os->channels + channel;
+	int n = os->n * os->factor / 2;
+	int stage;
+
+	for (stage = os->stages_num - 1; stage >= 0; stage--) {
+		_ps_oversample_decimate(ps_oversample_taps[stage], ps_oversample_taps_num[stage], state->down_even_history[stage], state->down_odd_history[stage], os->output, stage == 0 ? out : os->output, n, os->staging_a, os->staging_b);
+		n /= 2;
+	}
+}
+
+#endif
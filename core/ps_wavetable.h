@@ -0,0 +1,484 @@
+#ifndef PS_WAVETABLE_H
+#define PS_WAVETABLE_H
+
+/*
+	ps_wavetable.h
+
+	Wavetable playback, the core of wavecap~: table interpolation, morphing across a stack of tables, the oscillator with its envelope follower and the voice bank. Recording tables and tracking pitch are left to the host.
+
+	A t_ps_wavetable describes the table to read. data holds slots tables of size frames each (size a power of 2), stored as ps_sample like the signals. Its interpolation is one of ps_interp_type, and windowed-sinc interpolation also needs a kernel of sinc_taps taps filled by ps_wavetable_sinc_kernel_fill(), which can be shared by every table using that tap count.
+
+	Interpolators:
+		* truncate		(nearest frame below the phase)
+		* lin_2			(2-sample linear interpolation)
+		* lin_4			(4-sample cubic interpolation)
+		* sinc			(windowed-sinc interpolation with 8, 16 or 32 taps)
+
+	Windowed-sinc interpolation:
+		Kernels are Blackman-windowed sincs tabulated at PS_WAVETABLE_SINC_PHASES fractional phases. Each row is normalized to unity DC gain, and the two rows around the fractional phase are blended linearly. Reads that do not wrap around the end of the wavetable take the dot product straight from the table with four independent accumulators, which the compiler turns into packed multiply-adds. Reads that wrap gather their taps first.
+
+	Table stack:
+		With slots above 1, a morph position in [0, slots - 1] blends the two neighbouring slots at the same phase. Interpolation is linear in the table values, so the blend is applied to the taps of both slots before one interpolation. That keeps a single phase/kernel computation and a single read loop for both tables.
+
+	Voice bank:
+		A t_ps_voices is a bank of oscillators that all read one table. Each voice has its own phase and a gate envelope that ramps toward 1.0 when its pitch is non-zero and toward 0.0 when it is released. State is kept as structure-of-arrays padded to PS_WAVETABLE_VOICE_LANES so that the per-voice loops advance several voices per SIMD instruction.
+*/
+
+#include "ps_core.h"
+#include "ps_denormal.h"
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <stdint.h>
+
+#ifndef M_PI
+	#define M_PI 3.14159265358979323846
+#endif
+
+#define PS_WAVETABLE_VOICE_LANES 8
+#define PS_WAVETABLE_SINC_PHASES 1024
+#define PS_WAVETABLE_SINC_TAPS_MAX 32
+
+typedef enum {
+	ps_interp_truncate,
+	ps_interp_lin_2,
+	ps_interp_lin_4,
+	ps_interp_sinc,
+	ps_interp_types_num
+} ps_interp_type;
+
+typedef struct _ps_wavetable {
+	ps_sample* data;
+	uint32_t size;
+	uint32_t mask;
+	int slots;
+	ps_interp_type interp;
+	int sinc_taps;
+	const ps_sample* sinc_kernel;
+} t_ps_wavetable;
+
+/*
+	oscillator state
+	the control input sets the phase increment in table lengths per sample, either directly or through the envelope follower
+*/
+typedef enum {
+	// the control input is the increment
+	ps_wavetable_ctrl_direct,
+	// the envelope of the control input is the increment
+	ps_wavetable_ctrl_envelope,
+	// the control input is ignored and increment is left as the host set it (e.g. from a pitch tracker)
+	ps_wavetable_ctrl_hold
+} ps_wavetable_ctrl;
+
+typedef struct _ps_wavetable_osc {
+	ps_sample phase;
+	ps_sample increment;
+	// envelope follower
+	ps_sample env_atk_coeff;
+	ps_sample env_dcy_coeff;
+	ps_sample env_last;
+} t_ps_wavetable_osc;
+
+/*
+	voice bank state (structure-of-arrays, lanes is num padded to PS_WAVETABLE_VOICE_LANES)
+*/
+typedef struct _ps_voices {
+	int num;
+	int lanes;
+	ps_sample* pitch;
+	ps_sample* phase;
+	ps_sample* increment;
+	ps_sample* env;
+	ps_sample* env_target;
+} t_ps_voices;
+
+/*
+	envelope follower
+*/
+
+// coefficient that takes the follower 99% of the way to a new level in ms milliseconds
+PS_CORE_INLINE ps_sample ps_env_coeff (ps_sample ms, ps_sample sample_rate) {
+	return exp(log(0.01)/(ms * sample_rate * 0.001));
+}
+
+// moves env toward target with the attack coefficient when rising and the decay coefficient when falling (snapped, a decay toward silence would otherwise stall in the denormal range)
+PS_CORE_INLINE ps_sample ps_env_follow (ps_sample env, ps_sample target, ps_sample atk_coeff, ps_sample dcy_coeff) {
+	ps_sample coeff = target > env ? atk_coeff : dcy_coeff;
+
+	return (ps_sample) ps_denormal_snap(coeff * (env - target) + target);
+}
+
+/*
+	interpolators
+*/
+
+PS_CORE_INLINE ps_sample ps_wavetable_interp_truncate (const ps_sample* wavetable, uint32_t tableMask, ps_sample phase) {
+	long longPhase = (long) phase;
+	longPhase = longPhase & tableMask;
+
+	return *(wavetable + longPhase);
+}
+
+PS_CORE_INLINE ps_sample ps_wavetable_interp_lin_2 (const ps_sample* wavetable, uint32_t tableMask, ps_sample phase) {
+	long longPhase = (long) phase;
+	ps_sample phaseMix;
+
+	longPhase = longPhase & tableMask;
+	phaseMix = phase - (ps_sample)longPhase;
+
+	// Xa * (1.0 - pM) + Xb * pM = Xa - Xa*pM + Xb*pM = Xa + pM*(Xb - Xa)
+	return *(wavetable + longPhase)
+	+ (phaseMix * (*(wavetable + ((longPhase + 1)&tableMask)) - *(wavetable + longPhase)));
+}
+
+PS_CORE_INLINE ps_sample ps_wavetable_interp_lin_4 (const ps_sample* wavetable, uint32_t tableMask, ps_sample phase) {
+	long truncphase = (long) phase;
+	ps_sample fr = phase - (ps_sample) truncphase;
+	ps_sample inm1 = wavetable[(truncphase - 1) & tableMask];
+	ps_sample in = wavetable[(truncphase + 0) & tableMask];
+	ps_sample inp1 = wavetable[(truncphase + 1) & tableMask];
+	ps_sample inp2 = wavetable[(truncphase + 2) & tableMask];
+
+	return in + 0.5 * fr * (inp1 - inm1 +
+		fr * (4.0 * inp1 + 2.0 * inm1 - 5.0 * in - inp2 +
+		fr * (3.0 * (in - inp1) - inm1 + inp2)));
+}
+
+PS_CORE_INLINE ps_sample ps_wavetable_interp_sinc (const ps_sample* wavetable, uint32_t tableMask, ps_sample phase, const ps_sample* kernel, int taps) {
+	long truncphase = (long) phase;
+	long start = truncphase - taps / 2 + 1;
+	ps_sample row_position = (phase - (ps_sample) truncphase) * PS_WAVETABLE_SINC_PHASES;
+	int row_idx = (int) row_position;
+	ps_sample row_mix;
+	const ps_sample* row;
+	const ps_sample* taps_src;
+	ps_sample taps_wrapped[PS_WAVETABLE_SINC_TAPS_MAX];
+	ps_sample acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+	int j;
+
+	if (row_idx >= PS_WAVETABLE_SINC_PHASES) {
+		row_idx = PS_WAVETABLE_SINC_PHASES - 1;
+	}
+	row_mix = row_position - (ps_sample) row_idx;
+	row = kernel + row_idx * taps;
+
+	// contiguous taps are read in place, taps that wrap around the table are gathered first
+	if (start >= 0 && (uint32_t) (start + taps) <= tableMask + 1) {
+		taps_src = wavetable + start;
+	}
+	else {
+		for (j = 0; j < taps; j++) {
+			taps_wrapped[j] = wavetable[(start + j) & tableMask];
+		}
+		taps_src = taps_wrapped;
+	}
+
+	// four independent accumulators so the dot product maps onto packed multiply-adds
+	// (row + taps is the next row, the blend between them stays inside the same loop)
+	for (j = 0; j < taps; j += 4) {
+		acc[0] += (row[j] + row_mix * (row[j + taps] - row[j])) * taps_src[j];
+		acc[1] += (row[j + 1] + row_mix * (row[j + 1 + taps] - row[j + 1])) * taps_src[j + 1];
+		acc[2] += (row[j + 2] + row_mix * (row[j + 2 + taps] - row[j + 2])) * taps_src[j + 2];
+		acc[3] += (row[j + 3] + row_mix * (row[j + 3 + taps] - row[j + 3])) * taps_src[j + 3];
+	}
+
+	return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+}
+
+/*
+	fills the kernel table for a tap count (8, 16 or 32), (PS_WAVETABLE_SINC_PHASES + 1) * taps samples
+	row p (0 to PS_WAVETABLE_SINC_PHASES inclusive) holds the taps for fractional phase p / PS_WAVETABLE_SINC_PHASES, tap j weighs table[index - taps/2 + 1 + j]
+*/
+PS_CORE_INLINE void ps_wavetable_sinc_kernel_fill (ps_sample* kernel, int taps) {
+	ps_sample* row;
+	int p;
+	int j;
+	double fraction;
+	double distance;
+	double half_width = taps / 2.0;
+	double value;
+	double sum;
+
+	for (p = 0; p <= PS_WAVETABLE_SINC_PHASES; p++) {
+		row = kernel + p * taps;
+		fraction = (double) p / PS_WAVETABLE_SINC_PHASES;
+		sum = 0.0;
+		for (j = 0; j < taps; j++) {
+			distance = (double) (j - taps / 2 + 1) - fraction;
+			value = distance == 0.0 ? 1.0 : sin(M_PI * distance) / (M_PI * distance);
+			value *= 0.42 + 0.5 * cos(M_PI * distance / half_width) + 0.08 * cos(2.0 * M_PI * distance / half_width);
+			row[j] = (ps_sample) value;
+			sum += value;
+		}
+		for (j = 0; j < taps; j++) {
+			row[j] = (ps_sample) (row[j] / sum);
+		}
+	}
+}
+
+/*
+	interpolates between the same phase of two tables, mixed by mix
+*/
+PS_CORE_INLINE ps_sample ps_wavetable_interp_morph (const ps_sample* table_a, const ps_sample* table_b, ps_sample mix, uint32_t tableMask, ps_interp_type table_interp, ps_sample phase, const ps_sample* kernel, int taps) {
+	long truncphase = (long) phase;
+	ps_sample fr = phase - (ps_sample) truncphase;
+	ps_sample blended[PS_WAVETABLE_SINC_TAPS_MAX];
+	long start;
+	int width;
+	int offset;
+	int j;
+
+	// taps each interpolator reads, and where the read point sits among them
+	switch (table_interp) {
+	case ps_interp_truncate:
+		width = 1;
+		offset = 0;
+		break;
+	case ps_interp_lin_2:
+		width = 2;
+		offset = 0;
+		break;
+	case ps_interp_lin_4:
+		width = 4;
+		offset = 1;
+		break;
+	case ps_interp_sinc:
+		width = taps;
+		offset = taps / 2 - 1;
+		break;
+	default:
+		return 0.0f;
+	}
+
+	// blend the taps of both slots once, then interpolate the blend with the phase relative to the first tap
+	start = truncphase - offset;
+	for (j = 0; j < width; j++) {
+		blended[j] = table_a[(start + j) & tableMask] + mix * (table_b[(start + j) & tableMask] - table_a[(start + j) & tableMask]);
+	}
+	phase = (ps_sample) offset + fr;
+
+	switch (table_interp) {
+	case ps_interp_truncate:
+		return blended[0];
+	case ps_interp_lin_2:
+		return ps_wavetable_interp_lin_2(blended, 1, phase);
+	case ps_interp_lin_4:
+		return ps_wavetable_interp_lin_4(blended, 3, phase);
+	default:
+		return ps_wavetable_interp_sinc(blended, taps - 1, phase, kernel, taps);
+	}
+}
+
+/*
+	splits a morph position into the two neighbouring slots and the mix between them
+*/
+PS_CORE_INLINE ps_sample ps_wavetable_morph_slots (ps_sample morph, int slots, uint32_t table_size, const ps_sample* table, const ps_sample** table_a, const ps_sample** table_b) {
+	int slot;
+
+	if (!(morph > 0.0f)) {
+		morph = 0.0f;
+	}
+	else if (morph > (ps_sample) (slots - 1)) {
+		morph = (ps_sample) (slots - 1);
+	}
+	slot = (int) morph;
+	if (slot >= slots - 1) {
+		slot = slots - 2;
+	}
+
+	*table_a = table + slot * table_size;
+	*table_b = *table_a + table_size;
+	return morph - (ps_sample) slot;
+}
+
+/*
+	reads a table at phase (between two slots of the stack at morph when there is more than one)
+*/
+PS_CORE_INLINE ps_sample ps_wavetable_read (const t_ps_wavetable* table, ps_sample phase, ps_sample morph) {
+	ps_sample morph_mix;
+	const ps_sample* morph_table_a;
+	const ps_sample* morph_table_b;
+
+	if (table->slots > 1) {
+		morph_mix = ps_wavetable_morph_slots(morph, table->slots, table->size, table->data, &morph_table_a, &morph_table_b);
+		return ps_wavetable_interp_morph(morph_table_a, morph_table_b, morph_mix, table->mask, table->interp, phase, table->sinc_kernel, table->sinc_taps);
+	}
+
+	switch (table->interp) {
+	case ps_interp_truncate:
+		return ps_wavetable_interp_truncate(table->data, table->mask, phase);
+	case ps_interp_lin_2:
+		return ps_wavetable_interp_lin_2(table->data, table->mask, phase);
+	case ps_interp_lin_4:
+		return ps_wavetable_interp_lin_4(table->data, table->mask, phase);
+	case ps_interp_sinc:
+		return ps_wavetable_interp_sinc(table->data, table->mask, phase, table->sinc_kernel, table->sinc_taps);
+	default:
+		return 0.0f;
+	}
+}
+
+/*
+	runs the oscillator for n samples
+	in_ctrl drives the increment as ctrl says, in_morph is the morph position per sample (read only with more than one slot)
+*/
+PS_CORE_INLINE void ps_wavetable_osc (const t_ps_wavetable* table, t_ps_wavetable_osc* osc, ps_wavetable_ctrl ctrl, const ps_sample* in_ctrl, const ps_sample* in_morph, ps_sample* out, int n) {
+	uint32_t table_size = table->size;
+	ps_sample phase = osc->phase;
+	ps_sample phaseIncrement = osc->increment;
+	ps_sample env_atk_coeff = osc->env_atk_coeff;
+	ps_sample env_dcy_coeff = osc->env_dcy_coeff;
+	ps_sample env_last = osc->env_last;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		// follow envelope (a held increment ignores the control input)
+		if (ctrl == ps_wavetable_ctrl_envelope) {
+			env_last = ps_env_follow(env_last, ps_fabs(in_ctrl[i]), env_atk_coeff, env_dcy_coeff);
+		}
+		else if (ctrl == ps_wavetable_ctrl_direct) {
+			env_last = in_ctrl[i];
+		}
+
+		// wavetable oscillator
+		if (ctrl != ps_wavetable_ctrl_hold) {
+			phaseIncrement = ps_fabs(env_last) * table_size;
+		}
+
+		*(out++) = ps_wavetable_read(table, phase, table->slots > 1 ? in_morph[i] : 0.0f);
+
+		phase += phaseIncrement;
+		while (phase >= (ps_sample) table_size)
+			phase = phase - (ps_sample) table_size;
+		while (phase < 0.0f)
+			phase = phase + (ps_sample) table_size;
+	}
+
+	osc->phase = phase;
+	osc->increment = phaseIncrement;
+	osc->env_last = env_last;
+}
+
+/*
+	the oscillator over a block whose control input is all ctrl_value (a zero) and whose morph position is constant, for a host that found it so; returns 0 and leaves osc alone when the phase would still move (a held increment, or an envelope not yet decayed to exactly zero), otherwise sets frame_out to the one table read every sample of the block would be
+*/
+PS_CORE_INLINE int ps_wavetable_osc_silent (const t_ps_wavetable* table, t_ps_wavetable_osc* osc, ps_wavetable_ctrl ctrl, ps_sample ctrl_value, ps_sample morph, ps_sample* frame_out) {
+	if (ctrl == ps_wavetable_ctrl_hold || ctrl_value != 0.0f || (ctrl == ps_wavetable_ctrl_envelope && osc->env_last != 0.0f)) {
+		return 0;
+	}
+	// a table shrunk under the phase is wrapped by the first frame of ps_wavetable_osc()
+	if (osc->phase < 0.0f || osc->phase >= (ps_sample) table->size) {
+		return 0;
+	}
+
+	// a direct control input is its own envelope, a decayed one stays at zero
+	if (ctrl == ps_wavetable_ctrl_direct) {
+		osc->env_last = ctrl_value;
+	}
+	osc->increment = ps_fabs(osc->env_last) * table->size;
+	*frame_out = ps_wavetable_read(table, osc->phase, table->slots > 1 ? morph : 0.0f);
+	return 1;
+}
+
+/*
+	runs every voice of the bank for n samples and writes the sum to out
+	the increments are taken from the voice pitches in Hz once per call
+*/
+PS_CORE_INLINE void ps_voices_render (const t_ps_wavetable* table, t_ps_voices* voices, ps_sample env_atk_coeff, ps_sample env_dcy_coeff, ps_sample sample_rate, const ps_sample* in_morph, ps_sample* out, int n) {
+	// pull state from struct
+	int voices_lanes = voices->lanes;
+	uint32_t table_size = table->size;
+	uint32_t table_mask = table->mask;
+	ps_sample table_size_f = (ps_sample) table_size;
+	const ps_sample* table_data = table->data;
+	int table_slots = table->slots;
+	ps_interp_type table_interp = table->interp;
+	int table_sinc_taps = table->sinc_taps;
+	const ps_sample* table_sinc_kernel = table->sinc_kernel;
+	ps_sample* voices_pitch = voices->pitch;
+	ps_sample* voices_phase = voices->phase;
+	ps_sample* voices_increment = voices->increment;
+	ps_sample* voices_env = voices->env;
+	ps_sample* voices_env_target = voices->env_target;
+
+	// create state
+	int v;
+	ps_sample increment_scale;
+	ps_sample sum;
+	ps_sample voices_out[PS_WAVETABLE_VOICE_LANES];
+	ps_sample* lane_phase;
+	ps_sample* lane_env;
+	int lane;
+	ps_sample morph_mix = 0.0f;
+	const ps_sample* morph_table_a = table_data;
+	const ps_sample* morph_table_b = table_data;
+
+	// phase increments only change at block boundaries. Reduced below a table length (a pitch at or above the sample rate aliases anyway) they leave the phase wrapped by one subtraction per frame, once a phase left past the end of a table another instance shrank is back inside it
+	increment_scale = sample_rate > 0.0f ? table_size_f / sample_rate : 0.0f;
+	for (v = 0; v < voices_lanes; v++) {
+		voices_increment[v] = ps_fmod(voices_pitch[v] * increment_scale, table_size_f);
+		voices_phase[v] = ps_fmod(voices_phase[v], table_size_f);
+	}
+
+	while (n--) {
+		// every voice morphs with the same position
+		if (table_slots > 1) {
+			morph_mix = ps_wavetable_morph_slots(*in_morph++, table_slots, table_size, table_data, &morph_table_a, &morph_table_b);
+		}
+
+		sum = 0.0f;
+		for (lane = 0; lane < voices_lanes; lane += PS_WAVETABLE_VOICE_LANES) {
+			lane_phase = voices_phase + lane;
+			lane_env = voices_env + lane;
+
+			// gate envelopes (the same follower as the oscillator, driven by the voice target)
+			for (v = 0; v < PS_WAVETABLE_VOICE_LANES; v++) {
+				lane_env[v] = ps_env_follow(lane_env[v], voices_env_target[lane + v], env_atk_coeff, env_dcy_coeff);
+			}
+
+			// table reads (the gather itself is scalar, the switch is hoisted out of the voice loop)
+			if (table_slots > 1) {
+				for (v = 0; v < PS_WAVETABLE_VOICE_LANES; v++) {
+					voices_out[v] = ps_wavetable_interp_morph(morph_table_a, morph_table_b, morph_mix, table_mask, table_interp, lane_phase[v], table_sinc_kernel, table_sinc_taps);
+				}
+			}
+			else switch (table_interp) {
+			case ps_interp_truncate:
+				for (v = 0; v < PS_WAVETABLE_VOICE_LANES; v++) {
+					voices_out[v] = ps_wavetable_interp_truncate(table_data, table_mask, lane_phase[v]);
+				}
+				break;
+			case ps_interp_lin_2:
+				for (v = 0; v < PS_WAVETABLE_VOICE_LANES; v++) {
+					voices_out[v] = ps_wavetable_interp_lin_2(table_data, table_mask, lane_phase[v]);
+				}
+				break;
+			case ps_interp_lin_4:
+				for (v = 0; v < PS_WAVETABLE_VOICE_LANES; v++) {
+					voices_out[v] = ps_wavetable_interp_lin_4(table_data, table_mask, lane_phase[v]);
+				}
+				break;
+			case ps_interp_sinc:
+				for (v = 0; v < PS_WAVETABLE_VOICE_LANES; v++) {
+					voices_out[v] = ps_wavetable_interp_sinc(table_data, table_mask, lane_phase[v], table_sinc_kernel, table_sinc_taps);
+				}
+				break;
+			default:
+				for (v = 0; v < PS_WAVETABLE_VOICE_LANES; v++) {
+					voices_out[v] = 0.0f;
+				}
+			}
+
+			// mix and advance phases
+			for (v = 0; v < PS_WAVETABLE_VOICE_LANES; v++) {
+				sum += lane_env[v] * voices_out[v];
+				lane_phase[v] += voices_increment[lane + v];
+				lane_phase[v] -= lane_phase[v] >= table_size_f ? table_size_f : 0.0f;
+			}
+		}
+
+		*(out++) = sum;
+	}
+}
+
+#endif
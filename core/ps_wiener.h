@@ -0,0 +1,121 @@
+#ifndef PS_WIENER_H
+#define PS_WIENER_H
+
+/*
+	ps_wiener.h
+
+	Spectral flatness ("Wiener entropy"), the core of wiener~: the ratio of the geometric mean of the power (or amplitude) spectrum to its arithmetic mean. White noise approaches 1.0 and a pure sine wave tone approaches 0.0.
+
+	The FFT itself is left to the host, wiener~ uses KissFFT. A block is analyzed as:
+
+		1. ps_wiener_window_apply() with a window filled once by ps_wiener_window_hann() (or no window at all for a rectangle)
+		2. a real forward FFT of the block
+		3. ps_wiener_entropy() over the bins, given as interleaved real and imaginary parts (the layout of kiss_fft_cpx)
+
+	A small epsilon is added to each bin power so silence gives a sane 1.0 rather than a division by zero.
+
+	ps_wiener_bin_level() is the spectrum the entropy is computed from, one bin at a time, for hosts that also display or export it.
+*/
+
+#include "ps_core.h"
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#ifndef M_PI
+	#define M_PI 3.14159265358979323846
+#endif
+
+#define PS_WIENER_EPSILON 1e-20
+
+/*
+	fills n frames of a Hann window
+*/
+PS_CORE_INLINE void ps_wiener_window_hann (ps_sample* window, int n) {
+	int i;
+	double window_value;
+
+	// state for hann window functions
+	double cos_inner_value = 0.0;
+	double cos_inner_increment = (2.0 * M_PI) / ((double) (n - 1));
+
+	for (i = 0; i < n; i++) {
+		window_value = 0.5 * (1.0 - cos(cos_inner_value));
+		cos_inner_value += cos_inner_increment;
+		*window++ = (ps_sample) window_value;
+	}
+}
+
+/*
+	windows n frames of in into out
+*/
+PS_CORE_INLINE void ps_wiener_window_apply (const ps_sample* window, const ps_sample* in, ps_sample* out, int n) {
+	while (n--) {
+		*out++ = (*window++) * (*in++);
+	}
+}
+
+/*
+	level of one bin: its power or amplitude (including the epsilon, so silence reads -200 dB rather than -inf), or that level in dB
+*/
+PS_CORE_INLINE ps_sample ps_wiener_bin_level (ps_sample bin_r, ps_sample bin_i, int power_spectrum, int db) {
+	double bin_power = bin_r * bin_r + bin_i * bin_i + PS_WIENER_EPSILON;
+
+	// power and amplitude are the same level in dB
+	if (db) {
+		return (ps_sample) (10.0 * log10(bin_power));
+	}
+	return (ps_sample) (power_spectrum ? bin_power : sqrt(bin_power));
+}
+
+/*
+	spectral flatness of bins_num bins (interleaved real and imaginary parts), of the power spectrum if power_spectrum is set and of the amplitude spectrum otherwise
+*/
+PS_CORE_INLINE ps_sample ps_wiener_entropy (const ps_sample* bins, int bins_num, int power_spectrum) {
+	double bins_num_d = (double) bins_num;
+	int i;
+	ps_sample bin_r;
+	ps_sample bin_i;
+	double bin_amplitude;
+	double bin_power;
+	double bins_amplitude_sum = 0.0;
+	double bins_power_sum = 0.0;
+	double bins_amplitude_sum_ln = 0.0;
+	double bins_power_sum_ln = 0.0;
+	double wiener_numerator;
+	double wiener_denominator;
+
+	for (i = 0; i < bins_num; i++) {
+		bin_r = bins[2 * i];
+		bin_i = bins[2 * i + 1];
+
+		// calculate bin magnitude
+		bin_power = bin_r * bin_r + bin_i * bin_i + PS_WIENER_EPSILON;
+
+		// sum power
+		if (power_spectrum) {
+			bins_power_sum += bin_power;
+			bins_power_sum_ln += log(bin_power);
+		}
+		// sum amplitude
+		else {
+			bin_amplitude = sqrt(bin_power);
+
+			bins_amplitude_sum += bin_amplitude;
+			bins_amplitude_sum_ln += log(bin_amplitude);
+		}
+	}
+
+	// calculate wiener entropy
+	if (power_spectrum) {
+		wiener_numerator = exp(bins_power_sum_ln / bins_num_d);
+		wiener_denominator = bins_power_sum / bins_num_d;
+	}
+	else {
+		wiener_numerator = exp(bins_amplitude_sum_ln / bins_num_d);
+		wiener_denominator = bins_amplitude_sum / bins_num_d;
+	}
+	return (ps_sample) (wiener_numerator / wiener_denominator);
+}
+
+#endif
@@ -0,0 +1,238 @@
+#ifndef PS_WRAP_H
+#define PS_WRAP_H
+
+/*
+	ps_wrap.h
+
+	Amplitude wraparound, the core of wraparound~. A frame outside [-1.0, 1.0] is moved by steps of 2.0 until it is back inside, as if the signal lived on a cylinder.
+
+	Hard wrapping leaves discontinuities wherever the signal crosses the boundary. Softening smooths them: the hard wrapped frames also go through a soften_n frame circular buffer, and for soften_n frames after every change between wrapped and unwrapped the output is the exponential moving average of that buffer, decaying by alpha per frame into the past.
+
+	Each signal (channel) keeps a t_ps_wrap. The soften buffer belongs to the host: point soften_buffer at soften_n zeroed frames with ps_wrap_soften_reset() whenever soften_n changes.
+*/
+
+#include "ps_core.h"
+#include "ps_denormal.h"
+
+#include <math.h>
+
+typedef struct _ps_wrap {
+	// buffer head
+	int soften_buffer_idx;
+	// buffer (soften_n frames, owned by the host)
+	ps_sample* soften_buffer;
+	// keeps track of frame timer for softening (active if less than soften_n)
+	int soften_buffer_active_n;
+	// keeps track of if the last sample was wrapped for sample block transitions
+	int wrapped_last;
+} t_ps_wrap;
+
+/*
+	attaches a (zeroed) soften buffer of soften_n frames and marks softening inactive
+*/
+PS_CORE_INLINE void ps_wrap_soften_reset (t_ps_wrap* wrap, ps_sample* soften_buffer, int soften_n) {
+	wrap->soften_buffer_idx = 0;
+	wrap->soften_buffer = soften_buffer;
+	wrap->soften_buffer_active_n = soften_n;
+}
+
+/*
+	a single wrap step: exact for frames within [-3.0, 3.0], as selects rather than branches
+*/
+PS_CORE_INLINE ps_sample ps_wrap_step (ps_sample frame_current) {
+	frame_current = frame_current < -1.0f ? frame_current + 2.0f : frame_current;
+	frame_current = frame_current > 1.0f ? frame_current - 2.0f : frame_current;
+	return frame_current;
+}
+
+/*
+	wraps one frame, setting wrapped_current if it was outside [-1.0, 1.0]
+*/
+PS_CORE_INLINE ps_sample ps_wrap_frame (ps_sample frame_current, int* wrapped_current) {
+	*wrapped_current = (frame_current < -1.0f) | (frame_current > 1.0f);
+	if (frame_current >= -3.0f && frame_current <= 3.0f) {
+		return ps_wrap_step(frame_current);
+	}
+	while (frame_current < -1.0f) {
+		frame_current += 2.0f;
+	}
+	while (frame_current > 1.0f) {
+		frame_current -= 2.0f;
+	}
+	return frame_current;
+}
+
+/*
+	retrieves the nth past frame in the history of the soften buffer
+	returns NAN if n is negative or greater than or equal to buffer size
+*/
+PS_CORE_INLINE ps_sample ps_wrap_soften_retrieve (const t_ps_wrap* wrap, int soften_n, int n) {
+	int soften_buffer_idx_requested;
+
+	if (n < 0 || n >= soften_n) {
+		return NAN;
+	}
+
+	soften_buffer_idx_requested = wrap->soften_buffer_idx - 1 - n;
+	if (soften_buffer_idx_requested < 0) {
+		soften_buffer_idx_requested += soften_n;
+	}
+	return wrap->soften_buffer[soften_buffer_idx_requested];
+}
+
+/*
+	pushes a frame onto the soften buffer (flushed, so a signal fading out leaves no denormals in it)
+	soften_buffer_idx always points to the place where the next frame will go
+*/
+PS_CORE_INLINE void ps_wrap_soften_push (t_ps_wrap* wrap, int soften_n, ps_sample frame) {
+	wrap->soften_buffer[wrap->soften_buffer_idx++] = ps_denormal_flush(frame);
+	if (wrap->soften_buffer_idx >= soften_n) {
+		wrap->soften_buffer_idx = 0;
+	}
+}
+
+/*
+	calculates the exponential decay moving average for the current frame (slower DEBUG version which calls ps_wrap_soften_retrieve)
+*/
+PS_CORE_INLINE ps_sample ps_wrap_soften_average_debug (const t_ps_wrap* wrap, int soften_n, ps_sample soften_alpha) {
+	ps_sample dividend = 0.0f;
+	ps_sample divisor = 0.0f;
+	int i;
+	ps_sample i_alpha;
+
+	for (i = 0; i < soften_n; i++) {
+		i_alpha = ps_denormal_flush(pow(soften_alpha, i));
+		dividend += i_alpha * ps_wrap_soften_retrieve(wrap, soften_n, i);
+		divisor += i_alpha;
+	}
+	return dividend/divisor;
+}
+
+/*
+	calculates the exponential decay moving average for the current frame (faster version which wraps the circular buffer internally)
+	weights alpha^i that would be denormal (a small alpha with a long buffer) are flushed to zero
+*/
+PS_CORE_INLINE ps_sample ps_wrap_soften_average (const t_ps_wrap* wrap, int soften_n, ps_sample soften_alpha) {
+	ps_sample dividend = 0.0f;
+	ps_sample divisor = 0.0f;
+	int i = 0;
+	int soften_buffer_idx = wrap->soften_buffer_idx - 1;
+	int soften_buffer_idx_before_add = soften_buffer_idx;
+	ps_sample i_alpha;
+
+	while (i <= soften_buffer_idx_before_add) {
+		i_alpha = ps_denormal_flush(pow(soften_alpha, i));
+		dividend += i_alpha * wrap->soften_buffer[soften_buffer_idx--];
+		divisor += i_alpha;
+		i++;
+	}
+	soften_buffer_idx += soften_n;
+	while (i < soften_n) {
+		i_alpha = ps_denormal_flush(pow(soften_alpha, i));
+		dividend += i_alpha * wrap->soften_buffer[soften_buffer_idx--];
+		divisor += i_alpha;
+		i++;
+	}
+
+	return dividend/divisor;
+}
+
+/*
+	wraps and softens one frame
+*/
+PS_CORE_INLINE ps_sample ps_wrap_soften_frame (t_ps_wrap* wrap, int soften_n, ps_sample soften_alpha, ps_sample frame_current) {
+	int wrapped_current;
+	ps_sample frame_current_wrapped = ps_wrap_frame(frame_current, &wrapped_current);
+
+	// push hard wrapped frame onto soften buffer
+	ps_wrap_soften_push(wrap, soften_n, frame_current_wrapped);
+
+	// if we're switching from unwrapped to wrapped or vice versa activate softening
+	if (wrapped_current ^ wrap->wrapped_last) {
+		wrap->soften_buffer_active_n = 0;
+	}
+	wrap->wrapped_last = wrapped_current;
+
+	// if we're actively softening then continue to do so
+	if (wrap->soften_buffer_active_n < soften_n) {
+		wrap->soften_buffer_active_n++;
+		return ps_wrap_soften_average(wrap, soften_n, soften_alpha);
+	}
+	return frame_current_wrapped;
+}
+
+/*
+	hard wraps n frames of in scaled by gain (out may be in)
+
+	Frames within [-3.0, 3.0] need at most one step (ps_wrap_step), so a first pass scales the block and checks that every frame is in range, and the wrap then runs branch-free. Blocks that need more (or contain NaN) take the loops in ps_wrap_frame.
+*/
+PS_CORE_BLOCK void ps_wrap_hard (t_ps_wrap* wrap, const ps_sample* in, ps_sample* out, int n, ps_sample gain) {
+	int in_range = 1;
+	int wrapped_current = wrap->wrapped_last;
+	int frame_current_idx;
+
+	if (n <= 0) {
+		return;
+	}
+
+	for (frame_current_idx = 0; frame_current_idx < n; frame_current_idx++) {
+		out[frame_current_idx] = in[frame_current_idx] * gain;
+		in_range &= (out[frame_current_idx] >= -3.0f) & (out[frame_current_idx] <= 3.0f);
+	}
+	if (in_range) {
+		wrapped_current = (out[n - 1] < -1.0f) | (out[n - 1] > 1.0f);
+		for (frame_current_idx = 0; frame_current_idx < n; frame_current_idx++) {
+			out[frame_current_idx] = ps_wrap_step(out[frame_current_idx]);
+		}
+	}
+	else {
+		for (frame_current_idx = 0; frame_current_idx < n; frame_current_idx++) {
+			out[frame_current_idx] = ps_wrap_frame(out[frame_current_idx], &wrapped_current);
+		}
+	}
+	// ideally we would push onto the soften buffer here for maximum accuracy at transition time but we don't have a size for that yet
+	wrap->wrapped_last = wrapped_current;
+}
+
+/*
+	wraps and softens n frames of in scaled by gain (out may be in)
+*/
+PS_CORE_INLINE void ps_wrap_soften (t_ps_wrap* wrap, int soften_n, ps_sample soften_alpha, const ps_sample* in, ps_sample* out, int n, ps_sample gain) {
+	int frame_current_idx;
+
+	for (frame_current_idx = 0; frame_current_idx < n; frame_current_idx++) {
+		out[frame_current_idx] = ps_wrap_soften_frame(wrap, soften_n, soften_alpha, in[frame_current_idx] * gain);
+	}
+}
+
+/*
+	softens n frames that are all frame_current (already scaled), for a host that found its block constant; returns 0 and leaves wrap alone when that would not be a constant output (softening is active, or the constant crosses the wrap boundary and starts it), otherwise sets frame_out and leaves the soften buffer as n pushes of it would
+*/
+PS_CORE_INLINE int ps_wrap_soften_constant (t_ps_wrap* wrap, int soften_n, ps_sample frame_current, int n, ps_sample* frame_out) {
+	int wrapped_current;
+	ps_sample frame_current_wrapped = ps_wrap_frame(frame_current, &wrapped_current);
+	int pushes = n < soften_n ? n : soften_n;
+	int i;
+
+	if (wrap->soften_buffer_active_n < soften_n || wrapped_current != wrap->wrapped_last) {
+		return 0;
+	}
+
+	// only the last soften_n pushes stay in the buffer, and they are all the same frame
+	wrap->soften_buffer_idx = (wrap->soften_buffer_idx + n - pushes) % soften_n;
+	for (i = 0; i < pushes; i++) {
+		ps_wrap_soften_push(wrap, soften_n, frame_current_wrapped);
+	}
+	*frame_out = frame_current_wrapped;
+	return 1;
+}
+
+/*
+	defines ps_wrap_hard_N() for blocks of exactly N frames
+*/
+#define PS_WRAP_HARD_FIXED(N) \
+	static PS_KERNEL void ps_wrap_hard_##N (t_ps_wrap* wrap, const ps_sample* in, ps_sample* out, ps_sample gain) { \
+		ps_wrap_hard(wrap, in, out, N, gain); \
+	}
+
+#endif
@@ -12,93 +12,290 @@
 
 #include "m_pd.h"
 
+#include "../common/ps_bypass.h"
+#include "../common/ps_dispatch.h"
+#include "../common/ps_events.h"
+#include "../common/ps_lock.h"
+#include "../common/ps_multichannel.h"
+#include "../common/ps_profile.h"
+#include "../common/ps_rtpool.h"
+#include "../core/ps_fold.h"
+#include "../core/ps_oversample.h"
+#include "../core/ps_denormal.h"
+
 /*
 	folder~
 	Chris Donahue (http://cdonahue.me) 2014
 
-	This external is a wave folder with a twist! Instead of folding over a simple linear threshold, this external folds an audio signal over two signals representing the lower and upper threshold. Can be used as a traditional wave folder by folding over linear threshold signals.
+	This external is a wave folder with a twist! Instead of folding over a simple linear threshold, this external folds an audio signal over two signals representing the lower and upper threshold. Can be used as a traditional wave folder by folding over linear threshold signals. The folding itself is ps_fold() in core/ps_fold.h.
 
 	Inlets from left to right are:
 
 		1. audio signal to fold
 		2. lower threshold of folding
 		3. upper threshold of folding
+
+	All three inlets take multichannel signals (Pd 0.54+). The output has as many channels as the widest input, and an input with fewer channels is reused across them (see common/ps_multichannel.h).
+
+	Accepts the following messages:
+
+		1. "oversample": Expects 1, 2, 4 or 8. Folds at that multiple of the sample rate with half-band filters around it, so the harmonics that folding creates alias far less (see core/ps_oversample.h). All three inlets are upsampled. The output is delayed by ps_oversample_latency() frames (39 at 2x). 1 turns it off [default]
+		2. "gain": Expects the gain and an optional delay in ms. The change lands on the exact frame it is due at rather than the next block boundary (see common/ps_events.h), with the delay counted from the message's logical time like vline~. A float on the left inlet still sets it from the next block
+		3. "stats": Posts min/mean/max/p99 DSP time per block, or sends them to the receiver named by an optional symbol. Needs a PS_PROFILE build (see common/ps_profile.h)
+		4. "stats_reset": Clears the DSP timings
+		5. "bypass_stats": Posts how many channel blocks ran and how many were bypassed because their inputs were silent or constant, or sends them to the receiver named by an optional symbol (see common/ps_bypass.h)
+		6. "bypass_stats_reset": Clears the bypass counters
+		7. "bypass_enable", "bypass_disable": Turns the bypass on [default] or off
 */
 
 static t_class* folder_class;
+static t_ps_lock folder_setup_lock = PS_LOCK_INIT;
 
 typedef struct _folder {
     t_object x_obj;
 	// parameters
 	// amplitude gain for input signal
     t_float gain;
+	// requested oversampling factor and the oversampler sized for the current dsp chain
+	int oversample_factor;
+	t_ps_oversample oversample;
+	// perform timings (empty unless built with PS_PROFILE)
+	t_ps_profile profile;
+	// silent and constant block bypass (see common/ps_bypass.h)
+	t_ps_bypass bypass;
+	// sample-accurate gain changes (see common/ps_events.h)
+	t_ps_events events;
 } t_folder;
 
+enum {
+	folder_event_gain
+};
+
 /*
-	float receiever on second inlet to set gain
+	applies a gain change outside the perform routine (see ps_events_send())
 */
-void folder_gain (t_folder* x, t_float f) {
-	x->gain = f;
-	post("gain: %f", x->gain);
+static void _folder_event (void* owner, const t_ps_event* event) {
+	((t_folder*) owner)->gain = event->value;
+}
+
+/*
+	message receiver to set gain, delay_ms from now
+*/
+void folder_gain (t_folder* x, t_float f, t_floatarg delay_ms) {
+	ps_events_send(&x->events, x, _folder_event, folder_event_gain, f, delay_ms);
+	post("gain: %f", f);
+}
+
+/*
+	message receiver to set the oversampling factor
+*/
+void folder_oversample (t_folder* x, t_floatarg f) {
+	int factor = (int) f;
+
+	if (factor != 1 && factor != 2 && factor != 4 && factor != 8) {
+		error("oversample factor must be 1, 2, 4 or 8");
+		return;
+	}
+	x->oversample_factor = factor;
+
+	// resize now if dsp already ran, otherwise the next dsp call does
+	if (x->oversample.n > 0 && !ps_oversample_alloc(&x->oversample, factor, 3, x->oversample.channels_num, x->oversample.n)) {
+		error("oversample: out of memory, running at 1x");
+		return;
+	}
+
+	post("oversample: %d (latency %g samples)", factor, ps_oversample_latency(factor));
 }
 
 /*
-	main dsp callback
+	folds one channel split at the gain changes of the block, each segment with the gain due at its first frame (factor frames per base-rate frame)
 */
-static t_int* folder_perform (t_int* w) {
+static PS_KERNEL void _folder_fold_events (const t_ps_event* events, int events_num, t_float gain, t_float* in_sig, t_float* in_lower_thresh, t_float* in_upper_thresh, t_float* out, int n, int factor) {
+	int event = 0;
+	int start;
+	int end;
+
+	for (start = 0; start < n; start = end) {
+		while (event < events_num && events[event].offset <= start) {
+			gain = events[event++].value;
+		}
+		end = event < events_num ? events[event].offset : n;
+		ps_fold(in_sig + start * factor, in_lower_thresh + start * factor, in_upper_thresh + start * factor, out + start * factor, (end - start) * factor, gain);
+	}
+}
+
+/*
+	main dsp callback, for blocks of exactly fixed_n frames when that is not 0
+*/
+PS_KERNEL_BODY t_int* _folder_perform (t_int* w, int fixed_n) {
 	// parse args
 	t_folder* x = (t_folder*) w[1];
-    t_float* in_sig = (t_float*) w[2];
-    t_float* in_lower_thresh = (t_float*) w[3];
-	t_float* in_upper_thresh = (t_float*) w[4];
+    t_float* in_sig_vec = (t_float*) w[2];
+    t_float* in_lower_thresh_vec = (t_float*) w[3];
+	t_float* in_upper_thresh_vec = (t_float*) w[4];
     t_float* out = (t_float*) w[5];
-    int n = (int) w[6];
+    int n = fixed_n ? fixed_n : (int) w[6];
+	int nchans = (int) w[7];
+	int nchans_sig = (int) w[8];
+	int nchans_lower_thresh = (int) w[9];
+	int nchans_upper_thresh = (int) w[10];
 
 	// pull state from struct
-	float gain = x->gain;
+	t_float gain = x->gain;
+	t_ps_oversample* oversample = &x->oversample;
+	int oversample_factor = oversample->factor;
+	int bypass_enabled = x->bypass.enabled;
+	int events_num = ps_events_block(&x->events, n);
+	const t_ps_event* events = x->events.pending;
 
 	// create state
-	int folded_current;
-	int frame_current_idx = 0;
-	float frame_current_sig;
-	float frame_current_lower_thresh;
-	float below_lower_thresh;
-	float frame_current_upper_thresh;
-	float above_upper_thresh;
-	float frame_current_folded;
-
-	while (n--) {
-		frame_current_lower_thresh = *(in_lower_thresh + frame_current_idx) * gain;
-		frame_current_upper_thresh = *(in_upper_thresh + frame_current_idx) * gain;
-		frame_current_sig = *(in_sig + frame_current_idx) * gain;
-		frame_current_folded = frame_current_sig;
-		folded_current = 0;
-		
-		// fold over lower
-		below_lower_thresh = frame_current_lower_thresh - frame_current_sig;
-		if (below_lower_thresh > 0.0f) {
-			frame_current_folded = frame_current_lower_thresh + below_lower_thresh;
-			folded_current = 1;
-		}
+	t_ps_denormal denormal;
+	int channel;
+	t_float* in_sig;
+	t_float* in_lower_thresh;
+	t_float* in_upper_thresh;
+	t_sample frame;
+	int channel_blocks = nchans;
+	int bypassed = 0;
 
-		// fold over upper
-		above_upper_thresh = frame_current_sig - frame_current_upper_thresh;
-		if (above_upper_thresh > 0.0f) {
-			frame_current_folded = frame_current_upper_thresh - above_upper_thresh;
-			folded_current = 1;
-		}
+	PS_PROFILE_BEGIN(&x->profile);
+	denormal = ps_denormal_begin();
 
-		*(out + frame_current_idx++) = frame_current_folded;
+	// folding is stateless, so when every input has all channels they are one long block (not so the oversampling filters or gain changes within the block, and a single channel stays as it is, which keeps a fixed n constant)
+	if (oversample_factor == 1 && events_num == 0 && nchans > 1 && nchans_sig == nchans && nchans_lower_thresh == nchans && nchans_upper_thresh == nchans) {
+		n *= nchans;
+		nchans = 1;
 	}
 
-    return (w + 7);
+	for (channel = 0; channel < nchans; channel++) {
+		in_sig = ps_channel(in_sig_vec, channel, nchans_sig, n);
+		in_lower_thresh = ps_channel(in_lower_thresh_vec, channel, nchans_lower_thresh, n);
+		in_upper_thresh = ps_channel(in_upper_thresh_vec, channel, nchans_upper_thresh, n);
+
+		if (oversample_factor == 1) {
+			if (events_num > 0) {
+				_folder_fold_events(events, events_num, gain, in_sig, in_lower_thresh, in_upper_thresh, out, n, 1);
+			}
+			// constant inputs fold to one constant frame (see common/ps_bypass.h)
+			else if (bypass_enabled && ps_bypass_constant(in_sig, n) && ps_bypass_constant(in_lower_thresh, n) && ps_bypass_constant(in_upper_thresh, n)) {
+				ps_fold(in_sig, in_lower_thresh, in_upper_thresh, &frame, 1, gain);
+				ps_bypass_fill(out, frame, n);
+				// a merged block stands for every channel
+				bypassed += channel_blocks / nchans;
+			}
+			else {
+				ps_fold(in_sig, in_lower_thresh, in_upper_thresh, out, n, gain);
+			}
+		}
+		else {
+			in_sig = ps_oversample_up(oversample, channel, 0, in_sig);
+			in_lower_thresh = ps_oversample_up(oversample, channel, 1, in_lower_thresh);
+			in_upper_thresh = ps_oversample_up(oversample, channel, 2, in_upper_thresh);
+			if (events_num > 0) {
+				_folder_fold_events(events, events_num, gain, in_sig, in_lower_thresh, in_upper_thresh, oversample->output, n, oversample_factor);
+			}
+			else {
+				ps_fold(in_sig, in_lower_thresh, in_upper_thresh, oversample->output, n * oversample_factor, gain);
+			}
+			ps_oversample_down(oversample, channel, out);
+		}
+		out += n;
+	}
+	if (events_num > 0) {
+		x->gain = events[events_num - 1].value;
+	}
+
+	ps_denormal_end(denormal);
+	ps_bypass_count(&x->bypass, channel_blocks, bypassed);
+	PS_PROFILE_END(&x->profile);
+
+    return (w + 11);
+}
+
+/*
+	perform routines for any block size and for the common fixed ones, picked in folder_dsp
+*/
+static PS_KERNEL t_int* folder_perform (t_int* w) {
+	return _folder_perform(w, 0);
+}
+
+static PS_KERNEL t_int* folder_perform_64 (t_int* w) {
+	return _folder_perform(w, 64);
+}
+
+static PS_KERNEL t_int* folder_perform_128 (t_int* w) {
+	return _folder_perform(w, 128);
+}
+
+static PS_KERNEL t_int* folder_perform_256 (t_int* w) {
+	return _folder_perform(w, 256);
+}
+
+/*
+	pd callback: per-block DSP timings, see common/ps_profile.h
+*/
+static void folder_stats (t_folder* x, t_symbol* receiver) {
+	ps_profile_stats(&x->profile, "folder~", receiver);
+}
+
+static void folder_stats_reset (t_folder* x) {
+	ps_profile_reset(&x->profile, "folder~");
+}
+
+/*
+	pd callback: silent and constant block bypass, see common/ps_bypass.h
+*/
+static void folder_bypass_stats (t_folder* x, t_symbol* receiver) {
+	ps_bypass_stats(&x->bypass, "folder~", receiver);
+}
+
+static void folder_bypass_stats_reset (t_folder* x) {
+	ps_bypass_reset(&x->bypass);
+}
+
+static void folder_bypass_enable (t_folder* x) {
+	ps_bypass_enable(&x->bypass, "folder~", 1);
+}
+
+static void folder_bypass_disable (t_folder* x) {
+	ps_bypass_enable(&x->bypass, "folder~", 0);
 }
 
 /*
 	pd callback: register dsp
 */
 static void folder_dsp (t_folder* x, t_signal** sp) {
-    dsp_add(folder_perform, 6, x, sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, sp[3]->s_vec, sp[0]->s_n);
+	int nchans = PS_SIGNAL_NCHANS(sp[0]);
+	t_perfroutine perform;
+
+	if (PS_SIGNAL_NCHANS(sp[1]) > nchans) {
+		nchans = PS_SIGNAL_NCHANS(sp[1]);
+	}
+	if (PS_SIGNAL_NCHANS(sp[2]) > nchans) {
+		nchans = PS_SIGNAL_NCHANS(sp[2]);
+	}
+	ps_signal_setmultiout(&sp[3], nchans);
+
+	if (!ps_oversample_alloc(&x->oversample, x->oversample_factor, 3, nchans, sp[0]->s_n)) {
+		error("oversample: out of memory, running at 1x");
+	}
+	ps_events_dsp(&x->events, sp[0]->s_sr, sp[0]->s_n);
+
+	switch (sp[0]->s_n) {
+	case 64:
+		perform = folder_perform_64;
+		break;
+	case 128:
+		perform = folder_perform_128;
+		break;
+	case 256:
+		perform = folder_perform_256;
+		break;
+	default:
+		perform = folder_perform;
+	}
+
+    dsp_add(perform, 10, x, sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, sp[3]->s_vec, sp[0]->s_n, nchans, PS_SIGNAL_NCHANS(sp[0]), PS_SIGNAL_NCHANS(sp[1]), PS_SIGNAL_NCHANS(sp[2]));
 }
 
 /*
@@ -107,6 +304,11 @@ static void folder_dsp (t_folder* x, t_signal** sp) {
 static void* folder_new (t_floatarg f) {
     t_folder* x = (t_folder*) pd_new(folder_class);
 	x->gain = f;
+	x->oversample_factor = 1;
+	ps_oversample_init(&x->oversample);
+	ps_profile_init(&x->profile);
+	ps_bypass_init(&x->bypass);
+	ps_events_init(&x->events);
 
     inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, &s_signal);
     inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, &s_signal);
@@ -115,13 +317,37 @@ static void* folder_new (t_floatarg f) {
     return (void*) x;
 }
 
+/*
+	pd callback: delete object
+*/
+static void folder_delete (t_folder* x) {
+	ps_oversample_free(&x->oversample);
+}
+
 /*
 	pd callback: setup object
 */
 void folder_tilde_setup (void) {
-    folder_class = class_new(gensym("folder~"), (t_newmethod) folder_new, 0, sizeof(t_folder), 0, A_DEFFLOAT, 0);
+	ps_lock(&folder_setup_lock);
+	if (folder_class) {
+		ps_unlock(&folder_setup_lock);
+		return;
+	}
 
-    class_addmethod(folder_class, (t_method) folder_gain, gensym("gain"), A_FLOAT, 0);
+	// the oversampling buffers come from the pool (see common/ps_rtpool.h)
+	ps_rtpool_setup();
+    folder_class = class_new(gensym("folder~"), (t_newmethod) folder_new, (t_method) folder_delete, sizeof(t_folder), PS_CLASS_MULTICHANNEL, A_DEFFLOAT, 0);
+
+    class_addmethod(folder_class, (t_method) folder_gain, gensym("gain"), A_FLOAT, A_DEFFLOAT, 0);
+    class_addmethod(folder_class, (t_method) folder_oversample, gensym("oversample"), A_FLOAT, 0);
+    class_addmethod(folder_class, (t_method) folder_stats, gensym("stats"), A_DEFSYM, 0);
+    class_addmethod(folder_class, (t_method) folder_stats_reset, gensym("stats_reset"), A_NULL, 0);
+    class_addmethod(folder_class, (t_method) folder_bypass_stats, gensym("bypass_stats"), A_DEFSYM, 0);
+    class_addmethod(folder_class, (t_method) folder_bypass_stats_reset, gensym("bypass_stats_reset"), A_NULL, 0);
+    class_addmethod(folder_class, (t_method) folder_bypass_enable, gensym("bypass_enable"), A_NULL, 0);
+    class_addmethod(folder_class, (t_method) folder_bypass_disable, gensym("bypass_disable"), A_NULL, 0);
     CLASS_MAINSIGNALIN(folder_class, t_folder, gain);
     class_addmethod(folder_class, (t_method) folder_dsp, gensym("dsp"), A_CANT, 0);
+
+	ps_unlock(&folder_setup_lock);
 }
\ No newline at end of file
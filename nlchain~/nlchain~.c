@@ -0,0 +1,664 @@
+#ifdef NT
+#pragma warning( disable : 4244 )
+#pragma warning( disable : 4305 )
+#endif
+
+// pthread_setaffinity_np() for the worker threads (common/ps_parallel.h)
+#define _GNU_SOURCE
+
+#ifdef _WIN32
+    #ifndef NAN
+        static const unsigned long __nan[2] = {0xffffffff, 0x7fffffff};
+        #define NAN (*(const float *) __nan)
+    #endif
+#endif
+
+#include "m_pd.h"
+
+#include "../common/ps_bypass.h"
+#include "../common/ps_dispatch.h"
+#include "../common/ps_lock.h"
+#include "../common/ps_multichannel.h"
+#include "../common/ps_parallel.h"
+#include "../common/ps_profile.h"
+#include "../common/ps_rtpool.h"
+#include "../core/ps_blend.h"
+#include "../core/ps_fold.h"
+#include "../core/ps_wrap.h"
+#include "../core/ps_denormal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+	nlchain~
+
+	This external runs folder~, wraparound~ and blend~ as one object. Every sample goes through all stages in a single loop, so the chain costs one perform call and no intermediate signal buffers. The stages are the same core functions the separate objects run (core/ps_fold.h, core/ps_wrap.h and core/ps_blend.h), so the output matches them patched in series bit for bit (folder~ -> wraparound~ -> blend~ with the chain input as blend~'s second signal).
+
+	Creation arguments are the stages in processing order, any of:
+
+		* fold	(folder~: folds over a lower and an upper threshold signal)
+		* wrap	(wraparound~: hard or softened wraparound into [-1.0, 1.0])
+		* blend	(blend~: control signal blend of the chain so far (signal 1) and the dry input (signal 2))
+
+	No arguments is the usual voice, "fold wrap blend".
+
+	Inlets from left to right are:
+
+		1. audio signal
+		2. lower threshold of folding (only with a fold stage)
+		3. upper threshold of folding (only with a fold stage)
+		4. blend control signal (only with a blend stage)
+
+	All inlets take multichannel signals (Pd 0.54+, see common/ps_multichannel.h). Each wrap stage of each channel keeps its own wraparound state, like one wraparound~ per stage.
+
+	A bank of many channels can run on worker threads instead of Pd's own (threads n, see common/ps_parallel.h). The channels are spread over the workers, which compute a block while Pd runs the rest of the DSP chain, and the outlet gets it at the next block, so the output is one block late and otherwise the same. A bank of softened wraparounds is the chain "wrap" with soften. Changing threads while DSP runs drops one block. stats then times only what the object costs Pd's thread: the copies to and from the workers, and any wait for them.
+
+	Accepts the following messages:
+		* fold_gain f			(folder~ gain on the signal and both thresholds) [default 1]
+		* wrap_gain f			(wraparound~ gain) [default 1]
+		* soften n alpha		(wraparound~ softening with an n frame exponential moving average decaying by alpha)
+		* hard					(wraparound~ without softening) [default]
+		* threads n				(run the channels on n worker threads, one block late; 0 runs them on Pd's thread) [default 0]
+		* stats [receiver]		(post DSP time per block, or send it to receiver; needs a PS_PROFILE build, see common/ps_profile.h)
+		* stats_reset			(clear the DSP timings)
+		* bypass_stats [receiver]	(post channel blocks run and bypassed for silent or constant input, or send them to receiver; see common/ps_bypass.h)
+		* bypass_stats_reset	(clear the bypass counters)
+		* bypass_enable		(turn the bypass on) [default]
+		* bypass_disable		(turn the bypass off)
+*/
+
+#define NLCHAIN_STAGES_MAX 8
+#define NLCHAIN_CHUNK 64
+// a lane holds the four inlets and the outlet of one channel
+#define NLCHAIN_LANE_VECS 5
+
+static t_class* nlchain_class;
+static t_ps_lock nlchain_setup_lock = PS_LOCK_INIT;
+
+typedef enum {
+	stage_fold,
+	stage_wrap,
+	stage_blend
+} nlchain_stage;
+
+typedef struct _nlchain {
+    t_object x_obj;
+	t_float f;
+
+	// stages in processing order
+	int stages_num;
+	nlchain_stage stages[NLCHAIN_STAGES_MAX];
+	int has_fold;
+	int has_blend;
+	// wrap stages in the list, at least 1 so every channel has a wrap state
+	int wraps_num;
+
+	// parameters
+	t_float fold_gain;
+	t_float wrap_gain;
+	int hard;
+	int soften_n;
+	t_float soften_alpha;
+
+	// wrap state of every wrap stage of every channel (wraps_num per channel), with their soften buffers in one contiguous block
+	int channels_num;
+	t_ps_wrap* wraps;
+	t_sample* soften_buffers;
+	// soften buffers and lanes replaced while dsp runs, recycled at the next block (see common/ps_rtpool.h)
+	t_ps_rtpool_retired retired;
+
+	// worker threads, with one lane of NLCHAIN_LANE_VECS block_n vectors per channel (NULL without workers, see common/ps_parallel.h)
+	t_ps_parallel parallel;
+	int block_n;
+	t_sample* lanes;
+	// whether each lane's last block was bypassed
+	int* lanes_bypassed;
+
+	// perform timings (empty unless built with PS_PROFILE)
+	t_ps_profile profile;
+	// silent and constant block bypass (see common/ps_bypass.h)
+	t_ps_bypass bypass;
+} t_nlchain;
+
+/*
+	internal state helpers
+*/
+
+static void _nlchain_soften_buffers_alloc (t_nlchain* x) {
+	int wraps_total = x->channels_num * x->wraps_num;
+	int i;
+
+	ps_rtpool_retire(&x->retired, x->soften_buffers);
+	x->soften_buffers = NULL;
+	if (x->soften_n > 0) {
+		x->soften_buffers = (t_sample*) ps_rtpool_calloc(x->soften_n * wraps_total, sizeof(t_sample));
+	}
+	for (i = 0; i < wraps_total; i++) {
+		ps_wrap_soften_reset(&x->wraps[i], x->soften_buffers ? x->soften_buffers + i * x->soften_n : NULL, x->soften_n);
+	}
+}
+
+static void _nlchain_channels_alloc (t_nlchain* x, int channels_num) {
+	ps_rtpool_free(x->wraps);
+	x->channels_num = channels_num;
+	x->wraps = (t_ps_wrap*) ps_rtpool_calloc(channels_num * x->wraps_num, sizeof(t_ps_wrap));
+	_nlchain_soften_buffers_alloc(x);
+}
+
+static void _nlchain_lanes_alloc (t_nlchain* x) {
+	ps_rtpool_retire(&x->retired, x->lanes);
+	ps_rtpool_retire(&x->retired, x->lanes_bypassed);
+	x->lanes = NULL;
+	x->lanes_bypassed = NULL;
+	if (x->parallel.workers_num > 0 && x->block_n > 0) {
+		x->lanes = (t_sample*) ps_rtpool_calloc(NLCHAIN_LANE_VECS * x->block_n * x->channels_num, sizeof(t_sample));
+		x->lanes_bypassed = (int*) ps_rtpool_calloc(x->channels_num, sizeof(int));
+	}
+}
+
+/*
+	message receivers
+*/
+
+static void nlchain_fold_gain (t_nlchain* x, t_float f) {
+	ps_parallel_wait(&x->parallel);
+	x->fold_gain = f;
+	post("fold_gain: %f", x->fold_gain);
+}
+
+static void nlchain_wrap_gain (t_nlchain* x, t_float f) {
+	ps_parallel_wait(&x->parallel);
+	x->wrap_gain = f;
+	post("wrap_gain: %f", x->wrap_gain);
+}
+
+static void nlchain_soften (t_nlchain* x, t_floatarg soften_n, t_floatarg soften_alpha) {
+	if (soften_n < 2.0f) {
+		error("soften buffer length must be greater than 2");
+		return;
+	}
+	if (soften_alpha < 0.0f) {
+		error("soften alpha decay must be greater than 0");
+		return;
+	}
+
+	ps_parallel_wait(&x->parallel);
+	x->hard = 0;
+	x->soften_n = (int) soften_n;
+	x->soften_alpha = soften_alpha;
+	_nlchain_soften_buffers_alloc(x);
+
+	post("soften: n=%d, alpha=%f", x->soften_n, x->soften_alpha);
+}
+
+static void nlchain_hard (t_nlchain* x) {
+	ps_parallel_wait(&x->parallel);
+	x->hard = 1;
+	post("hard");
+}
+
+static void nlchain_threads (t_nlchain* x, t_floatarg f) {
+	int threads = f > 0.0f ? (int) f : 0;
+
+	if (ps_parallel_start(&x->parallel, threads) < threads) {
+		error("nlchain~: threads: started %d of %d worker threads", x->parallel.workers_num, threads);
+	}
+	_nlchain_lanes_alloc(x);
+
+	post("threads: %d", x->parallel.workers_num);
+}
+
+/*
+	one channel of any stage list
+
+	The stages run one after another over chunks of NLCHAIN_CHUNK frames held on the stack, so every stage is a tight loop the compiler can vectorize like the separate objects, while the chunk stays in L1. Stepping the stages per sample instead leaves the fold and wrap conditions as unpredictable branches. wraps holds the channel's wrap state of each wrap stage in order.
+*/
+static PS_KERNEL void _nlchain_run (t_nlchain* x, t_ps_wrap* wraps, t_float* in, t_float* in_lower_thresh, t_float* in_upper_thresh, t_float* in_ctrl, t_float* out, int n) {
+	t_sample frames[NLCHAIN_CHUNK];
+	t_float fold_gain = x->fold_gain;
+	t_float wrap_gain = x->wrap_gain;
+	int hard = x->hard;
+	t_ps_wrap* wrap;
+	int chunk_n;
+	int offset;
+	int i;
+	int s;
+
+	for (offset = 0; offset < n; offset += NLCHAIN_CHUNK) {
+		chunk_n = n - offset < NLCHAIN_CHUNK ? n - offset : NLCHAIN_CHUNK;
+
+		// out is written only after the last stage, it may be the same buffer as in
+		for (i = 0; i < chunk_n; i++) {
+			frames[i] = in[offset + i];
+		}
+
+		wrap = wraps;
+		for (s = 0; s < x->stages_num; s++) {
+			switch (x->stages[s]) {
+				case stage_fold:
+					ps_fold(frames, in_lower_thresh + offset, in_upper_thresh + offset, frames, chunk_n, fold_gain);
+					break;
+				case stage_wrap:
+					if (hard) {
+						ps_wrap_hard(wrap, frames, frames, chunk_n, wrap_gain);
+					}
+					else {
+						ps_wrap_soften(wrap, x->soften_n, x->soften_alpha, frames, frames, chunk_n, wrap_gain);
+					}
+					wrap++;
+					break;
+				case stage_blend:
+					// blend~'s default control gain of 1
+					ps_blend(in_ctrl + offset, frames, in + offset, frames, chunk_n, 1.0f);
+					break;
+			}
+		}
+
+		for (i = 0; i < chunk_n; i++) {
+			out[offset + i] = frames[i];
+		}
+	}
+}
+
+/*
+	one channel of the default "fold wrap blend" chain with a hard wrap, the stage order fixed at compile time
+
+	wraparound~ wraps with a loop per sample when a frame is far out of range, which keeps the whole chain from vectorizing. Frames within [-3.0, 3.0] need at most one step of 2.0 (ps_wrap_step), so a first pass checks that every frame of the block is in range and the fused loop then runs branch-free. Blocks that need more (or contain NaN) go through _nlchain_run, which has the loops.
+*/
+static PS_KERNEL void _nlchain_run_fold_wrap_blend (t_nlchain* x, t_ps_wrap* wraps, t_float* in, t_float* in_lower_thresh, t_float* in_upper_thresh, t_float* in_ctrl, t_float* out, int n) {
+	t_float fold_gain = x->fold_gain;
+	t_float wrap_gain = x->wrap_gain;
+	int in_range = 1;
+	int i;
+	t_sample dry;
+	t_sample frame;
+
+	if (n <= 0) {
+		return;
+	}
+
+	for (i = 0; i < n; i++) {
+		frame = ps_fold_frame(in[i], in_lower_thresh[i], in_upper_thresh[i], fold_gain) * wrap_gain;
+		in_range &= (frame >= -3.0f) & (frame <= 3.0f);
+	}
+	if (!in_range) {
+		_nlchain_run(x, wraps, in, in_lower_thresh, in_upper_thresh, in_ctrl, out, n);
+		return;
+	}
+
+	// wraparound~ keeps whether the last frame of the block wrapped (read before out can overwrite an aliased input)
+	frame = ps_fold_frame(in[n - 1], in_lower_thresh[n - 1], in_upper_thresh[n - 1], fold_gain) * wrap_gain;
+	wraps[0].wrapped_last = frame < -1.0f || frame > 1.0f;
+
+	for (i = 0; i < n; i++) {
+		dry = in[i];
+		frame = ps_fold_frame(dry, in_lower_thresh[i], in_upper_thresh[i], fold_gain) * wrap_gain;
+		frame = ps_wrap_step(frame);
+		out[i] = ps_blend_frame(in_ctrl[i], frame, dry);
+	}
+}
+
+/*
+	one channel whose inputs are all constant over n frames: runs the stages on one frame (see common/ps_bypass.h)
+	returns 0 and leaves the channel alone when softening cannot take the block as constant (see ps_wrap_soften_constant())
+*/
+static int _nlchain_run_constant (t_nlchain* x, t_ps_wrap* wraps, t_float* in, t_float* in_lower_thresh, t_float* in_upper_thresh, t_float* in_ctrl, int n, t_sample* frame_out) {
+	t_sample frame = in[0];
+	t_ps_wrap* wrap = wraps;
+	int s;
+
+	// a later softened wrap could refuse the block after an earlier one has advanced its state
+	if (!x->hard && x->wraps_num > 1) {
+		return 0;
+	}
+
+	for (s = 0; s < x->stages_num; s++) {
+		switch (x->stages[s]) {
+			case stage_fold:
+				ps_fold(&frame, in_lower_thresh, in_upper_thresh, &frame, 1, x->fold_gain);
+				break;
+			case stage_wrap:
+				if (x->hard) {
+					ps_wrap_hard(wrap, &frame, &frame, 1, x->wrap_gain);
+				}
+				else if (!ps_wrap_soften_constant(wrap, x->soften_n, frame * x->wrap_gain, n, &frame)) {
+					return 0;
+				}
+				wrap++;
+				break;
+			case stage_blend:
+				ps_blend(in_ctrl, &frame, in, &frame, 1, 1.0f);
+				break;
+		}
+	}
+
+	*frame_out = frame;
+	return 1;
+}
+
+/*
+	one channel through whichever loop fits it, returns 1 if the channel was bypassed
+*/
+static int _nlchain_channel (t_nlchain* x, t_ps_wrap* wraps, t_float* in, t_float* in_lower_thresh, t_float* in_upper_thresh, t_float* in_ctrl, t_float* out, int n, int fixed) {
+	t_sample frame;
+
+	// constant inputs run the chain once (see common/ps_bypass.h)
+	if (x->bypass.enabled && ps_bypass_constant(in, n) && ps_bypass_constant(in_lower_thresh, n) && ps_bypass_constant(in_upper_thresh, n) && ps_bypass_constant(in_ctrl, n) && _nlchain_run_constant(x, wraps, in, in_lower_thresh, in_upper_thresh, in_ctrl, n, &frame)) {
+		ps_bypass_fill(out, frame, n);
+		return 1;
+	}
+	if (fixed) {
+		_nlchain_run_fold_wrap_blend(x, wraps, in, in_lower_thresh, in_upper_thresh, in_ctrl, out, n);
+	}
+	else {
+		_nlchain_run(x, wraps, in, in_lower_thresh, in_upper_thresh, in_ctrl, out, n);
+	}
+	return 0;
+}
+
+static int _nlchain_fixed (t_nlchain* x) {
+	return x->hard && x->stages_num == 3 && x->stages[0] == stage_fold && x->stages[1] == stage_wrap && x->stages[2] == stage_blend;
+}
+
+/*
+	worker thread callback: one channel of the released block, from its lane to its lane (see common/ps_parallel.h)
+*/
+static void _nlchain_lane (void* owner, int lane) {
+	t_nlchain* x = (t_nlchain*) owner;
+	int n = x->block_n;
+	t_sample* in = x->lanes + lane * NLCHAIN_LANE_VECS * n;
+	t_ps_denormal denormal = ps_denormal_begin();
+
+	// absent stages read the input, like in the perform routine
+	x->lanes_bypassed[lane] = _nlchain_channel(x, x->wraps + lane * x->wraps_num, in, x->has_fold ? in + n : in, x->has_fold ? in + 2 * n : in, x->has_blend ? in + 3 * n : in, in + 4 * n, n, _nlchain_fixed(x));
+	ps_denormal_end(denormal);
+}
+
+/*
+	with worker threads: hands the block to the lanes and outputs the one they computed during the last tick (zeros when there is none)
+	returns the channel blocks of the output that were bypassed
+*/
+static int _nlchain_lanes_exchange (t_nlchain* x, t_float* in_vec, t_float* in_lower_thresh_vec, t_float* in_upper_thresh_vec, t_float* in_ctrl_vec, t_float* out, int n, int nchans, int nchans_in, int nchans_lower_thresh, int nchans_upper_thresh, int nchans_ctrl) {
+	int ready = ps_parallel_wait(&x->parallel);
+	size_t vec_size = n * sizeof(t_sample);
+	int bypassed = 0;
+	t_sample* lane;
+	int channel;
+
+	// every input is copied before any output, out may share memory with the inlets
+	for (channel = 0; channel < nchans; channel++) {
+		lane = x->lanes + channel * NLCHAIN_LANE_VECS * n;
+		memcpy(lane, ps_channel(in_vec, channel, nchans_in, n), vec_size);
+		if (x->has_fold) {
+			memcpy(lane + n, ps_channel(in_lower_thresh_vec, channel, nchans_lower_thresh, n), vec_size);
+			memcpy(lane + 2 * n, ps_channel(in_upper_thresh_vec, channel, nchans_upper_thresh, n), vec_size);
+		}
+		if (x->has_blend) {
+			memcpy(lane + 3 * n, ps_channel(in_ctrl_vec, channel, nchans_ctrl, n), vec_size);
+		}
+	}
+	for (channel = 0; channel < nchans; channel++) {
+		if (ready) {
+			memcpy(out + channel * n, x->lanes + (channel * NLCHAIN_LANE_VECS + 4) * n, vec_size);
+			bypassed += x->lanes_bypassed[channel];
+		}
+		else {
+			memset(out + channel * n, 0, vec_size);
+		}
+	}
+
+	ps_parallel_release(&x->parallel, nchans);
+	return bypassed;
+}
+
+/*
+	main dsp callback
+*/
+static t_int* nlchain_perform (t_int* w) {
+	// parse args
+	t_nlchain* x = (t_nlchain*) w[1];
+	t_float* in_vec = (t_float*) w[2];
+	t_float* in_lower_thresh_vec = (t_float*) w[3];
+	t_float* in_upper_thresh_vec = (t_float*) w[4];
+	t_float* in_ctrl_vec = (t_float*) w[5];
+	t_float* out = (t_float*) w[6];
+	int n = (int) w[7];
+	int nchans = (int) w[8];
+	int nchans_in = (int) w[9];
+	int nchans_lower_thresh = (int) w[10];
+	int nchans_upper_thresh = (int) w[11];
+	int nchans_ctrl = (int) w[12];
+
+	// pick the loop once per block
+	int fixed = _nlchain_fixed(x);
+
+	// create state
+	t_ps_denormal denormal;
+	int channel;
+	t_float* in;
+	t_float* in_lower_thresh;
+	t_float* in_upper_thresh;
+	t_float* in_ctrl;
+	int bypassed = 0;
+
+	PS_PROFILE_BEGIN(&x->profile);
+	// buffers a message replaced since the last block go back to the pool (see common/ps_rtpool.h)
+	ps_rtpool_recycle(&x->retired);
+
+	if (x->lanes != NULL) {
+		bypassed = _nlchain_lanes_exchange(x, in_vec, in_lower_thresh_vec, in_upper_thresh_vec, in_ctrl_vec, out, n, nchans, nchans_in, nchans_lower_thresh, nchans_upper_thresh, nchans_ctrl);
+		ps_bypass_count(&x->bypass, nchans, bypassed);
+		PS_PROFILE_END(&x->profile);
+		return (w + 13);
+	}
+
+	denormal = ps_denormal_begin();
+
+	for (channel = 0; channel < nchans; channel++) {
+		in = ps_channel(in_vec, channel, nchans_in, n);
+		// absent stages leave their inlets unused, point them at the input so the loops never see NULL
+		in_lower_thresh = x->has_fold ? ps_channel(in_lower_thresh_vec, channel, nchans_lower_thresh, n) : in;
+		in_upper_thresh = x->has_fold ? ps_channel(in_upper_thresh_vec, channel, nchans_upper_thresh, n) : in;
+		in_ctrl = x->has_blend ? ps_channel(in_ctrl_vec, channel, nchans_ctrl, n) : in;
+
+		bypassed += _nlchain_channel(x, x->wraps + channel * x->wraps_num, in, in_lower_thresh, in_upper_thresh, in_ctrl, out, n, fixed);
+		out += n;
+	}
+
+	ps_denormal_end(denormal);
+	ps_bypass_count(&x->bypass, nchans, bypassed);
+	PS_PROFILE_END(&x->profile);
+
+	return (w + 13);
+}
+
+/*
+	pd callback: per-block DSP timings, see common/ps_profile.h
+*/
+static void nlchain_stats (t_nlchain* x, t_symbol* receiver) {
+	ps_profile_stats(&x->profile, "nlchain~", receiver);
+}
+
+static void nlchain_stats_reset (t_nlchain* x) {
+	ps_profile_reset(&x->profile, "nlchain~");
+}
+
+/*
+	pd callback: silent and constant block bypass, see common/ps_bypass.h
+*/
+static void nlchain_bypass_stats (t_nlchain* x, t_symbol* receiver) {
+	ps_bypass_stats(&x->bypass, "nlchain~", receiver);
+}
+
+static void nlchain_bypass_stats_reset (t_nlchain* x) {
+	ps_bypass_reset(&x->bypass);
+}
+
+static void nlchain_bypass_enable (t_nlchain* x) {
+	ps_parallel_wait(&x->parallel);
+	ps_bypass_enable(&x->bypass, "nlchain~", 1);
+}
+
+static void nlchain_bypass_disable (t_nlchain* x) {
+	ps_parallel_wait(&x->parallel);
+	ps_bypass_enable(&x->bypass, "nlchain~", 0);
+}
+
+/*
+	pd callback: register dsp
+*/
+static void nlchain_dsp (t_nlchain* x, t_signal** sp) {
+	// inlets are the input, the fold thresholds if there is a fold stage and the control if there is a blend stage, then the outlet
+	t_signal* in = sp[0];
+	t_signal* lower_thresh = x->has_fold ? sp[1] : sp[0];
+	t_signal* upper_thresh = x->has_fold ? sp[2] : sp[0];
+	t_signal* ctrl = x->has_blend ? sp[1 + 2 * x->has_fold] : sp[0];
+	int outlet_idx = 1 + 2 * x->has_fold + x->has_blend;
+	int nchans = PS_SIGNAL_NCHANS(in);
+
+	if (PS_SIGNAL_NCHANS(lower_thresh) > nchans) {
+		nchans = PS_SIGNAL_NCHANS(lower_thresh);
+	}
+	if (PS_SIGNAL_NCHANS(upper_thresh) > nchans) {
+		nchans = PS_SIGNAL_NCHANS(upper_thresh);
+	}
+	if (PS_SIGNAL_NCHANS(ctrl) > nchans) {
+		nchans = PS_SIGNAL_NCHANS(ctrl);
+	}
+	// the workers are done with the old chain's last block before its buffers change
+	ps_parallel_drop(&x->parallel);
+	ps_rtpool_reclaim(&x->retired);
+	if (nchans != x->channels_num) {
+		_nlchain_channels_alloc(x, nchans);
+	}
+	x->block_n = in->s_n;
+	_nlchain_lanes_alloc(x);
+	ps_signal_setmultiout(&sp[outlet_idx], nchans);
+
+	dsp_add(nlchain_perform, 12, x, in->s_vec, lower_thresh->s_vec, upper_thresh->s_vec, ctrl->s_vec, sp[outlet_idx]->s_vec, in->s_n, nchans, PS_SIGNAL_NCHANS(in), PS_SIGNAL_NCHANS(lower_thresh), PS_SIGNAL_NCHANS(upper_thresh), PS_SIGNAL_NCHANS(ctrl));
+}
+
+/*
+	pd callback: initialize object
+*/
+static void* nlchain_new (t_symbol* selector, int argc, t_atom* argv) {
+	t_nlchain* x = (t_nlchain*) pd_new(nlchain_class);
+	const char* name;
+	int i;
+
+	x->f = 0.0f;
+	x->fold_gain = 1.0f;
+	x->wrap_gain = 1.0f;
+	x->hard = 1;
+	x->soften_n = 0;
+	x->soften_alpha = 0.0f;
+	x->wraps = NULL;
+	x->soften_buffers = NULL;
+	x->retired.head = NULL;
+	ps_parallel_init(&x->parallel, _nlchain_lane, x);
+	x->block_n = 0;
+	x->lanes = NULL;
+	x->lanes_bypassed = NULL;
+	ps_profile_init(&x->profile);
+	ps_bypass_init(&x->bypass);
+
+	// parse stage list
+	x->stages_num = 0;
+	for (i = 0; i < argc; i++) {
+		if (argv[i].a_type != A_SYMBOL) {
+			error("nlchain~: stage %d is not a symbol (fold, wrap or blend)", i);
+			continue;
+		}
+		if (x->stages_num == NLCHAIN_STAGES_MAX) {
+			error("nlchain~: more than %d stages, ignoring the rest", NLCHAIN_STAGES_MAX);
+			break;
+		}
+		name = argv[i].a_w.w_symbol->s_name;
+		if (strcmp(name, "fold") == 0) {
+			x->stages[x->stages_num++] = stage_fold;
+		}
+		else if (strcmp(name, "wrap") == 0) {
+			x->stages[x->stages_num++] = stage_wrap;
+		}
+		else if (strcmp(name, "blend") == 0) {
+			x->stages[x->stages_num++] = stage_blend;
+		}
+		else {
+			error("nlchain~: unknown stage %s (fold, wrap or blend)", name);
+		}
+	}
+	if (argc == 0) {
+		x->stages[0] = stage_fold;
+		x->stages[1] = stage_wrap;
+		x->stages[2] = stage_blend;
+		x->stages_num = 3;
+	}
+
+	x->has_fold = 0;
+	x->has_blend = 0;
+	x->wraps_num = 0;
+	for (i = 0; i < x->stages_num; i++) {
+		x->has_fold |= x->stages[i] == stage_fold;
+		x->has_blend |= x->stages[i] == stage_blend;
+		x->wraps_num += x->stages[i] == stage_wrap;
+	}
+	if (x->wraps_num == 0) {
+		x->wraps_num = 1;
+	}
+
+	_nlchain_channels_alloc(x, 1);
+
+	if (x->has_fold) {
+		inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, &s_signal);
+		inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, &s_signal);
+	}
+	if (x->has_blend) {
+		inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, &s_signal);
+	}
+	outlet_new(&x->x_obj, gensym("signal"));
+
+	return (void*) x;
+}
+
+/*
+	pd callback: delete object
+*/
+static void nlchain_delete (t_nlchain* x) {
+	ps_parallel_stop(&x->parallel);
+	ps_rtpool_free(x->lanes);
+	ps_rtpool_free(x->lanes_bypassed);
+	ps_rtpool_free(x->soften_buffers);
+	ps_rtpool_free(x->wraps);
+	ps_rtpool_reclaim(&x->retired);
+}
+
+/*
+	pd callback: setup object
+*/
+void nlchain_tilde_setup (void) {
+	ps_lock(&nlchain_setup_lock);
+	if (nlchain_class) {
+		ps_unlock(&nlchain_setup_lock);
+		return;
+	}
+
+	ps_rtpool_setup();
+	nlchain_class = class_new(gensym("nlchain~"), (t_newmethod) nlchain_new, (t_method) nlchain_delete, sizeof(t_nlchain), PS_CLASS_MULTICHANNEL, A_GIMME, 0);
+
+	class_addmethod(nlchain_class, (t_method) nlchain_fold_gain, gensym("fold_gain"), A_FLOAT, 0);
+	class_addmethod(nlchain_class, (t_method) nlchain_wrap_gain, gensym("wrap_gain"), A_FLOAT, 0);
+	class_addmethod(nlchain_class, (t_method) nlchain_soften, gensym("soften"), A_FLOAT, A_FLOAT, 0);
+	class_addmethod(nlchain_class, (t_method) nlchain_hard, gensym("hard"), A_NULL, 0);
+	class_addmethod(nlchain_class, (t_method) nlchain_threads, gensym("threads"), A_FLOAT, 0);
+	class_addmethod(nlchain_class, (t_method) nlchain_stats, gensym("stats"), A_DEFSYM, 0);
+	class_addmethod(nlchain_class, (t_method) nlchain_stats_reset, gensym("stats_reset"), A_NULL, 0);
+	class_addmethod(nlchain_class, (t_method) nlchain_bypass_stats, gensym("bypass_stats"), A_DEFSYM, 0);
+	class_addmethod(nlchain_class, (t_method) nlchain_bypass_stats_reset, gensym("bypass_stats_reset"), A_NULL, 0);
+	class_addmethod(nlchain_class, (t_method) nlchain_bypass_enable, gensym("bypass_enable"), A_NULL, 0);
+	class_addmethod(nlchain_class, (t_method) nlchain_bypass_disable, gensym("bypass_disable"), A_NULL, 0);
+	CLASS_MAINSIGNALIN(nlchain_class, t_nlchain, f);
+	class_addmethod(nlchain_class, (t_method) nlchain_dsp, gensym("dsp"), A_CANT, 0);
+
+	ps_unlock(&nlchain_setup_lock);
+}
@@ -0,0 +1,995 @@
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
+
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../core/ps_blend.h"
+#include "../core/ps_denormal.h"
+#include "../core/ps_fold.h"
+#include "../core/ps_oversample.h"
+#include "../core/ps_wiener.h"
+#include "../core/ps_wrap.h"
+
+#include "kiss_fft130/kiss_fftr.h"
+
+/*
+	ps_render
+
+	Offline batch renderer: runs the DSP core (core/) over audio files as fast as every core of the machine allows, instead of pushing them through Pd in real time. The input is memory mapped and cut into chunks of --chunk frames, and the chunks are spread over a pool of --threads worker threads.
+
+	Usage: ps_render kernel [kernel options] [--threads n] [--chunk frames] [--raw channels] [--sr rate] [--out file] in.wav
+
+	Kernels (the options mirror the messages of the matching external, every channel is processed on its own):
+		* fold [--lower x] [--upper x] [--gain g] [--oversample f]			folder~ with constant thresholds [defaults: -1.0, 1.0, 1.0]
+		* wrap [--gain g] [--soften n alpha] [--oversample f]				wraparound~ [default gain: 1.0, hard wrapping]
+		* blend [--ctrl c]													blend~ of channel pairs (0 with 1, 2 with 3, ...) by a constant control, so the output has half the channels [default: 0.0]
+		* wiener [--fft n] [--hop n] [--window hann|rectangle] [--power]	wiener~ over frames of n samples every hop samples [defaults: 1024, 1024, hann, amplitude spectrum]
+
+	Input is a WAV file (16, 24 or 32-bit PCM or 32-bit float) or, with --raw channels, headerless interleaved 32-bit floats at --sr (default 44100). Output depends on the extension of --out:
+		* .wav	32-bit float WAV, written through a memory map
+		* .csv	wiener only: one line per frame with its start time and one entropy per channel (also the default, on stdout)
+		* other	headerless interleaved 32-bit floats, written through a memory map
+	For wiener, a .wav or raw output is a per-sample entropy curve as long as the input: the entropies of all frames covering a sample are overlap-added with a Hann weight and normalized.
+
+	Chunk seams are seamless, the output does not depend on --chunk or --threads:
+		* fold, blend and hard wrap are stateless
+		* softened wrap and oversampling carry state (the soften buffer, the half-band filter histories), so a chunk starts from fresh state up to PS_RENDER_PREROLL_OVERSAMPLE + soften_n + 1 frames early and discards that output. The state then matches a single pass exactly, because it only depends on that many past frames
+		* wiener first computes every frame's entropy (chunks of frames, which may read past the chunk since the whole input is mapped), then overlap-adds them in chunks of samples
+	Frames of wiener start every hop samples from 0 until the end of the input, and are zero padded past it.
+
+	Scheduling is work stealing: each worker starts with an equal contiguous range of chunks and takes them from the front, and a worker that runs dry steals the back half of another worker's remaining range. Neighbouring chunks thus stay on one core while the load still evens out.
+
+	wavecap~ is a capture-driven instrument rather than a file processor, so it has no kernel here. A JSON report (realtime factor, throughput) goes to stdout, or to stderr when the CSV does.
+*/
+
+#define PS_RENDER_BLOCK 1024
+#define PS_RENDER_CHUNK_DEFAULT 65536
+#define PS_RENDER_CHANNELS_MAX 64
+#define PS_RENDER_THREADS_MAX 256
+// base-rate frames that cover the half-band filter histories of every factor, up and down
+#define PS_RENDER_PREROLL_OVERSAMPLE 128
+
+typedef enum {
+	ps_render_fold,
+	ps_render_wrap,
+	ps_render_blend,
+	ps_render_wiener
+} ps_render_kernel;
+
+typedef enum {
+	ps_render_format_pcm16,
+	ps_render_format_pcm24,
+	ps_render_format_pcm32,
+	ps_render_format_float32
+} ps_render_format;
+
+typedef struct _render_input {
+	const unsigned char* map;
+	size_t map_size;
+	const unsigned char* data;
+	long long frames;
+	int channels;
+	int sample_rate;
+	ps_render_format format;
+	int frame_bytes;
+} t_render_input;
+
+typedef struct _render t_render;
+
+typedef struct _render_worker {
+	pthread_t thread;
+	int thread_started;
+	pthread_mutex_t lock;
+	// chunks [task_next, task_end) still to run, the back half may be stolen
+	long task_next;
+	long task_end;
+	int idx;
+	t_render* render;
+
+	// scratch, one block per channel
+	ps_sample* in[PS_RENDER_CHANNELS_MAX];
+	ps_sample* out[PS_RENDER_CHANNELS_MAX];
+	ps_sample* lower;
+	ps_sample* upper;
+	ps_sample* ctrl;
+
+	// kernel state of the chunk being run
+	t_ps_wrap wraps[PS_RENDER_CHANNELS_MAX];
+	ps_sample* soften_buffers;
+	t_ps_oversample oversample;
+
+	// wiener
+	kiss_fftr_cfg fftr_cfg;
+	ps_sample* fftr_input;
+	kiss_fft_cpx* fftr_output;
+} t_render_worker;
+
+struct _render {
+	ps_render_kernel kernel;
+	t_render_input input;
+
+	// kernel params
+	ps_sample lower;
+	ps_sample upper;
+	ps_sample gain;
+	int soften_n;
+	ps_sample soften_alpha;
+	int oversample_factor;
+	ps_sample ctrl;
+	int fft_n;
+	int hop;
+	int window_hann;
+	int power_spectrum;
+
+	// output (float samples through a memory map, or the wiener frames for CSV)
+	int out_channels;
+	long long out_frames;
+	float* out;
+	unsigned char* out_map;
+	size_t out_map_size;
+
+	// wiener
+	ps_sample* window;
+	ps_sample* ola_weight;
+	long long wiener_frames;
+	float* entropies;
+
+	long long chunk_frames;
+	int preroll;
+
+	// current pool run
+	void (*task_run) (t_render_worker* worker, long task);
+	t_render_worker* workers;
+	int workers_num;
+};
+
+static double render_now_ns (void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+	input: WAV or raw floats through a read-only memory map
+*/
+
+static unsigned int render_read_u32 (const unsigned char* b) {
+	return b[0] | (b[1] << 8) | (b[2] << 16) | ((unsigned int) b[3] << 24);
+}
+
+static unsigned int render_read_u16 (const unsigned char* b) {
+	return b[0] | (b[1] << 8);
+}
+
+static int render_input_open (t_render_input* input, const char* path, int raw_channels, int raw_sample_rate) {
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	const unsigned char* chunk;
+	const unsigned char* end;
+	unsigned int chunk_size;
+	unsigned int format_tag = 0;
+	unsigned int bits = 0;
+	size_t data_size = 0;
+
+	memset(input, 0, sizeof(t_render_input));
+	if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+		fprintf(stderr, "could not open %s\n", path);
+		if (fd >= 0) {
+			close(fd);
+		}
+		return 0;
+	}
+	input->map_size = (size_t) st.st_size;
+	input->map = (const unsigned char*) mmap(NULL, input->map_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (input->map == MAP_FAILED) {
+		fprintf(stderr, "could not map %s\n", path);
+		input->map = NULL;
+		return 0;
+	}
+	// every chunk reads its range front to back
+	madvise((void*) input->map, input->map_size, MADV_SEQUENTIAL);
+
+	if (raw_channels > 0) {
+		input->data = input->map;
+		data_size = input->map_size;
+		input->channels = raw_channels;
+		input->sample_rate = raw_sample_rate;
+		input->format = ps_render_format_float32;
+		input->frame_bytes = raw_channels * 4;
+		input->frames = (long long) (data_size / input->frame_bytes);
+		return 1;
+	}
+
+	if (input->map_size < 12 || memcmp(input->map, "RIFF", 4) != 0 || memcmp(input->map + 8, "WAVE", 4) != 0) {
+		fprintf(stderr, "%s is not a WAV file (use --raw channels for raw floats)\n", path);
+		return 0;
+	}
+	chunk = input->map + 12;
+	end = input->map + input->map_size;
+	while (chunk + 8 <= end) {
+		chunk_size = render_read_u32(chunk + 4);
+		if (memcmp(chunk, "fmt ", 4) == 0 && chunk_size >= 16 && chunk + 8 + 16 <= end) {
+			format_tag = render_read_u16(chunk + 8);
+			input->channels = render_read_u16(chunk + 10);
+			input->sample_rate = render_read_u32(chunk + 12);
+			bits = render_read_u16(chunk + 22);
+			// WAVE_FORMAT_EXTENSIBLE keeps the real tag at the start of the subformat GUID
+			if (format_tag == 0xfffe && chunk_size >= 40 && chunk + 8 + 40 <= end) {
+				format_tag = render_read_u16(chunk + 8 + 24);
+			}
+		}
+		else if (memcmp(chunk, "data", 4) == 0) {
+			input->data = chunk + 8;
+			data_size = chunk_size;
+			// streamed WAVs leave the size at 0 or 0xffffffff
+			if (data_size == 0 || input->data + data_size > end) {
+				data_size = (size_t) (end - input->data);
+			}
+			break;
+		}
+		chunk += 8 + chunk_size + (chunk_size & 1);
+	}
+
+	if (format_tag == 1 && bits == 16) {
+		input->format = ps_render_format_pcm16;
+	}
+	else if (format_tag == 1 && bits == 24) {
+		input->format = ps_render_format_pcm24;
+	}
+	else if (format_tag == 1 && bits == 32) {
+		input->format = ps_render_format_pcm32;
+	}
+	else if (format_tag == 3 && bits == 32) {
+		input->format = ps_render_format_float32;
+	}
+	else {
+		fprintf(stderr, "%s: unsupported WAV format %u with %u bits\n", path, format_tag, bits);
+		return 0;
+	}
+	if (input->data == NULL || input->channels < 1) {
+		fprintf(stderr, "%s: no fmt or data chunk\n", path);
+		return 0;
+	}
+	input->frame_bytes = input->channels * (bits / 8);
+	input->frames = (long long) (data_size / input->frame_bytes);
+	return 1;
+}
+
+static void render_input_close (t_render_input* input) {
+	if (input->map) {
+		munmap((void*) input->map, input->map_size);
+		input->map = NULL;
+	}
+}
+
+/*
+	deinterleaves frames [frame, frame + n) of every channel into in, zero past the end of the input
+*/
+static void render_input_read (const t_render_input* input, long long frame, int n, ps_sample** in) {
+	const unsigned char* src;
+	int channels = input->channels;
+	int available = n;
+	int c;
+	int i;
+
+	if (frame + available > input->frames) {
+		available = frame < input->frames ? (int) (input->frames - frame) : 0;
+	}
+	src = input->data + (size_t) frame * input->frame_bytes;
+
+	for (c = 0; c < channels; c++) {
+		ps_sample* dst = in[c];
+
+		switch (input->format) {
+			case ps_render_format_pcm16:
+				for (i = 0; i < available; i++) {
+					const unsigned char* b = src + (size_t) i * input->frame_bytes + c * 2;
+					dst[i] = (ps_sample) ((int16_t) (b[0] | (b[1] << 8)) * (1.0 / 32768.0));
+				}
+				break;
+			case ps_render_format_pcm24:
+				for (i = 0; i < available; i++) {
+					const unsigned char* b = src + (size_t) i * input->frame_bytes + c * 3;
+					dst[i] = (ps_sample) ((int32_t) ((uint32_t) b[0] << 8 | (uint32_t) b[1] << 16 | (uint32_t) b[2] << 24) * (1.0 / 2147483648.0));
+				}
+				break;
+			case ps_render_format_pcm32:
+				for (i = 0; i < available; i++) {
+					int32_t v;
+
+					memcpy(&v, src + (size_t) i * input->frame_bytes + c * 4, 4);
+					dst[i] = (ps_sample) (v * (1.0 / 2147483648.0));
+				}
+				break;
+			case ps_render_format_float32:
+				for (i = 0; i < available; i++) {
+					float v;
+
+					memcpy(&v, src + (size_t) i * input->frame_bytes + c * 4, 4);
+					dst[i] = (ps_sample) v;
+				}
+				break;
+		}
+		for (i = available; i < n; i++) {
+			dst[i] = 0.0f;
+		}
+	}
+}
+
+/*
+	output: 32-bit float WAV or raw floats through a shared memory map
+*/
+
+static void render_write_u32 (unsigned char* b, unsigned int v) {
+	b[0] = v & 0xff;
+	b[1] = (v >> 8) & 0xff;
+	b[2] = (v >> 16) & 0xff;
+	b[3] = (v >> 24) & 0xff;
+}
+
+static void render_write_u16 (unsigned char* b, unsigned int v) {
+	b[0] = v & 0xff;
+	b[1] = (v >> 8) & 0xff;
+}
+
+static int render_output_open (t_render* r, const char* path, int wav) {
+	size_t header = wav ? 44 : 0;
+	size_t data_bytes = (size_t) r->out_frames * r->out_channels * sizeof(float);
+	unsigned char* b;
+	int fd;
+
+	if (wav && data_bytes > 0xffffffffu - 36) {
+		fprintf(stderr, "%s: output too large for WAV, use a raw output instead\n", path);
+		return 0;
+	}
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0 || ftruncate(fd, (off_t) (header + data_bytes)) != 0) {
+		fprintf(stderr, "could not open %s for writing\n", path);
+		if (fd >= 0) {
+			close(fd);
+		}
+		return 0;
+	}
+	r->out_map_size = header + data_bytes;
+	r->out_map = r->out_map_size ? (unsigned char*) mmap(NULL, r->out_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : NULL;
+	close(fd);
+	if (r->out_map == MAP_FAILED) {
+		fprintf(stderr, "could not map %s\n", path);
+		r->out_map = NULL;
+		return 0;
+	}
+	r->out = r->out_map ? (float*) (r->out_map + header) : NULL;
+
+	if (wav) {
+		b = r->out_map;
+		memcpy(b, "RIFF", 4);
+		render_write_u32(b + 4, (unsigned int) (36 + data_bytes));
+		memcpy(b + 8, "WAVEfmt ", 8);
+		render_write_u32(b + 16, 16);
+		render_write_u16(b + 20, 3);
+		render_write_u16(b + 22, r->out_channels);
+		render_write_u32(b + 24, r->input.sample_rate);
+		render_write_u32(b + 28, r->input.sample_rate * r->out_channels * 4);
+		render_write_u16(b + 32, r->out_channels * 4);
+		render_write_u16(b + 34, 32);
+		memcpy(b + 36, "data", 4);
+		render_write_u32(b + 40, (unsigned int) data_bytes);
+	}
+	return 1;
+}
+
+static void render_output_close (t_render* r) {
+	if (r->out_map) {
+		munmap(r->out_map, r->out_map_size);
+		r->out_map = NULL;
+	}
+}
+
+/*
+	interleaves n frames of out into the output at frame
+*/
+static void render_output_write (t_render* r, long long frame, int n, ps_sample** out) {
+	int channels = r->out_channels;
+	float* dst = r->out + (size_t) frame * channels;
+	int c;
+	int i;
+
+	for (c = 0; c < channels; c++) {
+		for (i = 0; i < n; i++) {
+			dst[(size_t) i * channels + c] = (float) out[c][i];
+		}
+	}
+}
+
+/*
+	work stealing thread pool
+*/
+
+static int render_task_take (t_render_worker* worker, long* task) {
+	t_render* r = worker->render;
+	t_render_worker* victim;
+	long remaining;
+	long stolen_end;
+	long steal;
+	int k;
+
+	pthread_mutex_lock(&worker->lock);
+	if (worker->task_next < worker->task_end) {
+		*task = worker->task_next++;
+		pthread_mutex_unlock(&worker->lock);
+		return 1;
+	}
+	pthread_mutex_unlock(&worker->lock);
+
+	for (k = 1; k < r->workers_num; k++) {
+		victim = r->workers + (worker->idx + k) % r->workers_num;
+
+		pthread_mutex_lock(&victim->lock);
+		remaining = victim->task_end - victim->task_next;
+		if (remaining <= 0) {
+			pthread_mutex_unlock(&victim->lock);
+			continue;
+		}
+		steal = (remaining + 1) / 2;
+		stolen_end = victim->task_end;
+		victim->task_end -= steal;
+		pthread_mutex_unlock(&victim->lock);
+
+		pthread_mutex_lock(&worker->lock);
+		worker->task_next = stolen_end - steal;
+		worker->task_end = stolen_end;
+		*task = worker->task_next++;
+		pthread_mutex_unlock(&worker->lock);
+		return 1;
+	}
+	return 0;
+}
+
+static void* render_worker_main (void* arg) {
+	t_render_worker* worker = (t_render_worker*) arg;
+	t_ps_denormal denormal = ps_denormal_begin();
+	long task;
+
+	while (render_task_take(worker, &task)) {
+		worker->render->task_run(worker, task);
+	}
+	ps_denormal_end(denormal);
+	return NULL;
+}
+
+/*
+	runs tasks [0, tasks_num) over the pool and waits for them all
+*/
+static void render_pool_run (t_render* r, long tasks_num, void (*task_run) (t_render_worker* worker, long task)) {
+	int i;
+
+	r->task_run = task_run;
+	for (i = 0; i < r->workers_num; i++) {
+		r->workers[i].task_next = tasks_num * i / r->workers_num;
+		r->workers[i].task_end = tasks_num * (i + 1) / r->workers_num;
+	}
+	// worker 0 is the calling thread
+	for (i = 1; i < r->workers_num; i++) {
+		// the chunks of a worker that fails to start get stolen by the others
+		r->workers[i].thread_started = pthread_create(&r->workers[i].thread, NULL, render_worker_main, r->workers + i) == 0;
+	}
+	render_worker_main(r->workers);
+	for (i = 1; i < r->workers_num; i++) {
+		if (r->workers[i].thread_started) {
+			pthread_join(r->workers[i].thread, NULL);
+		}
+	}
+}
+
+/*
+	sample kernels: one chunk of frames, started preroll frames early from fresh state
+*/
+static PS_KERNEL void render_chunk_samples (t_render_worker* worker, long task) {
+	t_render* r = worker->render;
+	int channels = r->input.channels;
+	long long start = task * r->chunk_frames;
+	long long end = start + r->chunk_frames;
+	long long frame;
+	int preroll = r->preroll;
+	int oversample_factor = r->oversample_factor;
+	t_ps_oversample* oversample = &worker->oversample;
+	ps_sample* frames_in;
+	ps_sample* frames_out;
+	int frames_n;
+	int skip;
+	int n;
+	int c;
+
+	if (end > r->input.frames) {
+		end = r->input.frames;
+	}
+	if (preroll > start) {
+		preroll = (int) start;
+	}
+
+	// fresh state, exactly what the externals start from
+	for (c = 0; c < channels; c++) {
+		worker->wraps[c].wrapped_last = 0;
+		if (r->soften_n > 0) {
+			memset(worker->soften_buffers + (size_t) c * r->soften_n, 0, r->soften_n * sizeof(ps_sample));
+			ps_wrap_soften_reset(worker->wraps + c, worker->soften_buffers + (size_t) c * r->soften_n, r->soften_n);
+		}
+	}
+	if (oversample_factor > 1 && !ps_oversample_alloc(oversample, oversample_factor, 1, channels, PS_RENDER_BLOCK)) {
+		fprintf(stderr, "oversample: out of memory\n");
+		exit(1);
+	}
+
+	for (frame = start - preroll; frame < end; frame += n) {
+		// oversampled blocks are always full, the padding past the input is discarded
+		n = end - frame < PS_RENDER_BLOCK ? (int) (end - frame) : PS_RENDER_BLOCK;
+		render_input_read(&r->input, frame, oversample_factor > 1 ? PS_RENDER_BLOCK : n, worker->in);
+
+		switch (r->kernel) {
+			case ps_render_blend:
+				for (c = 0; c < r->out_channels; c++) {
+					ps_blend(worker->ctrl, worker->in[2 * c], worker->in[2 * c + 1], worker->out[c], n, 1.0f);
+				}
+				break;
+			case ps_render_fold:
+			case ps_render_wrap:
+				for (c = 0; c < channels; c++) {
+					frames_in = worker->in[c];
+					frames_out = worker->out[c];
+					frames_n = n;
+					if (oversample_factor > 1) {
+						frames_in = ps_oversample_up(oversample, c, 0, frames_in);
+						frames_out = oversample->output;
+						frames_n = PS_RENDER_BLOCK * oversample_factor;
+					}
+
+					if (r->kernel == ps_render_fold) {
+						ps_fold(frames_in, worker->lower, worker->upper, frames_out, frames_n, r->gain);
+					}
+					else if (r->soften_n > 0) {
+						ps_wrap_soften(worker->wraps + c, r->soften_n, r->soften_alpha, frames_in, frames_out, frames_n, r->gain);
+					}
+					else {
+						ps_wrap_hard(worker->wraps + c, frames_in, frames_out, frames_n, r->gain);
+					}
+
+					if (oversample_factor > 1) {
+						ps_oversample_down(oversample, c, worker->out[c]);
+					}
+				}
+				break;
+			case ps_render_wiener:
+				break;
+		}
+
+		// drop the preroll
+		skip = frame < start ? (int) (start - frame) : 0;
+		if (skip < n) {
+			ps_sample* out[PS_RENDER_CHANNELS_MAX];
+
+			for (c = 0; c < r->out_channels; c++) {
+				out[c] = worker->out[c] + skip;
+			}
+			render_output_write(r, frame + skip, n - skip, out);
+		}
+	}
+}
+
+/*
+	wiener pass 1: the entropies of one chunk of frames
+*/
+static void render_chunk_wiener_frames (t_render_worker* worker, long task) {
+	t_render* r = worker->render;
+	int channels = r->input.channels;
+	long long frames_per_chunk = r->chunk_frames / r->hop > 0 ? r->chunk_frames / r->hop : 1;
+	long long f = task * frames_per_chunk;
+	long long f_end = f + frames_per_chunk;
+	const ps_sample* fftr_input;
+	int c;
+
+	if (f_end > r->wiener_frames) {
+		f_end = r->wiener_frames;
+	}
+	for (; f < f_end; f++) {
+		render_input_read(&r->input, f * r->hop, r->fft_n, worker->in);
+		for (c = 0; c < channels; c++) {
+			fftr_input = worker->in[c];
+			if (r->window_hann) {
+				ps_wiener_window_apply(r->window, worker->in[c], worker->fftr_input, r->fft_n);
+				fftr_input = worker->fftr_input;
+			}
+			kiss_fftr(worker->fftr_cfg, fftr_input, worker->fftr_output);
+			r->entropies[f * channels + c] = (float) ps_wiener_entropy((const ps_sample*) worker->fftr_output, r->fft_n / 2 - 1, r->power_spectrum);
+		}
+	}
+}
+
+/*
+	wiener pass 2: overlap-adds the entropies of every frame covering one chunk of samples
+*/
+static PS_KERNEL void render_chunk_wiener_ola (t_render_worker* worker, long task) {
+	t_render* r = worker->render;
+	int channels = r->out_channels;
+	long long start = task * r->chunk_frames;
+	long long end = start + r->chunk_frames;
+	long long t;
+	long long f;
+	long long f_first;
+	long long f_last;
+	double sums[PS_RENDER_CHANNELS_MAX];
+	double weight_sum;
+	double weight;
+	int c;
+
+	if (end > r->out_frames) {
+		end = r->out_frames;
+	}
+	for (t = start; t < end; t++) {
+		f_first = t - r->fft_n < 0 ? 0 : (t - r->fft_n) / r->hop + 1;
+		f_last = t / r->hop;
+		if (f_last >= r->wiener_frames) {
+			f_last = r->wiener_frames - 1;
+		}
+
+		weight_sum = 0.0;
+		for (c = 0; c < channels; c++) {
+			sums[c] = 0.0;
+		}
+		for (f = f_first; f <= f_last; f++) {
+			weight = r->ola_weight[t - f * r->hop];
+			weight_sum += weight;
+			for (c = 0; c < channels; c++) {
+				sums[c] += weight * r->entropies[f * channels + c];
+			}
+		}
+		for (c = 0; c < channels; c++) {
+			r->out[(size_t) t * channels + c] = weight_sum > 0.0 ? (float) (sums[c] / weight_sum) : 0.0f;
+		}
+	}
+}
+
+static int render_workers_alloc (t_render* r, int threads) {
+	int channels = r->input.channels;
+	int block = r->kernel == ps_render_wiener ? r->fft_n : PS_RENDER_BLOCK;
+	t_render_worker* worker;
+	int i;
+	int c;
+
+	r->workers = (t_render_worker*) calloc(threads, sizeof(t_render_worker));
+	if (r->workers == NULL) {
+		return 0;
+	}
+	r->workers_num = threads;
+	for (i = 0; i < threads; i++) {
+		worker = r->workers + i;
+		worker->idx = i;
+		worker->render = r;
+		pthread_mutex_init(&worker->lock, NULL);
+		for (c = 0; c < channels; c++) {
+			worker->in[c] = (ps_sample*) malloc(block * sizeof(ps_sample));
+			worker->out[c] = (ps_sample*) malloc(block * sizeof(ps_sample));
+			if (worker->in[c] == NULL || worker->out[c] == NULL) {
+				return 0;
+			}
+		}
+		ps_oversample_init(&worker->oversample);
+
+		switch (r->kernel) {
+			case ps_render_fold:
+			case ps_render_blend:
+				// constant controls, at the oversampled rate if need be
+				worker->lower = (ps_sample*) malloc(block * r->oversample_factor * sizeof(ps_sample));
+				worker->upper = (ps_sample*) malloc(block * r->oversample_factor * sizeof(ps_sample));
+				worker->ctrl = (ps_sample*) malloc(block * sizeof(ps_sample));
+				if (worker->lower == NULL || worker->upper == NULL || worker->ctrl == NULL) {
+					return 0;
+				}
+				for (c = 0; c < block * r->oversample_factor; c++) {
+					worker->lower[c] = r->lower;
+					worker->upper[c] = r->upper;
+				}
+				for (c = 0; c < block; c++) {
+					worker->ctrl[c] = r->ctrl;
+				}
+				break;
+			case ps_render_wrap:
+				if (r->soften_n > 0) {
+					worker->soften_buffers = (ps_sample*) malloc((size_t) channels * r->soften_n * sizeof(ps_sample));
+					if (worker->soften_buffers == NULL) {
+						return 0;
+					}
+				}
+				break;
+			case ps_render_wiener:
+				// kiss_fftr uses scratch space in its cfg, so every worker has its own
+				worker->fftr_cfg = kiss_fftr_alloc(r->fft_n, 0, 0, 0);
+				worker->fftr_input = (ps_sample*) malloc(r->fft_n * sizeof(ps_sample));
+				worker->fftr_output = (kiss_fft_cpx*) malloc((r->fft_n / 2 + 1) * sizeof(kiss_fft_cpx));
+				if (worker->fftr_cfg == NULL || worker->fftr_input == NULL || worker->fftr_output == NULL) {
+					return 0;
+				}
+				break;
+		}
+	}
+	return 1;
+}
+
+static void render_workers_free (t_render* r) {
+	t_render_worker* worker;
+	int i;
+	int c;
+
+	for (i = 0; i < r->workers_num; i++) {
+		worker = r->workers + i;
+		for (c = 0; c < PS_RENDER_CHANNELS_MAX; c++) {
+			free(worker->in[c]);
+			free(worker->out[c]);
+		}
+		free(worker->lower);
+		free(worker->upper);
+		free(worker->ctrl);
+		free(worker->soften_buffers);
+		ps_oversample_free(&worker->oversample);
+		free(worker->fftr_cfg);
+		free(worker->fftr_input);
+		free(worker->fftr_output);
+		pthread_mutex_destroy(&worker->lock);
+	}
+	free(r->workers);
+	r->workers = NULL;
+	r->workers_num = 0;
+}
+
+static int render_ends_with (const char* s, const char* suffix) {
+	size_t s_n = strlen(s);
+	size_t suffix_n = strlen(suffix);
+
+	return s_n >= suffix_n && strcmp(s + s_n - suffix_n, suffix) == 0;
+}
+
+static void render_usage (const char* argv0) {
+	fprintf(stderr, "usage: %s fold|wrap|blend|wiener [--lower x] [--upper x] [--gain g] [--soften n alpha] [--oversample f] [--ctrl c] [--fft n] [--hop n] [--window hann|rectangle] [--power] [--threads n] [--chunk frames] [--raw channels] [--sr rate] [--out file.wav|file.csv|file.raw] in.wav\n", argv0);
+}
+
+int main (int argc, char** argv) {
+	t_render r;
+	const char* kernel_name;
+	const char* in_path = NULL;
+	const char* out_path = NULL;
+	FILE* csv = NULL;
+	int csv_out;
+	int threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	int raw_channels = 0;
+	int raw_sample_rate = 44100;
+	long long chunks;
+	long long f;
+	double start;
+	double elapsed;
+	double seconds;
+	int i;
+	int c;
+
+	memset(&r, 0, sizeof(t_render));
+	r.lower = -1.0f;
+	r.upper = 1.0f;
+	r.gain = 1.0f;
+	r.oversample_factor = 1;
+	r.fft_n = 1024;
+	r.window_hann = 1;
+	r.chunk_frames = PS_RENDER_CHUNK_DEFAULT;
+
+	if (argc < 2) {
+		render_usage(argv[0]);
+		return 2;
+	}
+	kernel_name = argv[1];
+	if (strcmp(kernel_name, "fold") == 0) {
+		r.kernel = ps_render_fold;
+	}
+	else if (strcmp(kernel_name, "wrap") == 0) {
+		r.kernel = ps_render_wrap;
+	}
+	else if (strcmp(kernel_name, "blend") == 0) {
+		r.kernel = ps_render_blend;
+	}
+	else if (strcmp(kernel_name, "wiener") == 0) {
+		r.kernel = ps_render_wiener;
+	}
+	else {
+		render_usage(argv[0]);
+		return 2;
+	}
+
+	for (i = 2; i < argc; i++) {
+		if (strcmp(argv[i], "--lower") == 0 && i + 1 < argc) {
+			r.lower = (ps_sample) atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--upper") == 0 && i + 1 < argc) {
+			r.upper = (ps_sample) atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--gain") == 0 && i + 1 < argc) {
+			r.gain = (ps_sample) atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--soften") == 0 && i + 2 < argc) {
+			r.soften_n = atoi(argv[++i]);
+			r.soften_alpha = (ps_sample) atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--oversample") == 0 && i + 1 < argc) {
+			r.oversample_factor = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--ctrl") == 0 && i + 1 < argc) {
+			r.ctrl = (ps_sample) atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--fft") == 0 && i + 1 < argc) {
+			r.fft_n = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--hop") == 0 && i + 1 < argc) {
+			r.hop = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+			r.window_hann = strcmp(argv[++i], "rectangle") != 0;
+		}
+		else if (strcmp(argv[i], "--power") == 0) {
+			r.power_spectrum = 1;
+		}
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			threads = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--chunk") == 0 && i + 1 < argc) {
+			r.chunk_frames = atoll(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--raw") == 0 && i + 1 < argc) {
+			raw_channels = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--sr") == 0 && i + 1 < argc) {
+			raw_sample_rate = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+			out_path = argv[++i];
+		}
+		else if (argv[i][0] != '-' && in_path == NULL) {
+			in_path = argv[i];
+		}
+		else {
+			in_path = NULL;
+			break;
+		}
+	}
+	if (r.hop <= 0) {
+		r.hop = r.fft_n;
+	}
+	if (threads < 1) {
+		threads = 1;
+	}
+	else if (threads > PS_RENDER_THREADS_MAX) {
+		threads = PS_RENDER_THREADS_MAX;
+	}
+	if (in_path == NULL || r.chunk_frames < 1 || r.soften_n < 0 || r.fft_n < 4 || (r.fft_n & 1)) {
+		render_usage(argv[0]);
+		return 2;
+	}
+	if (r.oversample_factor != 1 && r.oversample_factor != 2 && r.oversample_factor != 4 && r.oversample_factor != 8) {
+		fprintf(stderr, "oversample: factor must be 1, 2, 4 or 8\n");
+		return 2;
+	}
+
+	if (!render_input_open(&r.input, in_path, raw_channels, raw_sample_rate)) {
+		return 1;
+	}
+	if (r.input.channels > PS_RENDER_CHANNELS_MAX) {
+		fprintf(stderr, "%s: more than %d channels\n", in_path, PS_RENDER_CHANNELS_MAX);
+		return 1;
+	}
+	if (r.kernel == ps_render_blend && (r.input.channels & 1)) {
+		fprintf(stderr, "blend: needs channel pairs, %s has %d channels\n", in_path, r.input.channels);
+		return 1;
+	}
+
+	r.out_channels = r.kernel == ps_render_blend ? r.input.channels / 2 : r.input.channels;
+	r.out_frames = r.input.frames;
+	if (r.kernel == ps_render_wrap && r.soften_n > 0) {
+		r.preroll = r.soften_n + 1;
+	}
+	if (r.oversample_factor > 1) {
+		r.preroll += PS_RENDER_PREROLL_OVERSAMPLE;
+	}
+
+	csv_out = r.kernel == ps_render_wiener && (out_path == NULL || render_ends_with(out_path, ".csv"));
+	if (!csv_out && out_path == NULL) {
+		fprintf(stderr, "%s: --out is required\n", kernel_name);
+		return 2;
+	}
+	if (!csv_out && render_ends_with(out_path, ".csv")) {
+		fprintf(stderr, "%s: CSV output is for wiener only\n", kernel_name);
+		return 2;
+	}
+	if (csv_out) {
+		csv = out_path ? fopen(out_path, "w") : stdout;
+		if (csv == NULL) {
+			fprintf(stderr, "could not open %s for writing\n", out_path);
+			return 1;
+		}
+	}
+	else if (!render_output_open(&r, out_path, render_ends_with(out_path, ".wav"))) {
+		return 1;
+	}
+
+	if (r.kernel == ps_render_wiener) {
+		r.wiener_frames = (r.input.frames + r.hop - 1) / r.hop;
+		r.entropies = (float*) malloc((size_t) (r.wiener_frames > 0 ? r.wiener_frames : 1) * r.input.channels * sizeof(float));
+		r.window = (ps_sample*) malloc(r.fft_n * sizeof(ps_sample));
+		r.ola_weight = (ps_sample*) malloc(r.fft_n * sizeof(ps_sample));
+		if (r.entropies == NULL || r.window == NULL || r.ola_weight == NULL) {
+			fprintf(stderr, "out of memory\n");
+			return 1;
+		}
+		ps_wiener_window_hann(r.window, r.fft_n);
+		// a Hann weight sampled between the window points, so the first sample of a frame still counts
+		for (i = 0; i < r.fft_n; i++) {
+			r.ola_weight[i] = (ps_sample) (0.5 - 0.5 * cos(2.0 * M_PI * (i + 0.5) / r.fft_n));
+		}
+	}
+	if (!render_workers_alloc(&r, threads)) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	// render
+	start = render_now_ns();
+	if (r.kernel == ps_render_wiener) {
+		long long frames_per_chunk = r.chunk_frames / r.hop > 0 ? r.chunk_frames / r.hop : 1;
+
+		render_pool_run(&r, (long) ((r.wiener_frames + frames_per_chunk - 1) / frames_per_chunk), render_chunk_wiener_frames);
+		if (!csv_out) {
+			render_pool_run(&r, (long) ((r.out_frames + r.chunk_frames - 1) / r.chunk_frames), render_chunk_wiener_ola);
+		}
+	}
+	else {
+		render_pool_run(&r, (long) ((r.out_frames + r.chunk_frames - 1) / r.chunk_frames), render_chunk_samples);
+	}
+	elapsed = render_now_ns() - start;
+
+	// output
+	if (csv_out) {
+		fprintf(csv, "frame,time");
+		for (c = 0; c < r.input.channels; c++) {
+			fprintf(csv, ",entropy_%d", c);
+		}
+		fprintf(csv, "\n");
+		for (f = 0; f < r.wiener_frames; f++) {
+			fprintf(csv, "%lld,%.6f", f, (double) (f * r.hop) / r.input.sample_rate);
+			for (c = 0; c < r.input.channels; c++) {
+				fprintf(csv, ",%.9g", r.entropies[f * r.input.channels + c]);
+			}
+			fprintf(csv, "\n");
+		}
+		if (csv != stdout) {
+			fclose(csv);
+		}
+	}
+	render_output_close(&r);
+
+	// report
+	chunks = (r.input.frames + r.chunk_frames - 1) / r.chunk_frames;
+	seconds = r.input.sample_rate > 0 ? (double) r.input.frames / r.input.sample_rate : 0.0;
+	fprintf(csv == stdout ? stderr : stdout, "{\"kernel\": \"%s\", \"input\": \"%s\", \"frames\": %lld, \"channels\": %d, \"sr\": %d, \"threads\": %d, \"chunks\": %lld, \"seconds\": %.3f, \"wall_seconds\": %.6f, \"realtime_factor\": %.2f, \"ns_per_sample\": %.3f}\n", kernel_name, in_path, r.input.frames, r.input.channels, r.input.sample_rate, r.workers_num, chunks, seconds, elapsed * 1e-9, elapsed > 0.0 ? seconds / (elapsed * 1e-9) : 0.0, r.input.frames > 0 ? elapsed / ((double) r.input.frames * r.input.channels) : 0.0);
+
+	render_workers_free(&r);
+	render_input_close(&r.input);
+	free(r.entropies);
+	free(r.window);
+	free(r.ola_weight);
+	return 0;
+}
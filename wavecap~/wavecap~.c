@@ -1,84 +1,287 @@
 ﻿#ifdef NT
 #pragma warning( disable : 4244 )
 #pragma warning( disable : 4305 )
+// fopen and _snprintf for save, which /WX would otherwise fail on as unsafe
+#pragma warning( disable : 4996 )
 #endif
 
-#ifndef NAN
-    static const unsigned long __nan[2] = {0xffffffff, 0x7fffffff};
-    #define NAN (*(const float *) __nan)
+#ifdef _WIN32
+    #ifndef NAN
+        static const unsigned long __nan[2] = {0xffffffff, 0x7fffffff};
+        #define NAN (*(const float *) __nan)
+    #endif
+    // the MSVC 11 runtime has only _snprintf, which skips the terminator when it truncates (save's temp path always fits)
+    #if defined(_MSC_VER) && _MSC_VER < 1900
+        #define snprintf _snprintf
+    #endif
 #endif
 
 #include "m_pd.h"
 
+#include "../common/ps_bypass.h"
+#include "../common/ps_dispatch.h"
+#include "../common/ps_events.h"
+#include "../common/ps_lock.h"
+#include "../common/ps_mmap.h"
+#include "../common/ps_multichannel.h"
+#include "../common/ps_profile.h"
+#include "../common/ps_rtpool.h"
+
+#define _USE_MATH_DEFINES
 #include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
 
+#include "../core/ps_wavetable.h"
+#include "../core/ps_denormal.h"
+
+#include "kiss_fft130/kiss_fftr.h"
+
+// KissFFT works on the signal buffers in place, so kiss_fft_scalar has to be t_sample (FLOATSIZE=64 in the Makefile builds both as double)
+typedef char _wavecap_kiss_fft_scalar_matches_t_sample[sizeof(kiss_fft_scalar) == sizeof(t_sample) ? 1 : -1];
+
 /*
 	wavecap~
 	Chris Donahue (http://cdonahue.me) 2014
 
-	This external is a wavetable oscillator that captures pitch from the envelope of an incoming signal. It also records the data for its wavetable via the first inlet. The 
+	This external is a wavetable oscillator that captures pitch from the envelope of an incoming signal, or from a pitch tracker running on it. It also records the data for its wavetable via the first inlet. The 
 
 	The wavecap~ external accepts the following messages:
 		* bang					(starts recording a wavetable from inlet 1)
 		* table_size n			(n must be an even power of 2) [default: 1024]
-		* table_interp n		(n must be 0, 1 or 2 where 0 is truncate, 1 is 2-sample linear interpolation and 2 is 4-sample linear interpolation) [default: 0]
-		* env_atk_ms n			(envelope follower attack in ms) [default 500]
-		* env_dcy_ms n			(envelope follower decay in ms) [default 10]
+		* table_interp n [ms]	(n must be 0, 1, 2 or 3 where 0 is truncate, 1 is 2-sample linear interpolation, 2 is 4-sample linear interpolation and 3 is windowed-sinc interpolation) [default: 0]
+		* table_sinc_taps n		(taps per output sample for windowed-sinc interpolation, n must be 8, 16 or 32) [default: 16]
+		* env_atk_ms n [ms]		(envelope follower attack in ms) [default 500]
+		* env_dcy_ms n [ms]		(envelope follower decay in ms) [default 10]
 		* env_enable			(enables envelope following) [default off]
 		* env_disable			(disables envelope following)
+		* pitch_enable			(inlet 2 is pitch tracked and the estimate drives the oscillator frequency) [default off]
+		* pitch_disable			(inlet 2 goes back to driving the phase increment directly)
+		* pitch_window n		(pitch tracker analysis window, n must be a power of 2) [default 2048]
+		* pitch_hop n			(samples between pitch tracker analyses) [default 512]
+		* pitch_threshold f		(YIN aperiodicity threshold, lower is stricter) [default 0.15]
+		* voices n				(n > 0 turns on the voice bank with n oscillators sharing the table, 0 turns it off) [default 0]
+		* pitches f1 f2 ...		(voice bank frequencies in Hz, one per voice, 0 releases a voice)
+		* table_slots k			(number of tables in the stack, recorded into by index and morphed between by inlet 3) [default: 1]
+		* table_slot i			(stack slot that bang, table_import and table_export work on) [default: 0]
+		* table_name name		(attaches to the shared table called name, no name detaches to a private table) [default: creation argument or private]
+		* table_import array	(copies a Pd array into the table, the array size must be a power of 2)
+		* table_export array	(resizes a Pd array to the table size and copies the table into it)
+		* save file				(writes every slot of the table to file, relative to the patch, see Table files below)
+		* load file				(maps a file written by save as the table, resizing it to the file's slots and size)
+		* stats [receiver]		(posts DSP time per block, or sends it to receiver; needs a PS_PROFILE build, see common/ps_profile.h)
+		* stats_reset			(clears the DSP timings)
+		* bypass_stats [receiver]	(posts channel blocks run and bypassed for silent or constant input, or sends them to receiver; see common/ps_bypass.h)
+		* bypass_stats_reset	(clears the bypass counters)
+		* bypass_enable		(turns the bypass on) [default]
+		* bypass_disable		(turns the bypass off)
+
+	Sample-accurate changes:
+		table_interp, env_atk_ms and env_dcy_ms take effect on the exact frame they fall due at, the message's logical time plus the optional delay in ms, rather than at the next block boundary. The oscillator or voice bank runs in segments between the changes (see common/ps_events.h).
+
+	Shared tables:
+		Instances with the same table_name read and record one reference-counted table from a process-wide registry instead of each keeping a copy. Any attached instance can record into it (bang) and every other instance plays the new contents right away. The table is freed when the last instance detaches. Pd arrays store t_word elements rather than packed floats, so table_import does one copy into the shared table rather than aliasing the array.
+
+	Table files:
+		save writes the table as a 64-byte header (magic "PSWT", format version, byte order, sample size, table size and slot count) followed by every slot's samples, exactly as they are in memory. It writes a temporary file and renames it over the old one, so instances that have the old file loaded keep reading it undisturbed. load maps the file read-only (common/ps_mmap.h) instead of reading it: nothing is copied, pages are read from disk the first time they are played, and every instance and process that loads the file shares one copy in the OS page cache. A loaded table is read-only, so bang and table_import first give it a private copy in memory. A file saved with the other sample precision (FLOATSIZE=64 and back) is converted into memory instead of mapped.
+
+	Voice bank:
+		When the voice bank is on, inlet 2 is ignored and the output is the sum of n table oscillators that all read the one captured table. Each voice has its own phase and a gate envelope that ramps toward 1.0 when its pitch is non-zero and toward 0.0 when it is released, using the env_atk_ms/env_dcy_ms times. With Pd 0.54+ inlet 2 can instead carry a multichannel signal: channel i then sets the frequency in Hz of voice i at every block (0 releases it), so one snake~ or other multichannel source plays the whole bank without pitches messages. Voice state is kept as structure-of-arrays padded to PS_WAVETABLE_VOICE_LANES so that the per-voice loops advance several voices per SIMD instruction.
+
+	Table stack:
+		With table_slots k above 1, the table holds k captures of table_size samples each. Inlet 3 is a morph position in [0, k - 1]. Each output sample blends the two neighbouring slots at the same phase. Interpolation is linear in the table values, so the blend is applied to the taps of both slots before one interpolation. That keeps a single phase/kernel computation and a single read loop for both tables.
+
+	Windowed-sinc interpolation:
+		Kernels are Blackman-windowed sincs tabulated at PS_WAVETABLE_SINC_PHASES fractional phases. Each row is normalized to unity DC gain, and the two rows around the fractional phase are blended linearly. The table for each tap count is built the first time an instance asks for it and is then shared by every instance in the process. Reads that do not wrap around the end of the wavetable take the dot product straight from the table with four independent accumulators, which the compiler turns into packed multiply-adds. Reads that wrap gather their taps first.
+
+	Pitch tracker:
+		The tracker is YIN (de Cheveigne and Kawahara 2002). The difference function is computed from an FFT cross-correlation of the first half of the window against the whole window, so each analysis costs two forward and one inverse real FFT instead of O(n^2) lag sums. One analysis runs every pitch_hop samples, at most once per DSP block, so tracking cost per block stays bounded. The estimate is published to the oscillator with a single store and held through unvoiced frames. The lowest trackable pitch is sample rate / (pitch_window / 2).
 
 	Resources used:
 		* Oscil.cpp from in class example on 10/16/14
 		* http://musicdsp.org/showArchiveComment.php?ArchiveID=136
+		* http://audition.ens.fr/adc/pdf/2002_JASA_YIN.pdf
+		* http://kissfft.sourceforge.net/
 */
 
+// samples in every slot of a table together, which keeps slot * size and the (int) casts of the size in range
+#define WAVECAP_TABLE_SAMPLES_MAX ((uint32_t) 1 << 28)
+
 static t_class* wavecap_class;
+static t_ps_lock wavecap_setup_lock = PS_LOCK_INIT;
 
-typedef enum {
-	truncate,
-	lin_2,
-	lin_4,
-	interp_types_num,
-} interp_type;
+#define WAVECAP_FILE_VERSION 1
+#define WAVECAP_FILE_BYTE_ORDER 0x01020304
+// samples start this far into a table file, so a mapped table is as aligned as one from the pool
+#define WAVECAP_FILE_DATA_OFFSET 64
+
+// header of a table file written by save (see Table files above)
+typedef struct _wavecap_file_header {
+	char magic[4];
+	uint32_t version;
+	// WAVECAP_FILE_BYTE_ORDER as the saving machine stores it
+	uint32_t byte_order;
+	// 4 (float) or 8 (double)
+	uint32_t sample_bytes;
+	uint32_t size;
+	uint32_t slots;
+	uint32_t data_offset;
+} t_wavecap_file_header;
+
+typedef struct _wavecap_table {
+	// registry key (NULL for private tables)
+	t_symbol* name;
+	int refcount;
+
+	uint32_t size;
+	uint32_t mask;
+	int slots;
+	t_sample* data;
+	// data replaced by a resize, recycled at the next block of an attached object (see common/ps_rtpool.h)
+	t_ps_rtpool_retired retired;
+	// file data points into when it was loaded (NULL when it is pool memory), and replaced mappings, closed at the next dsp call
+	t_ps_mmap* mapping;
+	t_ps_mmap* mappings_retired;
+
+	struct _wavecap_table* next;
+} t_wavecap_table;
+
+// registry of named tables shared between instances. Names are symbols, which are per Pd instance, so objects in different Pd instances never share a table
+static t_wavecap_table* wavecap_tables = NULL;
+
+// windowed-sinc kernel tables for 8, 16 and 32 taps, built on first use and shared between instances
+static t_sample* wavecap_sinc_kernels[3] = {NULL, NULL, NULL};
+
+// guards the registry and the kernel tables against objects of other Pd instances running on other threads (see common/ps_lock.h)
+static t_ps_lock wavecap_shared_lock = PS_LOCK_INIT;
 
 typedef struct _wavecap {
     t_object x_obj;
 	t_float f;
+	// patch the object is in, which relative file names are resolved against
+	t_canvas* canvas;
 	
 	// dsp settings
 	int block_size;
-	float sample_rate;
-	float nyquist_rate;
+	t_float sample_rate;
+	t_float nyquist_rate;
 
 	// table parameters
 	int table_record;
-	uint32_t table_size;
-	uint32_t table_mask;
-	float* table;
-	interp_type table_interp;
+	int table_record_slot;
+	t_wavecap_table* table;
+	ps_interp_type table_interp;
+	int table_sinc_taps;
+	t_sample* table_sinc_kernel;
 
 	// env parameters
 	int env_enabled;
-	float env_atk_ms;
-	float env_dcy_ms;
+	t_float env_atk_ms;
+	t_float env_dcy_ms;
+
+	// table oscillator state, with the computed envelope follower coefficients
+	t_ps_wavetable_osc osc;
+
+	// pitch tracker parameters
+	int pitch_enabled;
+	int pitch_window;
+	int pitch_hop;
+	t_float pitch_threshold;
 
-	// computed
-	float env_atk_coeff;
-	float env_dcy_coeff;
-	float env_last;
+	// pitch tracker state
+	kiss_fftr_cfg pitch_fft_cfg;
+	kiss_fftr_cfg pitch_ifft_cfg;
+	t_sample* pitch_buffer;
+	int pitch_buffer_idx;
+	int pitch_hop_countdown;
+	t_sample* pitch_frame;
+	t_sample* pitch_lag;
+	kiss_fft_cpx* pitch_spectrum_frame;
+	kiss_fft_cpx* pitch_spectrum_head;
+	t_sample pitch_estimate;
 
-	// table oscillator state
-	float phase;
-	float phaseIncrement;
+	// voice bank state
+	t_ps_voices voices;
+	// channels on inlet 2, more than one drives the voice pitches
+	int voices_pitch_nchans;
+
+	// voice and pitch tracker buffers replaced while dsp runs, recycled at the next block (see common/ps_rtpool.h)
+	t_ps_rtpool_retired retired;
+
+	// perform timings (empty unless built with PS_PROFILE)
+	t_ps_profile profile;
+	// silent and constant block bypass (see common/ps_bypass.h)
+	t_ps_bypass bypass;
+	// sample-accurate parameter changes (see common/ps_events.h)
+	t_ps_events events;
 } t_wavecap;
 
+enum {
+	wavecap_event_table_interp,
+	wavecap_event_env_atk_ms,
+	wavecap_event_env_dcy_ms
+};
+
+/*
+	hands the table's data to the retired lists, pool memory or a file mapping alike
+*/
+static void _wavecap_table_retire_data (t_wavecap_table* table) {
+	if (table->mapping) {
+		table->mapping->retired = table->mappings_retired;
+		table->mappings_retired = table->mapping;
+		table->mapping = NULL;
+	}
+	else {
+		ps_rtpool_retire(&table->retired, table->data);
+	}
+	table->data = NULL;
+}
+
+/*
+	frees and unmaps everything retired, from the dsp method or on detach
+*/
+static void _wavecap_table_reclaim (t_wavecap_table* table) {
+	t_ps_mmap* mapping;
+
+	ps_rtpool_reclaim(&table->retired);
+	while (table->mappings_retired) {
+		mapping = table->mappings_retired;
+		table->mappings_retired = mapping->retired;
+		ps_mmap_close(mapping);
+		ps_rtpool_free(mapping);
+	}
+}
+
+/*
+	gives a table mapped from a file a writable copy in memory, before anything records or imports into it
+*/
+static int _wavecap_table_own (t_wavecap_table* table) {
+	size_t samples = (size_t) table->size * table->slots;
+	t_sample* data;
+
+	if (table->mapping == NULL) {
+		return 1;
+	}
+	data = (t_sample*) ps_rtpool_alloc(samples * sizeof(t_sample));
+	if (data == NULL) {
+		error("table: could not allocate %d slots of %d samples", table->slots, table->size);
+		return 0;
+	}
+	memcpy(data, table->data, samples * sizeof(t_sample));
+	_wavecap_table_retire_data(table);
+	table->data = data;
+	return 1;
+}
+
 /*
 	bang receiever
 */
 
 static void wavecap_table_record (t_wavecap* x) {
-	x->table_record = x->table_size;
+	if (!_wavecap_table_own(x->table)) {
+		return;
+	}
+	x->table_record = x->table->size;
 	post("recording...");
 }
 
@@ -86,34 +289,357 @@ static void wavecap_table_record (t_wavecap* x) {
 	internal state helpers
 */
 
-static void _wavecap_table_free (t_wavecap* x) {
-	if (x->table) {
-		free(x->table);
+static int _wavecap_table_resize (t_wavecap_table* table, uint32_t size, int slots) {
+	t_sample* data;
+
+	if (size == 0 || slots < 1 || (size_t) size * slots > WAVECAP_TABLE_SAMPLES_MAX) {
+		error("table: %d slots of %u samples exceed the limit of %u samples", slots, size, WAVECAP_TABLE_SAMPLES_MAX);
+		return 0;
+	}
+	data = (t_sample*) ps_rtpool_calloc((size_t) size * slots, sizeof(t_sample));
+	if (data == NULL) {
+		error("table: could not allocate %d slots of %d samples", slots, size);
+		return 0;
 	}
+	_wavecap_table_retire_data(table);
+	table->data = data;
+	table->size = size;
+	table->mask = size - 1;
+	table->slots = slots;
+	return 1;
 }
 
-static void _wavecap_table_alloc (t_wavecap* x) {
-	if (x->table_size > 0) {
-		x->table = (float*) calloc(x->table_size, sizeof(float));
+static t_sample* _wavecap_table_slot (t_wavecap* x) {
+	int slot = x->table_record_slot < x->table->slots ? x->table_record_slot : x->table->slots - 1;
+
+	return x->table->data + slot * x->table->size;
+}
+
+static t_wavecap_table* _wavecap_table_attach (t_symbol* name, uint32_t size) {
+	t_wavecap_table* table;
+
+	ps_lock(&wavecap_shared_lock);
+
+	// named tables are looked up in the registry first
+	if (name) {
+		for (table = wavecap_tables; table; table = table->next) {
+			if (table->name == name) {
+				table->refcount++;
+				ps_unlock(&wavecap_shared_lock);
+				return table;
+			}
+		}
 	}
-	else {
-		x->table = NULL;
+
+	table = (t_wavecap_table*) ps_rtpool_calloc(1, sizeof(t_wavecap_table));
+	if (table && !_wavecap_table_resize(table, size, 1)) {
+		ps_rtpool_free(table);
+		table = NULL;
+	}
+	if (table) {
+		table->name = name;
+		table->refcount = 1;
+		if (name) {
+			table->next = wavecap_tables;
+			wavecap_tables = table;
+		}
+	}
+
+	ps_unlock(&wavecap_shared_lock);
+	return table;
+}
+
+static void _wavecap_table_detach (t_wavecap_table* table) {
+	t_wavecap_table** link;
+
+	if (table == NULL) {
+		return;
+	}
+
+	ps_lock(&wavecap_shared_lock);
+	if (--table->refcount > 0) {
+		ps_unlock(&wavecap_shared_lock);
+		return;
+	}
+	if (table->name) {
+		for (link = &wavecap_tables; *link; link = &(*link)->next) {
+			if (*link == table) {
+				*link = table->next;
+				break;
+			}
+		}
 	}
+	ps_unlock(&wavecap_shared_lock);
+
+	_wavecap_table_retire_data(table);
+	_wavecap_table_reclaim(table);
+	ps_rtpool_free(table);
+}
+
+static int _wavecap_sinc_kernel_slot (int taps) {
+	switch (taps) {
+	case 8:
+		return 0;
+	case 16:
+		return 1;
+	case 32:
+		return 2;
+	default:
+		return -1;
+	}
+}
+
+/*
+	returns the shared kernel table for a tap count, building it the first time (see ps_wavetable_sinc_kernel_fill())
+*/
+static t_sample* _wavecap_sinc_kernel_get (int taps) {
+	int slot = _wavecap_sinc_kernel_slot(taps);
+	t_sample* kernel;
+
+	if (slot < 0) {
+		return NULL;
+	}
+
+	// the first caller builds the table while the others wait for it
+	ps_lock(&wavecap_shared_lock);
+	kernel = wavecap_sinc_kernels[slot];
+	if (kernel == NULL) {
+		kernel = (t_sample*) ps_rtpool_alloc(sizeof(t_sample) * (PS_WAVETABLE_SINC_PHASES + 1) * taps);
+		if (kernel) {
+			ps_wavetable_sinc_kernel_fill(kernel, taps);
+			wavecap_sinc_kernels[slot] = kernel;
+		}
+	}
+	ps_unlock(&wavecap_shared_lock);
+
+	return kernel;
+}
+
+static t_garray* _wavecap_garray_find (t_symbol* name, const char* selector) {
+	t_garray* garray = (t_garray*) pd_findbyclass(name, garray_class);
+
+	if (garray == NULL) {
+		error("%s: %s: no such array", selector, name->s_name);
+	}
+	return garray;
 }
 
 static void _wavecap_table_reset_phase (t_wavecap* x) {
-	x->phase = 0.0f;
-	x->phaseIncrement = 0.0f;
+	int v;
+
+	x->osc.phase = 0.0f;
+	x->osc.increment = 0.0f;
+	for (v = 0; v < x->voices.lanes; v++) {
+		x->voices.phase[v] = 0.0f;
+	}
+}
+
+static void _wavecap_voices_free (t_wavecap* x) {
+	ps_rtpool_retire(&x->retired, x->voices.pitch);
+	x->voices.pitch = NULL;
+	x->voices.phase = NULL;
+	x->voices.increment = NULL;
+	x->voices.env = NULL;
+	x->voices.env_target = NULL;
+	x->voices.num = 0;
+	x->voices.lanes = 0;
+}
+
+static void _wavecap_voices_alloc (t_wavecap* x, int voices_num) {
+	int voices_lanes = ((voices_num + PS_WAVETABLE_VOICE_LANES - 1) / PS_WAVETABLE_VOICE_LANES) * PS_WAVETABLE_VOICE_LANES;
+	t_sample* voices;
+
+	// one allocation holds every per-voice array, each padded to whole lanes
+	voices = (t_sample*) ps_rtpool_calloc(voices_lanes * 5, sizeof(t_sample));
+	if (voices == NULL) {
+		return;
+	}
+	x->voices.pitch = voices;
+	x->voices.phase = voices + voices_lanes;
+	x->voices.increment = voices + voices_lanes * 2;
+	x->voices.env = voices + voices_lanes * 3;
+	x->voices.env_target = voices + voices_lanes * 4;
+	x->voices.num = voices_num;
+	x->voices.lanes = voices_lanes;
+}
+
+static void _wavecap_pitch_free (t_wavecap* x) {
+	ps_rtpool_retire(&x->retired, x->pitch_fft_cfg);
+	x->pitch_fft_cfg = NULL;
+	ps_rtpool_retire(&x->retired, x->pitch_ifft_cfg);
+	x->pitch_ifft_cfg = NULL;
+	ps_rtpool_retire(&x->retired, x->pitch_buffer);
+	x->pitch_buffer = NULL;
+	ps_rtpool_retire(&x->retired, x->pitch_spectrum_frame);
+	x->pitch_spectrum_frame = NULL;
+	x->pitch_frame = NULL;
+	x->pitch_lag = NULL;
+	x->pitch_spectrum_head = NULL;
+}
+
+/*
+	KissFFT sizes its state first, then builds it in pool memory
+*/
+static kiss_fftr_cfg _wavecap_fftr_alloc (int nfft, int inverse) {
+	size_t size = 0;
+
+	kiss_fftr_alloc(nfft, inverse, NULL, &size);
+	return kiss_fftr_alloc(nfft, inverse, ps_rtpool_alloc(size), &size);
+}
+
+static int _wavecap_pitch_alloc (t_wavecap* x) {
+	int nfft = x->pitch_window;
+	int nbins = nfft / 2 + 1;
+
+	x->pitch_fft_cfg = _wavecap_fftr_alloc(nfft, 0);
+	x->pitch_ifft_cfg = _wavecap_fftr_alloc(nfft, 1);
+
+	// history, analysis frame and lag buffers share one allocation, as do the two spectra
+	x->pitch_buffer = (t_sample*) ps_rtpool_calloc(nfft * 3, sizeof(t_sample));
+	x->pitch_spectrum_frame = (kiss_fft_cpx*) ps_rtpool_calloc(nbins * 2, sizeof(kiss_fft_cpx));
+
+	if (!x->pitch_fft_cfg || !x->pitch_ifft_cfg || !x->pitch_buffer || !x->pitch_spectrum_frame) {
+		_wavecap_pitch_free(x);
+		return 0;
+	}
+	x->pitch_frame = x->pitch_buffer + nfft;
+	x->pitch_lag = x->pitch_buffer + nfft * 2;
+	x->pitch_spectrum_head = x->pitch_spectrum_frame + nbins;
+	x->pitch_buffer_idx = 0;
+	x->pitch_hop_countdown = x->pitch_hop;
+	return 1;
+}
+
+/*
+	runs one YIN analysis over the pitch history and publishes the estimate if the frame is voiced
+*/
+static void _wavecap_pitch_analyze (t_wavecap* x) {
+	int nfft = x->pitch_window;
+	int half = nfft / 2;
+	int nbins = half + 1;
+	int mask = nfft - 1;
+	t_sample* buffer = x->pitch_buffer;
+	t_sample* frame = x->pitch_frame;
+	t_sample* lag = x->pitch_lag;
+	kiss_fft_cpx* spectrum_frame = x->pitch_spectrum_frame;
+	kiss_fft_cpx* spectrum_head = x->pitch_spectrum_head;
+	t_sample threshold = x->pitch_threshold;
+	t_sample sample_rate = x->sample_rate;
+
+	int i;
+	int tau;
+	int tau_found;
+	t_sample scale = 1.0f / (t_sample) nfft;
+	t_sample re;
+	t_sample im;
+	double energy_head;
+	double energy_lag;
+	double difference;
+	double difference_sum;
+	t_sample s0;
+	t_sample s1;
+	t_sample s2;
+	t_sample shift;
+	t_sample denominator;
+
+	// linearize the history, oldest sample first
+	for (i = 0; i < nfft; i++) {
+		frame[i] = buffer[(x->pitch_buffer_idx + i) & mask];
+	}
+
+	// r(tau) = sum over j < half of frame[j] * frame[j + tau], as the cross-correlation of the zero-padded head with the frame
+	for (i = 0; i < half; i++) {
+		lag[i] = frame[i];
+	}
+	for (i = half; i < nfft; i++) {
+		lag[i] = 0.0f;
+	}
+	kiss_fftr(x->pitch_fft_cfg, frame, spectrum_frame);
+	kiss_fftr(x->pitch_fft_cfg, lag, spectrum_head);
+	for (i = 0; i < nbins; i++) {
+		re = spectrum_head[i].r * spectrum_frame[i].r + spectrum_head[i].i * spectrum_frame[i].i;
+		im = spectrum_head[i].r * spectrum_frame[i].i - spectrum_head[i].i * spectrum_frame[i].r;
+		spectrum_head[i].r = re;
+		spectrum_head[i].i = im;
+	}
+	kiss_fftri(x->pitch_ifft_cfg, spectrum_head, lag);
+
+	// d(tau) = r_0(0) + r_tau(0) - 2 r(tau), replaced in place by the cumulative mean normalized difference
+	energy_head = 0.0;
+	for (i = 0; i < half; i++) {
+		energy_head += frame[i] * frame[i];
+	}
+	energy_lag = energy_head;
+	difference_sum = 0.0;
+	lag[0] = 1.0f;
+	for (tau = 1; tau < half; tau++) {
+		energy_lag += frame[tau + half - 1] * frame[tau + half - 1] - frame[tau - 1] * frame[tau - 1];
+		difference = energy_head + energy_lag - 2.0 * lag[tau] * scale;
+		if (difference < 0.0) {
+			difference = 0.0;
+		}
+		difference_sum += difference;
+		lag[tau] = difference_sum > 0.0 ? (t_sample) (difference * tau / difference_sum) : 1.0f;
+	}
+
+	// first dip under the threshold, followed down to its local minimum
+	tau_found = 0;
+	for (tau = 2; tau < half - 1; tau++) {
+		if (lag[tau] < threshold) {
+			while (tau + 1 < half - 1 && lag[tau + 1] < lag[tau]) {
+				tau++;
+			}
+			tau_found = tau;
+			break;
+		}
+	}
+	if (tau_found == 0 || sample_rate <= 0.0f) {
+		return;
+	}
+
+	// parabolic interpolation around the minimum
+	s0 = lag[tau_found - 1];
+	s1 = lag[tau_found];
+	s2 = lag[tau_found + 1];
+	denominator = s0 + s2 - 2.0f * s1;
+	shift = denominator != 0.0f ? 0.5f * (s0 - s2) / denominator : 0.0f;
+
+	x->pitch_estimate = sample_rate / ((t_sample) tau_found + shift);
+}
+
+/*
+	pushes a block into the pitch history and runs an analysis when a hop has elapsed (never more than one per block)
+*/
+static void _wavecap_pitch_track (t_wavecap* x, t_float* in, int n) {
+	t_sample* buffer = x->pitch_buffer;
+	int mask = x->pitch_window - 1;
+	int buffer_idx = x->pitch_buffer_idx;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		buffer[buffer_idx] = in[i];
+		buffer_idx = (buffer_idx + 1) & mask;
+	}
+	x->pitch_buffer_idx = buffer_idx;
+
+	x->pitch_hop_countdown -= n;
+	if (x->pitch_hop_countdown <= 0) {
+		_wavecap_pitch_analyze(x);
+		x->pitch_hop_countdown += x->pitch_hop;
+		if (x->pitch_hop_countdown <= 0) {
+			x->pitch_hop_countdown = x->pitch_hop;
+		}
+	}
 }
 
 static void _wavecap_env_atk_coeff_recompute (t_wavecap* x) {
-	x->env_atk_coeff = exp(log(0.01)/(x->env_atk_ms * x->sample_rate * 0.001));
-	x->env_last = 0.0f;
+	x->osc.env_atk_coeff = ps_env_coeff(x->env_atk_ms, x->sample_rate);
+	x->osc.env_last = 0.0f;
 }
 
 static void _wavecap_env_dcy_coeff_recompute (t_wavecap* x) {
-	x->env_dcy_coeff = exp(log(0.01)/(x->env_dcy_ms * x->sample_rate * 0.001));
-	x->env_last = 0.0f;
+	x->osc.env_dcy_coeff = ps_env_coeff(x->env_dcy_ms, x->sample_rate);
+	x->osc.env_last = 0.0f;
 }
 
 /*
@@ -130,6 +656,108 @@ static void wavecap_env_enable (t_wavecap* x) {
 	post("inlet 2 envelope follower enabled");
 }
 
+static void wavecap_pitch_disable (t_wavecap* x) {
+	x->pitch_enabled = 0;
+	post("inlet 2 pitch tracker disabled");
+}
+
+static void wavecap_pitch_enable (t_wavecap* x) {
+	if (x->pitch_buffer == NULL && !_wavecap_pitch_alloc(x)) {
+		error("pitch_enable: could not allocate pitch tracker");
+		return;
+	}
+	x->pitch_enabled = 1;
+	post("inlet 2 pitch tracker enabled");
+}
+
+static void wavecap_pitch_window (t_wavecap* x, t_float f) {
+	int pitch_window_new = (int) f;
+
+	if (pitch_window_new < 64 || (pitch_window_new & (pitch_window_new - 1)) != 0) {
+		error("pitch_window: %d is not a power of two of at least 64", pitch_window_new);
+		return;
+	}
+
+	if (pitch_window_new != x->pitch_window) {
+		x->pitch_window = pitch_window_new;
+		if (x->pitch_buffer) {
+			_wavecap_pitch_free(x);
+			if (!_wavecap_pitch_alloc(x)) {
+				error("pitch_window: could not allocate pitch tracker");
+				x->pitch_enabled = 0;
+			}
+		}
+	}
+
+	post("pitch_window: %d", x->pitch_window);
+}
+
+static void wavecap_pitch_hop (t_wavecap* x, t_float f) {
+	int pitch_hop_new = (int) f;
+
+	if (pitch_hop_new < 1) {
+		error("pitch_hop: %d invalid, must be at least 1", pitch_hop_new);
+		return;
+	}
+
+	x->pitch_hop = pitch_hop_new;
+	x->pitch_hop_countdown = pitch_hop_new;
+	post("pitch_hop: %d", x->pitch_hop);
+}
+
+static void wavecap_pitch_threshold (t_wavecap* x, t_float f) {
+	if (f <= 0.0f || f >= 1.0f) {
+		error("pitch_threshold: %f invalid, must be in the interval (0, 1)", f);
+		return;
+	}
+
+	x->pitch_threshold = f;
+	post("pitch_threshold: %f", x->pitch_threshold);
+}
+
+static void wavecap_voices (t_wavecap* x, t_float f) {
+	int voices_num = (int) f;
+
+	if (voices_num < 0) {
+		error("voices: %d invalid, must be 0 or more", voices_num);
+		return;
+	}
+
+	if (voices_num != x->voices.num) {
+		_wavecap_voices_free(x);
+		if (voices_num > 0) {
+			_wavecap_voices_alloc(x, voices_num);
+		}
+	}
+
+	post("voices: %d", x->voices.num);
+}
+
+static void wavecap_pitches (t_wavecap* x, t_symbol* selector, int argc, t_atom* argv) {
+	int v;
+	t_sample pitch;
+
+	if (x->voices.num == 0) {
+		error("pitches: voice bank is off, send voices n first");
+		return;
+	}
+
+	if (argc > x->voices.num) {
+		error("pitches: received %d pitches for %d voices, ignoring the extra pitches", argc, x->voices.num);
+		argc = x->voices.num;
+	}
+
+	for (v = 0; v < argc; v++) {
+		if (argv[v].a_type != A_FLOAT) {
+			error("pitches: argument %d is not a number", v);
+			continue;
+		}
+		pitch = ps_fabs(argv[v].a_w.w_float);
+		x->voices.pitch[v] = pitch;
+		x->voices.env_target[v] = pitch > 0.0f ? 1.0f : 0.0f;
+	}
+}
+
 static void wavecap_table_size (t_wavecap* x, t_float f) {
 	uint32_t table_size_new = (uint32_t) f;
 	
@@ -139,93 +767,461 @@ static void wavecap_table_size (t_wavecap* x, t_float f) {
 		return;
 	}
 
-	// check if it changed
-	if (table_size_new != x->table_size) {
-		x->table_size = table_size_new;
-		x->table_mask = table_size_new - 1;
-		_wavecap_table_free(x);
-		_wavecap_table_alloc(x);
+	// check if it changed (resizing a shared table resizes it for every attached instance)
+	if (table_size_new != x->table->size) {
+		_wavecap_table_resize(x->table, table_size_new, x->table->slots);
+		x->table_record = 0;
+		_wavecap_table_reset_phase(x);
 	}
 
-	post("table_size: %d", x->table_size);
+	post("table_size: %d", x->table->size);
 }
 
-static void wavecap_table_interp (t_wavecap* x, t_float f) {
+static void wavecap_table_slots (t_wavecap* x, t_float f) {
+	int slots = (int) f;
+
+	if (slots < 1) {
+		error("table_slots: %d invalid, must be at least 1", slots);
+		return;
+	}
+
+	// resizing clears every slot (and does so for every instance sharing the table)
+	if (slots != x->table->slots) {
+		_wavecap_table_resize(x->table, x->table->size, slots);
+		x->table_record = 0;
+		_wavecap_table_reset_phase(x);
+	}
+
+	post("table_slots: %d", x->table->slots);
+}
+
+static void wavecap_table_slot (t_wavecap* x, t_float f) {
+	int slot = (int) f;
+
+	if (slot < 0 || slot >= x->table->slots) {
+		error("table_slot: %d invalid, must be in the interval [%d, %d)", slot, 0, x->table->slots);
+		return;
+	}
+
+	x->table_record_slot = slot;
+	x->table_record = 0;
+	post("table_slot: %d", slot);
+}
+
+static void wavecap_table_name (t_wavecap* x, t_symbol* s) {
+	t_symbol* name = (s && *s->s_name) ? s : NULL;
+	t_wavecap_table* table;
+
+	if (name == x->table->name) {
+		return;
+	}
+
+	table = _wavecap_table_attach(name, x->table->size);
+	if (table == NULL) {
+		error("table_name: could not attach table");
+		return;
+	}
+	_wavecap_table_detach(x->table);
+	x->table = table;
+	x->table_record = 0;
+	_wavecap_table_reset_phase(x);
+
+	if (name) {
+		post("table_name: %s (%d instances, size %d)", name->s_name, table->refcount, table->size);
+	}
+	else {
+		post("table_name: private");
+	}
+}
+
+static void wavecap_table_import (t_wavecap* x, t_symbol* s) {
+	t_garray* garray = _wavecap_garray_find(s, "table_import");
+	t_wavecap_table* table = x->table;
+	t_sample* data;
+	t_word* vec;
+	int size;
+	int i;
+
+	if (garray == NULL) {
+		return;
+	}
+	if (!garray_getfloatwords(garray, &size, &vec)) {
+		error("table_import: %s: bad template", s->s_name);
+		return;
+	}
+	if (size <= 0 || (size & (size - 1)) != 0) {
+		error("table_import: %s: size %d is not a non-zero power of two", s->s_name, size);
+		return;
+	}
+
+	if ((uint32_t) size != table->size) {
+		if (!_wavecap_table_resize(table, (uint32_t) size, table->slots)) {
+			return;
+		}
+		_wavecap_table_reset_phase(x);
+	}
+	else if (!_wavecap_table_own(table)) {
+		return;
+	}
+	x->table_record = 0;
+	data = _wavecap_table_slot(x);
+
+	for (i = 0; i < size; i++) {
+		data[i] = vec[i].w_float;
+	}
+
+	post("table_import: %s (%d samples)", s->s_name, size);
+}
+
+static void wavecap_table_export (t_wavecap* x, t_symbol* s) {
+	t_garray* garray = _wavecap_garray_find(s, "table_export");
+	t_wavecap_table* table = x->table;
+	t_sample* data = _wavecap_table_slot(x);
+	t_word* vec;
+	int size;
+	int i;
+
+	if (garray == NULL) {
+		return;
+	}
+
+	garray_resize_long(garray, (long) table->size);
+	if (!garray_getfloatwords(garray, &size, &vec)) {
+		error("table_export: %s: bad template", s->s_name);
+		return;
+	}
+	if ((uint32_t) size > table->size) {
+		size = (int) table->size;
+	}
+
+	for (i = 0; i < size; i++) {
+		vec[i].w_float = data[i];
+	}
+	garray_redraw(garray);
+
+	post("table_export: %s (%d samples)", s->s_name, size);
+}
+
+static void wavecap_save (t_wavecap* x, t_symbol* s) {
+	t_wavecap_table* table = x->table;
+	char path[MAXPDSTRING];
+	char path_temp[MAXPDSTRING + 4];
+	unsigned char padding[WAVECAP_FILE_DATA_OFFSET];
+	t_wavecap_file_header header;
+	size_t samples = (size_t) table->size * table->slots;
+	FILE* file;
+	int written;
+
+	canvas_makefilename(x->canvas, s->s_name, path, MAXPDSTRING);
+	snprintf(path_temp, sizeof(path_temp), "%s.tmp", path);
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "PSWT", 4);
+	header.version = WAVECAP_FILE_VERSION;
+	header.byte_order = WAVECAP_FILE_BYTE_ORDER;
+	header.sample_bytes = sizeof(t_sample);
+	header.size = table->size;
+	header.slots = (uint32_t) table->slots;
+	header.data_offset = WAVECAP_FILE_DATA_OFFSET;
+	memset(padding, 0, sizeof(padding));
+
+	file = fopen(path_temp, "wb");
+	if (file == NULL) {
+		error("save: %s: could not open for writing", path_temp);
+		return;
+	}
+	written = fwrite(&header, sizeof(header), 1, file) == 1;
+	written = written && fwrite(padding, WAVECAP_FILE_DATA_OFFSET - sizeof(header), 1, file) == 1;
+	written = written && fwrite(table->data, sizeof(t_sample), samples, file) == samples;
+	written = fclose(file) == 0 && written;
+	if (!written) {
+		error("save: %s: write failed", path_temp);
+		remove(path_temp);
+		return;
+	}
+
+	// replace the old file in one step, instances that mapped it keep the old contents
+#ifdef _WIN32
+	written = MoveFileExA(path_temp, path, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	written = rename(path_temp, path) == 0;
+#endif
+	if (!written) {
+		error("save: %s: could not replace (is it loaded?)", path);
+		remove(path_temp);
+		return;
+	}
+
+	post("save: %s (%d slots of %d samples)", path, table->slots, table->size);
+}
+
+static void wavecap_load (t_wavecap* x, t_symbol* s) {
+	t_wavecap_table* table = x->table;
+	char path[MAXPDSTRING];
+	t_ps_mmap* mapping;
+	t_wavecap_file_header header;
+	const unsigned char* samples;
+	t_sample* data = NULL;
+	size_t i;
+
+	canvas_makefilename(x->canvas, s->s_name, path, MAXPDSTRING);
+	mapping = (t_ps_mmap*) ps_rtpool_calloc(1, sizeof(t_ps_mmap));
+	if (mapping == NULL) {
+		error("load: out of memory");
+		return;
+	}
+	if (!ps_mmap_open(mapping, path)) {
+		error("load: %s: could not open", path);
+		ps_rtpool_free(mapping);
+		return;
+	}
+
+	// only the header is read here, the samples stay on disk until they are played
+	memset(&header, 0, sizeof(header));
+	if (mapping->size >= sizeof(header)) {
+		memcpy(&header, mapping->data, sizeof(header));
+	}
+	if (memcmp(header.magic, "PSWT", 4) != 0 || header.version != WAVECAP_FILE_VERSION) {
+		error("load: %s: not a wavecap~ table file", path);
+	}
+	else if (header.byte_order != WAVECAP_FILE_BYTE_ORDER) {
+		error("load: %s: saved with the other byte order", path);
+	}
+	else if ((header.sample_bytes != sizeof(float) && header.sample_bytes != sizeof(double)) || header.size == 0 || (header.size & (header.size - 1)) != 0 || header.slots < 1 || header.data_offset < sizeof(header) || header.data_offset % header.sample_bytes != 0) {
+		error("load: %s: bad header", path);
+	}
+	// each factor on its own, so a corrupt header cannot overflow the products
+	else if (header.size > WAVECAP_TABLE_SAMPLES_MAX || header.slots > WAVECAP_TABLE_SAMPLES_MAX / header.size) {
+		error("load: %s: %u slots of %u samples exceed the limit of %u samples", path, header.slots, header.size, WAVECAP_TABLE_SAMPLES_MAX);
+	}
+	else if (mapping->size < header.data_offset || header.slots > (uint64_t) (mapping->size - header.data_offset) / ((uint64_t) header.size * header.sample_bytes)) {
+		error("load: %s: truncated", path);
+	}
+	else {
+		samples = mapping->data + header.data_offset;
+
+		// the other precision cannot be played from the file, convert it into memory
+		if (header.sample_bytes != sizeof(t_sample)) {
+			data = (t_sample*) ps_rtpool_alloc((size_t) header.size * header.slots * sizeof(t_sample));
+			if (data == NULL) {
+				error("table: could not allocate %d slots of %d samples", (int) header.slots, (int) header.size);
+			}
+			else if (header.sample_bytes == sizeof(float)) {
+				for (i = 0; i < (size_t) header.size * header.slots; i++) {
+					data[i] = (t_sample) ((const float*) samples)[i];
+				}
+			}
+			else {
+				for (i = 0; i < (size_t) header.size * header.slots; i++) {
+					data[i] = (t_sample) ((const double*) samples)[i];
+				}
+			}
+		}
+
+		if (header.sample_bytes == sizeof(t_sample) || data) {
+			_wavecap_table_retire_data(table);
+			if (data) {
+				table->data = data;
+			}
+			else {
+				table->data = (t_sample*) samples;
+				table->mapping = mapping;
+				mapping = NULL;
+			}
+			table->size = header.size;
+			table->mask = header.size - 1;
+			table->slots = (int) header.slots;
+			x->table_record = 0;
+			if (x->table_record_slot >= table->slots) {
+				x->table_record_slot = table->slots - 1;
+			}
+			_wavecap_table_reset_phase(x);
+			post("load: %s (%d slots of %d samples%s)", path, table->slots, table->size, data ? ", converted" : "");
+		}
+	}
+
+	if (mapping) {
+		ps_mmap_close(mapping);
+		ps_rtpool_free(mapping);
+	}
+}
+
+/*
+	applies one parameter change, from the perform routine or a message handler (see ps_events_send())
+*/
+static void _wavecap_event (void* owner, const t_ps_event* event) {
+	t_wavecap* x = (t_wavecap*) owner;
+
+	switch (event->param) {
+		case wavecap_event_table_interp:
+			x->table_interp = (ps_interp_type) (int) event->value;
+			break;
+		case wavecap_event_env_atk_ms:
+			x->env_atk_ms = event->value;
+			_wavecap_env_atk_coeff_recompute(x);
+			break;
+		case wavecap_event_env_dcy_ms:
+			x->env_dcy_ms = event->value;
+			_wavecap_env_dcy_coeff_recompute(x);
+			break;
+	}
+}
+
+static void wavecap_table_interp (t_wavecap* x, t_float f, t_floatarg delay_ms) {
 	int i = (int) f;
-	if (i < 0 || i >= interp_types_num) {
-		error("table_interp: %d invalid, must be in the interval [%d, %d)", i, 0, interp_types_num);
+	if (i < 0 || i >= ps_interp_types_num) {
+		error("table_interp: %d invalid, must be in the interval [%d, %d)", i, 0, ps_interp_types_num);
+		return;
+	}
+
+	if (i == ps_interp_sinc && x->table_sinc_kernel == NULL) {
+		x->table_sinc_kernel = _wavecap_sinc_kernel_get(x->table_sinc_taps);
+		if (x->table_sinc_kernel == NULL) {
+			error("table_interp: could not allocate sinc kernel");
+			return;
+		}
+	}
+
+	// the sinc kernel is in place before the change falls due
+	ps_events_send(&x->events, x, _wavecap_event, wavecap_event_table_interp, (t_float) i, delay_ms);
+	post("table_interp: %d", i);
+}
+
+static void wavecap_table_sinc_taps (t_wavecap* x, t_float f) {
+	int taps = (int) f;
+	t_sample* kernel;
+
+	if (_wavecap_sinc_kernel_slot(taps) < 0) {
+		error("table_sinc_taps: %d invalid, must be 8, 16 or 32", taps);
+		return;
+	}
+
+	kernel = _wavecap_sinc_kernel_get(taps);
+	if (kernel == NULL) {
+		error("table_sinc_taps: could not allocate sinc kernel");
 		return;
 	}
 
-	x->table_interp = (interp_type) i;
-	post("table_interp: %d", x->table_interp);
+	x->table_sinc_taps = taps;
+	x->table_sinc_kernel = kernel;
+	post("table_sinc_taps: %d", x->table_sinc_taps);
 }
 
-static void wavecap_env_atk_ms (t_wavecap* x, t_float f) {
-	x->env_atk_ms = f;
-	_wavecap_env_atk_coeff_recompute(x);
-	post("env_atk_ms: %f", x->env_atk_ms);
+static void wavecap_env_atk_ms (t_wavecap* x, t_float f, t_floatarg delay_ms) {
+	ps_events_send(&x->events, x, _wavecap_event, wavecap_event_env_atk_ms, f, delay_ms);
+	post("env_atk_ms: %f", f);
+}
+
+static void wavecap_env_dcy_ms (t_wavecap* x, t_float f, t_floatarg delay_ms) {
+	ps_events_send(&x->events, x, _wavecap_event, wavecap_event_env_dcy_ms, f, delay_ms);
+	post("env_dcy_ms: %f", f);
+}
+
+/*
+	voice bank dsp: runs every voice of the bank for n samples and writes the sum to out
+*/
+static PS_KERNEL void _wavecap_voices_perform (t_wavecap* x, const t_ps_wavetable* wavetable, t_float* in_morph, t_float* out, int n) {
+	ps_voices_render(wavetable, &x->voices, x->osc.env_atk_coeff, x->osc.env_dcy_coeff, x->sample_rate, in_morph, out, n);
 }
 
-static void wavecap_env_dcy_ms (t_wavecap* x, t_float f) {
-	x->env_dcy_ms = f;
-	_wavecap_env_dcy_coeff_recompute(x);
-	post("env_dcy_ms: %f", x->env_dcy_ms);
+/*
+	sets voice pitches from a multichannel inlet 2, one channel per voice, sampled once per block
+*/
+static void _wavecap_voices_pitch_signal (t_wavecap* x, t_float* in_pitch, int nchans, int n) {
+	int voices = nchans < x->voices.num ? nchans : x->voices.num;
+	int v;
+	t_sample pitch;
+
+	for (v = 0; v < voices; v++) {
+		pitch = ps_fabs(in_pitch[v * n]);
+		x->voices.pitch[v] = pitch;
+		x->voices.env_target[v] = pitch > 0.0f ? 1.0f : 0.0f;
+	}
 }
 
 /*
-	interpolators
+	applies the parameter changes due by frame start, to x and to the perform routine's copies of its state; returns the first change not yet due
 */
+static int _wavecap_events_apply (t_wavecap* x, const t_ps_event* events, int events_num, int event, int start, t_ps_wavetable* wavetable, t_ps_wavetable_osc* osc) {
+	// a change of envelope time also restarts the envelope, so the changes apply to the oscillator as it is at start
+	x->osc = *osc;
+	while (event < events_num && events[event].offset <= start) {
+		_wavecap_event(x, &events[event++]);
+	}
+	wavetable->interp = x->table_interp;
+	*osc = x->osc;
+	return event;
+}
 
 /*
 	main dsp callback
 */
-static t_int* wavecap_perform (t_int* w) {
+static PS_KERNEL t_int* wavecap_perform (t_int* w) {
 	// parse args
 	t_wavecap* x = (t_wavecap*) w[1];
     t_float* in_table = (t_float*) w[2];
 	t_float* in_env = (t_float*) w[3];
-    t_float* out = (t_float*) w[4];
+	t_float* in_morph = (t_float*) w[4];
+    t_float* out = (t_float*) w[5];
 	int n = x->block_size;
-	float sample_rate = x->sample_rate;
+	t_sample sample_rate = x->sample_rate;
 	//float nyquist_rate = x->nyquist_rate;
 
 	// pull state from struct
 	int table_record = x->table_record;
-	uint32_t table_size = x->table_size;
-	uint32_t table_mask = x->table_mask;
-	float* table = x->table;
-	interp_type table_interp = x->table_interp;
-	int env_enabled = x->env_enabled;
-	float env_atk_ms = x->env_atk_ms;
-	float env_dcy_ms = x->env_dcy_ms;
-	float env_atk_coeff = x->env_atk_coeff;
-	float env_dcy_coeff = x->env_dcy_coeff;
-	float env_last = x->env_last;
-	float phase = x->phase;
-	float phaseIncrement = x->phaseIncrement;
+	int table_record_slot = x->table_record_slot;
+	int table_slots = x->table->slots;
+	uint32_t table_size = x->table->size;
+	t_sample* table = x->table->data;
+	int pitch_enabled = x->pitch_enabled;
+	t_ps_wavetable_osc osc = x->osc;
+	int events_num = ps_events_block(&x->events, n);
+	const t_ps_event* events = x->events.pending;
 
 	// create state
+	t_ps_denormal denormal;
 	int n_computed = 0;
-	int table_idx;
-	float env_tmp = 0.0f;
-
-	// alias Terbe's variables
-	long longPhase;
-	float phaseMix;
-	uint32_t tableMask = table_mask;
-	float* wavetable = table;
-	long truncphase;
-	float fr;
-	float inm1;
-	float in;
-	float inp1;
-	float inp2;
-	float freqAngle;
-
-	// record table
+	int event = 0;
+	int start;
+	int end;
+	t_ps_wavetable wavetable;
+	ps_wavetable_ctrl ctrl;
+	t_sample frame;
+	int bypassed = 0;
+
+	PS_PROFILE_BEGIN(&x->profile);
+	// buffers a message replaced since the last block go back to the pool (see common/ps_rtpool.h)
+	ps_rtpool_recycle(&x->retired);
+	ps_rtpool_recycle(&x->table->retired);
+	denormal = ps_denormal_begin();
+
+	wavetable.data = table;
+	wavetable.size = table_size;
+	wavetable.mask = x->table->mask;
+	wavetable.slots = table_slots;
+	wavetable.interp = x->table_interp;
+	wavetable.sinc_taps = x->table_sinc_taps;
+	wavetable.sinc_kernel = x->table_sinc_kernel;
+
+	// pitch tracker sees the whole block of inlet 2, recording or not
+	if (pitch_enabled) {
+		_wavecap_pitch_track(x, in_env, n);
+		osc.increment = sample_rate > 0.0f ? x->pitch_estimate * table_size / sample_rate : 0.0f;
+	}
+
+	// record table (another instance may have shrunk a shared table since the bang, or loaded a read-only file into it)
+	if (x->table->mapping) {
+		table_record = 0;
+		x->table_record = 0;
+	}
+	if (table_record > (int) table_size) {
+		table_record = table_size;
+	}
+	if (table_record_slot >= table_slots) {
+		table_record_slot = table_slots - 1;
+	}
 	if (table_record > 0) {
-		table += table_size - table_record;
+		table += table_record_slot * table_size + table_size - table_record;
 		while (table_record > 0 && n_computed < n) {
 			*table++ = *in_table++;
 			table_record--;
@@ -234,78 +1230,94 @@ static t_int* wavecap_perform (t_int* w) {
 			n_computed++;
 		}
 		if (table_record == 0) {
-			table = x->table;
 			_wavecap_table_reset_phase(x);
 			post("done!");
 		}
 		x->table_record = table_record;
 	}
 
-	// follow envelope and generate wave
-	in_env += n_computed;
-	while (n_computed < n) {
-		// envelope follower
-		if (env_enabled) {
-			env_tmp = fabsf(*in_env++);
-			if (env_tmp > env_last) {
-				env_last = env_atk_coeff * (env_last - env_tmp) + env_tmp;
-			}
-			else {
-				env_last = env_dcy_coeff * (env_last - env_tmp) + env_tmp;
-			}
+	// voice bank replaces the single oscillator
+	if (x->voices.num > 0) {
+		if (x->voices_pitch_nchans > 1) {
+			_wavecap_voices_pitch_signal(x, in_env, x->voices_pitch_nchans, n);
 		}
-		else {
-			env_last = *in_env++;
+		// parameter changes split the block at their frames (see common/ps_events.h)
+		for (start = n_computed; start < n; start = end) {
+			event = _wavecap_events_apply(x, events, events_num, event, start, &wavetable, &osc);
+			end = event < events_num ? events[event].offset : n;
+			_wavecap_voices_perform(x, &wavetable, in_morph + start, out + start - n_computed, end - start);
 		}
+		_wavecap_events_apply(x, events, events_num, event, n, &wavetable, &osc);
+		ps_denormal_end(denormal);
+		ps_bypass_count(&x->bypass, 1, 0);
+		PS_PROFILE_END(&x->profile);
+		return (w + 6);
+	}
 
-		// wavetable oscillator
-		phaseIncrement = fabsf(env_last) * table_size;
-
-		// interpolate
-		switch (table_interp) {
-		case truncate:
-			longPhase = (long)phase;
-			longPhase = longPhase & tableMask;
+	// follow envelope (a tracked pitch holds the increment for the whole block instead) and generate wave
+	if (pitch_enabled) {
+		ctrl = ps_wavetable_ctrl_hold;
+	}
+	else if (x->env_enabled) {
+		ctrl = ps_wavetable_ctrl_envelope;
+	}
+	else {
+		ctrl = ps_wavetable_ctrl_direct;
+	}
 
-			*(out++) = *(wavetable + longPhase);
-			break;
-		case lin_2:
-			longPhase = (long)phase;
-			longPhase = longPhase & tableMask;
-			phaseMix = phase - (float)longPhase;
-
-			// Xa * (1.0 - pM) + Xb * pM = Xa - Xa*pM + Xb*pM = Xa + pM*(Xb - Xa)
-			*(out++) = *(wavetable + longPhase)
-			+ (phaseMix * (*(wavetable + ((longPhase + 1)&tableMask)) - *(wavetable + longPhase)));
-			break;
-		case lin_4:
-			truncphase = (long) phase;
-			fr = phase - (float) truncphase;
-			inm1 = wavetable[(truncphase - 1) & tableMask];
-			in = wavetable[(truncphase + 0) & tableMask];
-			inp1 = wavetable[(truncphase + 1) & tableMask];
-			inp2 = wavetable[(truncphase + 2) & tableMask];
-
-			*(out++) = in + 0.5 * fr * (inp1 - inm1 +
-				fr * (4.0 * inp1 + 2.0 * inm1 - 5.0 * in - inp2 +
-				fr * (3.0 * (in - inp1) - inm1 + inp2)));
-			break;
-		default:
-			*(out++) = 0.0f;
+	// a silent control input with the envelope at rest leaves the phase standing, so the block is one table read (see common/ps_bypass.h)
+	if (x->bypass.enabled && n_computed == 0 && events_num == 0 && ps_bypass_silent(in_env, n) && (table_slots == 1 || ps_bypass_constant(in_morph, n)) && ps_wavetable_osc_silent(&wavetable, &osc, ctrl, in_env[0], in_morph[0], &frame)) {
+		ps_bypass_fill(out, frame, n);
+		bypassed = 1;
+	}
+	else if (events_num > 0) {
+		for (start = n_computed; start < n; start = end) {
+			event = _wavecap_events_apply(x, events, events_num, event, start, &wavetable, &osc);
+			end = event < events_num ? events[event].offset : n;
+			ps_wavetable_osc(&wavetable, &osc, ctrl, in_env + start, in_morph + start, out + start - n_computed, end - start);
 		}
-
-		n_computed++;
-		phase += phaseIncrement;
-		while (phase >= (float) table_size)
-			phase = phase - (float) table_size;
-		while (phase < 0.0f)
-			phase = phase + (float) table_size;
+		_wavecap_events_apply(x, events, events_num, event, n, &wavetable, &osc);
+	}
+	else {
+		ps_wavetable_osc(&wavetable, &osc, ctrl, in_env + n_computed, in_morph + n_computed, out, n - n_computed);
 	}
-	x->env_last = env_last;
-	x->phase = phase;
-	x->phaseIncrement = phaseIncrement;
+	x->osc = osc;
 
-    return (w + 5);
+	ps_denormal_end(denormal);
+	ps_bypass_count(&x->bypass, 1, bypassed);
+	PS_PROFILE_END(&x->profile);
+
+    return (w + 6);
+}
+
+/*
+	pd callback: per-block DSP timings, see common/ps_profile.h
+*/
+static void wavecap_stats (t_wavecap* x, t_symbol* receiver) {
+	ps_profile_stats(&x->profile, "wavecap~", receiver);
+}
+
+static void wavecap_stats_reset (t_wavecap* x) {
+	ps_profile_reset(&x->profile, "wavecap~");
+}
+
+/*
+	pd callback: silent and constant block bypass, see common/ps_bypass.h
+*/
+static void wavecap_bypass_stats (t_wavecap* x, t_symbol* receiver) {
+	ps_bypass_stats(&x->bypass, "wavecap~", receiver);
+}
+
+static void wavecap_bypass_stats_reset (t_wavecap* x) {
+	ps_bypass_reset(&x->bypass);
+}
+
+static void wavecap_bypass_enable (t_wavecap* x) {
+	ps_bypass_enable(&x->bypass, "wavecap~", 1);
+}
+
+static void wavecap_bypass_disable (t_wavecap* x) {
+	ps_bypass_enable(&x->bypass, "wavecap~", 0);
 }
 
 /*
@@ -313,7 +1325,11 @@ static t_int* wavecap_perform (t_int* w) {
 */
 static void wavecap_dsp (t_wavecap* x, t_signal** sp) {
 	// store sample rate
-	float sr = sp[0]->s_sr;
+	t_float sr = sp[0]->s_sr;
+
+	// the previous chain is gone, so nothing still reads what messages replaced
+	ps_rtpool_reclaim(&x->retired);
+	_wavecap_table_reclaim(x->table);
 	if (x->sample_rate != sr) {
 		x->sample_rate = sr;
 		x->nyquist_rate = sr / 2.0f;
@@ -325,40 +1341,83 @@ static void wavecap_dsp (t_wavecap* x, t_signal** sp) {
 
 	// store block size
 	x->block_size = sp[0]->s_n;
+	ps_events_dsp(&x->events, sr, x->block_size);
 
-    dsp_add(wavecap_perform, 4, x, sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec);
+	// the other inlets read their first channel, the output is always one channel
+	x->voices_pitch_nchans = PS_SIGNAL_NCHANS(sp[1]);
+	ps_signal_setmultiout(&sp[3], 1);
+
+    dsp_add(wavecap_perform, 5, x, sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, sp[3]->s_vec);
 }
 
 /*
 	pd callback: initialize object
 */
-static void* wavecap_new (t_floatarg f) {
+static void* wavecap_new (t_symbol* s) {
     t_wavecap* x = (t_wavecap*) pd_new(wavecap_class);
-	x->f = f;
+	x->f = 0.0f;
+	x->canvas = canvas_getcurrent();
+	ps_profile_init(&x->profile);
+	ps_bypass_init(&x->bypass);
+	ps_events_init(&x->events);
 	x->block_size = -1;
 	x->sample_rate = 0.0f;
 	x->nyquist_rate = 0.0f;
 
 	// set parameter defaults
 	x->table_record = 0;
-	x->table_size = 1024;
-	x->table_mask = 1023;
-	x->table_interp = truncate;
+	x->table_record_slot = 0;
+	x->table_interp = ps_interp_truncate;
+	x->table_sinc_taps = 16;
+	x->table_sinc_kernel = NULL;
 	
 	x->env_enabled = 0;
 	x->env_atk_ms = 10.0f;
 	x->env_dcy_ms = 500.0f;
 
 	// compute env follower coefficients
-	x->env_atk_coeff = NAN;
-	x->env_dcy_coeff = NAN;
-	x->env_last = 0.0f;
+	x->osc.env_atk_coeff = NAN;
+	x->osc.env_dcy_coeff = NAN;
+	x->osc.env_last = 0.0f;
+
+	x->voices.num = 0;
+	x->voices.lanes = 0;
+	x->voices_pitch_nchans = 1;
+	x->voices.pitch = NULL;
+	x->voices.phase = NULL;
+	x->voices.increment = NULL;
+	x->voices.env = NULL;
+	x->voices.env_target = NULL;
+
+	x->pitch_enabled = 0;
+	x->pitch_window = 2048;
+	x->pitch_hop = 512;
+	x->pitch_threshold = 0.15f;
+	x->pitch_fft_cfg = NULL;
+	x->pitch_ifft_cfg = NULL;
+	x->pitch_buffer = NULL;
+	x->pitch_buffer_idx = 0;
+	x->pitch_hop_countdown = 0;
+	x->pitch_frame = NULL;
+	x->pitch_lag = NULL;
+	x->pitch_spectrum_frame = NULL;
+	x->pitch_spectrum_head = NULL;
+	x->pitch_estimate = 0.0f;
+
+	x->retired.head = NULL;
+
+	// attach to a shared table if named, otherwise a private one
+	x->table = _wavecap_table_attach(*s->s_name ? s : NULL, 1024);
+	if (x->table == NULL) {
+		pd_free((t_pd*) x);
+		return NULL;
+	}
 
 	// call helpers
-	_wavecap_table_alloc(x);
 	_wavecap_table_reset_phase(x);
 
 	// create inlets
+    inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, 0);
     inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, 0);
 	outlet_new(&x->x_obj, &s_signal);
 
@@ -369,23 +1428,56 @@ static void* wavecap_new (t_floatarg f) {
 	pd callback: delete object
 */
 static void wavecap_delete (t_wavecap* x) {
-	_wavecap_table_free(x);
+	_wavecap_table_detach(x->table);
+	_wavecap_voices_free(x);
+	_wavecap_pitch_free(x);
+	ps_rtpool_reclaim(&x->retired);
 }
 
 /*
 	pd callback: setup object
 */
 void wavecap_tilde_setup (void) {
-    wavecap_class = class_new(gensym("wavecap~"), (t_newmethod) wavecap_new, (t_method) wavecap_delete, sizeof(t_wavecap), 0, A_NULL, 0);
+	ps_lock(&wavecap_setup_lock);
+	if (wavecap_class) {
+		ps_unlock(&wavecap_setup_lock);
+		return;
+	}
+
+	ps_rtpool_setup();
+    wavecap_class = class_new(gensym("wavecap~"), (t_newmethod) wavecap_new, (t_method) wavecap_delete, sizeof(t_wavecap), PS_CLASS_MULTICHANNEL, A_DEFSYM, 0);
 	
 	class_addbang(wavecap_class, (t_method) wavecap_table_record);
 	class_addmethod(wavecap_class, (t_method) wavecap_env_enable, gensym("env_enable"), A_NULL, 0);
 	class_addmethod(wavecap_class, (t_method) wavecap_env_disable, gensym("env_disable"), A_NULL, 0);
+	class_addmethod(wavecap_class, (t_method) wavecap_pitch_enable, gensym("pitch_enable"), A_NULL, 0);
+	class_addmethod(wavecap_class, (t_method) wavecap_pitch_disable, gensym("pitch_disable"), A_NULL, 0);
+	class_addmethod(wavecap_class, (t_method) wavecap_pitch_window, gensym("pitch_window"), A_FLOAT, 0);
+	class_addmethod(wavecap_class, (t_method) wavecap_pitch_hop, gensym("pitch_hop"), A_FLOAT, 0);
+	class_addmethod(wavecap_class, (t_method) wavecap_pitch_threshold, gensym("pitch_threshold"), A_FLOAT, 0);
 	class_addmethod(wavecap_class, (t_method) wavecap_table_size, gensym("table_size"), A_FLOAT, 0);
-    class_addmethod(wavecap_class, (t_method) wavecap_table_interp, gensym("table_interp"), A_FLOAT, 0);
-    class_addmethod(wavecap_class, (t_method) wavecap_env_atk_ms, gensym("env_atk_ms"), A_FLOAT, 0);
-    class_addmethod(wavecap_class, (t_method) wavecap_env_dcy_ms, gensym("env_dcy_ms"), A_FLOAT, 0);
+	class_addmethod(wavecap_class, (t_method) wavecap_table_slots, gensym("table_slots"), A_FLOAT, 0);
+	class_addmethod(wavecap_class, (t_method) wavecap_table_slot, gensym("table_slot"), A_FLOAT, 0);
+	class_addmethod(wavecap_class, (t_method) wavecap_table_name, gensym("table_name"), A_DEFSYM, 0);
+	class_addmethod(wavecap_class, (t_method) wavecap_table_import, gensym("table_import"), A_SYMBOL, 0);
+	class_addmethod(wavecap_class, (t_method) wavecap_table_export, gensym("table_export"), A_SYMBOL, 0);
+	class_addmethod(wavecap_class, (t_method) wavecap_save, gensym("save"), A_SYMBOL, 0);
+	class_addmethod(wavecap_class, (t_method) wavecap_load, gensym("load"), A_SYMBOL, 0);
+    class_addmethod(wavecap_class, (t_method) wavecap_table_interp, gensym("table_interp"), A_FLOAT, A_DEFFLOAT, 0);
+    class_addmethod(wavecap_class, (t_method) wavecap_table_sinc_taps, gensym("table_sinc_taps"), A_FLOAT, 0);
+    class_addmethod(wavecap_class, (t_method) wavecap_env_atk_ms, gensym("env_atk_ms"), A_FLOAT, A_DEFFLOAT, 0);
+    class_addmethod(wavecap_class, (t_method) wavecap_env_dcy_ms, gensym("env_dcy_ms"), A_FLOAT, A_DEFFLOAT, 0);
+    class_addmethod(wavecap_class, (t_method) wavecap_voices, gensym("voices"), A_FLOAT, 0);
+    class_addmethod(wavecap_class, (t_method) wavecap_pitches, gensym("pitches"), A_GIMME, 0);
+    class_addmethod(wavecap_class, (t_method) wavecap_stats, gensym("stats"), A_DEFSYM, 0);
+    class_addmethod(wavecap_class, (t_method) wavecap_stats_reset, gensym("stats_reset"), A_NULL, 0);
+    class_addmethod(wavecap_class, (t_method) wavecap_bypass_stats, gensym("bypass_stats"), A_DEFSYM, 0);
+    class_addmethod(wavecap_class, (t_method) wavecap_bypass_stats_reset, gensym("bypass_stats_reset"), A_NULL, 0);
+    class_addmethod(wavecap_class, (t_method) wavecap_bypass_enable, gensym("bypass_enable"), A_NULL, 0);
+    class_addmethod(wavecap_class, (t_method) wavecap_bypass_disable, gensym("bypass_disable"), A_NULL, 0);
 
     CLASS_MAINSIGNALIN(wavecap_class, t_wavecap, f);
     class_addmethod(wavecap_class, (t_method) wavecap_dsp, gensym("dsp"), A_CANT, 0);
+
+	ps_unlock(&wavecap_setup_lock);
 }
\ No newline at end of file
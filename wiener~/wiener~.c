@@ -3,13 +3,29 @@
 #pragma warning( disable : 4305 )
 #endif
 
+// pthread_setaffinity_np() for the worker threads (common/ps_parallel.h)
+#define _GNU_SOURCE
+
 #define _USE_MATH_DEFINES
 #include <math.h>
 
 #include "m_pd.h"
 
+#include "../common/ps_bypass.h"
+#include "../common/ps_dispatch.h"
+#include "../common/ps_lock.h"
+#include "../common/ps_multichannel.h"
+#include "../common/ps_parallel.h"
+#include "../common/ps_profile.h"
+#include "../common/ps_rtpool.h"
+#include "../core/ps_wiener.h"
+#include "../core/ps_denormal.h"
+
 #include "kiss_fft130/kiss_fftr.h"
 
+// KissFFT works on the signal buffers in place, so kiss_fft_scalar has to be t_sample (FLOATSIZE=64 in the Makefile builds both as double)
+typedef char _wiener_kiss_fft_scalar_matches_t_sample[sizeof(kiss_fft_scalar) == sizeof(t_sample) ? 1 : -1];
+
 /*	
 	wiener~
 	Chris Donahue (http://cdonahue.me) 2014
@@ -21,11 +37,24 @@
 		* window_type hann		(hann window applied to the input signal before FFT)
 		* power_spectrum		(use power spectrum (FFT bin magnitude squared) for entropy computation)
 		* amplitude_spectrum	(use amplitude spectrum (FFT bin magnitude) for entropy computation)
+		* spectrum_array name	(write the spectrum of every block into the array called name, no name stops writing) [default: none]
+		* spectrum_db n			(n = 1 writes the spectrum in dB, 0 writes the power or amplitude itself) [default: 0]
+		* spectrum_redraw ms	(time between redraws of the spectrum array, 0 redraws after every block) [default: 50]
+		* threads n				(analyze the channels on n worker threads, one block late; 0 analyzes them on Pd's thread) [default: 0]
+		* stats [receiver]		(post DSP time per block, or send it to receiver; needs a PS_PROFILE build, see common/ps_profile.h)
+		* stats_reset			(clear the DSP timings)
+		* bypass_stats [receiver]	(post channel blocks run and bypassed for silent or constant input, or send them to receiver; see common/ps_bypass.h)
+		* bypass_stats_reset	(clear the bypass counters)
+		* bypass_enable		(turn the bypass on) [default]
+		* bypass_disable		(turn the bypass off)
 
 	Additional details:
 		* FFT size is PD's current block size.
+		* Multichannel input (Pd 0.54+) is analyzed per channel. A single channel outputs a float as before, several channels output a list with one entropy per channel.
+		* With threads the channels are analyzed on worker threads, each with its own FFT, while Pd runs the rest of the DSP chain (see common/ps_parallel.h). The entropies and the spectrum of a block come out at the next block, and nothing comes out at the first block after DSP starts or threads changes. stats then times only what the object costs Pd's thread: the copies to and from the workers, and any wait for them.
 		* Small epsilon value is added to each bin power to ensure no divide by zero craziness and sane output (1.0) for incoming silence
-		* KissFFT is used for FFT calculation
+		* The spectrum array gets the bins the entropy is computed from (power or amplitude, following power_spectrum/amplitude_spectrum, unnormalized), of the first channel. Bin i is at i * sample rate / block size Hz. There are block size / 2 - 1 bins: a longer array keeps its extra points, a shorter one gets the bins that fit. The perform routine writes them straight into the array's storage, like tabsend~, and only schedules the redraw. The redraw itself runs from a clock, outside the DSP tick, at most once per spectrum_redraw ms.
+		* KissFFT is used for FFT calculation, the windowing and the entropy itself are in core/ps_wiener.h
 
 	Resources used:
 		* http://en.wikipedia.org/wiki/Spectral_flatness
@@ -35,15 +64,31 @@
 		* http://kissfft.sourceforge.net/
 */
 
-#define epsilon 1e-20
-
 static t_class* wiener_class;
+static t_ps_lock wiener_setup_lock = PS_LOCK_INIT;
 
 typedef enum {
 	rectangle,
 	hann
 } fftr_window_type;
 
+// what _wiener_channel() did with a block
+typedef enum {
+	block_computed,
+	// silent and computed, its entropy fills the silence cache
+	block_silent_computed,
+	// silent and taken from the silence cache (bypassed)
+	block_silent_cached
+} wiener_block;
+
+// FFT state for one channel at a time, the perform routine's own or a worker lane's
+typedef struct _wiener_fft {
+	kiss_fftr_cfg cfg;
+	kiss_fft_cpx* output;
+	// windowed copy of one channel (the input vector belongs to Pd and is left untouched)
+	t_sample* input;
+} t_wiener_fft;
+
 typedef struct _wiener {
     t_object x_obj;
     t_float x_f;
@@ -59,81 +104,190 @@ typedef struct _wiener {
 	fftr_window_type fftr_input_window_type;
 
 	// fft state
-	kiss_fftr_cfg fftr_cfg;
+	t_wiener_fft fft;
 	int fftr_output_size;
-	kiss_fft_cpx* fftr_output;
-	float* fftr_input_window;
+	t_sample* fftr_input_window;
+
+	// spectrum export: the array's storage (NULL when not exporting) and its size in points
+	t_symbol* spectrum_name;
+	t_word* spectrum_vec;
+	int spectrum_size;
+	int spectrum_db;
+	// samples between redraws, and left until the next one
+	t_float spectrum_redraw_ms;
+	int spectrum_redraw_samples;
+	int spectrum_redraw_countdown;
+	t_clock* spectrum_redraw_clock;
+	t_float sample_rate;
+
+	// flatness of a silent block for the amplitude [0] and power [1] spectrum, cached by the first silent block at this block size
+	t_sample silence_entropy[2];
+	int silence_entropy_valid[2];
+
+	// one entropy per channel, sent as a list when there are several
+	int channels_num;
+	t_atom* channels_entropy;
+
+	// windows and lanes replaced while dsp runs, recycled at the next block (see common/ps_rtpool.h)
+	t_ps_rtpool_retired retired;
+
+	// worker threads, with one lane per channel: a copy of its input, its own FFT and its result (NULL without workers, see common/ps_parallel.h)
+	t_ps_parallel parallel;
+	int lanes_num;
+	t_sample* lanes_input;
+	t_wiener_fft* lanes_fft;
+	t_sample* lanes_entropy;
+	wiener_block* lanes_block;
+	// spectrum type of the block the lanes hold
+	int lanes_power_spectrum;
+
+	// perform timings (empty unless built with PS_PROFILE)
+	t_ps_profile profile;
+	// silent and constant block bypass (see common/ps_bypass.h)
+	t_ps_bypass bypass;
 } t_wiener;
 
 /*
 	internal state helpers
 */
 
+static void _wiener_fft_alloc (t_wiener_fft* fft, int nfft) {
+	size_t cfg_size = 0;
+
+	// KissFFT sizes its state first, then builds it in pool memory
+	kiss_fftr_alloc(nfft, 0, NULL, &cfg_size);
+	fft->cfg = kiss_fftr_alloc(nfft, 0, ps_rtpool_alloc(cfg_size), &cfg_size);
+	// kiss_fftr writes nfft / 2 + 1 bins even though only the first fftr_output_size are used
+	fft->output = (kiss_fft_cpx*) ps_rtpool_alloc(sizeof(kiss_fft_cpx) * (nfft / 2 + 1));
+	fft->input = (t_sample*) ps_rtpool_alloc(sizeof(t_sample) * nfft);
+}
+
+static void _wiener_fft_free (t_wiener_fft* fft) {
+	ps_rtpool_free(fft->cfg);
+	fft->cfg = NULL;
+	ps_rtpool_free(fft->output);
+	fft->output = NULL;
+	ps_rtpool_free(fft->input);
+	fft->input = NULL;
+}
+
 static void _wiener_fftr_alloc (t_wiener* x) {
-	int nfft = x->block_size;
-	int fftr_output_size = (nfft / 2) - 1;
-	x->fftr_cfg = kiss_fftr_alloc(nfft, 0, 0, 0);
-	x->fftr_output_size = fftr_output_size;
-	x->fftr_output = (kiss_fft_cpx*) malloc(sizeof(kiss_fft_cpx) * fftr_output_size);
+	x->fftr_output_size = (x->block_size / 2) - 1;
+	_wiener_fft_alloc(&x->fft, x->block_size);
 }
 
 static void _wiener_fftr_free (t_wiener* x) {
-	if (x->fftr_cfg) {
-		free(x->fftr_cfg);
-		x->fftr_cfg = NULL;
+	_wiener_fft_free(&x->fft);
+}
+
+/*
+	lanes for the worker threads, sized for the current channels and block size; the workers must be stopped or waited for
+*/
+static void _wiener_lanes_retire (t_wiener* x) {
+	int i;
+
+	if (x->lanes_fft != NULL) {
+		for (i = 0; i < x->lanes_num; i++) {
+			ps_rtpool_retire(&x->retired, x->lanes_fft[i].cfg);
+			ps_rtpool_retire(&x->retired, x->lanes_fft[i].output);
+			ps_rtpool_retire(&x->retired, x->lanes_fft[i].input);
+		}
+	}
+	ps_rtpool_retire(&x->retired, x->lanes_fft);
+	x->lanes_fft = NULL;
+	ps_rtpool_retire(&x->retired, x->lanes_input);
+	x->lanes_input = NULL;
+	ps_rtpool_retire(&x->retired, x->lanes_entropy);
+	x->lanes_entropy = NULL;
+	ps_rtpool_retire(&x->retired, x->lanes_block);
+	x->lanes_block = NULL;
+	x->lanes_num = 0;
+}
+
+static void _wiener_lanes_alloc (t_wiener* x) {
+	int i;
+
+	_wiener_lanes_retire(x);
+	if (x->parallel.workers_num == 0 || x->block_size <= 0 || x->channels_num <= 0) {
+		return;
 	}
-	if (x->fftr_output) {
-		free(x->fftr_output);
-		x->fftr_output = NULL;
+	x->lanes_num = x->channels_num;
+	x->lanes_input = (t_sample*) ps_rtpool_calloc(x->channels_num * x->block_size, sizeof(t_sample));
+	x->lanes_fft = (t_wiener_fft*) ps_rtpool_calloc(x->channels_num, sizeof(t_wiener_fft));
+	x->lanes_entropy = (t_sample*) ps_rtpool_calloc(x->channels_num, sizeof(t_sample));
+	x->lanes_block = (wiener_block*) ps_rtpool_calloc(x->channels_num, sizeof(wiener_block));
+	for (i = 0; i < x->channels_num; i++) {
+		_wiener_fft_alloc(&x->lanes_fft[i], x->block_size);
 	}
 }
 
+static void _wiener_channels_alloc (t_wiener* x, int channels_num) {
+	ps_rtpool_free(x->channels_entropy);
+	x->channels_num = channels_num;
+	x->channels_entropy = (t_atom*) ps_rtpool_calloc(channels_num, sizeof(t_atom));
+}
+
 static int _wiener_fftr_input_window_needs_buffer (t_wiener* x) {
 	return x->fftr_input_window_type >= 1;
 }
 
 static void _wiener_fftr_input_window_alloc (t_wiener* x) {
-	int n;
 	int block_size = x->block_size;
-	float* fftr_input_window;
-	double window_value;
-
-	// state for hann window functions
-	double cos_inner_value;
-	double cos_inner_increment;
 
 	if (block_size > 0 && _wiener_fftr_input_window_needs_buffer(x)) {
-		fftr_input_window = (float*) malloc(sizeof(float) * block_size);
-		x->fftr_input_window = fftr_input_window;
+		x->fftr_input_window = (t_sample*) ps_rtpool_alloc(sizeof(t_sample) * block_size);
 		
 		if (x->fftr_input_window_type == hann) {
-			cos_inner_value = 0.0;
-			cos_inner_increment = (2.0 * M_PI) / ((double) (block_size - 1));
-			for (n = 0; n < block_size; n++) {
-				window_value = 0.5 * (1.0 - cos(cos_inner_value));
-				cos_inner_value += cos_inner_increment;
-				*fftr_input_window++ = (float) window_value;
-			}
+			ps_wiener_window_hann(x->fftr_input_window, block_size);
 		}
 	}
 }
 
 static void _wiener_fftr_input_window_free (t_wiener* x) {
-	if (x->fftr_input_window) {
-		free(x->fftr_input_window);
-		x->fftr_input_window = NULL;
-	}
+	ps_rtpool_retire(&x->retired, x->fftr_input_window);
+	x->fftr_input_window = NULL;
 }
 
-static void _wiener_fftr_input_apply_window (t_wiener* x, float* fftr_input) {
+/*
+	returns the FFT input for one channel: the signal itself for a rectangle window, otherwise a windowed copy in fft->input
+*/
+static const t_sample* _wiener_fftr_input_apply_window (t_wiener* x, t_wiener_fft* fft, const t_sample* in) {
 	if (_wiener_fftr_input_window_needs_buffer(x)) {
-		float* fftr_input_window = x->fftr_input_window;
-		int n = x->block_size;
+		ps_wiener_window_apply(x->fftr_input_window, in, fft->input, x->block_size);
+		return fft->input;
+	}
+	return in;
+}
 
-		while (n--) {
-			*fftr_input = (*fftr_input_window++) * (*fftr_input++);
-		}
+/*
+	looks up the spectrum array and points spectrum_vec at its storage; called when the name changes and from the dsp method, since Pd rebuilds the DSP chain whenever an array used in DSP is resized or deleted
+*/
+static void _wiener_spectrum_attach (t_wiener* x) {
+	t_garray* garray;
+
+	x->spectrum_vec = NULL;
+	x->spectrum_size = 0;
+	if (x->spectrum_name == &s_) {
+		return;
+	}
+
+	garray = (t_garray*) pd_findbyclass(x->spectrum_name, garray_class);
+	if (garray == NULL) {
+		error("spectrum_array: %s: no such array", x->spectrum_name->s_name);
+		return;
+	}
+	if (!garray_getfloatwords(garray, &x->spectrum_size, &x->spectrum_vec)) {
+		error("spectrum_array: %s: bad template", x->spectrum_name->s_name);
+		x->spectrum_vec = NULL;
+		x->spectrum_size = 0;
+		return;
 	}
+	garray_usedindsp(garray);
+}
+
+static void _wiener_spectrum_redraw_recompute (t_wiener* x) {
+	x->spectrum_redraw_samples = (int) (x->spectrum_redraw_ms * x->sample_rate * 0.001f);
+	x->spectrum_redraw_countdown = 0;
 }
 
 /*
@@ -154,6 +308,8 @@ static void wiener_window_type (t_wiener* x, t_symbol* selector, int argc, t_ato
 		return;
 	}
 
+	ps_parallel_wait(&x->parallel);
+
 	arg_0 = argv[0].a_w.w_symbol->s_name;
 
 	if (strcmp(arg_0, "rectangle") == 0) {
@@ -176,96 +332,296 @@ static void wiener_window_type (t_wiener* x, t_symbol* selector, int argc, t_ato
 }
 
 static void wiener_amplitude_spectrum (t_wiener* x) {
+	ps_parallel_wait(&x->parallel);
 	x->wiener_power_spectrum = 0;
 
 	post("using amplitude spectrum for Wiener entropy calculation");
 }
 
 static void wiener_power_spectrum (t_wiener* x) {
+	ps_parallel_wait(&x->parallel);
 	x->wiener_power_spectrum = 1;
 
 	post("using power spectrum for Wiener entropy calculation");
 }
 
+static void wiener_spectrum_array (t_wiener* x, t_symbol* s) {
+	x->spectrum_name = s;
+	_wiener_spectrum_attach(x);
+
+	if (x->spectrum_vec) {
+		post("spectrum_array: %s (%d points)", s->s_name, x->spectrum_size);
+	}
+	else if (s == &s_) {
+		post("spectrum_array: none");
+	}
+}
+
+static void wiener_spectrum_db (t_wiener* x, t_float f) {
+	x->spectrum_db = f != 0.0f;
+
+	post("spectrum_db: %d", x->spectrum_db);
+}
+
+static void wiener_spectrum_redraw (t_wiener* x, t_float f) {
+	if (f < 0.0f) {
+		error("spectrum_redraw: %f invalid, must be 0 or more", f);
+		return;
+	}
+	x->spectrum_redraw_ms = f;
+	_wiener_spectrum_redraw_recompute(x);
+
+	post("spectrum_redraw: %f", x->spectrum_redraw_ms);
+}
+
+static void wiener_threads (t_wiener* x, t_floatarg f) {
+	int threads = f > 0.0f ? (int) f : 0;
+
+	if (ps_parallel_start(&x->parallel, threads) < threads) {
+		error("wiener~: threads: started %d of %d worker threads", x->parallel.workers_num, threads);
+	}
+	_wiener_lanes_alloc(x);
+
+	post("threads: %d", x->parallel.workers_num);
+}
+
+/*
+	pd callback: clock set by the perform routine, redraws the spectrum array outside the DSP tick
+*/
+static void wiener_spectrum_redraw_tick (t_wiener* x) {
+	t_garray* garray;
+
+	// looked up again, the array may have gone since the perform routine asked
+	if (x->spectrum_name != &s_ && (garray = (t_garray*) pd_findbyclass(x->spectrum_name, garray_class))) {
+		garray_redraw(garray);
+	}
+}
+
+/*
+	spectral flatness of one channel
+*/
+static PS_KERNEL t_sample _wiener_entropy (t_wiener* x, t_wiener_fft* fft, const t_sample* in) {
+	// apply window and compute fft
+	kiss_fftr(fft->cfg, _wiener_fftr_input_apply_window(x, fft, in), fft->output);
+
+	// bins as interleaved real and imaginary parts
+	return ps_wiener_entropy((const t_sample*) fft->output, x->fftr_output_size, x->wiener_power_spectrum);
+}
+
+/*
+	writes the bins of fft's last FFT into the spectrum array
+*/
+static PS_KERNEL void _wiener_spectrum_write (t_wiener* x, const t_wiener_fft* fft, t_word* vec, int size) {
+	const t_sample* bins = (const t_sample*) fft->output;
+	int power_spectrum = x->wiener_power_spectrum;
+	int db = x->spectrum_db;
+	int i;
+
+	if (size > x->fftr_output_size) {
+		size = x->fftr_output_size;
+	}
+	for (i = 0; i < size; i++) {
+		vec[i].w_float = ps_wiener_bin_level(bins[2 * i], bins[2 * i + 1], power_spectrum, db);
+	}
+}
+
+/*
+	writes the spectrum of a silent block (every bin zero, as the FFT of zeros gives) into the spectrum array
+*/
+static void _wiener_spectrum_write_silent (t_wiener* x, t_word* vec, int size) {
+	t_sample level = ps_wiener_bin_level(0.0f, 0.0f, x->wiener_power_spectrum, x->spectrum_db);
+	int i;
+
+	if (size > x->fftr_output_size) {
+		size = x->fftr_output_size;
+	}
+	for (i = 0; i < size; i++) {
+		vec[i].w_float = level;
+	}
+}
+
+/*
+	spectral flatness of one channel into entropy, from the silence cache when it can (see common/ps_bypass.h)
+*/
+static wiener_block _wiener_channel (t_wiener* x, t_wiener_fft* fft, const t_sample* in, t_sample* entropy) {
+	// silence always has the same flatness, the first silent block computes it and the rest take it from the cache
+	int silent = x->bypass.enabled && ps_bypass_silent(in, x->block_size);
+
+	if (silent && x->silence_entropy_valid[x->wiener_power_spectrum]) {
+		*entropy = x->silence_entropy[x->wiener_power_spectrum];
+		return block_silent_cached;
+	}
+	*entropy = _wiener_entropy(x, fft, in);
+	return silent ? block_silent_computed : block_computed;
+}
+
+/*
+	fills the silence cache from a silent block, and writes the first channel's spectrum
+*/
+static void _wiener_channel_done (t_wiener* x, int channel, const t_wiener_fft* fft, wiener_block block, t_sample entropy, int power_spectrum) {
+	if (block == block_silent_computed) {
+		x->silence_entropy[power_spectrum] = entropy;
+		x->silence_entropy_valid[power_spectrum] = 1;
+	}
+	if (channel == 0 && x->spectrum_vec) {
+		if (block == block_silent_cached) {
+			_wiener_spectrum_write_silent(x, x->spectrum_vec, x->spectrum_size);
+		}
+		else {
+			_wiener_spectrum_write(x, fft, x->spectrum_vec, x->spectrum_size);
+		}
+	}
+}
+
+/*
+	worker thread callback: one channel of the released block, from its lane to its lane (see common/ps_parallel.h)
+*/
+static void _wiener_lane (void* owner, int lane) {
+	t_wiener* x = (t_wiener*) owner;
+	t_ps_denormal denormal = ps_denormal_begin();
+
+	x->lanes_block[lane] = _wiener_channel(x, &x->lanes_fft[lane], x->lanes_input + lane * x->block_size, &x->lanes_entropy[lane]);
+	ps_denormal_end(denormal);
+}
+
+/*
+	with worker threads: takes the entropies and spectrum the lanes computed during the last tick, and hands them this block
+	returns 0 when the lanes had no block yet, otherwise the entropies are in channels_entropy and bypassed counts the cached ones
+*/
+static int _wiener_lanes_exchange (t_wiener* x, const t_sample* in, int nchans, int* bypassed) {
+	int ready = ps_parallel_wait(&x->parallel);
+	int channel;
+
+	if (ready) {
+		for (channel = 0; channel < nchans; channel++) {
+			SETFLOAT(&x->channels_entropy[channel], x->lanes_entropy[channel]);
+			_wiener_channel_done(x, channel, &x->lanes_fft[channel], x->lanes_block[channel], x->lanes_entropy[channel], x->lanes_power_spectrum);
+			*bypassed += x->lanes_block[channel] == block_silent_cached;
+		}
+	}
+
+	memcpy(x->lanes_input, in, nchans * x->block_size * sizeof(t_sample));
+	x->lanes_power_spectrum = x->wiener_power_spectrum;
+	ps_parallel_release(&x->parallel, nchans);
+	return ready;
+}
+
 /*
 	main dsp callback
 */
 static t_int* wiener_perform (t_int* w) {
 	// pull state from args
 	t_wiener* x = (t_wiener*) w[1];
-    float* fftr_input = (float*) w[2];
-    int n = (int) w[4];
+    t_sample* in = (t_sample*) w[2];
+	int nchans = (int) w[3];
 
 	// pull state from struct
 	t_outlet* outlet = x->outlet;
 	int block_size = x->block_size;
-	int wiener_power_spectrum = x->wiener_power_spectrum;
-	kiss_fftr_cfg fftr_cfg = x->fftr_cfg;
-	int fftr_output_size = x->fftr_output_size;
-	double fftr_output_size_d = (double) fftr_output_size;
-	kiss_fft_cpx* fftr_output = x->fftr_output;
-	
-	// create state
-	int i;
-	double fftr_bin_amplitude;
-	double fftr_bin_power;
-	double fftr_bins_amplitude_sum = 0.0;
-	double fftr_bins_power_sum = 0.0;
-	double fftr_bins_amplitude_sum_ln = 0.0;
-	double fftr_bins_power_sum_ln = 0.0;
-	double wiener_numerator;
-	double wiener_denominator;
-	float wiener_entropy;
-
-	// apply window
-	_wiener_fftr_input_apply_window(x, fftr_input);
-	
-	// compute fft
-	kiss_fftr(fftr_cfg, fftr_input, fftr_output);
+	t_atom* channels_entropy = x->channels_entropy;
+	int power_spectrum = x->wiener_power_spectrum;
 
-	// compute wiener entropy
-	for (i = 0; i < fftr_output_size; i++) {
-		kiss_fft_cpx bin = fftr_output[i];
+	// create state
+	t_ps_denormal denormal;
+	int channel;
+	wiener_block block;
+	t_sample entropy;
+	int bypassed = 0;
+
+	PS_PROFILE_BEGIN(&x->profile);
+	// buffers a message replaced since the last block go back to the pool (see common/ps_rtpool.h)
+	ps_rtpool_recycle(&x->retired);
+
+	if (x->lanes_input != NULL) {
+		if (!_wiener_lanes_exchange(x, in, nchans, &bypassed)) {
+			PS_PROFILE_END(&x->profile);
+			return (w + 4);
+		}
+	}
+	else {
+		denormal = ps_denormal_begin();
+
+		for (channel = 0; channel < nchans; channel++) {
+			block = _wiener_channel(x, &x->fft, in + channel * block_size, &entropy);
+			SETFLOAT(&channels_entropy[channel], entropy);
+			// the first channel's bins are still in the FFT output
+			_wiener_channel_done(x, channel, &x->fft, block, entropy, power_spectrum);
+			bypassed += block == block_silent_cached;
+		}
 
-		// calculate bin magnitude
-		fftr_bin_power = bin.r * bin.r + bin.i * bin.i + epsilon;
+		ps_denormal_end(denormal);
+	}
 
-		// sum power
-		if (wiener_power_spectrum) {
-			fftr_bins_power_sum += fftr_bin_power;
-			fftr_bins_power_sum_ln += log(fftr_bin_power);
-		}
-		// sum amplitude
-		else {
-			fftr_bin_amplitude = sqrt(fftr_bin_power);
+	ps_bypass_count(&x->bypass, nchans, bypassed);
+	PS_PROFILE_END(&x->profile);
 
-			fftr_bins_amplitude_sum += fftr_bin_amplitude;
-			fftr_bins_amplitude_sum_ln += log(fftr_bin_amplitude);
+	// only schedule the redraw, the clock runs it after this tick
+	if (x->spectrum_vec) {
+		x->spectrum_redraw_countdown -= block_size;
+		if (x->spectrum_redraw_countdown <= 0) {
+			x->spectrum_redraw_countdown = x->spectrum_redraw_samples;
+			clock_delay(x->spectrum_redraw_clock, 0.0);
 		}
 	}
 
-	// calculate wiener entropy
-	if (wiener_power_spectrum) {
-		wiener_numerator = exp(fftr_bins_power_sum_ln / fftr_output_size_d);
-		wiener_denominator = fftr_bins_power_sum / fftr_output_size_d;
+	// output
+	if (nchans == 1) {
+		outlet_float(outlet, atom_getfloat(&channels_entropy[0]));
 	}
 	else {
-		wiener_numerator = exp(fftr_bins_amplitude_sum_ln / fftr_output_size_d);
-		wiener_denominator = fftr_bins_amplitude_sum / fftr_output_size_d;
+		outlet_list(outlet, &s_list, nchans, channels_entropy);
 	}
-	wiener_entropy = (float) (wiener_numerator / wiener_denominator);
-
-	// output
-	outlet_float(outlet, wiener_entropy);
 
     return (w + 4);
 }
 
+/*
+	pd callback: per-block DSP timings, see common/ps_profile.h
+*/
+static void wiener_stats (t_wiener* x, t_symbol* receiver) {
+	ps_profile_stats(&x->profile, "wiener~", receiver);
+}
+
+static void wiener_stats_reset (t_wiener* x) {
+	ps_profile_reset(&x->profile, "wiener~");
+}
+
+/*
+	pd callback: silent and constant block bypass, see common/ps_bypass.h
+*/
+static void wiener_bypass_stats (t_wiener* x, t_symbol* receiver) {
+	ps_bypass_stats(&x->bypass, "wiener~", receiver);
+}
+
+static void wiener_bypass_stats_reset (t_wiener* x) {
+	ps_bypass_reset(&x->bypass);
+}
+
+static void wiener_bypass_enable (t_wiener* x) {
+	ps_parallel_wait(&x->parallel);
+	ps_bypass_enable(&x->bypass, "wiener~", 1);
+}
+
+static void wiener_bypass_disable (t_wiener* x) {
+	ps_parallel_wait(&x->parallel);
+	ps_bypass_enable(&x->bypass, "wiener~", 0);
+}
+
 /*
 	pd callback: register dsp
 */
 static void wiener_dsp (t_wiener* x, t_signal** sp) {
 	int block_size = sp[0]->s_n;
+
+	// the workers are done with the old chain's last block before its buffers change
+	ps_parallel_drop(&x->parallel);
+	ps_rtpool_reclaim(&x->retired);
+	if (x->sample_rate != sp[0]->s_sr) {
+		x->sample_rate = sp[0]->s_sr;
+		_wiener_spectrum_redraw_recompute(x);
+	}
+	_wiener_spectrum_attach(x);
+
 	if (x->block_size != block_size) {
 		x->block_size = block_size;
 
@@ -274,9 +630,17 @@ static void wiener_dsp (t_wiener* x, t_signal** sp) {
 
 		_wiener_fftr_input_window_free(x);
 		_wiener_fftr_input_window_alloc(x);
+
+		x->silence_entropy_valid[0] = 0;
+		x->silence_entropy_valid[1] = 0;
+	}
+
+	if (PS_SIGNAL_NCHANS(sp[0]) != x->channels_num) {
+		_wiener_channels_alloc(x, PS_SIGNAL_NCHANS(sp[0]));
 	}
+	_wiener_lanes_alloc(x);
 
-    dsp_add(wiener_perform, 3, x, sp[0]->s_vec, sp[0]->s_n);
+    dsp_add(wiener_perform, 3, x, sp[0]->s_vec, PS_SIGNAL_NCHANS(sp[0]));
 }
 
 /*
@@ -292,11 +656,43 @@ static void* wiener_new (void) {
 
 	x->fftr_input_window_type = hann;
 
-	x->fftr_cfg = NULL;
+	x->fft.cfg = NULL;
+	x->fft.output = NULL;
+	x->fft.input = NULL;
 	x->fftr_output_size = -1;
-	x->fftr_output = NULL;
 	x->fftr_input_window = NULL;
 
+	x->spectrum_name = &s_;
+	x->spectrum_vec = NULL;
+	x->spectrum_size = 0;
+	x->spectrum_db = 0;
+	x->spectrum_redraw_ms = 50.0f;
+	x->spectrum_redraw_samples = 0;
+	x->spectrum_redraw_countdown = 0;
+	x->spectrum_redraw_clock = clock_new(x, (t_method) wiener_spectrum_redraw_tick);
+	x->sample_rate = 0.0f;
+
+	x->silence_entropy[0] = 1.0f;
+	x->silence_entropy[1] = 1.0f;
+	x->silence_entropy_valid[0] = 0;
+	x->silence_entropy_valid[1] = 0;
+
+	x->channels_num = 0;
+	x->channels_entropy = NULL;
+	x->retired.head = NULL;
+
+	ps_parallel_init(&x->parallel, _wiener_lane, x);
+	x->lanes_num = 0;
+	x->lanes_input = NULL;
+	x->lanes_fft = NULL;
+	x->lanes_entropy = NULL;
+	x->lanes_block = NULL;
+	x->lanes_power_spectrum = 0;
+
+	ps_profile_init(&x->profile);
+
+	ps_bypass_init(&x->bypass);
+
     //inlet_new(&x->x_obj, &x->x_obj.ob_pd, 0, 0);
 	x->outlet = outlet_new(&x->x_obj, &s_float);
 
@@ -307,20 +703,44 @@ static void* wiener_new (void) {
 	pd callback: delete object
 */
 static void wiener_delete (t_wiener* x) {
+	ps_parallel_stop(&x->parallel);
+	_wiener_lanes_retire(x);
+	clock_free(x->spectrum_redraw_clock);
 	_wiener_fftr_free(x);
 	_wiener_fftr_input_window_free(x);
+	ps_rtpool_free(x->channels_entropy);
+	ps_rtpool_reclaim(&x->retired);
 }
 
 /*
 	pd callback: setup object
 */
 void wiener_tilde_setup (void) {
-    wiener_class = class_new(gensym("wiener~"), (t_newmethod) wiener_new, (t_method) wiener_delete, sizeof(t_wiener), 0, A_NULL, 0);
+	ps_lock(&wiener_setup_lock);
+	if (wiener_class) {
+		ps_unlock(&wiener_setup_lock);
+		return;
+	}
+
+	ps_rtpool_setup();
+    wiener_class = class_new(gensym("wiener~"), (t_newmethod) wiener_new, (t_method) wiener_delete, sizeof(t_wiener), PS_CLASS_MULTICHANNEL, A_NULL, 0);
 
 	class_addmethod(wiener_class, (t_method) wiener_window_type, gensym("window_type"), A_GIMME, 0);
 	class_addmethod(wiener_class, (t_method) wiener_amplitude_spectrum, gensym("amplitude_spectrum"), A_NULL, 0);
 	class_addmethod(wiener_class, (t_method) wiener_power_spectrum, gensym("power_spectrum"), A_NULL, 0);
+	class_addmethod(wiener_class, (t_method) wiener_spectrum_array, gensym("spectrum_array"), A_DEFSYM, 0);
+	class_addmethod(wiener_class, (t_method) wiener_spectrum_db, gensym("spectrum_db"), A_FLOAT, 0);
+	class_addmethod(wiener_class, (t_method) wiener_spectrum_redraw, gensym("spectrum_redraw"), A_FLOAT, 0);
+	class_addmethod(wiener_class, (t_method) wiener_threads, gensym("threads"), A_FLOAT, 0);
+	class_addmethod(wiener_class, (t_method) wiener_stats, gensym("stats"), A_DEFSYM, 0);
+	class_addmethod(wiener_class, (t_method) wiener_stats_reset, gensym("stats_reset"), A_NULL, 0);
+	class_addmethod(wiener_class, (t_method) wiener_bypass_stats, gensym("bypass_stats"), A_DEFSYM, 0);
+	class_addmethod(wiener_class, (t_method) wiener_bypass_stats_reset, gensym("bypass_stats_reset"), A_NULL, 0);
+	class_addmethod(wiener_class, (t_method) wiener_bypass_enable, gensym("bypass_enable"), A_NULL, 0);
+	class_addmethod(wiener_class, (t_method) wiener_bypass_disable, gensym("bypass_disable"), A_NULL, 0);
 	
     CLASS_MAINSIGNALIN(wiener_class, t_wiener, x_f);
     class_addmethod(wiener_class, (t_method) wiener_dsp, gensym("dsp"), A_CANT, 0);
+
+	ps_unlock(&wiener_setup_lock);
 }
\ No newline at end of file
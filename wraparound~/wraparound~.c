@@ -12,7 +12,17 @@
 
 #include "m_pd.h"
 
-#include <math.h>
+#include "../common/ps_bypass.h"
+#include "../common/ps_dispatch.h"
+#include "../common/ps_events.h"
+#include "../common/ps_lock.h"
+#include "../common/ps_multichannel.h"
+#include "../common/ps_profile.h"
+#include "../common/ps_rtpool.h"
+#include "../core/ps_oversample.h"
+#include "../core/ps_wrap.h"
+#include "../core/ps_denormal.h"
+
 #include <stdlib.h>
 
 /*
@@ -26,15 +36,27 @@
 	Inlets from left to right:
 
 		1. audio signal to wrap
-		2. audio signal gain (float)
+		2. audio signal gain (float), like a "gain" message without delay
 
 	Accepts the following messages:
 
 		1. "soften": Expects numerical parameters n and alpha. Instructs the external to run a smoothing algorithm to smooth out signal discontinuities created by wraparound. N is the size of the buffer to use for smoothing, alpha is the decay for the exponential moving average smoothing algorithm.
 		2. "hard": Returns the external to its default state after a soften message
+		3. "oversample": Expects 1, 2, 4 or 8. Wraps at that multiple of the sample rate with half-band filters around it, so the discontinuities alias far less (see core/ps_oversample.h). Soften buffer lengths then count oversampled frames. The output is delayed by ps_oversample_latency() frames (39 at 2x). 1 turns it off [default]
+		4. "gain": Expects the gain and an optional delay in ms. The change lands on the exact frame it is due at rather than the next block boundary (see common/ps_events.h), with the delay counted from the message's logical time like vline~. Softening keeps its state across the change
+		5. "stats": Posts min/mean/max/p99 DSP time per block, or sends them to the receiver named by an optional symbol. Needs a PS_PROFILE build (see common/ps_profile.h)
+		6. "stats_reset": Clears the DSP timings
+		7. "bypass_stats": Posts how many channel blocks ran and how many were bypassed because their inputs were silent or constant, or sends them to the receiver named by an optional symbol (see common/ps_bypass.h)
+		8. "bypass_stats_reset": Clears the bypass counters
+		9. "bypass_enable", "bypass_disable": Turns the bypass on [default] or off
+
+	The signal inlet takes multichannel signals (Pd 0.54+) and the output has the same channels. Each channel keeps its own wrap and soften state, and all of them are processed in one perform call.
+
+	The wrapping and softening are ps_wrap_hard() and ps_wrap_soften() in core/ps_wrap.h.
 */
 
 static t_class* wraparound_class;
+static t_ps_lock wraparound_setup_lock = PS_LOCK_INIT;
 
 typedef struct _wraparound {
     t_object x_obj;
@@ -45,115 +67,68 @@ typedef struct _wraparound {
 	t_int hard;
 	// buffer size for exponential moving average smoothing
 	t_int soften_n;
-	// buffer head
-	int soften_buffer_idx;
-	// buffer
-	float* soften_buffer;
 	// exponential decay parameters
 	t_float soften_alpha;
-	// keeps track of frame timer for softening (active if less than soften_n)
-	int soften_buffer_active_n;
-	// keeps track of if the last sample was wrapped for sample block transitions
-	t_int wrapped_last;
+	// channel state, with the soften buffers of all channels in one contiguous block
+	int channels_num;
+	t_ps_wrap* channels;
+	t_sample* soften_buffers;
+	// soften buffers replaced while dsp runs, recycled at the next block (see common/ps_rtpool.h)
+	t_ps_rtpool_retired retired;
+	// requested oversampling factor and the oversampler sized for the current dsp chain
+	int oversample_factor;
+	t_ps_oversample oversample;
+	// perform timings (empty unless built with PS_PROFILE)
+	t_ps_profile profile;
+	// silent and constant block bypass (see common/ps_bypass.h)
+	t_ps_bypass bypass;
+	// sample-accurate gain changes (see common/ps_events.h)
+	t_ps_events events;
 } t_wraparound;
 
-/*
-	retrieves the nth past frame in the history of the soften buffer
-	returns NAN if n is negative or greater than or equal to buffer size
-*/
-#ifdef _WIN32
-static __inline float soften_buffer_retrieve (t_wraparound* x, int n) {
-#else
-static inline float soften_buffer_retrieve (t_wraparound* x, int n) {
-#endif
-	int soften_buffer_idx_requested;
-
-	if (n < 0 || n >= x->soften_n) {
-		return NAN;
-	}
-
-	soften_buffer_idx_requested = x->soften_buffer_idx - 1 - n;
-	if (soften_buffer_idx_requested < 0) {
-		soften_buffer_idx_requested += x->soften_n;
-	}
-	return x->soften_buffer[soften_buffer_idx_requested];
-}
+enum {
+	wraparound_event_gain
+};
 
 /*
-	pushes a frame onto the soften buffer
-	soften_buffer_idx always points to the place where the next frame will go
+	applies a gain change outside the perform routine (see ps_events_send())
 */
-#ifdef _WIN32
-static __inline void soften_buffer_push (t_wraparound* x, float frame) {
-#else
-static inline void soften_buffer_push (t_wraparound* x, float frame) {
-#endif
-	x->soften_buffer[x->soften_buffer_idx++] = frame;
-	if (x->soften_buffer_idx >= x->soften_n) {
-		x->soften_buffer_idx = 0;
-	}
+static void _wraparound_event (void* owner, const t_ps_event* event) {
+	((t_wraparound*) owner)->gain = event->value;
 }
 
 /*
-	calculates the exponential decay moving average for the current frame (slower DEBUG version which calls soften_buffer_retrieve)
+	(re)allocates the soften buffers for every channel and marks softening inactive
 */
-#ifdef _WIN32
-static __inline float calculate_exponential_moving_average (t_wraparound* x) {
-#else
-static inline float calculate_exponential_moving_average (t_wraparound* x) {
-#endif
-	float dividend = 0.0f;
-	float divisor = 0.0f;
+static void _wraparound_soften_buffers_alloc (t_wraparound* x) {
 	int i;
-	float i_alpha;
 
-	for (i = 0; i < x->soften_n; i++) {
-		i_alpha = pow(x->soften_alpha, i);
-		dividend += i_alpha * soften_buffer_retrieve(x, i);
-		divisor += i_alpha;
+	ps_rtpool_retire(&x->retired, x->soften_buffers);
+	x->soften_buffers = NULL;
+	if (x->soften_n > 0) {
+		x->soften_buffers = (t_sample*) ps_rtpool_calloc(x->soften_n * x->channels_num, sizeof(t_sample));
+	}
+	for (i = 0; i < x->channels_num; i++) {
+		ps_wrap_soften_reset(&x->channels[i], x->soften_buffers ? x->soften_buffers + i * x->soften_n : NULL, x->soften_n);
 	}
-	return dividend/divisor;
 }
 
 /*
-	calculates the exponential decay moving average for the current frame (faster version which wraps the circular buffer internally)
+	(re)allocates channel state when the channel count changes
 */
-#ifdef _WIN32
-static __inline float calculate_exponential_moving_average_fast (t_wraparound* x) {
-#else
-static inline float calculate_exponential_moving_average_fast (t_wraparound* x) {
-#endif
-	float dividend = 0.0f;
-	float divisor = 0.0f;
-	int i = 0;
-	int soften_n = x->soften_n;
-	int soften_buffer_idx = x->soften_buffer_idx - 1;
-	int soften_buffer_idx_before_add = soften_buffer_idx;
-	float i_alpha;
-
-	while (i <= soften_buffer_idx_before_add) {
-		i_alpha = pow(x->soften_alpha, i);
-		dividend += i_alpha * x->soften_buffer[soften_buffer_idx--];
-		divisor += i_alpha;
-		i++;
-	}
-	soften_buffer_idx += soften_n;
-	while (i < soften_n) {
-		i_alpha = pow(x->soften_alpha, i);
-		dividend += i_alpha * x->soften_buffer[soften_buffer_idx--];
-		divisor += i_alpha;
-		i++;
-	}
-
-	return dividend/divisor;
+static void _wraparound_channels_alloc (t_wraparound* x, int channels_num) {
+	ps_rtpool_free(x->channels);
+	x->channels_num = channels_num;
+	x->channels = (t_ps_wrap*) ps_rtpool_calloc(channels_num, sizeof(t_ps_wrap));
+	_wraparound_soften_buffers_alloc(x);
 }
 
 /*
 	message receiver to set to soften
 */
 void wraparound_soften (t_wraparound* x, t_symbol* selector, int argcount, t_atom* argvec) {
-	float soften_n;
-	float soften_alpha;
+	t_float soften_n;
+	t_float soften_alpha;
 
 	// check arg count
 	if (argcount != 2) {
@@ -186,17 +161,11 @@ void wraparound_soften (t_wraparound* x, t_symbol* selector, int argcount, t_ato
 	// assign args
 	x->hard = 0;
 	x->soften_n = (t_int) soften_n;
-	if (x->soften_buffer) {
-		free(x->soften_buffer);
-	}
-	x->soften_buffer_idx = 0;
-	x->soften_buffer = (float*) calloc(x->soften_n, sizeof(float));
-	x->soften_buffer_active_n = x->soften_n;
 	x->soften_alpha = soften_alpha;
+	_wraparound_soften_buffers_alloc(x);
 
 	post("soften: n=%d, alpha=%f", x->soften_n, x->soften_alpha);
 }
-
 /*
 	message receiver to set to hard wrap
 */
@@ -206,103 +175,228 @@ void wraparound_hard (t_wraparound* x) {
 }
 
 /*
-	float receiever on second inlet to set gain
+	float receiever on second inlet and message receiver to set gain, delay_ms from now
 */
-void wraparound_gain (t_wraparound* x, t_float f) {
-	x->gain = f;
-	post("gain: %f", x->gain);
+void wraparound_gain (t_wraparound* x, t_float f, t_floatarg delay_ms) {
+	ps_events_send(&x->events, x, _wraparound_event, wraparound_event_gain, f, delay_ms);
+	post("gain: %f", f);
+}
+
+/*
+	message receiver to set the oversampling factor
+*/
+void wraparound_oversample (t_wraparound* x, t_floatarg f) {
+	int factor = (int) f;
+
+	if (factor != 1 && factor != 2 && factor != 4 && factor != 8) {
+		error("oversample factor must be 1, 2, 4 or 8");
+		return;
+	}
+	x->oversample_factor = factor;
+
+	// resize now if dsp already ran, otherwise the next dsp call does
+	if (x->oversample.n > 0 && !ps_oversample_alloc(&x->oversample, factor, 1, x->oversample.channels_num, x->oversample.n)) {
+		error("oversample: out of memory, running at 1x");
+		return;
+	}
+
+	post("oversample: %d (latency %g samples)", factor, ps_oversample_latency(factor));
+}
+
+/*
+	wraps one channel split at the gain changes of the block, each segment with the gain due at its first frame (factor frames per base-rate frame)
+*/
+static PS_KERNEL void _wraparound_events (t_wraparound* x, t_ps_wrap* channel, const t_ps_event* events, int events_num, t_float gain, t_float* in, t_float* out, int n, int factor) {
+	int event = 0;
+	int start;
+	int end;
+
+	for (start = 0; start < n; start = end) {
+		while (event < events_num && events[event].offset <= start) {
+			gain = events[event++].value;
+		}
+		end = event < events_num ? events[event].offset : n;
+		if (x->hard) {
+			ps_wrap_hard(channel, in + start * factor, out + start * factor, (end - start) * factor, gain);
+		}
+		else {
+			ps_wrap_soften(channel, x->soften_n, x->soften_alpha, in + start * factor, out + start * factor, (end - start) * factor, gain);
+		}
+	}
 }
 
 /*
-	main dsp callback
+	main dsp callback, for blocks of exactly fixed_n frames when that is not 0
 */
-static t_int* wraparound_perform (t_int* w) {
+PS_KERNEL_BODY t_int* _wraparound_perform (t_int* w, int fixed_n) {
 	// parse args
 	t_wraparound* x = (t_wraparound*) w[1];
     t_float* in = (t_float*) w[2];
     t_float* out = (t_float*) w[3];
-    int n = (int) w[4];
+    int n = fixed_n ? fixed_n : (int) w[4];
+	int nchans = (int) w[5];
 
 	// pull state from struct
-	float gain = x->gain;
-	int wrapped_last = x->wrapped_last;
+	t_float gain = x->gain;
 	int hard = x->hard;
 	int soften_n = x->soften_n;
-	float soften_alpha = x->soften_alpha;
+	t_float soften_alpha = x->soften_alpha;
+	t_ps_wrap* channel = x->channels;
+	t_ps_wrap* channels_end = x->channels + nchans;
+	t_ps_oversample* oversample = &x->oversample;
+	int oversample_factor = oversample->factor;
+	int bypass_enabled = x->bypass.enabled;
+	int events_num = ps_events_block(&x->events, n);
+	const t_ps_event* events = x->events.pending;
 
 	// create state
-	int wrapped_current = 0;
-	int frame_current_idx = 0;
-	float frame_current;
-	float frame_current_wrapped;
-
-	if (hard) {
-		while (n--) {
-			frame_current = *(in + frame_current_idx) * gain;
-			
-			// calculate wrapped frame
-			wrapped_current = 0;
-			while (frame_current < -1.0f) {
-				frame_current += 2.0f;
-				wrapped_current = 1;
+	t_ps_denormal denormal;
+	t_sample frame;
+	int constant;
+	int bypassed = 0;
+	// the frames the wrap runs on, the channel's own or oversampled ones
+	t_float* frames_in;
+	t_float* frames_out;
+	int frames_n;
+
+	PS_PROFILE_BEGIN(&x->profile);
+	// buffers a message replaced since the last block go back to the pool (see common/ps_rtpool.h)
+	ps_rtpool_recycle(&x->retired);
+	denormal = ps_denormal_begin();
+
+	for (; channel < channels_end; channel++, in += n, out += n) {
+		// a constant input wraps to one constant frame, unless it sets softening going (see common/ps_bypass.h)
+		if (bypass_enabled && oversample_factor == 1 && events_num == 0 && ps_bypass_constant(in, n)) {
+			if (hard) {
+				ps_wrap_hard(channel, in, &frame, 1, gain);
+				constant = 1;
+			}
+			else {
+				constant = ps_wrap_soften_constant(channel, soften_n, in[0] * gain, n, &frame);
 			}
-			while (frame_current > 1.0f) {
-				frame_current -= 2.0f;
-				wrapped_current = 1;
+			if (constant) {
+				ps_bypass_fill(out, frame, n);
+				bypassed++;
+				continue;
 			}
+		}
+
+		frames_in = in;
+		frames_out = out;
+		frames_n = n;
+		if (oversample_factor > 1) {
+			frames_in = ps_oversample_up(oversample, (int) (channel - x->channels), 0, in);
+			frames_out = oversample->output;
+			frames_n = n * oversample_factor;
+		}
+
+		if (events_num > 0) {
+			_wraparound_events(x, channel, events, events_num, gain, frames_in, frames_out, n, oversample_factor);
+		}
+		else if (hard) {
+			ps_wrap_hard(channel, frames_in, frames_out, frames_n, gain);
+		}
+		else {
+			ps_wrap_soften(channel, soften_n, soften_alpha, frames_in, frames_out, frames_n, gain);
+		}
 
-			*(out + frame_current_idx++) = frame_current;
+		if (oversample_factor > 1) {
+			ps_oversample_down(oversample, (int) (channel - x->channels), out);
 		}
-		// ideally we would memcpy into the soften buffer here for maximum accuracy at transition time but we don't have a size for that yet
 	}
-	else {
-		while (n--) {
-			frame_current = *(in + frame_current_idx) * gain;
-			
-			// calculate wrapped frame
-			wrapped_current = 0;
-			frame_current_wrapped = frame_current;
-			while (frame_current_wrapped < -1.0f) {
-				frame_current_wrapped += 2.0f;
-				wrapped_current = 1;
-			}
-			while (frame_current_wrapped > 1.0f) {
-				frame_current_wrapped -= 2.0f;
-				wrapped_current = 1;
-			}
+	if (events_num > 0) {
+		x->gain = events[events_num - 1].value;
+	}
 
-			// push hard wrapped frame onto soften buffer
-			soften_buffer_push(x, frame_current_wrapped);
+	ps_denormal_end(denormal);
+	ps_bypass_count(&x->bypass, nchans, bypassed);
+	PS_PROFILE_END(&x->profile);
 
-			// if we're switching from unwrapped to wrapped or vice versa activate softening
-			if (wrapped_current ^ wrapped_last) {
-				x->soften_buffer_active_n = 0;
-			}
+    return (w + 6);
+}
 
-			// if we're actively softening then continue to do so
-			if (x->soften_buffer_active_n < soften_n) {
-				frame_current = calculate_exponential_moving_average_fast(x);
-				x->soften_buffer_active_n++;
-			}
-			else {
-				frame_current = frame_current_wrapped;
-			}
+/*
+	perform routines for any block size and for the common fixed ones, picked in wraparound_dsp
+*/
+static PS_KERNEL t_int* wraparound_perform (t_int* w) {
+	return _wraparound_perform(w, 0);
+}
 
-			*(out + frame_current_idx++) = frame_current;
-			wrapped_last = wrapped_current;
-		}
-	}
+static PS_KERNEL t_int* wraparound_perform_64 (t_int* w) {
+	return _wraparound_perform(w, 64);
+}
 
-	x->wrapped_last = wrapped_current;
+static PS_KERNEL t_int* wraparound_perform_128 (t_int* w) {
+	return _wraparound_perform(w, 128);
+}
 
-    return (w + 5);
+static PS_KERNEL t_int* wraparound_perform_256 (t_int* w) {
+	return _wraparound_perform(w, 256);
+}
+
+/*
+	pd callback: per-block DSP timings, see common/ps_profile.h
+*/
+static void wraparound_stats (t_wraparound* x, t_symbol* receiver) {
+	ps_profile_stats(&x->profile, "wraparound~", receiver);
+}
+
+static void wraparound_stats_reset (t_wraparound* x) {
+	ps_profile_reset(&x->profile, "wraparound~");
+}
+
+/*
+	pd callback: silent and constant block bypass, see common/ps_bypass.h
+*/
+static void wraparound_bypass_stats (t_wraparound* x, t_symbol* receiver) {
+	ps_bypass_stats(&x->bypass, "wraparound~", receiver);
+}
+
+static void wraparound_bypass_stats_reset (t_wraparound* x) {
+	ps_bypass_reset(&x->bypass);
+}
+
+static void wraparound_bypass_enable (t_wraparound* x) {
+	ps_bypass_enable(&x->bypass, "wraparound~", 1);
+}
+
+static void wraparound_bypass_disable (t_wraparound* x) {
+	ps_bypass_enable(&x->bypass, "wraparound~", 0);
 }
 
 /*
 	pd callback: register dsp
 */
 static void wraparound_dsp (t_wraparound* x, t_signal** sp) {
-    dsp_add(wraparound_perform, 4, x, sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
+	int nchans = PS_SIGNAL_NCHANS(sp[0]);
+	t_perfroutine perform;
+
+	ps_rtpool_reclaim(&x->retired);
+	if (nchans != x->channels_num) {
+		_wraparound_channels_alloc(x, nchans);
+	}
+	ps_signal_setmultiout(&sp[1], nchans);
+
+	if (!ps_oversample_alloc(&x->oversample, x->oversample_factor, 1, nchans, sp[0]->s_n)) {
+		error("oversample: out of memory, running at 1x");
+	}
+	ps_events_dsp(&x->events, sp[0]->s_sr, sp[0]->s_n);
+
+	switch (sp[0]->s_n) {
+	case 64:
+		perform = wraparound_perform_64;
+		break;
+	case 128:
+		perform = wraparound_perform_128;
+		break;
+	case 256:
+		perform = wraparound_perform_256;
+		break;
+	default:
+		perform = wraparound_perform;
+	}
+
+    dsp_add(perform, 5, x, sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n, nchans);
 }
 
 /*
@@ -313,11 +407,16 @@ static void* wraparound_new (t_floatarg f) {
 	x->gain = f;
 	x->hard = 1;
 	x->soften_n = 0;
-	x->soften_buffer_idx = 0;
-	x->soften_buffer = NULL;
 	x->soften_alpha = 0.0f;
-	x->soften_buffer_active_n = 0;
-	x->wrapped_last = 0;
+	x->channels = NULL;
+	x->soften_buffers = NULL;
+	x->retired.head = NULL;
+	_wraparound_channels_alloc(x, 1);
+	x->oversample_factor = 1;
+	ps_oversample_init(&x->oversample);
+	ps_profile_init(&x->profile);
+	ps_bypass_init(&x->bypass);
+	ps_events_init(&x->events);
 
     inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_float, gensym("gain"));
 	outlet_new(&x->x_obj, gensym("signal"));
@@ -329,20 +428,37 @@ static void* wraparound_new (t_floatarg f) {
 	pd callback: delete object
 */
 static void wraparound_delete (t_wraparound* x) {
-	if (x->soften_buffer) {
-		free(x->soften_buffer);
-	}
+	ps_rtpool_free(x->soften_buffers);
+	ps_rtpool_free(x->channels);
+	ps_rtpool_reclaim(&x->retired);
+	ps_oversample_free(&x->oversample);
 }
 
 /*
 	pd callback: setup object
 */
 void wraparound_tilde_setup (void) {
-    wraparound_class = class_new(gensym("wraparound~"), (t_newmethod) wraparound_new, (t_method) wraparound_delete, sizeof(t_wraparound), 0, A_DEFFLOAT, 0);
+	ps_lock(&wraparound_setup_lock);
+	if (wraparound_class) {
+		ps_unlock(&wraparound_setup_lock);
+		return;
+	}
+
+	ps_rtpool_setup();
+    wraparound_class = class_new(gensym("wraparound~"), (t_newmethod) wraparound_new, (t_method) wraparound_delete, sizeof(t_wraparound), PS_CLASS_MULTICHANNEL, A_DEFFLOAT, 0);
 
     class_addmethod(wraparound_class, (t_method) wraparound_soften, gensym("soften"), A_GIMME, 0);
     class_addmethod(wraparound_class, (t_method) wraparound_hard, gensym("hard"), 0);
-    class_addmethod(wraparound_class, (t_method) wraparound_gain, gensym("gain"), A_FLOAT, 0);
+    class_addmethod(wraparound_class, (t_method) wraparound_gain, gensym("gain"), A_FLOAT, A_DEFFLOAT, 0);
+    class_addmethod(wraparound_class, (t_method) wraparound_oversample, gensym("oversample"), A_FLOAT, 0);
+    class_addmethod(wraparound_class, (t_method) wraparound_stats, gensym("stats"), A_DEFSYM, 0);
+    class_addmethod(wraparound_class, (t_method) wraparound_stats_reset, gensym("stats_reset"), A_NULL, 0);
+    class_addmethod(wraparound_class, (t_method) wraparound_bypass_stats, gensym("bypass_stats"), A_DEFSYM, 0);
+    class_addmethod(wraparound_class, (t_method) wraparound_bypass_stats_reset, gensym("bypass_stats_reset"), A_NULL, 0);
+    class_addmethod(wraparound_class, (t_method) wraparound_bypass_enable, gensym("bypass_enable"), A_NULL, 0);
+    class_addmethod(wraparound_class, (t_method) wraparound_bypass_disable, gensym("bypass_disable"), A_NULL, 0);
     CLASS_MAINSIGNALIN(wraparound_class, t_wraparound, gain);
     class_addmethod(wraparound_class, (t_method) wraparound_dsp, gensym("dsp"), A_CANT, 0);
+
+	ps_unlock(&wraparound_setup_lock);
 }
\ No newline at end of file